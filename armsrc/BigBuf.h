@@ -35,7 +35,7 @@
 uint8_t *BigBuf_get_addr(void);
 uint32_t BigBuf_get_size(void);
 uint8_t *BigBuf_get_EM_addr(void);
-uint16_t BigBuf_max_traceLen(void);
+uint32_t BigBuf_max_traceLen(void);
 uint32_t BigBuf_get_hi(void);
 
 void BigBuf_initialize(void);
@@ -247,8 +247,8 @@ static int receive_ng_internal(PacketCommandNG *rx, uint32_t read_ng(uint8_t *da
 
 int receive_ng(PacketCommandNG *rx) {
 
-    // Check if there is a packet available
-    if (usb_poll_validate_length()) {
+    // Check if there is a packet available,  or the rest of a pipelined one
+    if (usb_read_ng_pending() || usb_poll_validate_length()) {
         return receive_ng_internal(rx, usb_read_ng, true, false);
     }
 
@@ -581,13 +581,14 @@ void doT55x7Acquisition(size_t sample_size, bool ledcontrol) {
 #define T55xx_READ_TOL   5
 
     uint8_t *dest = BigBuf_get_addr();
-    uint16_t bufsize = BigBuf_max_traceLen();
+    uint32_t bufsize = BigBuf_max_traceLen();
 
     if (bufsize > sample_size)
         bufsize = sample_size;
 
     uint8_t lastSample = 0;
-    uint16_t i = 0, skipCnt = 0;
+    uint32_t i = 0;
+    uint16_t skipCnt = 0;
     bool startFound = false;
     bool highFound = false;
     bool lowFound = false;
@@ -668,13 +669,14 @@ void doT55x7Acquisition(size_t sample_size, bool ledcontrol) {
 #endif
 void doCotagAcquisition(void) {
 
-    uint16_t bufsize = BigBuf_max_traceLen();
+    uint32_t bufsize = BigBuf_max_traceLen();
     uint8_t *dest = BigBuf_malloc(bufsize);
 
     dest[0] = 0;
 
     bool firsthigh = false, firstlow = false;
-    uint16_t i = 0, noise_counter = 0;
+    uint32_t i = 0;
+    uint16_t noise_counter = 0;
 
     uint16_t checker = 0;
 
@@ -48,6 +48,7 @@ THE SOFTWARE.
 */
 
 #include "hardnested_bf_core.h"
+#include "hardnested_bitarray_core.h"
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -61,6 +62,11 @@ THE SOFTWARE.
 #include "parity.h"
 #include "ui.h"             // PrintAndLogEx
 //#include "common.h"
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__) && !defined(NOSIMD_BUILD)
+#include <arm_neon.h>
+#endif
 
 // bitslice type
 // while AVX supports 256 bit vector floating point operations, we need integer operations for boolean logic
@@ -88,6 +94,23 @@ typedef union {
     uint8_t bytes[MAX_BITSLICES / 8];
 } bitslice_t;
 
+// test if all slices of a bitslice are zero.
+// A memcmp() needlessly spills/fills all the vector registers to/from the stack, use a vector test where available
+// and short-circuiting 64 bit compares otherwise.
+#if defined(__AVX512F__)
+#define bitslice_is_zero(bs) (_mm512_test_epi64_mask((__m512i)(bs).value, (__m512i)(bs).value) == 0)
+#elif defined(__AVX2__)
+#define bitslice_is_zero(bs) (_mm256_testz_si256((__m256i)(bs).value, (__m256i)(bs).value))
+#elif defined(__AVX__)
+#define bitslice_is_zero(bs) (_mm_testz_si128((__m128i)(bs).value, (__m128i)(bs).value))
+#elif defined(__ARM_NEON) && defined(__aarch64__) && !defined(NOSIMD_BUILD)
+#define bitslice_is_zero(bs) (vmaxvq_u32((uint32x4_t)(bs).value) == 0)
+#elif MAX_BITSLICES > 64
+#define bitslice_is_zero(bs) ((bs).bytes64[0] == 0 && (bs).bytes64[1] == 0)
+#else
+#define bitslice_is_zero(bs) ((bs).bytes64[0] == 0)
+#endif
+
 // filter function (f20)
 // sourced from ``Wirelessly Pickpocketing a Mifare Classic Card'' by Flavio Garcia, Peter van Rossum, Roel Verdult and Ronny Wichers Schreur
 #define f20a(a,b,c,d) (((a|b)^(a&d))^(c&((a^b)|d)))
@@ -434,19 +457,7 @@ uint64_t CRACK_STATES_BITSLICED(uint32_t cuid, uint8_t *best_first_bytes, statel
                         results.value &= ~parity_bit_vector ^ decrypted_parity_bit_vector;
 
                         // make sure we still have a match in our set
-                        // if(memcmp(&results, &bs_zeroes, sizeof(bitslice_t)) == 0){
-
-                        // this is much faster on my gcc, because somehow a memcmp needlessly spills/fills all the xmm registers to/from the stack - ???
-                        // the short-circuiting also helps
-                        if (results.bytes64[0] == 0
-#if MAX_BITSLICES > 64
-                                && results.bytes64[1] == 0
-#endif
-#if MAX_BITSLICES > 128
-                                && results.bytes64[2] == 0
-                                && results.bytes64[3] == 0
-#endif
-                           ) {
+                        if (bitslice_is_zero(results)) {
 #if defined (DEBUG_BRUTE_FORCE)
                             if (elimination_step < MAX_ELIMINATION_STEP) {
                                 keys_eliminated[elimination_step] += MAX_BITSLICES;
@@ -563,6 +574,7 @@ void SetSIMDInstr(SIMDExecInstr instr) {
 
     crack_states_bitsliced_function_p = &crack_states_bitsliced_dispatch;
     bitslice_test_nonces_function_p = &bitslice_test_nonces_dispatch;
+    bitarray_dispatch_reset();
 }
 
 static SIMDExecInstr GetSIMDInstr(void) {
@@ -598,6 +610,11 @@ static SIMDExecInstr GetSIMDInstr(void) {
     return instr;
 }
 
+// the setting as given to SetSIMDInstr(), SIMD_AUTO is not resolved
+SIMDExecInstr GetSIMDInstrSetting(void) {
+    return intSIMDInstr;
+}
+
 SIMDExecInstr GetSIMDInstrAuto(void) {
     SIMDExecInstr instr = intSIMDInstr;
     if (instr == SIMD_AUTO)
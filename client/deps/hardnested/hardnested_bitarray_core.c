@@ -20,11 +20,17 @@
 #include "hardnested_bf_core.h"
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #ifndef __APPLE__
 #include <malloc.h>
 #endif
+#if defined (__AVX512F__)
+#include <immintrin.h>
+#elif defined (__ARM_NEON) && !defined (NOSIMD_BUILD)
+#include <arm_neon.h>
+#endif
 
 // this needs to be compiled several times for each instruction set.
 // For each instruction set, define a dedicated function name:
@@ -188,10 +194,114 @@ inline uint32_t BITCOUNT(uint32_t a) {
 }
 
 
+#if defined (__AVX512F__)
+// AVX512 VPOPCNTDQ (Ice Lake, Zen 4 and later) counts bits in all 64 bit lanes of a 512 bit vector at once.
+// It is an optional extension to AVX512F and therefore checked at runtime.
+#define VPOPCNTDQ_TARGET __attribute__((target("avx512vpopcntdq")))
+
+static bool cpu_has_vpopcntdq(void) {
+    static int8_t has_vpopcntdq = -1;
+    if (has_vpopcntdq < 0) {
+        __builtin_cpu_init();
+        has_vpopcntdq = __builtin_cpu_supports("avx512vpopcntdq") ? 1 : 0;
+    }
+    return has_vpopcntdq;
+}
+
+// horizontal sum through memory, the extract intrinsics used by _mm512_reduce_add_epi64 trip -Wuninitialized on gcc 12
+VPOPCNTDQ_TARGET static inline uint32_t reduce_add_vpopcntdq(__m512i count) {
+    uint64_t lanes[8];
+    _mm512_storeu_si512(lanes, count);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+}
+
+VPOPCNTDQ_TARGET static uint32_t count_states_vpopcntdq(const uint32_t *A) {
+    __m512i count = _mm512_setzero_si512();
+    for (uint32_t i = 0; i < (1 << 19); i += 16) {
+        count = _mm512_add_epi64(count, _mm512_popcnt_epi64(_mm512_loadu_si512(A + i)));
+    }
+    return reduce_add_vpopcntdq(count);
+}
+
+VPOPCNTDQ_TARGET static uint32_t count_bitarray_AND_vpopcntdq(uint32_t *restrict A, const uint32_t *restrict B) {
+    __m512i count = _mm512_setzero_si512();
+    for (uint32_t i = 0; i < (1 << 19); i += 16) {
+        __m512i a = _mm512_and_si512(_mm512_loadu_si512(A + i), _mm512_loadu_si512(B + i));
+        _mm512_storeu_si512(A + i, a);
+        count = _mm512_add_epi64(count, _mm512_popcnt_epi64(a));
+    }
+    return reduce_add_vpopcntdq(count);
+}
+
+// missing operands are passed as NULL, the first three are ANDed with a single VPTERNLOG
+VPOPCNTDQ_TARGET static uint32_t count_bitarray_AND4_vpopcntdq(const uint32_t *A, const uint32_t *B, const uint32_t *C, const uint32_t *D) {
+    __m512i count = _mm512_setzero_si512();
+    for (uint32_t i = 0; i < (1 << 19); i += 16) {
+        __m512i abc = _mm512_ternarylogic_epi64(_mm512_loadu_si512(A + i), _mm512_loadu_si512(B + i), C ? _mm512_loadu_si512(C + i) : _mm512_set1_epi64(-1), 0x80);
+        if (D) {
+            abc = _mm512_and_si512(abc, _mm512_loadu_si512(D + i));
+        }
+        count = _mm512_add_epi64(count, _mm512_popcnt_epi64(abc));
+    }
+    return reduce_add_vpopcntdq(count);
+}
+
+#elif defined (__ARM_NEON) && !defined (NOSIMD_BUILD)
+// NEON has a per byte population count only. Widen and accumulate the byte counts with pairwise adds.
+static inline uint64x2_t popcount_acc_neon(uint64x2_t count, uint32x4_t a) {
+    return vpadalq_u32(count, vpaddlq_u16(vpaddlq_u8(vcntq_u8(vreinterpretq_u8_u32(a)))));
+}
+
+static uint32_t count_states_neon(const uint32_t *A) {
+    uint64x2_t count = vdupq_n_u64(0);
+    for (uint32_t i = 0; i < (1 << 19); i += 4) {
+        count = popcount_acc_neon(count, vld1q_u32(A + i));
+    }
+    return vgetq_lane_u64(count, 0) + vgetq_lane_u64(count, 1);
+}
+
+static uint32_t count_bitarray_AND_neon(uint32_t *restrict A, const uint32_t *restrict B) {
+    uint64x2_t count = vdupq_n_u64(0);
+    for (uint32_t i = 0; i < (1 << 19); i += 4) {
+        uint32x4_t a = vandq_u32(vld1q_u32(A + i), vld1q_u32(B + i));
+        vst1q_u32(A + i, a);
+        count = popcount_acc_neon(count, a);
+    }
+    return vgetq_lane_u64(count, 0) + vgetq_lane_u64(count, 1);
+}
+
+// missing operands are passed as NULL
+static uint32_t count_bitarray_AND4_neon(const uint32_t *A, const uint32_t *B, const uint32_t *C, const uint32_t *D) {
+    uint64x2_t count = vdupq_n_u64(0);
+    for (uint32_t i = 0; i < (1 << 19); i += 4) {
+        uint32x4_t a = vandq_u32(vld1q_u32(A + i), vld1q_u32(B + i));
+        if (C) {
+            a = vandq_u32(a, vld1q_u32(C + i));
+        }
+        if (D) {
+            a = vandq_u32(a, vld1q_u32(D + i));
+        }
+        count = popcount_acc_neon(count, a);
+    }
+    return vgetq_lane_u64(count, 0) + vgetq_lane_u64(count, 1);
+}
+#endif
+
+
+// Generic versions count the bits of 64 bit words, which halves the number of popcounts.
+// Bitarrays are aligned and have (1 << 19) 32 bit words.
 inline uint32_t COUNT_STATES(uint32_t *A) {
+#if defined (__AVX512F__)
+    if (cpu_has_vpopcntdq()) {
+        return count_states_vpopcntdq(A);
+    }
+#elif defined (__ARM_NEON) && !defined (NOSIMD_BUILD)
+    return count_states_neon(A);
+#endif
+    const uint64_t *a = (const uint64_t *)__builtin_assume_aligned(A, __BIGGEST_ALIGNMENT__);
     uint32_t count = 0;
-    for (uint32_t i = 0; i < (1 << 19); i++) {
-        count += BITCOUNT(A[i]);
+    for (uint32_t i = 0; i < (1 << 18); i++) {
+        count += __builtin_popcountll(a[i]);
     }
     return count;
 }
@@ -219,12 +329,19 @@ inline void BITARRAY_LOW20_AND(uint32_t *restrict A, uint32_t *restrict B) {
 
 
 inline uint32_t COUNT_BITARRAY_AND(uint32_t *restrict A, uint32_t *restrict B) {
-    A = __builtin_assume_aligned(A, __BIGGEST_ALIGNMENT__);
-    B = __builtin_assume_aligned(B, __BIGGEST_ALIGNMENT__);
+#if defined (__AVX512F__)
+    if (cpu_has_vpopcntdq()) {
+        return count_bitarray_AND_vpopcntdq(A, B);
+    }
+#elif defined (__ARM_NEON) && !defined (NOSIMD_BUILD)
+    return count_bitarray_AND_neon(A, B);
+#endif
+    uint64_t *a = (uint64_t *)__builtin_assume_aligned(A, __BIGGEST_ALIGNMENT__);
+    const uint64_t *b = (const uint64_t *)__builtin_assume_aligned(B, __BIGGEST_ALIGNMENT__);
     uint32_t count = 0;
-    for (uint32_t i = 0; i < (1 << 19); i++) {
-        A[i] &= B[i];
-        count += BITCOUNT(A[i]);
+    for (uint32_t i = 0; i < (1 << 18); i++) {
+        a[i] &= b[i];
+        count += __builtin_popcountll(a[i]);
     }
     return count;
 }
@@ -245,6 +362,7 @@ inline uint32_t COUNT_BITARRAY_LOW20_AND(uint32_t *restrict A, uint32_t *restric
 }
 
 
+// the compilers already emit a single VPTERNLOG for B & C & D on AVX512 and vectorize this well everywhere else
 inline void BITARRAY_AND4(uint32_t *restrict A, uint32_t *restrict B, uint32_t *restrict C, uint32_t *restrict D) {
     A = __builtin_assume_aligned(A, __BIGGEST_ALIGNMENT__);
     B = __builtin_assume_aligned(B, __BIGGEST_ALIGNMENT__);
@@ -266,36 +384,57 @@ inline void BITARRAY_OR(uint32_t *restrict A, uint32_t *restrict B) {
 
 
 inline uint32_t COUNT_BITARRAY_AND2(uint32_t *restrict A, uint32_t *restrict B) {
-    A = __builtin_assume_aligned(A, __BIGGEST_ALIGNMENT__);
-    B = __builtin_assume_aligned(B, __BIGGEST_ALIGNMENT__);
+#if defined (__AVX512F__)
+    if (cpu_has_vpopcntdq()) {
+        return count_bitarray_AND4_vpopcntdq(A, B, NULL, NULL);
+    }
+#elif defined (__ARM_NEON) && !defined (NOSIMD_BUILD)
+    return count_bitarray_AND4_neon(A, B, NULL, NULL);
+#endif
+    const uint64_t *a = (const uint64_t *)__builtin_assume_aligned(A, __BIGGEST_ALIGNMENT__);
+    const uint64_t *b = (const uint64_t *)__builtin_assume_aligned(B, __BIGGEST_ALIGNMENT__);
     uint32_t count = 0;
-    for (uint32_t i = 0; i < (1 << 19); i++) {
-        count += BITCOUNT(A[i] & B[i]);
+    for (uint32_t i = 0; i < (1 << 18); i++) {
+        count += __builtin_popcountll(a[i] & b[i]);
     }
     return count;
 }
 
 
 inline uint32_t COUNT_BITARRAY_AND3(uint32_t *restrict A, uint32_t *restrict B, uint32_t *restrict C) {
-    A = __builtin_assume_aligned(A, __BIGGEST_ALIGNMENT__);
-    B = __builtin_assume_aligned(B, __BIGGEST_ALIGNMENT__);
-    C = __builtin_assume_aligned(C, __BIGGEST_ALIGNMENT__);
+#if defined (__AVX512F__)
+    if (cpu_has_vpopcntdq()) {
+        return count_bitarray_AND4_vpopcntdq(A, B, C, NULL);
+    }
+#elif defined (__ARM_NEON) && !defined (NOSIMD_BUILD)
+    return count_bitarray_AND4_neon(A, B, C, NULL);
+#endif
+    const uint64_t *a = (const uint64_t *)__builtin_assume_aligned(A, __BIGGEST_ALIGNMENT__);
+    const uint64_t *b = (const uint64_t *)__builtin_assume_aligned(B, __BIGGEST_ALIGNMENT__);
+    const uint64_t *c = (const uint64_t *)__builtin_assume_aligned(C, __BIGGEST_ALIGNMENT__);
     uint32_t count = 0;
-    for (uint32_t i = 0; i < (1 << 19); i++) {
-        count += BITCOUNT(A[i] & B[i] & C[i]);
+    for (uint32_t i = 0; i < (1 << 18); i++) {
+        count += __builtin_popcountll(a[i] & b[i] & c[i]);
     }
     return count;
 }
 
 
 inline uint32_t COUNT_BITARRAY_AND4(uint32_t *restrict A, uint32_t *restrict B, uint32_t *restrict C, uint32_t *restrict D) {
-    A = __builtin_assume_aligned(A, __BIGGEST_ALIGNMENT__);
-    B = __builtin_assume_aligned(B, __BIGGEST_ALIGNMENT__);
-    C = __builtin_assume_aligned(C, __BIGGEST_ALIGNMENT__);
-    D = __builtin_assume_aligned(D, __BIGGEST_ALIGNMENT__);
+#if defined (__AVX512F__)
+    if (cpu_has_vpopcntdq()) {
+        return count_bitarray_AND4_vpopcntdq(A, B, C, D);
+    }
+#elif defined (__ARM_NEON) && !defined (NOSIMD_BUILD)
+    return count_bitarray_AND4_neon(A, B, C, D);
+#endif
+    const uint64_t *a = (const uint64_t *)__builtin_assume_aligned(A, __BIGGEST_ALIGNMENT__);
+    const uint64_t *b = (const uint64_t *)__builtin_assume_aligned(B, __BIGGEST_ALIGNMENT__);
+    const uint64_t *c = (const uint64_t *)__builtin_assume_aligned(C, __BIGGEST_ALIGNMENT__);
+    const uint64_t *d = (const uint64_t *)__builtin_assume_aligned(D, __BIGGEST_ALIGNMENT__);
     uint32_t count = 0;
-    for (uint32_t i = 0; i < (1 << 19); i++) {
-        count += BITCOUNT(A[i] & B[i] & C[i] & D[i]);
+    for (uint32_t i = 0; i < (1 << 18); i++) {
+        count += __builtin_popcountll(a[i] & b[i] & c[i] & d[i]);
     }
     return count;
 }
@@ -318,6 +457,20 @@ count_bitarray_AND2_t *count_bitarray_AND2_function_p = &count_bitarray_AND2_dis
 count_bitarray_AND3_t *count_bitarray_AND3_function_p = &count_bitarray_AND3_dispatch;
 count_bitarray_AND4_t *count_bitarray_AND4_function_p = &count_bitarray_AND4_dispatch;
 
+// select the compute functions again on next use, e.g. after SetSIMDInstr()
+void bitarray_dispatch_reset(void) {
+    count_states_function_p = &count_states_dispatch;
+    bitarray_AND_function_p = &bitarray_AND_dispatch;
+    bitarray_low20_AND_function_p = &bitarray_low20_AND_dispatch;
+    count_bitarray_AND_function_p = &count_bitarray_AND_dispatch;
+    count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_dispatch;
+    bitarray_AND4_function_p = &bitarray_AND4_dispatch;
+    bitarray_OR_function_p = &bitarray_OR_dispatch;
+    count_bitarray_AND2_function_p = &count_bitarray_AND2_dispatch;
+    count_bitarray_AND3_function_p = &count_bitarray_AND3_dispatch;
+    count_bitarray_AND4_function_p = &count_bitarray_AND4_dispatch;
+}
+
 // determine the available instruction set at runtime and call the correct function
 uint32_t *malloc_bitarray_dispatch(uint32_t x) {
 #if defined(COMPILER_HAS_SIMD_NEON)
@@ -389,230 +542,360 @@ uint32_t bitcount_dispatch(uint32_t a) {
 }
 
 uint32_t count_states_dispatch(uint32_t *bitarray) {
-#if defined(COMPILER_HAS_SIMD_NEON)
-    if (arm_has_neon()) count_states_function_p = &count_states_NEON;
-    else
-#endif
-
+    switch (GetSIMDInstrAuto()) {
 #if defined(COMPILER_HAS_SIMD_AVX512)
-        if (__builtin_cpu_supports("avx512f")) count_states_function_p = &count_states_AVX512;
-        else
+        case SIMD_AVX512:
+            count_states_function_p = &count_states_AVX512;
+            break;
 #endif
 #if defined(COMPILER_HAS_SIMD_X86)
-            if (__builtin_cpu_supports("avx2")) count_states_function_p = &count_states_AVX2;
-            else if (__builtin_cpu_supports("avx")) count_states_function_p = &count_states_AVX;
-            else if (__builtin_cpu_supports("sse2")) count_states_function_p = &count_states_SSE2;
-            else if (__builtin_cpu_supports("mmx")) count_states_function_p = &count_states_MMX;
-            else
+        case SIMD_AVX2:
+            count_states_function_p = &count_states_AVX2;
+            break;
+        case SIMD_AVX:
+            count_states_function_p = &count_states_AVX;
+            break;
+        case SIMD_SSE2:
+            count_states_function_p = &count_states_SSE2;
+            break;
+        case SIMD_MMX:
+            count_states_function_p = &count_states_MMX;
+            break;
 #endif
-                count_states_function_p = &count_states_NOSIMD;
+#if defined(COMPILER_HAS_SIMD_NEON)
+        case SIMD_NEON:
+            count_states_function_p = &count_states_NEON;
+            break;
+#endif
+        case SIMD_AUTO:
+        case SIMD_NONE:
+            count_states_function_p = &count_states_NOSIMD;
+            break;
+    }
 
     // call the most optimized function for this CPU
     return (*count_states_function_p)(bitarray);
 }
 
 void bitarray_AND_dispatch(uint32_t *A, uint32_t *B) {
-#if defined(COMPILER_HAS_SIMD_NEON)
-    if (arm_has_neon()) bitarray_AND_function_p = &bitarray_AND_NEON;
-    else
-#endif
-
+    switch (GetSIMDInstrAuto()) {
 #if defined(COMPILER_HAS_SIMD_AVX512)
-        if (__builtin_cpu_supports("avx512f")) bitarray_AND_function_p = &bitarray_AND_AVX512;
-        else
+        case SIMD_AVX512:
+            bitarray_AND_function_p = &bitarray_AND_AVX512;
+            break;
 #endif
 #if defined(COMPILER_HAS_SIMD_X86)
-            if (__builtin_cpu_supports("avx2")) bitarray_AND_function_p = &bitarray_AND_AVX2;
-            else if (__builtin_cpu_supports("avx")) bitarray_AND_function_p = &bitarray_AND_AVX;
-            else if (__builtin_cpu_supports("sse2")) bitarray_AND_function_p = &bitarray_AND_SSE2;
-            else if (__builtin_cpu_supports("mmx")) bitarray_AND_function_p = &bitarray_AND_MMX;
-            else
+        case SIMD_AVX2:
+            bitarray_AND_function_p = &bitarray_AND_AVX2;
+            break;
+        case SIMD_AVX:
+            bitarray_AND_function_p = &bitarray_AND_AVX;
+            break;
+        case SIMD_SSE2:
+            bitarray_AND_function_p = &bitarray_AND_SSE2;
+            break;
+        case SIMD_MMX:
+            bitarray_AND_function_p = &bitarray_AND_MMX;
+            break;
 #endif
-                bitarray_AND_function_p = &bitarray_AND_NOSIMD;
+#if defined(COMPILER_HAS_SIMD_NEON)
+        case SIMD_NEON:
+            bitarray_AND_function_p = &bitarray_AND_NEON;
+            break;
+#endif
+        case SIMD_AUTO:
+        case SIMD_NONE:
+            bitarray_AND_function_p = &bitarray_AND_NOSIMD;
+            break;
+    }
 
     // call the most optimized function for this CPU
     (*bitarray_AND_function_p)(A, B);
 }
 
 void bitarray_low20_AND_dispatch(uint32_t *A, uint32_t *B) {
-#if defined(COMPILER_HAS_SIMD_NEON)
-    if (arm_has_neon()) bitarray_low20_AND_function_p = &bitarray_low20_AND_NEON;
-    else
-#endif
-
+    switch (GetSIMDInstrAuto()) {
 #if defined(COMPILER_HAS_SIMD_AVX512)
-        if (__builtin_cpu_supports("avx512f")) bitarray_low20_AND_function_p = &bitarray_low20_AND_AVX512;
-        else
+        case SIMD_AVX512:
+            bitarray_low20_AND_function_p = &bitarray_low20_AND_AVX512;
+            break;
 #endif
 #if defined(COMPILER_HAS_SIMD_X86)
-            if (__builtin_cpu_supports("avx2")) bitarray_low20_AND_function_p = &bitarray_low20_AND_AVX2;
-            else if (__builtin_cpu_supports("avx")) bitarray_low20_AND_function_p = &bitarray_low20_AND_AVX;
-            else if (__builtin_cpu_supports("sse2")) bitarray_low20_AND_function_p = &bitarray_low20_AND_SSE2;
-            else if (__builtin_cpu_supports("mmx")) bitarray_low20_AND_function_p = &bitarray_low20_AND_MMX;
-            else
+        case SIMD_AVX2:
+            bitarray_low20_AND_function_p = &bitarray_low20_AND_AVX2;
+            break;
+        case SIMD_AVX:
+            bitarray_low20_AND_function_p = &bitarray_low20_AND_AVX;
+            break;
+        case SIMD_SSE2:
+            bitarray_low20_AND_function_p = &bitarray_low20_AND_SSE2;
+            break;
+        case SIMD_MMX:
+            bitarray_low20_AND_function_p = &bitarray_low20_AND_MMX;
+            break;
 #endif
-                bitarray_low20_AND_function_p = &bitarray_low20_AND_NOSIMD;
+#if defined(COMPILER_HAS_SIMD_NEON)
+        case SIMD_NEON:
+            bitarray_low20_AND_function_p = &bitarray_low20_AND_NEON;
+            break;
+#endif
+        case SIMD_AUTO:
+        case SIMD_NONE:
+            bitarray_low20_AND_function_p = &bitarray_low20_AND_NOSIMD;
+            break;
+    }
 
     // call the most optimized function for this CPU
     (*bitarray_low20_AND_function_p)(A, B);
 }
 
 uint32_t count_bitarray_AND_dispatch(uint32_t *A, uint32_t *B) {
-#if defined(COMPILER_HAS_SIMD_NEON)
-    if (arm_has_neon()) count_bitarray_AND_function_p = &count_bitarray_AND_NEON;
-    else
-#endif
-
+    switch (GetSIMDInstrAuto()) {
 #if defined(COMPILER_HAS_SIMD_AVX512)
-        if (__builtin_cpu_supports("avx512f")) count_bitarray_AND_function_p = &count_bitarray_AND_AVX512;
-        else
+        case SIMD_AVX512:
+            count_bitarray_AND_function_p = &count_bitarray_AND_AVX512;
+            break;
 #endif
 #if defined(COMPILER_HAS_SIMD_X86)
-            if (__builtin_cpu_supports("avx2")) count_bitarray_AND_function_p = &count_bitarray_AND_AVX2;
-            else if (__builtin_cpu_supports("avx")) count_bitarray_AND_function_p = &count_bitarray_AND_AVX;
-            else if (__builtin_cpu_supports("sse2")) count_bitarray_AND_function_p = &count_bitarray_AND_SSE2;
-            else if (__builtin_cpu_supports("mmx")) count_bitarray_AND_function_p = &count_bitarray_AND_MMX;
-            else
+        case SIMD_AVX2:
+            count_bitarray_AND_function_p = &count_bitarray_AND_AVX2;
+            break;
+        case SIMD_AVX:
+            count_bitarray_AND_function_p = &count_bitarray_AND_AVX;
+            break;
+        case SIMD_SSE2:
+            count_bitarray_AND_function_p = &count_bitarray_AND_SSE2;
+            break;
+        case SIMD_MMX:
+            count_bitarray_AND_function_p = &count_bitarray_AND_MMX;
+            break;
 #endif
-                count_bitarray_AND_function_p = &count_bitarray_AND_NOSIMD;
+#if defined(COMPILER_HAS_SIMD_NEON)
+        case SIMD_NEON:
+            count_bitarray_AND_function_p = &count_bitarray_AND_NEON;
+            break;
+#endif
+        case SIMD_AUTO:
+        case SIMD_NONE:
+            count_bitarray_AND_function_p = &count_bitarray_AND_NOSIMD;
+            break;
+    }
 
     // call the most optimized function for this CPU
     return (*count_bitarray_AND_function_p)(A, B);
 }
 
 uint32_t count_bitarray_low20_AND_dispatch(uint32_t *A, uint32_t *B) {
-#if defined(COMPILER_HAS_SIMD_NEON)
-    if (arm_has_neon()) count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_NEON;
-    else
-#endif
-
+    switch (GetSIMDInstrAuto()) {
 #if defined(COMPILER_HAS_SIMD_AVX512)
-        if (__builtin_cpu_supports("avx512f")) count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_AVX512;
-        else
+        case SIMD_AVX512:
+            count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_AVX512;
+            break;
 #endif
 #if defined(COMPILER_HAS_SIMD_X86)
-            if (__builtin_cpu_supports("avx2")) count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_AVX2;
-            else if (__builtin_cpu_supports("avx")) count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_AVX;
-            else if (__builtin_cpu_supports("sse2")) count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_SSE2;
-            else if (__builtin_cpu_supports("mmx")) count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_MMX;
-            else
+        case SIMD_AVX2:
+            count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_AVX2;
+            break;
+        case SIMD_AVX:
+            count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_AVX;
+            break;
+        case SIMD_SSE2:
+            count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_SSE2;
+            break;
+        case SIMD_MMX:
+            count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_MMX;
+            break;
 #endif
-                count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_NOSIMD;
+#if defined(COMPILER_HAS_SIMD_NEON)
+        case SIMD_NEON:
+            count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_NEON;
+            break;
+#endif
+        case SIMD_AUTO:
+        case SIMD_NONE:
+            count_bitarray_low20_AND_function_p = &count_bitarray_low20_AND_NOSIMD;
+            break;
+    }
 
     // call the most optimized function for this CPU
     return (*count_bitarray_low20_AND_function_p)(A, B);
 }
 
 void bitarray_AND4_dispatch(uint32_t *A, uint32_t *B, uint32_t *C, uint32_t *D) {
-#if defined(COMPILER_HAS_SIMD_NEON)
-    if (arm_has_neon()) bitarray_AND4_function_p = &bitarray_AND4_NEON;
-    else
-#endif
-
+    switch (GetSIMDInstrAuto()) {
 #if defined(COMPILER_HAS_SIMD_AVX512)
-        if (__builtin_cpu_supports("avx512f")) bitarray_AND4_function_p = &bitarray_AND4_AVX512;
-        else
+        case SIMD_AVX512:
+            bitarray_AND4_function_p = &bitarray_AND4_AVX512;
+            break;
 #endif
 #if defined(COMPILER_HAS_SIMD_X86)
-            if (__builtin_cpu_supports("avx2")) bitarray_AND4_function_p = &bitarray_AND4_AVX2;
-            else if (__builtin_cpu_supports("avx")) bitarray_AND4_function_p = &bitarray_AND4_AVX;
-            else if (__builtin_cpu_supports("sse2")) bitarray_AND4_function_p = &bitarray_AND4_SSE2;
-            else if (__builtin_cpu_supports("mmx")) bitarray_AND4_function_p = &bitarray_AND4_MMX;
-            else
+        case SIMD_AVX2:
+            bitarray_AND4_function_p = &bitarray_AND4_AVX2;
+            break;
+        case SIMD_AVX:
+            bitarray_AND4_function_p = &bitarray_AND4_AVX;
+            break;
+        case SIMD_SSE2:
+            bitarray_AND4_function_p = &bitarray_AND4_SSE2;
+            break;
+        case SIMD_MMX:
+            bitarray_AND4_function_p = &bitarray_AND4_MMX;
+            break;
 #endif
-                bitarray_AND4_function_p = &bitarray_AND4_NOSIMD;
+#if defined(COMPILER_HAS_SIMD_NEON)
+        case SIMD_NEON:
+            bitarray_AND4_function_p = &bitarray_AND4_NEON;
+            break;
+#endif
+        case SIMD_AUTO:
+        case SIMD_NONE:
+            bitarray_AND4_function_p = &bitarray_AND4_NOSIMD;
+            break;
+    }
 
     // call the most optimized function for this CPU
     (*bitarray_AND4_function_p)(A, B, C, D);
 }
 
 void bitarray_OR_dispatch(uint32_t *A, uint32_t *B) {
-#if defined(COMPILER_HAS_SIMD_NEON)
-    if (arm_has_neon()) bitarray_OR_function_p = &bitarray_OR_NEON;
-    else
-#endif
-
+    switch (GetSIMDInstrAuto()) {
 #if defined(COMPILER_HAS_SIMD_AVX512)
-        if (__builtin_cpu_supports("avx512f")) bitarray_OR_function_p = &bitarray_OR_AVX512;
-        else
+        case SIMD_AVX512:
+            bitarray_OR_function_p = &bitarray_OR_AVX512;
+            break;
 #endif
 #if defined(COMPILER_HAS_SIMD_X86)
-            if (__builtin_cpu_supports("avx2")) bitarray_OR_function_p = &bitarray_OR_AVX2;
-            else if (__builtin_cpu_supports("avx")) bitarray_OR_function_p = &bitarray_OR_AVX;
-            else if (__builtin_cpu_supports("sse2")) bitarray_OR_function_p = &bitarray_OR_SSE2;
-            else if (__builtin_cpu_supports("mmx")) bitarray_OR_function_p = &bitarray_OR_MMX;
-            else
+        case SIMD_AVX2:
+            bitarray_OR_function_p = &bitarray_OR_AVX2;
+            break;
+        case SIMD_AVX:
+            bitarray_OR_function_p = &bitarray_OR_AVX;
+            break;
+        case SIMD_SSE2:
+            bitarray_OR_function_p = &bitarray_OR_SSE2;
+            break;
+        case SIMD_MMX:
+            bitarray_OR_function_p = &bitarray_OR_MMX;
+            break;
 #endif
-                bitarray_OR_function_p = &bitarray_OR_NOSIMD;
+#if defined(COMPILER_HAS_SIMD_NEON)
+        case SIMD_NEON:
+            bitarray_OR_function_p = &bitarray_OR_NEON;
+            break;
+#endif
+        case SIMD_AUTO:
+        case SIMD_NONE:
+            bitarray_OR_function_p = &bitarray_OR_NOSIMD;
+            break;
+    }
 
     // call the most optimized function for this CPU
     (*bitarray_OR_function_p)(A, B);
 }
 
 uint32_t count_bitarray_AND2_dispatch(uint32_t *A, uint32_t *B) {
-#if defined(COMPILER_HAS_SIMD_NEON)
-    if (arm_has_neon()) count_bitarray_AND2_function_p = &count_bitarray_AND2_NEON;
-    else
-#endif
-
+    switch (GetSIMDInstrAuto()) {
 #if defined(COMPILER_HAS_SIMD_AVX512)
-        if (__builtin_cpu_supports("avx512f")) count_bitarray_AND2_function_p = &count_bitarray_AND2_AVX512;
-        else
+        case SIMD_AVX512:
+            count_bitarray_AND2_function_p = &count_bitarray_AND2_AVX512;
+            break;
 #endif
 #if defined(COMPILER_HAS_SIMD_X86)
-            if (__builtin_cpu_supports("avx2")) count_bitarray_AND2_function_p = &count_bitarray_AND2_AVX2;
-            else if (__builtin_cpu_supports("avx")) count_bitarray_AND2_function_p = &count_bitarray_AND2_AVX;
-            else if (__builtin_cpu_supports("sse2")) count_bitarray_AND2_function_p = &count_bitarray_AND2_SSE2;
-            else if (__builtin_cpu_supports("mmx")) count_bitarray_AND2_function_p = &count_bitarray_AND2_MMX;
-            else
+        case SIMD_AVX2:
+            count_bitarray_AND2_function_p = &count_bitarray_AND2_AVX2;
+            break;
+        case SIMD_AVX:
+            count_bitarray_AND2_function_p = &count_bitarray_AND2_AVX;
+            break;
+        case SIMD_SSE2:
+            count_bitarray_AND2_function_p = &count_bitarray_AND2_SSE2;
+            break;
+        case SIMD_MMX:
+            count_bitarray_AND2_function_p = &count_bitarray_AND2_MMX;
+            break;
 #endif
-                count_bitarray_AND2_function_p = &count_bitarray_AND2_NOSIMD;
+#if defined(COMPILER_HAS_SIMD_NEON)
+        case SIMD_NEON:
+            count_bitarray_AND2_function_p = &count_bitarray_AND2_NEON;
+            break;
+#endif
+        case SIMD_AUTO:
+        case SIMD_NONE:
+            count_bitarray_AND2_function_p = &count_bitarray_AND2_NOSIMD;
+            break;
+    }
 
     // call the most optimized function for this CPU
     return (*count_bitarray_AND2_function_p)(A, B);
 }
 
 uint32_t count_bitarray_AND3_dispatch(uint32_t *A, uint32_t *B, uint32_t *C) {
-#if defined(COMPILER_HAS_SIMD_NEON)
-    if (arm_has_neon()) count_bitarray_AND3_function_p = &count_bitarray_AND3_NEON;
-    else
-#endif
-
+    switch (GetSIMDInstrAuto()) {
 #if defined(COMPILER_HAS_SIMD_AVX512)
-        if (__builtin_cpu_supports("avx512f")) count_bitarray_AND3_function_p = &count_bitarray_AND3_AVX512;
-        else
+        case SIMD_AVX512:
+            count_bitarray_AND3_function_p = &count_bitarray_AND3_AVX512;
+            break;
 #endif
 #if defined(COMPILER_HAS_SIMD_X86)
-            if (__builtin_cpu_supports("avx2")) count_bitarray_AND3_function_p = &count_bitarray_AND3_AVX2;
-            else if (__builtin_cpu_supports("avx")) count_bitarray_AND3_function_p = &count_bitarray_AND3_AVX;
-            else if (__builtin_cpu_supports("sse2")) count_bitarray_AND3_function_p = &count_bitarray_AND3_SSE2;
-            else if (__builtin_cpu_supports("mmx")) count_bitarray_AND3_function_p = &count_bitarray_AND3_MMX;
-            else
+        case SIMD_AVX2:
+            count_bitarray_AND3_function_p = &count_bitarray_AND3_AVX2;
+            break;
+        case SIMD_AVX:
+            count_bitarray_AND3_function_p = &count_bitarray_AND3_AVX;
+            break;
+        case SIMD_SSE2:
+            count_bitarray_AND3_function_p = &count_bitarray_AND3_SSE2;
+            break;
+        case SIMD_MMX:
+            count_bitarray_AND3_function_p = &count_bitarray_AND3_MMX;
+            break;
 #endif
-                count_bitarray_AND3_function_p = &count_bitarray_AND3_NOSIMD;
+#if defined(COMPILER_HAS_SIMD_NEON)
+        case SIMD_NEON:
+            count_bitarray_AND3_function_p = &count_bitarray_AND3_NEON;
+            break;
+#endif
+        case SIMD_AUTO:
+        case SIMD_NONE:
+            count_bitarray_AND3_function_p = &count_bitarray_AND3_NOSIMD;
+            break;
+    }
 
     // call the most optimized function for this CPU
     return (*count_bitarray_AND3_function_p)(A, B, C);
 }
 
 uint32_t count_bitarray_AND4_dispatch(uint32_t *A, uint32_t *B, uint32_t *C, uint32_t *D) {
-#if defined(COMPILER_HAS_SIMD_NEON)
-    if (arm_has_neon()) count_bitarray_AND4_function_p = &count_bitarray_AND4_NEON;
-    else
-#endif
-
+    switch (GetSIMDInstrAuto()) {
 #if defined(COMPILER_HAS_SIMD_AVX512)
-        if (__builtin_cpu_supports("avx512f")) count_bitarray_AND4_function_p = &count_bitarray_AND4_AVX512;
-        else
+        case SIMD_AVX512:
+            count_bitarray_AND4_function_p = &count_bitarray_AND4_AVX512;
+            break;
 #endif
 #if defined(COMPILER_HAS_SIMD_X86)
-            if (__builtin_cpu_supports("avx2")) count_bitarray_AND4_function_p = &count_bitarray_AND4_AVX2;
-            else if (__builtin_cpu_supports("avx")) count_bitarray_AND4_function_p = &count_bitarray_AND4_AVX;
-            else if (__builtin_cpu_supports("sse2")) count_bitarray_AND4_function_p = &count_bitarray_AND4_SSE2;
-            else if (__builtin_cpu_supports("mmx")) count_bitarray_AND4_function_p = &count_bitarray_AND4_MMX;
-            else
+        case SIMD_AVX2:
+            count_bitarray_AND4_function_p = &count_bitarray_AND4_AVX2;
+            break;
+        case SIMD_AVX:
+            count_bitarray_AND4_function_p = &count_bitarray_AND4_AVX;
+            break;
+        case SIMD_SSE2:
+            count_bitarray_AND4_function_p = &count_bitarray_AND4_SSE2;
+            break;
+        case SIMD_MMX:
+            count_bitarray_AND4_function_p = &count_bitarray_AND4_MMX;
+            break;
 #endif
-                count_bitarray_AND4_function_p = &count_bitarray_AND4_NOSIMD;
+#if defined(COMPILER_HAS_SIMD_NEON)
+        case SIMD_NEON:
+            count_bitarray_AND4_function_p = &count_bitarray_AND4_NEON;
+            break;
+#endif
+        case SIMD_AUTO:
+        case SIMD_NONE:
+            count_bitarray_AND4_function_p = &count_bitarray_AND4_NOSIMD;
+            break;
+    }
 
     // call the most optimized function for this CPU
     return (*count_bitarray_AND4_function_p)(A, B, C, D);
@@ -65,5 +65,6 @@ void bitarray_OR(uint32_t *A, uint32_t *B);
 uint32_t count_bitarray_AND2(uint32_t *A, uint32_t *B);
 uint32_t count_bitarray_AND3(uint32_t *A, uint32_t *B, uint32_t *C);
 uint32_t count_bitarray_AND4(uint32_t *A, uint32_t *B, uint32_t *C, uint32_t *D);
+void bitarray_dispatch_reset(void);
 
 #endif
@@ -68,7 +68,7 @@ THE SOFTWARE.
 #include "fileutils.h"
 #include "pm3_cmd.h"
 
-#define NUM_BRUTE_FORCE_THREADS         (num_CPUs())
+#define NUM_BRUTE_FORCE_THREADS         (hardnested_num_threads())
 #define DEFAULT_BRUTE_FORCE_RATE        (120000000.0) // if benchmark doesn't succeed
 #define TEST_BENCH_SIZE                 (6000)        // number of odd and even states for brute force benchmark
 #define TEST_BENCH_FILENAME             "hardnested_bf_bench_data.bin"
@@ -78,7 +78,10 @@ THE SOFTWARE.
 #define DEBUG_KEY_ELIMINATION           1
 // #define DEBUG_BRUTE_FORCE
 
-#define MIN_BUCKETS_SIZE                128
+#define MIN_WORK_ITEMS_SIZE             128
+#define WORK_ITEM_STATES                (1ULL << 28)  // buckets are split in work items of about this many states
+#define PROGRESS_INTERVAL               5000          // ms between two brute force progress lines
+#define CHECKPOINT_MAGIC                0x4b434648    // "HFCK"
 
 typedef enum {
     EVEN_STATE = 0,
@@ -89,13 +92,40 @@ static uint32_t nonces_to_bruteforce = 0;
 static uint32_t bf_test_nonce[256];
 static uint8_t bf_test_nonce_2nd_byte[256];
 static uint8_t bf_test_nonce_par[256];
-static uint32_t bucket_count = 0;
-static size_t buckets_allocated = 0;
-static statelist_t **buckets = NULL;
 static uint32_t keys_found = 0;
 static uint64_t num_keys_tested;
 static uint64_t found_bs_key = 0;
 
+// work items are slices of the candidate buckets (odd states are split), taken by the threads in order
+typedef struct {
+    statelist_t slice;
+    uint32_t odd_offset;
+    uint32_t first_odd;         // identify the bucket independently of the candidates order
+    uint32_t first_even;
+    uint32_t len_odd;
+} work_item_t;
+
+static work_item_t *work_items = NULL;
+static uint32_t work_item_count = 0;
+static size_t work_items_allocated = 0;
+static uint32_t next_work_item = 0;
+static uint32_t threads_running = 0;
+static bool stop_brute_force = false;
+static bool brute_force_paused = false;
+
+// checkpoint file: header followed by one record per work item searched without success
+typedef struct {
+    uint32_t first_odd;
+    uint32_t first_even;
+    uint32_t len_odd;
+    uint32_t len_even;
+    uint32_t odd_offset;
+} checkpoint_record_t;
+
+static char checkpoint_filename[FILE_PATH_SIZE] = {0};
+static FILE *checkpoint_file = NULL;
+static pthread_mutex_t checkpoint_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 uint8_t trailing_zeros(uint8_t byte) {
     static const uint8_t trailing_zeros_LUT[256] = {
         8, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
@@ -151,49 +181,46 @@ __attribute__((force_align_arg_pointer))
 #endif
 crack_states_thread(void *x) {
     struct arg {
-        bool silent;
         int thread_ID;
         uint32_t cuid;
         uint32_t num_acquired_nonces;
-        uint64_t maximum_states;
         noncelist_t *nonces;
         uint8_t *best_first_bytes;
     } *thread_arg;
 
-    const int num_brute_force_threads = NUM_BRUTE_FORCE_THREADS;
     thread_arg = (struct arg *)x;
-    const int thread_id = thread_arg->thread_ID;
-    uint32_t current_bucket = thread_id;
-    while (current_bucket < bucket_count) {
-        statelist_t *bucket = buckets[current_bucket];
-        if (bucket) {
+    while (keys_found == 0 && __atomic_load_n(&stop_brute_force, __ATOMIC_ACQUIRE) == false) {
+        uint32_t current_item = __atomic_fetch_add(&next_work_item, 1, __ATOMIC_SEQ_CST);
+        if (current_item >= work_item_count) {
+            break;
+        }
+        work_item_t *item = &work_items[current_item];
 #if defined (DEBUG_BRUTE_FORCE)
-            PrintAndLogEx(INFO, "Thread " _YELLOW_("%u") " starts working on bucket " _YELLOW_("%u") "\n", thread_id, current_bucket);
+        PrintAndLogEx(INFO, "Thread " _YELLOW_("%u") " starts working on item " _YELLOW_("%u") "\n", thread_arg->thread_ID, current_item);
 #endif
-            const uint64_t key = crack_states_bitsliced(thread_arg->cuid, thread_arg->best_first_bytes, bucket, &keys_found, &num_keys_tested, nonces_to_bruteforce, bf_test_nonce_2nd_byte, thread_arg->nonces);
-            if (key != -1) {
-                __atomic_fetch_add(&keys_found, 1, __ATOMIC_SEQ_CST);
-                __atomic_fetch_add(&found_bs_key, key, __ATOMIC_SEQ_CST);
-
-                char progress_text[80];
-                char keystr[19];
-                snprintf(keystr, sizeof(keystr), "%012" PRIX64 "  ", key);
-                snprintf(progress_text, sizeof(progress_text), "Brute force phase completed.  Key found: " _GREEN_("%s"), keystr);
-                hardnested_print_progress(thread_arg->num_acquired_nonces, progress_text, 0.0, 0);
-                break;
-            } else if (keys_found) {
-                break;
-            } else {
-                if (!thread_arg->silent) {
-                    char progress_text[80];
-                    snprintf(progress_text, sizeof(progress_text), "Brute force phase: %6.02f%%  ", 100.0 * (float)num_keys_tested / (float)(thread_arg->maximum_states));
-                    float remaining_bruteforce = thread_arg->nonces[thread_arg->best_first_bytes[0]].expected_num_brute_force - (float)num_keys_tested / 2;
-                    hardnested_print_progress(thread_arg->num_acquired_nonces, progress_text, remaining_bruteforce, 5000);
-                }
-            }
+        const uint64_t key = crack_states_bitsliced(thread_arg->cuid, thread_arg->best_first_bytes, &item->slice, &keys_found, &num_keys_tested, nonces_to_bruteforce, bf_test_nonce_2nd_byte, thread_arg->nonces);
+        if (key != -1) {
+            __atomic_fetch_add(&keys_found, 1, __ATOMIC_SEQ_CST);
+            __atomic_fetch_add(&found_bs_key, key, __ATOMIC_SEQ_CST);
+
+            char progress_text[80];
+            char keystr[19];
+            snprintf(keystr, sizeof(keystr), "%012" PRIX64 "  ", key);
+            snprintf(progress_text, sizeof(progress_text), "Brute force phase completed.  Key found: " _GREEN_("%s"), keystr);
+            hardnested_print_progress(thread_arg->num_acquired_nonces, progress_text, 0.0, 0);
+            break;
+        } else if (keys_found) {
+            break;
+        }
+        if (checkpoint_file != NULL) {
+            checkpoint_record_t record = {item->first_odd, item->first_even, item->len_odd, item->slice.len[EVEN_STATE], item->odd_offset};
+            pthread_mutex_lock(&checkpoint_mutex);
+            fwrite(&record, sizeof(record), 1, checkpoint_file);
+            fflush(checkpoint_file);
+            pthread_mutex_unlock(&checkpoint_mutex);
         }
-        current_bucket += num_brute_force_threads;
     }
+    __atomic_fetch_sub(&threads_running, 1, __ATOMIC_SEQ_CST);
     return NULL;
 }
 
@@ -298,27 +325,92 @@ static void write_benchfile(statelist_t *candidates) {
 #endif
 
 
-static bool ensure_buckets_alloc(size_t need_buckets) {
-    if (need_buckets > buckets_allocated) {
-        size_t alloc_sz = ((buckets_allocated == 0) ? MIN_BUCKETS_SIZE : (buckets_allocated * 2));
-        while (need_buckets > alloc_sz) {
+static bool ensure_work_items_alloc(size_t need_items) {
+    if (need_items > work_items_allocated) {
+        size_t alloc_sz = ((work_items_allocated == 0) ? MIN_WORK_ITEMS_SIZE : (work_items_allocated * 2));
+        while (need_items > alloc_sz) {
             alloc_sz *= 2;
         }
-        statelist_t **new_buckets = realloc(buckets, sizeof(statelist_t *) * alloc_sz);
-        if (new_buckets == NULL) {
-            free(buckets);
-            buckets_allocated = 0;
+        work_item_t *new_items = realloc(work_items, sizeof(work_item_t) * alloc_sz);
+        if (new_items == NULL) {
+            free(work_items);
+            work_items = NULL;
+            work_items_allocated = 0;
             return false;
         }
-        buckets = new_buckets;
-        memset(buckets + buckets_allocated, 0, (alloc_sz - buckets_allocated) * sizeof(statelist_t *));
-        buckets_allocated = alloc_sz;
+        work_items = new_items;
+        work_items_allocated = alloc_sz;
     }
 
     return true;
 }
 
 
+static int compare_checkpoint_records(const void *a, const void *b) {
+    return memcmp(a, b, sizeof(checkpoint_record_t));
+}
+
+
+// read the work items already searched, and open the checkpoint file to append new ones
+static checkpoint_record_t *open_checkpoint(uint32_t cuid, size_t *num_records) {
+    *num_records = 0;
+    checkpoint_record_t *records = NULL;
+
+    FILE *f = fopen(checkpoint_filename, "rb");
+    if (f != NULL) {
+        uint32_t header[2] = {0};
+        if (fread(header, sizeof(header), 1, f) == 1 && header[0] == CHECKPOINT_MAGIC && header[1] == cuid) {
+            size_t allocated = 0;
+            checkpoint_record_t record;
+            while (fread(&record, sizeof(record), 1, f) == 1) {
+                if (*num_records == allocated) {
+                    allocated = (allocated == 0) ? MIN_WORK_ITEMS_SIZE : allocated * 2;
+                    checkpoint_record_t *tmp = realloc(records, allocated * sizeof(checkpoint_record_t));
+                    if (tmp == NULL) {
+                        break;
+                    }
+                    records = tmp;
+                }
+                records[(*num_records)++] = record;
+            }
+        } else {
+            PrintAndLogEx(WARNING, "Checkpoint file `" _YELLOW_("%s") "` belongs to another card, starting over", checkpoint_filename);
+        }
+        fclose(f);
+    }
+
+    if (*num_records) {
+        qsort(records, *num_records, sizeof(checkpoint_record_t), compare_checkpoint_records);
+        checkpoint_file = fopen(checkpoint_filename, "ab");
+    } else {
+        checkpoint_file = fopen(checkpoint_filename, "wb");
+        if (checkpoint_file != NULL) {
+            uint32_t header[2] = {CHECKPOINT_MAGIC, cuid};
+            fwrite(header, sizeof(header), 1, checkpoint_file);
+            fflush(checkpoint_file);
+        }
+    }
+    if (checkpoint_file == NULL) {
+        PrintAndLogEx(WARNING, "Can't write checkpoint file `" _YELLOW_("%s") "`", checkpoint_filename);
+    }
+    return records;
+}
+
+
+void brute_force_set_checkpoint(const char *filename) {
+    if (filename == NULL) {
+        checkpoint_filename[0] = '\0';
+    } else {
+        snprintf(checkpoint_filename, sizeof(checkpoint_filename), "%s", filename);
+    }
+}
+
+
+bool brute_force_aborted(void) {
+    return brute_force_paused;
+}
+
+
 bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint32_t num_acquired_nonces, uint64_t maximum_states, noncelist_t *nonces, uint8_t *best_first_bytes, uint64_t *found_key) {
 #if defined (WRITE_BENCH_FILE)
     write_benchfile(candidates);
@@ -330,58 +422,143 @@ bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint
     keys_found = 0;
     num_keys_tested = 0;
     found_bs_key = 0;
+    stop_brute_force = false;
+    brute_force_paused = false;
 
     bitslice_test_nonces(nonces_to_bruteforce, bf_test_nonce, bf_test_nonce_par);
 
-    // count number of states to go
-    bucket_count = 0;
+    size_t num_records = 0;
+    checkpoint_record_t *records = NULL;
+    if (silent == false && checkpoint_filename[0] != '\0') {
+        records = open_checkpoint(cuid, &num_records);
+    }
+
+    // split the buckets in work items, skipping the ones already searched
+    work_item_count = 0;
+    next_work_item = 0;
+    uint64_t states_skipped = 0;
     for (statelist_t *p = candidates; p != NULL; p = p->next) {
         if (p->states[ODD_STATE] != NULL && p->states[EVEN_STATE] != NULL) {
-            if (!ensure_buckets_alloc(bucket_count + 1)) {
-                PrintAndLogEx(ERR, "Can't allocate buckets, abort!");
-                return false;
+            uint32_t odd_chunk = MAX(1, WORK_ITEM_STATES / p->len[EVEN_STATE]);
+            for (uint32_t offset = 0; offset < p->len[ODD_STATE]; offset += odd_chunk) {
+                uint32_t len = MIN(odd_chunk, p->len[ODD_STATE] - offset);
+                if (num_records) {
+                    checkpoint_record_t record = {p->states[ODD_STATE][0], p->states[EVEN_STATE][0], p->len[ODD_STATE], p->len[EVEN_STATE], offset};
+                    if (bsearch(&record, records, num_records, sizeof(checkpoint_record_t), compare_checkpoint_records) != NULL) {
+                        states_skipped += (uint64_t)len * p->len[EVEN_STATE];
+                        continue;
+                    }
+                }
+                if (!ensure_work_items_alloc(work_item_count + 1)) {
+                    PrintAndLogEx(ERR, "Can't allocate work items, abort!");
+                    free(records);
+                    return false;
+                }
+                work_item_t *item = &work_items[work_item_count++];
+                item->slice.states[ODD_STATE] = p->states[ODD_STATE] + offset;
+                item->slice.len[ODD_STATE] = len;
+                item->slice.states[EVEN_STATE] = p->states[EVEN_STATE];
+                item->slice.len[EVEN_STATE] = p->len[EVEN_STATE];
+                item->slice.next = NULL;
+                item->odd_offset = offset;
+                item->first_odd = p->states[ODD_STATE][0];
+                item->first_even = p->states[EVEN_STATE][0];
+                item->len_odd = p->len[ODD_STATE];
             }
-
-            buckets[bucket_count] = p;
-            bucket_count++;
         }
     }
+    free(records);
+    if (states_skipped) {
+        PrintAndLogEx(INFO, "Resuming from checkpoint, skipping " _YELLOW_("%" PRIu64) " states already searched", states_skipped);
+        num_keys_tested = states_skipped;
+    }
 
     uint64_t start_time = msclock();
 
 #if defined(__linux__) ||  defined(__APPLE__)
-    if (NUM_BRUTE_FORCE_THREADS < 0)
+    if (num_brute_force_threads < 1)
         return false;
 #endif
 
     pthread_t threads[num_brute_force_threads];
     struct args {
-        bool silent;
         int thread_ID;
         uint32_t cuid;
         uint32_t num_acquired_nonces;
-        uint64_t maximum_states;
         noncelist_t *nonces;
         uint8_t *best_first_bytes;
     } thread_args[num_brute_force_threads];
 
+    bool thread_started[num_brute_force_threads];
+    uint32_t num_started = 0;
+    threads_running = num_brute_force_threads;
     for (uint32_t i = 0; i < num_brute_force_threads; i++) {
         thread_args[i].thread_ID = i;
-        thread_args[i].silent = silent;
         thread_args[i].cuid = cuid;
         thread_args[i].num_acquired_nonces = num_acquired_nonces;
-        thread_args[i].maximum_states = maximum_states;
         thread_args[i].nonces = nonces;
         thread_args[i].best_first_bytes = best_first_bytes;
-        pthread_create(&threads[i], NULL, crack_states_thread, (void *)&thread_args[i]);
+        thread_started[i] = (pthread_create(&threads[i], NULL, crack_states_thread, (void *)&thread_args[i]) == 0);
+        if (thread_started[i]) {
+            num_started++;
+        } else {
+            // it will never count itself out
+            __atomic_fetch_sub(&threads_running, 1, __ATOMIC_SEQ_CST);
+        }
+    }
+
+    if (num_started == 0) {
+        PrintAndLogEx(WARNING, "Can't start brute force threads, searching on the main thread");
+        __atomic_store_n(&threads_running, 1, __ATOMIC_RELEASE);
+        crack_states_thread((void *)&thread_args[0]);
+    }
+
+    // report the rate and let the user pause the search. Running work items are completed first
+    if (silent == false) {
+        uint64_t last_time = start_time;
+        uint64_t last_tested = num_keys_tested;
+        while (__atomic_load_n(&threads_running, __ATOMIC_ACQUIRE) > 0) {
+            msleep(100);
+            if (brute_force_paused == false && kbd_enter_pressed()) {
+                brute_force_paused = true;
+                __atomic_store_n(&stop_brute_force, true, __ATOMIC_RELEASE);
+                PrintAndLogEx(INFO, "Pausing brute force, waiting for the running work items...");
+            }
+            uint64_t now = msclock();
+            if (now - last_time >= PROGRESS_INTERVAL) {
+                uint64_t tested = __atomic_load_n(&num_keys_tested, __ATOMIC_ACQUIRE);
+                char progress_text[80];
+                snprintf(progress_text, sizeof(progress_text), "Brute force phase: %6.02f%%  %6.1f Mkeys/s",
+                         100.0 * (float)tested / (float)maximum_states,
+                         (float)(tested - last_tested) / (float)(now - last_time) / 1000.0);
+                float remaining_bruteforce = nonces[best_first_bytes[0]].expected_num_brute_force - (float)tested / 2;
+                hardnested_print_progress(num_acquired_nonces, progress_text, remaining_bruteforce, 0);
+                last_time = now;
+                last_tested = tested;
+            }
+        }
     }
+
     for (uint32_t i = 0; i < num_brute_force_threads; i++) {
-        pthread_join(threads[i], 0);
+        if (thread_started[i]) {
+            pthread_join(threads[i], 0);
+        }
+    }
+
+    if (checkpoint_file != NULL) {
+        fclose(checkpoint_file);
+        checkpoint_file = NULL;
+        if (keys_found) {
+            remove(checkpoint_filename);
+        } else if (brute_force_paused) {
+            PrintAndLogEx(INFO, "Brute force progress saved in `" _YELLOW_("%s") "`, run the same command to resume", checkpoint_filename);
+        }
     }
 
-    free(buckets);
-    buckets = NULL;
-    buckets_allocated = 0;
+    free(work_items);
+    work_items = NULL;
+    work_items_allocated = 0;
+    work_item_count = 0;
 
     uint64_t elapsed_time = msclock() - start_time;
 
@@ -479,6 +656,9 @@ static bool read_bench_data(statelist_t *test_candidates) {
 
 
 float brute_force_benchmark(void) {
+    // every attack starts with the benchmark
+    brute_force_paused = false;
+
     const int num_brute_force_threads = NUM_BRUTE_FORCE_THREADS;
     statelist_t test_candidates[num_brute_force_threads];
 
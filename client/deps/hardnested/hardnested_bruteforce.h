@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "hardnested_stateset.h"
 
 #define NUM_SUMS 19 // number of possible sum property values
 
@@ -42,6 +43,7 @@ typedef struct noncelist {
     float expected_num_brute_force;
     uint16_t BitFlips[0x400];
     uint32_t *states_bitarray[2];
+    stateset_t *states_set[2];          // replaces states_bitarray once the nonces are acquired
     uint32_t num_states_bitarray[2];
     bool all_bitflips_dirty[2];
     noncelistentry_t *first;
@@ -56,6 +58,8 @@ typedef struct {
 void prepare_bf_test_nonces(noncelist_t *nonces, uint8_t best_first_byte);
 bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint32_t num_acquired_nonces, uint64_t maximum_states, noncelist_t *nonces, uint8_t *best_first_bytes, uint64_t *found_key);
 float brute_force_benchmark(void);
+void brute_force_set_checkpoint(const char *filename);
+bool brute_force_aborted(void);
 uint8_t trailing_zeros(uint8_t byte);
 bool verify_key(uint32_t cuid, noncelist_t *nonces, const uint8_t *best_first_bytes, uint32_t odd, uint32_t even);
 
@@ -0,0 +1,260 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// Compressed sets of 24 bit Crypto1 half states for the hardnested attack
+//-----------------------------------------------------------------------------
+
+#include "hardnested_stateset.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CHUNK_WORDS       2048      // 32 bit words per 2^16 bit chunk
+#define CHUNK_BITMAP_SIZE (CHUNK_WORDS * sizeof(uint32_t))
+#define ARRAY_MAX_COUNT   (CHUNK_BITMAP_SIZE / sizeof(uint16_t))
+
+// same bit order as the bitarrays in cmdhfmfhard.c: MSB first
+static inline bool test_bit(const uint32_t *bitarray, uint32_t index) {
+    return bitarray[index >> 5] & (0x80000000 >> (index & 0x1f));
+}
+
+// store the set bits of a 2^16 bit bitmap in the smallest container
+static bool chunk_from_bitmap(stateset_chunk_t *chunk, const uint32_t *bitmap) {
+    uint32_t count = 0;
+    uint32_t num_runs = 0;
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < CHUNK_WORDS; i++) {
+        uint32_t w = bitmap[i];
+        count += __builtin_popcount(w);
+        num_runs += __builtin_popcount(w & ~(w >> 1 | prev << 31));
+        prev = w & 1;
+    }
+
+    memset(chunk, 0, sizeof(stateset_chunk_t));
+    chunk->count = count;
+    if (count == 0) {
+        chunk->type = STATESET_EMPTY;
+        return true;
+    }
+
+    size_t array_size = (count <= ARRAY_MAX_COUNT) ? count * sizeof(uint16_t) : CHUNK_BITMAP_SIZE;
+    size_t runs_size = num_runs * 2 * sizeof(uint16_t);
+
+    if (runs_size < array_size && runs_size < CHUNK_BITMAP_SIZE) {
+        chunk->type = STATESET_RUNS;
+        chunk->num = num_runs;
+        chunk->values = malloc(runs_size);
+        if (chunk->values == NULL) {
+            return false;
+        }
+        uint16_t *run = chunk->values;
+        uint32_t run_start = 0;
+        prev = 0;
+        for (uint32_t i = 0; i < CHUNK_WORDS; i++) {
+            uint32_t w = bitmap[i];
+            uint32_t next = (i + 1 < CHUNK_WORDS) ? bitmap[i + 1] >> 31 : 0;
+            uint32_t starts = w & ~(w >> 1 | prev << 31);
+            uint32_t ends = w & ~(w << 1 | next);
+            // handle starts and ends in bit order. A single bit run starts and ends at the same bit.
+            while (starts | ends) {
+                uint32_t s = starts ? __builtin_clz(starts) : 32;
+                uint32_t e = ends ? __builtin_clz(ends) : 32;
+                if (s <= e) {
+                    run_start = i * 32 + s;
+                    starts &= ~(0x80000000 >> s);
+                } else {
+                    *run++ = run_start;
+                    *run++ = i * 32 + e - run_start;
+                    ends &= ~(0x80000000 >> e);
+                }
+            }
+            prev = w & 1;
+        }
+    } else if (array_size < CHUNK_BITMAP_SIZE) {
+        chunk->type = STATESET_ARRAY;
+        chunk->num = count;
+        chunk->values = malloc(array_size);
+        if (chunk->values == NULL) {
+            return false;
+        }
+        uint16_t *v = chunk->values;
+        for (uint32_t i = 0; i < CHUNK_WORDS; i++) {
+            uint32_t w = bitmap[i];
+            while (w) {
+                uint32_t b = __builtin_clz(w);
+                *v++ = i * 32 + b;
+                w &= ~(0x80000000 >> b);
+            }
+        }
+    } else {
+        chunk->type = STATESET_BITMAP;
+        chunk->bitmap = malloc(CHUNK_BITMAP_SIZE);
+        if (chunk->bitmap == NULL) {
+            return false;
+        }
+        memcpy(chunk->bitmap, bitmap, CHUNK_BITMAP_SIZE);
+    }
+    return true;
+}
+
+static size_t chunk_size(const stateset_chunk_t *chunk) {
+    switch (chunk->type) {
+        case STATESET_ARRAY:
+            return chunk->num * sizeof(uint16_t);
+        case STATESET_RUNS:
+            return chunk->num * 2 * sizeof(uint16_t);
+        case STATESET_BITMAP:
+            return CHUNK_BITMAP_SIZE;
+        default:
+            return 0;
+    }
+}
+
+stateset_t *stateset_from_bitarray(const uint32_t *bitarray) {
+    stateset_t *set = calloc(1, sizeof(stateset_t));
+    if (set == NULL) {
+        return NULL;
+    }
+    for (uint32_t c = 0; c < STATESET_CHUNKS; c++) {
+        if (chunk_from_bitmap(&set->chunk[c], bitarray + c * CHUNK_WORDS) == false) {
+            stateset_free(set);
+            return NULL;
+        }
+        set->count += set->chunk[c].count;
+        set->size += chunk_size(&set->chunk[c]);
+    }
+    return set;
+}
+
+void stateset_free(stateset_t *set) {
+    if (set == NULL) {
+        return;
+    }
+    for (uint32_t c = 0; c < STATESET_CHUNKS; c++) {
+        free(set->chunk[c].values);
+        free(set->chunk[c].bitmap);
+    }
+    free(set);
+}
+
+static bool chunk_contains(const stateset_chunk_t *chunk, uint16_t low) {
+    switch (chunk->type) {
+        case STATESET_ARRAY: {
+            const uint16_t *v = chunk->values;
+            uint32_t lo = 0, hi = chunk->num;
+            while (lo < hi) {
+                uint32_t mid = (lo + hi) / 2;
+                if (v[mid] < low) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            return lo < chunk->num && v[lo] == low;
+        }
+        case STATESET_RUNS: {
+            // last run starting at or before low
+            const uint16_t *run = chunk->values;
+            uint32_t lo = 0, hi = chunk->num;
+            while (lo < hi) {
+                uint32_t mid = (lo + hi) / 2;
+                if (run[2 * mid] <= low) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            return lo > 0 && low - run[2 * (lo - 1)] <= run[2 * (lo - 1) + 1];
+        }
+        case STATESET_BITMAP:
+            return test_bit(chunk->bitmap, low);
+        default:
+            return false;
+    }
+}
+
+bool stateset_contains(const stateset_t *set, uint32_t state) {
+    return chunk_contains(&set->chunk[(state >> 16) & 0xff], state & 0xffff);
+}
+
+static inline bool state_passes(uint32_t state, const stateset_chunk_t *chunk2, const uint32_t *A, const uint32_t *B) {
+    return (A == NULL || test_bit(A, state))
+           && (B == NULL || test_bit(B, state))
+           && (chunk2 == NULL || chunk_contains(chunk2, state & 0xffff));
+}
+
+uint32_t stateset_filter(const stateset_t *set, const stateset_t *set2, const uint32_t *A, const uint32_t *B, uint32_t *list) {
+    uint32_t count = 0;
+    for (uint32_t c = 0; c < STATESET_CHUNKS; c++) {
+        const stateset_chunk_t *chunk = &set->chunk[c];
+        const stateset_chunk_t *chunk2 = (set2 != NULL) ? &set2->chunk[c] : NULL;
+        if (chunk->type == STATESET_EMPTY || (chunk2 != NULL && chunk2->type == STATESET_EMPTY)) {
+            continue;
+        }
+        uint32_t high = c << 16;
+        switch (chunk->type) {
+            case STATESET_ARRAY:
+                for (uint32_t i = 0; i < chunk->num; i++) {
+                    uint32_t state = high | chunk->values[i];
+                    if (state_passes(state, chunk2, A, B)) {
+                        if (list != NULL) {
+                            list[count] = state;
+                        }
+                        count++;
+                    }
+                }
+                break;
+            case STATESET_RUNS:
+                for (uint32_t i = 0; i < chunk->num; i++) {
+                    uint32_t first = high | chunk->values[2 * i];
+                    uint32_t last = first + chunk->values[2 * i + 1];
+                    for (uint32_t state = first; state <= last; state++) {
+                        if (state_passes(state, chunk2, A, B)) {
+                            if (list != NULL) {
+                                list[count] = state;
+                            }
+                            count++;
+                        }
+                    }
+                }
+                break;
+            case STATESET_BITMAP:
+                for (uint32_t i = 0; i < CHUNK_WORDS; i++) {
+                    uint32_t w = chunk->bitmap[i];
+                    if (A != NULL) {
+                        w &= A[(high >> 5) + i];
+                    }
+                    if (B != NULL) {
+                        w &= B[(high >> 5) + i];
+                    }
+                    while (w) {
+                        uint32_t b = __builtin_clz(w);
+                        uint32_t state = high | (i * 32 + b);
+                        if (chunk2 == NULL || chunk_contains(chunk2, state & 0xffff)) {
+                            if (list != NULL) {
+                                list[count] = state;
+                            }
+                            count++;
+                        }
+                        w &= ~(0x80000000 >> b);
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return count;
+}
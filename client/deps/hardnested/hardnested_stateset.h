@@ -0,0 +1,65 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// Compressed sets of 24 bit Crypto1 half states for the hardnested attack.
+//
+// The 2^24 states are split into 256 chunks of 2^16 states. Like in roaring
+// bitmaps each chunk is stored in the smallest of three containers:
+//  - a sorted array of the low 16 bits of the states,
+//  - a sorted list of runs (start, length - 1),
+//  - a dense 8 KiB bitmap in the same bit order as the 2^24 bit bitarrays.
+// Empty chunks take no memory at all.
+//-----------------------------------------------------------------------------
+
+#ifndef HARDNESTED_STATESET_H__
+#define HARDNESTED_STATESET_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define STATESET_CHUNKS 256
+
+typedef enum {
+    STATESET_EMPTY = 0,
+    STATESET_ARRAY,
+    STATESET_RUNS,
+    STATESET_BITMAP,
+} stateset_container_t;
+
+typedef struct {
+    uint8_t type;           // stateset_container_t
+    uint16_t num;           // number of array entries or runs
+    uint32_t count;         // number of states in this chunk
+    uint16_t *values;       // STATESET_ARRAY: low 16 bits, STATESET_RUNS: (start, length - 1) pairs
+    uint32_t *bitmap;       // STATESET_BITMAP: 2048 words
+} stateset_chunk_t;
+
+typedef struct {
+    uint32_t count;         // number of states
+    size_t size;            // bytes used by the containers
+    stateset_chunk_t chunk[STATESET_CHUNKS];
+} stateset_t;
+
+stateset_t *stateset_from_bitarray(const uint32_t *bitarray);
+void stateset_free(stateset_t *set);
+
+bool stateset_contains(const stateset_t *set, uint32_t state);
+
+// states of set which are also in set2 and in the bitarrays A and B, each of them may be NULL.
+// Writes them in ascending order to list if not NULL, returns their number.
+uint32_t stateset_filter(const stateset_t *set, const stateset_t *set2, const uint32_t *A, const uint32_t *B, uint32_t *list);
+
+#endif
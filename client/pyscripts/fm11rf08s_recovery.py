@@ -40,8 +40,7 @@ else:
                                                "..", "tools"))
 
 tools = {
-    "staticnested_1nt": os.path.join(f"{TOOLS_PATH}", "staticnested_1nt"),
-    "staticnested_2x1nt": os.path.join(f"{TOOLS_PATH}", "staticnested_2x1nt_rf08s"),
+    "staticnested_rf08s_card": os.path.join(f"{TOOLS_PATH}", "staticnested_rf08s_card"),
     "staticnested_2x1nt1key": os.path.join(f"{TOOLS_PATH}", "staticnested_2x1nt_rf08s_1key"),
 }
 for tool, bin in tools.items():
@@ -132,79 +131,36 @@ for sec in range(NUM_SECTORS):
                 print("Error, could not collect nonces, abort")
                 exit()
 
-print("Running staticnested_1nt & 2x1nt when doable...")
-keys = [[set(), set()] for _ in range(NUM_SECTORS)]
-all_keys = set()
-duplicates = set()
-# Availability of filtered dicts
-filtered_dicts = [[False, False] for _ in range(NUM_SECTORS)]
-for sec in range(NUM_SECTORS):
-    if found_keys[sec][0] != "" and found_keys[sec][1] != "":
-        continue
-    if found_keys[sec][0] == "" and found_keys[sec][1] == "" and nt[sec][0] != nt[sec][1]:
-        for key_type in [0, 1]:
-            cmd = [tools["staticnested_1nt"], f"{uid:08X}", f"{sec}",
-                   nt[sec][key_type], nt_enc[sec][key_type], par_err[sec][key_type]]
-            if args.debug:
-                print(' '.join(cmd))
-            subprocess.run(cmd, capture_output=True)
-        cmd = [tools["staticnested_2x1nt"],
-               f"keys_{uid:08x}_{sec:02}_{nt[sec][0]}.dic", f"keys_{uid:08x}_{sec:02}_{nt[sec][1]}.dic"]
-        if args.debug:
-            print(' '.join(cmd))
-        subprocess.run(cmd, capture_output=True)
-        filtered_dicts[sec][key_type] = True
-        for key_type in [0, 1]:
-            with (open(f"keys_{uid:08x}_{sec:02}_{nt[sec][key_type]}_filtered.dic")) as f:
-                keys_set = set()
-                while line := f.readline().rstrip():
-                    if line not in keys_set:
-                        keys_set.add(line)
-                keys[sec][key_type] = keys_set
-                duplicates.update(all_keys.intersection(keys_set))
-                all_keys.update(keys_set)
-    else:  # one key not found or both identical
-        if found_keys[sec][0] == "":
-            key_type = 0
-        else:
-            key_type = 1
-        cmd = [tools["staticnested_1nt"], f"{uid:08X}", f"{sec}",
-               nt[sec][key_type], nt_enc[sec][key_type], par_err[sec][key_type]]
-        if args.debug:
-            print(' '.join(cmd))
-        subprocess.run(cmd, capture_output=True)
-        with (open(f"keys_{uid:08x}_{sec:02}_{nt[sec][key_type]}.dic")) as f:
-            keys_set = set()
-            while line := f.readline().rstrip():
-                if line not in keys_set:
-                    keys_set.add(line)
-            keys[sec][key_type] = keys_set
-            duplicates.update(all_keys.intersection(keys_set))
-            all_keys.update(keys_set)
-
-print("Looking for common keys across sectors...")
-keys_filtered = [[set(), set()] for _ in range(NUM_SECTORS)]
-for dup in duplicates:
+print("Running staticnested_rf08s_card on all sectors...")
+# Same as running staticnested_1nt & 2x1nt when doable, then looking for common keys across sectors
+nonces_file = f"keys_{uid:08x}_nonces.txt"
+with (open(nonces_file, "w")) as f:
     for sec in range(NUM_SECTORS):
-        for key_type in [0, 1]:
-            if dup in keys[sec][key_type]:
-                keys_filtered[sec][key_type].add(dup)
-                if nt[sec][0] == nt[sec][1] and key_type == 0 and keys[sec][1] == set() and found_keys[sec][1] == "":
-                    keys_filtered[sec][1].add(dup)
-                    continue
-
-# Availability of duplicates dicts
+        if found_keys[sec][0] != "" and found_keys[sec][1] != "":
+            continue
+        known = "-"
+        if found_keys[sec][0] != "":
+            known = "a"
+        elif found_keys[sec][1] != "":
+            known = "b"
+        f.write(f"{sec} {nt[sec][0]} {nt_enc[sec][0]} {par_err[sec][0]} "
+                f"{nt[sec][1]} {nt_enc[sec][1]} {par_err[sec][1]} {known}\n")
+cmd = [tools["staticnested_rf08s_card"], f"{uid:08X}", nonces_file]
+if args.debug:
+    print(' '.join(cmd))
+result = subprocess.run(cmd, capture_output=True, text=True).stdout
+# Availability of filtered and duplicates dicts
+filtered_dicts = [[False, False] for _ in range(NUM_SECTORS)]
 duplicates_dicts = [[False, False] for _ in range(NUM_SECTORS)]
-first = True
-for sec in range(NUM_SECTORS):
-    for key_type in [0, 1]:
-        if len(keys_filtered[sec][key_type]) > 0:
-            if first:
-                print("Saving duplicates dicts...")
-                first = False
-            with (open(f"keys_{uid:08x}_{sec:02}_{nt[sec][key_type]}_duplicates.dic", "w")) as f:
-                for k in keys_filtered[sec][key_type]:
-                    f.write(f"{k}\n")
+for line in result.split('\n'):
+    # DICT: <sector> <A|B> <full|filtered|duplicates> <filename> <nr keys>
+    if line.startswith("DICT:"):
+        res = line.split()
+        sec = int(res[1])
+        key_type = ['A', 'B'].index(res[2])
+        if res[3] == "filtered":
+            filtered_dicts[sec][key_type] = True
+        elif res[3] == "duplicates":
             duplicates_dicts[sec][key_type] = True
 
 abort = False
@@ -0,0 +1,510 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// Offline batch decoding of LF (.pm3) and HF (.trace) capture files
+//
+// Every file is decoded on its own worker buffers, LF captures go straight
+// through the lfdemod.c decoders and never touch the graph or demod buffers.
+// Each file gives one JSON line, written in directory order.
+//-----------------------------------------------------------------------------
+
+// this define is needed for scandir/alphasort to work
+#define _GNU_SOURCE
+#include "batch.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "ui.h"
+#include "comms.h"                  // g_pm3_capabilities
+#include "util.h"                   // num_CPUs, str_endswith
+#include "commonutil.h"             // ARRAYLEN
+#include "lfdemod.h"
+#include "graph.h"                  // demod_ctx_t
+#include "cmdtrace.h"               // TraceDecodeJSON
+#include "emv/emvjson.h"            // JsonSaveStr
+#include "mifare/mifaredefault.h"   // mifare default key array
+#include "jansson.h"
+
+#ifdef _WIN32
+#include "scandir.h"
+#endif
+
+// same defaults as `lf em 410x demod`
+#define BATCH_ASK_MAXERR    100
+
+typedef struct {
+    char *path;
+    const char *name;
+    char *json;
+    bool done;
+    bool is_hf;
+    bool failed;
+    bool found;
+} batch_item_t;
+
+typedef struct {
+    batch_item_t *items;
+    uint32_t count;
+    uint32_t next;          // next item to decode, shared by all workers
+    uint32_t written;       // next item to write
+    uint8_t protocol;
+    const char *hf_type;
+    FILE *out;
+    batch_stats_t *stats;
+    pthread_mutex_t lock;
+} batch_ctx_t;
+
+// cmdhflist.c annotators keep their protocol state between frames,  only one trace at a time.
+// HF only gets parallel once that state (auth data, key cache, hitag2 state) moves into a per trace context,
+// the remaining LF decoders once the cmdlf*.c demods no longer print and touch client globals while decoding
+static pthread_mutex_t gs_annotate_lock = PTHREAD_MUTEX_INITIALIZER;
+
+bool batch_match(const char *pattern, const char *name) {
+    const char *star = NULL;
+    const char *retry = NULL;
+
+    while (*name) {
+        if (*pattern == '*') {
+            star = pattern++;
+            retry = name;
+        } else if (*pattern == '?' || *pattern == *name) {
+            pattern++;
+            name++;
+        } else if (star) {
+            pattern = star + 1;
+            name = ++retry;
+        } else {
+            return false;
+        }
+    }
+
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return (*pattern == '\0');
+}
+
+// same as `data load`,  into the graph buffer of the worker's demod context
+static size_t batch_load_pm3(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+
+    g_GraphTraceLen = 0;
+    char line[80];
+    while (fgets(line, sizeof(line), f)) {
+        if (GraphReserve(g_GraphTraceLen + 1) == false) {
+            break;
+        }
+        g_GraphBuffer[g_GraphTraceLen++] = atoi(line);
+    }
+    fclose(f);
+    GraphChanged();
+    return g_GraphTraceLen;
+}
+
+// the samples as the demods see them after `data load`,  trimmed and without offset
+static void batch_get_samples(uint8_t *samples, size_t n) {
+    getFromGraphBufferEx(samples, n);
+    removeSignalOffset(samples, n);
+    // the graph buffer trims again on the way back to the demods
+    for (size_t i = 0; i < n; i++) {
+        if (samples[i] == 0) {
+            samples[i] = 1;
+        }
+    }
+    computeSignalProperties(samples, n);
+}
+
+static bool batch_em410x(json_t *root, const uint8_t *samples, size_t n, uint8_t *bits) {
+
+    // ASK demod is limited to the device sample buffer,  when connected
+    size_t size = n;
+    if (g_pm3_capabilities.bigbuf_size && g_pm3_capabilities.bigbuf_size < size) {
+        size = g_pm3_capabilities.bigbuf_size;
+    }
+    memcpy(bits, samples, size);
+
+    int clk = 0, foundclk = 0, invert = 0, start_idx = 0;
+    size_t ststart = 0, stend = 0;
+    DetectST(bits, &size, &foundclk, &ststart, &stend);
+    if (foundclk == 32 || foundclk == 64) {
+        clk = foundclk;
+    }
+
+    int errcnt = askdemod_ext(bits, &size, &clk, &invert, BATCH_ASK_MAXERR, 0, 1, &start_idx);
+    if (errcnt < 0 || errcnt > BATCH_ASK_MAXERR || size < 16) {
+        return false;
+    }
+
+    uint32_t hi = 0;
+    uint64_t lo = 0;
+    size_t idx = 0;
+    int type = Em410xDecode(bits, &size, &idx, &hi, &lo);
+    if (type < 0 || (hi == 0 && lo == 0)) {
+        return false;
+    }
+
+    char id[40] = {0};
+    if (type & 0x2) {
+        snprintf(id, sizeof(id), "%06X%016" PRIX64, hi, lo);
+    } else if (type & 0x4) {
+        snprintf(id, sizeof(id), "%010" PRIX64, ((uint64_t)hi << 16) | (lo >> 48));
+    } else {
+        snprintf(id, sizeof(id), "%010" PRIX64, lo);
+    }
+
+    JsonSaveStr(root, "protocol", "EM410x");
+    JsonSaveStr(root, "id", id);
+    JsonSaveInt(root, "clock", clk);
+    return true;
+}
+
+static bool batch_hid(json_t *root, const uint8_t *samples, size_t n, uint8_t *bits) {
+    size_t size = n;
+    memcpy(bits, samples, n);
+
+    uint32_t hi2 = 0, hi = 0, lo = 0;
+    int wave_idx = 0;
+    if (HIDdemodFSK(bits, &size, &hi2, &hi, &lo, &wave_idx) < 0) {
+        return false;
+    }
+    if (hi2 == 0 && hi == 0 && lo == 0) {
+        return false;
+    }
+
+    char raw[25] = {0};
+    snprintf(raw, sizeof(raw), "%08x%08x%08x", hi2, hi, lo);
+    JsonSaveStr(root, "protocol", "HID Prox");
+    JsonSaveStr(root, "raw", raw);
+    return true;
+}
+
+static bool batch_awid(json_t *root, const uint8_t *samples, size_t n, uint8_t *bits) {
+    size_t size = n;
+    memcpy(bits, samples, n);
+
+    int wave_idx = 0;
+    int idx = detectAWID(bits, &size, &wave_idx);
+    if (idx <= 0) {
+        return false;
+    }
+
+    char raw[25] = {0};
+    snprintf(raw, sizeof(raw), "%08x%08x%08x"
+             , bytebits_to_byte(bits + idx, 32)
+             , bytebits_to_byte(bits + idx + 32, 32)
+             , bytebits_to_byte(bits + idx + 64, 32)
+            );
+
+    // format length and parity check like `lf awid demod`
+    size = removeParity(bits, idx + 8, 4, 1, 88);
+    if (size != 66) {
+        return false;
+    }
+
+    JsonSaveStr(root, "protocol", "AWID");
+    JsonSaveStr(root, "raw", raw);
+    JsonSaveInt(root, "format", bytebits_to_byte(bits, 8));
+    return true;
+}
+
+static bool batch_ioprox(json_t *root, const uint8_t *samples, size_t n, uint8_t *bits) {
+    size_t size = n;
+    memcpy(bits, samples, n);
+
+    int wave_idx = 0;
+    int idx = detectIOProx(bits, &size, &wave_idx);
+    if (idx <= 0) {
+        return false;
+    }
+
+    uint8_t crc = bytebits_to_byte(bits + idx + 54, 8);
+    uint8_t calccrc = 0;
+    for (uint8_t i = 1; i < 6; ++i) {
+        calccrc += bytebits_to_byte(bits + idx + 9 * i, 8);
+    }
+    calccrc = 0xff - calccrc;
+    if (crc != calccrc) {
+        return false;
+    }
+
+    char raw[17] = {0};
+    snprintf(raw, sizeof(raw), "%08x%08x", bytebits_to_byte(bits + idx, 32), bytebits_to_byte(bits + idx + 32, 32));
+    JsonSaveStr(root, "protocol", "IO Prox");
+    JsonSaveStr(root, "raw", raw);
+    JsonSaveInt(root, "version", bytebits_to_byte(bits + idx + 27, 8));
+    JsonSaveInt(root, "fc", bytebits_to_byte(bits + idx + 18, 8));
+    JsonSaveInt(root, "cn", (bytebits_to_byte(bits + idx + 36, 8) << 8) | bytebits_to_byte(bits + idx + 45, 8));
+    return true;
+}
+
+static bool batch_decode_lf(json_t *root, const char *path) {
+
+    size_t n = batch_load_pm3(path);
+    if (n == 0) {
+        JsonSaveStr(root, "error", "no samples");
+        return false;
+    }
+
+    uint8_t *samples = calloc(n, sizeof(uint8_t));
+    uint8_t *bits = calloc(n, sizeof(uint8_t));
+    if (samples == NULL || bits == NULL) {
+        free(samples);
+        free(bits);
+        JsonSaveStr(root, "error", "failed to allocate memory");
+        return false;
+    }
+    batch_get_samples(samples, n);
+
+    JsonSaveStr(root, "type", "lf");
+    JsonSaveInt(root, "samples", n);
+    JsonSaveBoolean(root, "noise", getSignalProperties()->isnoise);
+
+    bool found = batch_em410x(root, samples, n, bits)
+                 || batch_hid(root, samples, n, bits)
+                 || batch_awid(root, samples, n, bits)
+                 || batch_ioprox(root, samples, n, bits);
+
+    if (found == false) {
+        // unknown tag,  give the clocks for a closer look
+        memcpy(bits, samples, n);
+        int clk = 0;
+        DetectASKClock(bits, n, &clk, 20);
+        JsonSaveInt(root, "ask_clock", clk);
+
+        uint16_t fc = countFC(bits, n, true);
+        JsonSaveInt(root, "fc_high", fc >> 8);
+        JsonSaveInt(root, "fc_low", fc & 0xFF);
+    }
+
+    free(samples);
+    free(bits);
+    return found;
+}
+
+static bool batch_decode_hf(json_t *root, const char *path, const batch_ctx_t *ctx) {
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        JsonSaveStr(root, "error", "can't open file");
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    // trace offsets are 32 bit
+    if (fsize <= 0 || (uint64_t)fsize > UINT32_MAX) {
+        fclose(f);
+        JsonSaveStr(root, "error", (fsize <= 0) ? "empty trace" : "trace too large");
+        return false;
+    }
+
+    uint8_t *trace = calloc(fsize, sizeof(uint8_t));
+    if (trace == NULL) {
+        fclose(f);
+        JsonSaveStr(root, "error", "failed to allocate memory");
+        return false;
+    }
+
+    size_t bytes_read = fread(trace, 1, fsize, f);
+    fclose(f);
+
+    if (bytes_read != fsize) {
+        free(trace);
+        JsonSaveStr(root, "error", "bytes read mismatch file size");
+        return false;
+    }
+
+    JsonSaveStr(root, "type", "hf");
+    JsonSaveStr(root, "protocol", (ctx->hf_type[0]) ? ctx->hf_type : "raw");
+    JsonSaveInt(root, "bytes", fsize);
+
+    json_t *frames = json_array();
+    pthread_mutex_lock(&gs_annotate_lock);
+    TraceDecodeJSON(trace, fsize, ctx->protocol, g_mifare_default_keys, ARRAYLEN(g_mifare_default_keys), frames);
+    pthread_mutex_unlock(&gs_annotate_lock);
+    json_object_set_new(root, "frames", frames);
+
+    free(trace);
+    return true;
+}
+
+// write out every finished item in directory order,  caller holds the lock
+static void batch_flush(batch_ctx_t *ctx) {
+    while (ctx->written < ctx->count && ctx->items[ctx->written].done) {
+        batch_item_t *item = &ctx->items[ctx->written];
+
+        if (item->json) {
+            fputs(item->json, ctx->out);
+            fputc('\n', ctx->out);
+            free(item->json);
+            item->json = NULL;
+        }
+
+        ctx->stats->files++;
+        if (item->failed) {
+            ctx->stats->failed++;
+        } else if (item->is_hf) {
+            ctx->stats->hf++;
+        } else {
+            ctx->stats->lf++;
+            if (item->found) {
+                ctx->stats->found++;
+            }
+        }
+        ctx->written++;
+    }
+}
+
+static void *batch_worker(void *arg) {
+    batch_ctx_t *ctx = (batch_ctx_t *)arg;
+
+    // own graph buffers and signal properties,  sized by the captures as they are loaded
+    demod_ctx_t *dctx = demod_ctx_new(0);
+    if (dctx == NULL) {
+        return NULL;
+    }
+    demod_ctx_bind(dctx);
+
+    for (;;) {
+        uint32_t i = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED);
+        if (i >= ctx->count) {
+            break;
+        }
+
+        batch_item_t *item = &ctx->items[i];
+
+        json_t *root = json_object();
+        JsonSaveStr(root, "file", item->name);
+
+        if (item->is_hf) {
+            item->failed = (batch_decode_hf(root, item->path, ctx) == false);
+        } else {
+            item->found = batch_decode_lf(root, item->path);
+            item->failed = (json_object_get(root, "error") != NULL);
+        }
+
+        char *json = json_dumps(root, JSON_COMPACT | JSON_PRESERVE_ORDER);
+        json_decref(root);
+
+        pthread_mutex_lock(&ctx->lock);
+        item->json = json;
+        item->done = true;
+        batch_flush(ctx);
+        pthread_mutex_unlock(&ctx->lock);
+    }
+
+    demod_ctx_free(dctx);
+    return NULL;
+}
+
+static int batch_select(const struct dirent *entry) {
+    return (str_endswith(entry->d_name, ".pm3") || str_endswith(entry->d_name, ".trace"));
+}
+
+int batch_decode_dir(const char *dir, const batch_opts_t *opts, FILE *out, batch_stats_t *stats) {
+
+    batch_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.hf_type = (opts->hf_type) ? opts->hf_type : "";
+    ctx.out = out;
+    ctx.stats = stats;
+
+    if (TraceProtocolFromName(ctx.hf_type, &ctx.protocol) != PM3_SUCCESS) {
+        PrintAndLogEx(FAILED, "Unknown protocol \"%s\"", ctx.hf_type);
+        return PM3_EINVARG;
+    }
+
+    struct dirent **namelist;
+    int n = scandir(dir, &namelist, batch_select, alphasort);
+    if (n < 0) {
+        PrintAndLogEx(FAILED, "Can't read directory " _YELLOW_("%s"), dir);
+        return PM3_EFILE;
+    }
+
+    ctx.items = calloc(MAX(n, 1), sizeof(batch_item_t));
+    if (ctx.items == NULL) {
+        for (int i = 0; i < n; i++) {
+            free(namelist[i]);
+        }
+        free(namelist);
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+
+    size_t dirlen = strlen(dir);
+    bool add_sep = (dirlen > 0 && dir[dirlen - 1] != '/' && dir[dirlen - 1] != '\\');
+
+    for (int i = 0; i < n; i++) {
+        const char *name = namelist[i]->d_name;
+
+        if (opts->pattern == NULL || batch_match(opts->pattern, name)) {
+            batch_item_t *item = &ctx.items[ctx.count];
+            size_t len = dirlen + strlen(name) + 2;
+            item->path = calloc(len, sizeof(char));
+            if (item->path) {
+                snprintf(item->path, len, "%s%s%s", dir, (add_sep) ? "/" : "", name);
+                item->name = item->path + dirlen + (add_sep ? 1 : 0);
+                item->is_hf = str_endswith(name, ".trace");
+                ctx.count++;
+            }
+        }
+        free(namelist[i]);
+    }
+    free(namelist);
+
+    memset(stats, 0, sizeof(batch_stats_t));
+
+    size_t tc = (opts->threads) ? opts->threads : (size_t)num_CPUs();
+    tc = MIN(tc, ctx.count);
+    if (tc < 1) {
+        tc = 1;
+    }
+
+    pthread_mutex_init(&ctx.lock, NULL);
+
+    pthread_t threads[tc];
+    size_t started = 0;
+    for (; started < tc; started++) {
+        if (pthread_create(&threads[started], NULL, batch_worker, &ctx)) {
+            PrintAndLogEx(WARNING, "Failed to create pthreads. Quitting");
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&ctx.lock);
+
+    // a worker that failed to allocate its buffers leaves items behind
+    int res = (ctx.written == ctx.count) ? PM3_SUCCESS : PM3_EMALLOC;
+
+    for (uint32_t i = 0; i < ctx.count; i++) {
+        free(ctx.items[i].json);
+        free(ctx.items[i].path);
+    }
+    free(ctx.items);
+    return res;
+}
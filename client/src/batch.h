@@ -0,0 +1,42 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// Offline batch decoding of LF (.pm3) and HF (.trace) capture files
+//-----------------------------------------------------------------------------
+
+#ifndef BATCH_H__
+#define BATCH_H__
+
+#include <stdio.h>
+#include "common.h"
+
+typedef struct {
+    const char *pattern;    // file name pattern, * and ? wildcards.  NULL = *.pm3 and *.trace
+    const char *hf_type;    // `trace list -t` protocol name used for .trace files
+    size_t threads;         // 0 = one per cpu
+} batch_opts_t;
+
+typedef struct {
+    uint32_t files;
+    uint32_t lf;
+    uint32_t hf;
+    uint32_t found;         // lf files with a known tag
+    uint32_t failed;
+} batch_stats_t;
+
+bool batch_match(const char *pattern, const char *name);
+int batch_decode_dir(const char *dir, const batch_opts_t *opts, FILE *out, batch_stats_t *stats);
+
+#endif
@@ -1036,6 +1036,7 @@ static int CmdAnalyseFoo(const char *Cmd) {
     PrintAndLogEx(INFO, "Got:  %s", data3);
 
     ClearGraph(false);
+    GraphReserve(15000);
     g_GraphTraceLen = 15000;
 
     for (int i = 0; i < 4095; i++) {
@@ -1073,6 +1074,7 @@ static int CmdAnalyseFoo(const char *Cmd) {
         int o = i >> 5;
         g_GraphBuffer[i + 10000] = o;
     }
+    GraphChanged();
 
     RepaintGraphWindow();
     ShowGraphWindow();
@@ -22,6 +22,7 @@
 #include <math.h>                // pow
 #include <ctype.h>               // tolower
 #include <locale.h>              // number formatter..
+#include <pthread.h>             // autocorr_lock
 #include "commonutil.h"          // ARRAYLEN
 #include "cmdparser.h"           // for command_t
 #include "ui.h"                  // for show graph controls
@@ -41,12 +42,14 @@
 #include "mbedtls/ctr_drbg.h"    // random generator
 #include "atrs.h"                // ATR lookup
 #include "crypto/libpcrypto.h"   // Cryptography
+#include "util_posix.h"          // msclock
+#include "batch.h"               // batch_decode_dir
+#include "cmdtrace.h"            // TraceProtocolFromName
 
 
-uint8_t g_DemodBuffer[MAX_DEMOD_BUF_LEN] = { 0x00 };
-size_t g_DemodBufferLen = 0;
-int32_t g_DemodStartIdx = 0;
-int g_DemodClock = 0;
+
+// bumped on every g_DemodBuffer write, lets the demod cache tell if a demod produced output
+static uint32_t g_DemodBufferGen = 0;
 
 static int CmdHelp(const char *Cmd);
 
@@ -102,6 +105,7 @@ void setDemodBuff(const uint8_t *buff, size_t size, size_t start_idx) {
         g_DemodBuffer[i] = buff[start_idx++];
 
     g_DemodBufferLen = size;
+    g_DemodBufferGen++;
 }
 
 bool getDemodBuff(uint8_t *buff, size_t *size) {
@@ -115,6 +119,118 @@ bool getDemodBuff(uint8_t *buff, size_t *size) {
     return true;
 }
 
+static uint64_t samples_hash(const int *in, size_t len) {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint32_t)in[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Demod result cache.
+// `lf search` runs many protocol decoders against the same graph and several of them
+// start with the exact same raw demod (same modulation, same clock / invert / maxerr).
+// While enabled, the non-verbose raw demods below store their outcome in the current
+// demod context, keyed by their arguments, and later identical calls just replay it into
+// g_DemodBuffer / clock grid instead of demodulating the samples again.
+// Entries belong to one generation of the samples,  see GraphChanged().
+typedef enum {
+    DEMOD_CACHE_ASK = 1,
+    DEMOD_CACHE_BIPHASE,
+    DEMOD_CACHE_FSK,
+    DEMOD_CACHE_PSK,
+    DEMOD_CACHE_NRZ,
+} demod_cache_type_t;
+
+static void demod_cache_clear(demod_cache_t *cache) {
+    for (size_t i = 0; i < cache->count; i++) {
+        free(cache->entries[i].bits);
+    }
+    memset(cache->entries, 0, sizeof(cache->entries));
+    cache->count = 0;
+}
+
+void demod_cache_enable(bool enable) {
+    demod_ctx_t *ctx = demod_ctx_current();
+    demod_cache_clear(&ctx->cache);
+    ctx->cache.enabled = enable;
+    ctx->cache.graph_gen = ctx->graph_gen;
+    ctx->cache.graph_len = ctx->graph_len;
+}
+
+// cache is only valid while the graph is untouched,  drop everything if the samples changed.
+static demod_cache_t *demod_cache_active(bool verbose) {
+    demod_ctx_t *ctx = demod_ctx_current();
+    if (ctx->cache.enabled == false || verbose || g_debugMode) {
+        return NULL;
+    }
+
+    if (ctx->cache.graph_gen != ctx->graph_gen || ctx->cache.graph_len != ctx->graph_len) {
+        demod_cache_clear(&ctx->cache);
+        ctx->cache.graph_gen = ctx->graph_gen;
+        ctx->cache.graph_len = ctx->graph_len;
+    }
+    return &ctx->cache;
+}
+
+static demod_cache_entry_t *demod_cache_find(demod_cache_t *cache, demod_cache_type_t type, const int *args) {
+    for (size_t i = 0; i < cache->count; i++) {
+        demod_cache_entry_t *e = &cache->entries[i];
+        if (e->type == type && memcmp(e->args, args, sizeof(e->args)) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static int demod_cache_replay(const demod_cache_entry_t *e, bool *stCheck) {
+    if (e->has_demod) {
+        setDemodBuff(e->bits, e->bitlen, 0);
+        setClockGrid(e->clk, e->start_idx);
+    }
+    if (e->st) {
+        if (stCheck) {
+            *stCheck = true;
+        }
+        g_MarkerC.pos = e->st_start;
+        g_MarkerD.pos = e->st_end;
+    }
+    return e->ret;
+}
+
+static void demod_cache_store(demod_cache_t *cache, demod_cache_type_t type, const int *args, int ret, bool has_demod, bool st) {
+    if (cache->count == DEMOD_CACHE_SIZE) {
+        return;
+    }
+
+    demod_cache_entry_t *e = &cache->entries[cache->count];
+    memset(e, 0, sizeof(*e));
+    e->type = type;
+    memcpy(e->args, args, sizeof(e->args));
+    e->ret = ret;
+
+    if (has_demod) {
+        e->bits = calloc(g_DemodBufferLen + 1, sizeof(uint8_t));
+        if (e->bits == NULL) {
+            return;
+        }
+        memcpy(e->bits, g_DemodBuffer, g_DemodBufferLen);
+        e->bitlen = g_DemodBufferLen;
+        e->clk = g_DemodClock;
+        e->start_idx = g_DemodStartIdx;
+        e->has_demod = true;
+    }
+
+    if (st) {
+        e->st = true;
+        e->st_start = g_MarkerC.pos;
+        e->st_end = g_MarkerD.pos;
+    }
+    cache->count++;
+}
+
 // include <math.h>
 // Root mean square
 /*
@@ -369,6 +485,7 @@ int CmdGetBitStream(const char *Cmd) {
     for (uint32_t i = 0; i < g_GraphTraceLen; i++) {
         g_GraphBuffer[i] = (g_GraphBuffer[i] >= 1) ? 1 : 0;
     }
+    GraphChanged();
     RepaintGraphWindow();
     return PM3_SUCCESS;
 }
@@ -401,7 +518,7 @@ static int CmdConvertBitStream(const char *Cmd) {
 // verbose will print results and demoding messages
 // emSearch will auto search for EM410x format in bitstream
 // askType switches decode: ask/raw = 0, ask/manchester = 1
-int ASKDemod_ext(int clk, int invert, int maxErr, size_t maxlen, bool amplify, bool verbose, bool emSearch, uint8_t askType, bool *stCheck) {
+static int ASKDemod_ext_run(int clk, int invert, int maxErr, size_t maxlen, bool amplify, bool verbose, bool emSearch, uint8_t askType, bool *stCheck) {
     PrintAndLogEx(DEBUG, "DEBUG: (ASKDemod_ext) clk %i invert %i maxErr %i maxLen %zu amplify %i verbose %i emSearch %i askType %i "
                   , clk
                   , invert
@@ -525,6 +642,29 @@ int ASKDemod_ext(int clk, int invert, int maxErr, size_t maxlen, bool amplify, b
     return PM3_SUCCESS;
 }
 
+int ASKDemod_ext(int clk, int invert, int maxErr, size_t maxlen, bool amplify, bool verbose, bool emSearch, uint8_t askType, bool *stCheck) {
+    // em410x search prints,  never served from cache
+    demod_cache_t *cache = (emSearch) ? NULL : demod_cache_active(verbose);
+    if (cache == NULL) {
+        return ASKDemod_ext_run(clk, invert, maxErr, maxlen, amplify, verbose, emSearch, askType, stCheck);
+    }
+
+    int args[6] = { clk, invert, maxErr, (int)maxlen, amplify, askType };
+    demod_cache_entry_t *e = demod_cache_find(cache, DEMOD_CACHE_ASK, args);
+    if (e) {
+        return demod_cache_replay(e, stCheck);
+    }
+
+    uint32_t gen = g_DemodBufferGen;
+    bool st = false;
+    int res = ASKDemod_ext_run(clk, invert, maxErr, maxlen, amplify, verbose, emSearch, askType, &st);
+    if (st && stCheck) {
+        *stCheck = true;
+    }
+    demod_cache_store(cache, DEMOD_CACHE_ASK, args, res, gen != g_DemodBufferGen, st);
+    return res;
+}
+
 int ASKDemod(int clk, int invert, int maxErr, size_t maxlen, bool amplify, bool verbose, bool emSearch, uint8_t askType) {
     bool st = false;
     return ASKDemod_ext(clk, invert, maxErr, maxlen, amplify, verbose, emSearch, askType, &st);
@@ -727,7 +867,7 @@ static int CmdBiphaseDecodeRaw(const char *Cmd) {
 }
 
 // ASK Demod then Biphase decode g_GraphBuffer samples
-int ASKbiphaseDemod(int offset, int clk, int invert, int maxErr, bool verbose) {
+static int ASKbiphaseDemod_run(int offset, int clk, int invert, int maxErr, bool verbose) {
     //ask raw demod g_GraphBuffer first
 
     uint8_t *bs = calloc(MAX_DEMOD_BUF_LEN, sizeof(uint8_t));
@@ -778,6 +918,24 @@ int ASKbiphaseDemod(int offset, int clk, int invert, int maxErr, bool verbose) {
     return PM3_SUCCESS;
 }
 
+int ASKbiphaseDemod(int offset, int clk, int invert, int maxErr, bool verbose) {
+    demod_cache_t *cache = demod_cache_active(verbose);
+    if (cache == NULL) {
+        return ASKbiphaseDemod_run(offset, clk, invert, maxErr, verbose);
+    }
+
+    int args[6] = { offset, clk, invert, maxErr, 0, 0 };
+    demod_cache_entry_t *e = demod_cache_find(cache, DEMOD_CACHE_BIPHASE, args);
+    if (e) {
+        return demod_cache_replay(e, NULL);
+    }
+
+    uint32_t gen = g_DemodBufferGen;
+    int res = ASKbiphaseDemod_run(offset, clk, invert, maxErr, verbose);
+    demod_cache_store(cache, DEMOD_CACHE_BIPHASE, args, res, gen != g_DemodBufferGen, false);
+    return res;
+}
+
 // see ASKbiphaseDemod
 static int Cmdaskbiphdemod(const char *Cmd) {
     CLIParserContext *ctx;
@@ -843,39 +1001,239 @@ static int Cmdaskrawdemod(const char *Cmd) {
     return ASKDemod_ext(clk, invert, max_err, max_len, amplify, true, false, 0, &st);
 }
 
-int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveGrph, bool verbose) {
-    // sanity check
-    if (window > len) {
-        window = len;
+// Autocorrelation is computed with the Wiener-Khinchin theorem,  the inverse FFT of the power
+// spectrum gives the lagged sums of products for all lags at once in O(n log n).
+// The signal is zero padded to a power of two of at least twice its length so the
+// circular correlation doesn't wrap around.
+//
+// The real valued transform of size n is done as a complex FFT of size n/2.
+// The cos/sin tables are kept between calls and only rebuilt when n changes.
+// The plot window calls AutoCorrelate from its own thread,  the tables and the cache
+// below are only touched with autocorr_lock held.
+typedef struct {
+    size_t n;
+    double *cos_tab;    // cos(2 * pi * k / n),  k < n/2
+    double *sin_tab;    // sin(2 * pi * k / n),  k < n/2
+} autocorr_plan_t;
+
+static autocorr_plan_t autocorr_plan = { 0, NULL, NULL };
+
+// lagged sums are cached,  `lf search` correlates the same samples with several windows
+typedef struct {
+    const int *in;
+    size_t len;
+    uint64_t hash;
+    double *autocv;
+} autocorr_cache_t;
+
+static autocorr_cache_t autocorr_cache = { NULL, 0, 0, NULL };
+
+static pthread_mutex_t autocorr_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool autocorr_plan_init(size_t n) {
+    if (autocorr_plan.n == n) {
+        return true;
     }
 
-    //test
-    double autocv = 0.0;    // Autocovariance value
-    size_t correlation = 0;
-    int lastmax = 0;
+    free(autocorr_plan.cos_tab);
+    free(autocorr_plan.sin_tab);
+    autocorr_plan.n = 0;
 
-    // in, len, 4000
-    double mean = compute_mean(in, len);
-    // Computed variance
-    double variance = compute_variance(in, len);
+    autocorr_plan.cos_tab = calloc(n / 2, sizeof(double));
+    autocorr_plan.sin_tab = calloc(n / 2, sizeof(double));
+    if (autocorr_plan.cos_tab == NULL || autocorr_plan.sin_tab == NULL) {
+        free(autocorr_plan.cos_tab);
+        free(autocorr_plan.sin_tab);
+        autocorr_plan.cos_tab = NULL;
+        autocorr_plan.sin_tab = NULL;
+        return false;
+    }
 
-    int *correl_buf = calloc(MAX_GRAPH_TRACE_LEN, sizeof(int));
+    for (size_t k = 0; k < n / 2; k++) {
+        double phi = 2.0 * M_PI * (double)k / (double)n;
+        autocorr_plan.cos_tab[k] = cos(phi);
+        autocorr_plan.sin_tab[k] = sin(phi);
+    }
+    autocorr_plan.n = n;
+    return true;
+}
 
-    uint8_t peak_cnt = 0;
-    size_t peaks[10] = {0};
+// in-place radix-2 complex FFT of m = n/2 interleaved (re, im) values,  not normalized
+static void autocorr_fft(double *z, size_t m, bool inverse) {
+
+    // bit reversal permutation
+    for (size_t i = 1, j = 0; i < m; i++) {
+        size_t bit = m >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if (i < j) {
+            double t = z[2 * i];
+            z[2 * i] = z[2 * j];
+            z[2 * j] = t;
+            t = z[2 * i + 1];
+            z[2 * i + 1] = z[2 * j + 1];
+            z[2 * j + 1] = t;
+        }
+    }
+
+    for (size_t len = 2; len <= m; len <<= 1) {
+        size_t half = len >> 1;
+        size_t step = autocorr_plan.n / len;
+        for (size_t i = 0; i < m; i += len) {
+            for (size_t j = 0; j < half; j++) {
+                double wr = autocorr_plan.cos_tab[j * step];
+                double wi = (inverse) ? autocorr_plan.sin_tab[j * step] : -autocorr_plan.sin_tab[j * step];
+                double *a = z + 2 * (i + j);
+                double *b = z + 2 * (i + j + half);
+                double tr = b[0] * wr - b[1] * wi;
+                double ti = b[0] * wi + b[1] * wr;
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+}
 
-    for (size_t i = 0; i < len - window; ++i) {
+// sums[i] = sum (in[j] - mean) * (in[j + i] - mean),  for all lags i < len
+static bool autocorr_sums_fft(const int *in, size_t len, double mean, double *sums) {
+
+    size_t n = 2;
+    while (n < 2 * len) {
+        n <<= 1;
+    }
+
+    if (autocorr_plan_init(n) == false) {
+        return false;
+    }
+
+    size_t m = n / 2;
+    double *z = calloc(2 * m, sizeof(double));
+    double *pwr = calloc(m + 1, sizeof(double));
+    if (z == NULL || pwr == NULL) {
+        free(z);
+        free(pwr);
+        return false;
+    }
+
+    // pack even / odd samples as real / imaginary parts
+    for (size_t i = 0; i < len; i++) {
+        z[i] = in[i] - mean;
+    }
 
+    autocorr_fft(z, m, false);
+
+    // unpack the spectrum of the real signal and keep its power,  X[k] for k <= n/2
+    for (size_t k = 0; k <= m; k++) {
+        size_t k1 = k % m;
+        size_t k2 = (m - k) % m;
+        double zr = z[2 * k1], zi = z[2 * k1 + 1];
+        double cr = z[2 * k2], ci = -z[2 * k2 + 1];
+
+        double er = (zr + cr) / 2, ei = (zi + ci) / 2;
+        double fr = (zi - ci) / 2, fi = -(zr - cr) / 2;
+
+        double wr, wi;
+        if (k == m) {
+            wr = -1.0;
+            wi = 0.0;
+        } else {
+            wr = autocorr_plan.cos_tab[k];
+            wi = -autocorr_plan.sin_tab[k];
+        }
+
+        double xr = er + (fr * wr - fi * wi);
+        double xi = ei + (fr * wi + fi * wr);
+        pwr[k] = xr * xr + xi * xi;
+    }
+
+    // the power spectrum is real and symmetric,  pack it again for the inverse transform
+    for (size_t k = 0; k < m; k++) {
+        double e = pwr[k] + pwr[m - k];
+        double o = pwr[k] - pwr[m - k];
+        z[2 * k] = e - o * autocorr_plan.sin_tab[k];
+        z[2 * k + 1] = o * autocorr_plan.cos_tab[k];
+    }
+
+    autocorr_fft(z, m, true);
+
+    for (size_t i = 0; i < len; i++) {
+        sums[i] = z[i] / n;
+    }
+
+    free(pwr);
+    free(z);
+    return true;
+}
+
+// reference O(n^2) implementation
+static void autocorr_sums_naive(const int *in, size_t len, size_t lags, double mean, double *sums) {
+    for (size_t i = 0; i < lags; ++i) {
+        double sum = 0.0;
         for (size_t j = 0; j < (len - i); j++) {
-            autocv += (in[j] - mean) * (in[j + i] - mean);
+            sum += (in[j] - mean) * (in[j + i] - mean);
         }
+        sums[i] = sum;
+    }
+}
+
+// the autocovariance of a lag carries over the value of the previous lag
+static void autocorr_from_sums(double *sums, size_t len, size_t lags) {
+    double autocv = 0.0;
+    for (size_t i = 0; i < lags; ++i) {
+        autocv += sums[i];
         autocv = (1.0 / (len - i)) * autocv;
+        sums[i] = autocv;
+    }
+}
+
+// returns autocovariance for all lags < len,  owned by the cache and valid while autocorr_lock is held
+static const double *autocorr_get(const int *in, size_t len, double mean) {
+
+    uint64_t hash = samples_hash(in, len);
+    if (autocorr_cache.autocv && autocorr_cache.in == in && autocorr_cache.len == len && autocorr_cache.hash == hash) {
+        return autocorr_cache.autocv;
+    }
+
+    free(autocorr_cache.autocv);
+    autocorr_cache.autocv = NULL;
+
+    double *autocv = calloc(len, sizeof(double));
+    if (autocv == NULL) {
+        return NULL;
+    }
+
+    if (autocorr_sums_fft(in, len, mean, autocv) == false) {
+        free(autocv);
+        return NULL;
+    }
+    autocorr_from_sums(autocv, len, len);
+
+    autocorr_cache.in = in;
+    autocorr_cache.len = len;
+    autocorr_cache.hash = hash;
+    autocorr_cache.autocv = autocv;
+    return autocv;
+}
+
+// Find shortest distance between peaks
+static int autocorr_distance(const double *autocv, size_t lags, double variance) {
+
+    size_t correlation = 0;
+    int lastmax = 0;
+
+    uint8_t peak_cnt = 0;
+    size_t peaks[10] = {0};
 
-        correl_buf[i] = autocv;
+    for (size_t i = 0; i < lags; ++i) {
 
         // Computed autocorrelation value to be returned
         // Autocorrelation is autocovariance divided by variance
-        double ac_value = autocv / variance;
+        double ac_value = autocv[i] / variance;
 
         // keep track of which distance is repeating.
         // A value near 1.0 or more indicates a correlation in the signal
@@ -889,7 +1247,6 @@ int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveG
         }
     }
 
-    // Find shorts distance between peaks
     int distance = -1;
     for (size_t i = 0; i < ARRAYLEN(peaks); ++i) {
 
@@ -907,6 +1264,48 @@ int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveG
             distance = peaks[i];
         }
     }
+    return distance;
+}
+
+int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveGrph, bool verbose) {
+    // sanity check
+    if (window > len) {
+        window = len;
+    }
+
+    // in, len, 4000
+    double mean = compute_mean(in, len);
+    // Computed variance
+    double variance = compute_variance(in, len);
+
+    size_t lags = len - window;
+    int *correl_buf = NULL;
+    if (SaveGrph) {
+        correl_buf = calloc(MAX_GRAPH_TRACE_LEN, sizeof(int));
+        if (correl_buf == NULL) {
+            PrintAndLogEx(WARNING, "failed to allocate memory");
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&autocorr_lock);
+
+    const double *autocv = autocorr_get(in, len, mean);
+    if (autocv == NULL) {
+        pthread_mutex_unlock(&autocorr_lock);
+        PrintAndLogEx(WARNING, "failed to allocate memory");
+        free(correl_buf);
+        return -1;
+    }
+
+    int distance = autocorr_distance(autocv, lags, variance);
+    if (distance > -1 && correl_buf) {
+        for (size_t i = 0; i < lags; i++) {
+            correl_buf[i] = autocv[i];
+        }
+    }
+
+    pthread_mutex_unlock(&autocorr_lock);
 
     if (distance > -1) {
         if (verbose) {
@@ -914,6 +1313,7 @@ int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveG
         }
     } else {
         PrintAndLogEx(HINT, "No repeating pattern found, try increasing window size");
+        free(correl_buf);
         // return value -1, indication to increase window size
         return -1;
     }
@@ -921,31 +1321,101 @@ int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveG
     if (SaveGrph) {
         //g_GraphTraceLen = g_GraphTraceLen - window;
         memcpy(out, correl_buf, len * sizeof(int));
+        if (out == g_GraphBuffer) {
+            GraphChanged();
+        }
         setClockGrid(distance, 0);
         g_DemodBufferLen = 0;
         RepaintGraphWindow();
+        free(correl_buf);
     }
-    free(correl_buf);
     return distance;
 }
 
+// compare FFT and O(n^2) computation
+static int AutoCorrelateBench(const int *in, size_t len, size_t window) {
+
+    if (window > len) {
+        window = len;
+    }
+    size_t lags = len - window;
+
+    double mean = compute_mean(in, len);
+    double variance = compute_variance(in, len);
+
+    double *fft = calloc(len, sizeof(double));
+    double *naive = calloc(len, sizeof(double));
+    if (fft == NULL || naive == NULL) {
+        PrintAndLogEx(WARNING, "failed to allocate memory");
+        free(fft);
+        free(naive);
+        return PM3_EMALLOC;
+    }
+
+    uint64_t t1 = msclock();
+    pthread_mutex_lock(&autocorr_lock);
+    bool fft_ok = autocorr_sums_fft(in, len, mean, fft);
+    pthread_mutex_unlock(&autocorr_lock);
+    if (fft_ok == false) {
+        PrintAndLogEx(WARNING, "failed to allocate memory");
+        free(fft);
+        free(naive);
+        return PM3_EMALLOC;
+    }
+    autocorr_from_sums(fft, len, lags);
+    int dist_fft = autocorr_distance(fft, lags, variance);
+    t1 = msclock() - t1;
+
+    uint64_t t2 = msclock();
+    autocorr_sums_naive(in, len, lags, mean, naive);
+    autocorr_from_sums(naive, len, lags);
+    int dist_naive = autocorr_distance(naive, lags, variance);
+    t2 = msclock() - t2;
+
+    double max_err = 0.0;
+    for (size_t i = 0; i < lags; i++) {
+        double err = fabs(fft[i] - naive[i]) / variance;
+        if (err > max_err) {
+            max_err = err;
+        }
+    }
+
+    free(fft);
+    free(naive);
+
+    PrintAndLogEx(INFO, "samples.......... " _YELLOW_("%zu") "   lags " _YELLOW_("%zu"), len, lags);
+    PrintAndLogEx(INFO, "FFT.............. " _YELLOW_("%4d") " samples   %" PRIu64 " ms", dist_fft, t1);
+    PrintAndLogEx(INFO, "O(n^2)........... " _YELLOW_("%4d") " samples   %" PRIu64 " ms", dist_naive, t2);
+    PrintAndLogEx(INFO, "max abs error.... %.3g", max_err);
+
+    if (dist_fft != dist_naive) {
+        PrintAndLogEx(FAILED, "Autocorrelation FFT vs O(n^2) ( %s )", _RED_("fail"));
+        return PM3_ESOFT;
+    }
+    PrintAndLogEx(SUCCESS, "Autocorrelation FFT vs O(n^2) ( %s )", _GREEN_("ok"));
+    return PM3_SUCCESS;
+}
+
 static int CmdAutoCorr(const char *Cmd) {
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "data autocorr",
                   "Autocorrelate over window is used to detect repeating sequences.\n"
                   "We use it as detection of how long in bits a message inside the signal is",
                   "data autocorr -w 4000\n"
-                  "data autocorr -w 4000 -g"
+                  "data autocorr -w 4000 -g\n"
+                  "data autocorr -w 4000 --bench"
                  );
     void *argtable[] = {
         arg_param_begin,
         arg_lit0("g", NULL, "save back to GraphBuffer (overwrite)"),
         arg_u64_0("w", "win", "<dec>", "window length for correlation. def 4000"),
+        arg_lit0(NULL, "bench", "compare FFT against O(n^2) computation"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, true);
     bool updateGrph = arg_get_lit(ctx, 1);
     uint32_t window = arg_get_u32_def(ctx, 2, 4000);
+    bool bench = arg_get_lit(ctx, 3);
     CLIParserFree(ctx);
 
     PrintAndLogEx(INFO, "Using window size " _YELLOW_("%u"), window);
@@ -961,6 +1431,10 @@ static int CmdAutoCorr(const char *Cmd) {
         return PM3_EINVARG;
     }
 
+    if (bench) {
+        return AutoCorrelateBench(g_GraphBuffer, g_GraphTraceLen, window);
+    }
+
     AutoCorrelate(g_GraphBuffer, g_GraphBuffer, g_GraphTraceLen, window, updateGrph, true);
     return PM3_SUCCESS;
 }
@@ -987,6 +1461,11 @@ static int CmdBitsamples(const char *Cmd) {
         return PM3_ETIMEOUT;
     }
 
+    if (GraphReserve(ARRAYLEN(got) * 8) == false) {
+        PrintAndLogEx(FAILED, "failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+
     for (size_t j = 0; j < ARRAYLEN(got); j++) {
         for (uint8_t k = 0; k < 8; k++) {
             if (got[j] & (1 << (7 - k)))
@@ -996,6 +1475,7 @@ static int CmdBitsamples(const char *Cmd) {
         }
     }
     g_GraphTraceLen = cnt;
+    GraphChanged();
     RepaintGraphWindow();
     return PM3_SUCCESS;
 }
@@ -1043,6 +1523,7 @@ static int CmdDecimate(const char *Cmd) {
 
     g_GraphTraceLen /= n;
     PrintAndLogEx(SUCCESS, "decimated by " _GREEN_("%u"), n);
+    GraphChanged();
     RepaintGraphWindow();
     return PM3_SUCCESS;
 }
@@ -1089,8 +1570,15 @@ static int CmdUndecimate(const char *Cmd) {
         g_index++;
     }
 
+    if (GraphReserve(s_index) == false) {
+        PrintAndLogEx(FAILED, "failed to allocate memory");
+        free(swap);
+        return PM3_EMALLOC;
+    }
+
     memcpy(g_GraphBuffer, swap, s_index * sizeof(int));
     g_GraphTraceLen = s_index;
+    GraphChanged();
     RepaintGraphWindow();
     free(swap);
     return PM3_SUCCESS;
@@ -1123,6 +1611,7 @@ static int CmdGraphShiftZero(const char *Cmd) {
             shiftedVal = -127;
         g_GraphBuffer[i] = shiftedVal;
     }
+    GraphChanged();
     CmdNorm("");
     return PM3_SUCCESS;
 }
@@ -1161,6 +1650,7 @@ static int CmdAskEdgeDetect(const char *Cmd) {
 
     PrintAndLogEx(INFO, "using threshold " _YELLOW_("%i"), threshold);
     int res = AskEdgeDetect(g_GraphBuffer, g_GraphBuffer, g_GraphTraceLen, threshold);
+    GraphChanged();
     RepaintGraphWindow();
     return res;
 }
@@ -1259,7 +1749,7 @@ static char *GetFSKType(uint8_t fchigh, uint8_t fclow, uint8_t invert) {
 // fsk raw demod and print binary
 // takes 4 arguments - Clock, invert, fchigh, fclow
 // defaults: clock = 50, invert=1, fchigh=10, fclow=8 (RF/10 RF/8 (fsk2a))
-int FSKrawDemod(uint8_t rfLen, uint8_t invert, uint8_t fchigh, uint8_t fclow, bool verbose) {
+static int FSKrawDemod_run(uint8_t rfLen, uint8_t invert, uint8_t fchigh, uint8_t fclow, bool verbose) {
     //raw fsk demod  no manchester decoding no start bit finding just get binary from wave
     if (getSignalProperties()->isnoise) {
         if (verbose) {
@@ -1328,6 +1818,24 @@ out:
     return PM3_SUCCESS;
 }
 
+int FSKrawDemod(uint8_t rfLen, uint8_t invert, uint8_t fchigh, uint8_t fclow, bool verbose) {
+    demod_cache_t *cache = demod_cache_active(verbose);
+    if (cache == NULL) {
+        return FSKrawDemod_run(rfLen, invert, fchigh, fclow, verbose);
+    }
+
+    int args[6] = { rfLen, invert, fchigh, fclow, 0, 0 };
+    demod_cache_entry_t *e = demod_cache_find(cache, DEMOD_CACHE_FSK, args);
+    if (e) {
+        return demod_cache_replay(e, NULL);
+    }
+
+    uint32_t gen = g_DemodBufferGen;
+    int res = FSKrawDemod_run(rfLen, invert, fchigh, fclow, verbose);
+    demod_cache_store(cache, DEMOD_CACHE_FSK, args, res, gen != g_DemodBufferGen, false);
+    return res;
+}
+
 // fsk raw demod and print binary
 // takes 4 arguments - Clock, invert, fchigh, fclow
 // defaults: clock = 50, invert=1, fchigh=10, fclow=8 (RF/10 RF/8 (fsk2a))
@@ -1363,7 +1871,7 @@ static int CmdFSKrawdemod(const char *Cmd) {
 }
 
 // attempt to psk1 demod graph buffer
-int PSKDemod(int clk, int invert, int maxErr, bool verbose) {
+static int PSKDemod_run(int clk, int invert, int maxErr, bool verbose) {
     if (getSignalProperties()->isnoise) {
         if (verbose) {
             PrintAndLogEx(INFO, "signal looks like noise");
@@ -1407,10 +1915,28 @@ int PSKDemod(int clk, int invert, int maxErr, bool verbose) {
     return PM3_SUCCESS;
 }
 
+int PSKDemod(int clk, int invert, int maxErr, bool verbose) {
+    demod_cache_t *cache = demod_cache_active(verbose);
+    if (cache == NULL) {
+        return PSKDemod_run(clk, invert, maxErr, verbose);
+    }
+
+    int args[6] = { clk, invert, maxErr, 0, 0, 0 };
+    demod_cache_entry_t *e = demod_cache_find(cache, DEMOD_CACHE_PSK, args);
+    if (e) {
+        return demod_cache_replay(e, NULL);
+    }
+
+    uint32_t gen = g_DemodBufferGen;
+    int res = PSKDemod_run(clk, invert, maxErr, verbose);
+    demod_cache_store(cache, DEMOD_CACHE_PSK, args, res, gen != g_DemodBufferGen, false);
+    return res;
+}
+
 // takes 3 arguments - clock, invert, maxErr as integers
 // attempts to demodulate nrz only
 // prints binary found and saves in g_DemodBuffer for further commands
-int NRZrawDemod(int clk, int invert, int maxErr, bool verbose) {
+static int NRZrawDemod_run(int clk, int invert, int maxErr, bool verbose) {
 
     int errCnt = 0, clkStartIdx = 0;
 
@@ -1464,6 +1990,24 @@ int NRZrawDemod(int clk, int invert, int maxErr, bool verbose) {
     return PM3_SUCCESS;
 }
 
+int NRZrawDemod(int clk, int invert, int maxErr, bool verbose) {
+    demod_cache_t *cache = demod_cache_active(verbose);
+    if (cache == NULL) {
+        return NRZrawDemod_run(clk, invert, maxErr, verbose);
+    }
+
+    int args[6] = { clk, invert, maxErr, 0, 0, 0 };
+    demod_cache_entry_t *e = demod_cache_find(cache, DEMOD_CACHE_NRZ, args);
+    if (e) {
+        return demod_cache_replay(e, NULL);
+    }
+
+    uint32_t gen = g_DemodBufferGen;
+    int res = NRZrawDemod_run(clk, invert, maxErr, verbose);
+    demod_cache_store(cache, DEMOD_CACHE_NRZ, args, res, gen != g_DemodBufferGen, false);
+    return res;
+}
+
 static int CmdNRZrawDemod(const char *Cmd) {
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "data rawdemod --nr",
@@ -1891,6 +2435,11 @@ int getSamplesFromBufEx(uint8_t *data, size_t sample_num, uint8_t bits_per_sampl
 
     size_t max_num = MIN(sample_num, MAX_GRAPH_TRACE_LEN);
 
+    if (GraphReserve(max_num) == false) {
+        PrintAndLogEx(FAILED, "failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+
     if (bits_per_sample < 8) {
 
         if (verbose) PrintAndLogEx(INFO, "Unpacking...");
@@ -1911,6 +2460,7 @@ int getSamplesFromBufEx(uint8_t *data, size_t sample_num, uint8_t bits_per_sampl
         }
         g_GraphTraceLen = max_num;
     }
+    GraphChanged();
 
     uint8_t *bits = calloc(g_GraphTraceLen, sizeof(uint8_t));
     if (bits == NULL) {
@@ -2001,6 +2551,9 @@ static int CmdLoad(const char *Cmd) {
     if (is_bin) {
         uint8_t val[2];
         while (fread(val, 1, 1, f)) {
+            if (GraphReserve(g_GraphTraceLen + 1) == false) {
+                break;
+            }
             g_GraphBuffer[g_GraphTraceLen] = val[0] - 127;
             g_GraphTraceLen++;
 
@@ -2010,6 +2563,9 @@ static int CmdLoad(const char *Cmd) {
     } else {
         char line[80];
         while (fgets(line, sizeof(line), f)) {
+            if (GraphReserve(g_GraphTraceLen + 1) == false) {
+                break;
+            }
             g_GraphBuffer[g_GraphTraceLen] = atoi(line);
             g_GraphTraceLen++;
 
@@ -2018,6 +2574,7 @@ static int CmdLoad(const char *Cmd) {
         }
     }
     fclose(f);
+    GraphChanged();
 
     PrintAndLogEx(SUCCESS, "loaded " _YELLOW_("%s") " samples", commaprint(g_GraphTraceLen));
 
@@ -2068,6 +2625,7 @@ int CmdLtrim(const char *Cmd) {
     }
     g_GraphTraceLen -= ds;
     g_DemodStartIdx -= ds;
+    GraphChanged();
     RepaintGraphWindow();
     return PM3_SUCCESS;
 }
@@ -2096,6 +2654,7 @@ static int CmdRtrim(const char *Cmd) {
     }
 
     g_GraphTraceLen = ds;
+    GraphChanged();
     RepaintGraphWindow();
     return PM3_SUCCESS;
 }
@@ -2136,6 +2695,7 @@ static int CmdMtrim(const char *Cmd) {
     }
 
     g_DemodStartIdx = 0;
+    GraphChanged();
     RepaintGraphWindow();
     return PM3_SUCCESS;
 }
@@ -2168,6 +2728,7 @@ int CmdNorm(const char *Cmd) {
             //marshmelow: adjusted *1000 to *256 to make +/- 128 so demod commands still work
         }
     }
+    GraphChanged();
 
     uint8_t *bits = calloc(g_GraphTraceLen, sizeof(uint8_t));
     if (bits == NULL) {
@@ -2318,6 +2879,7 @@ static int CmdDirectionalThreshold(const char *Cmd) {
     PrintAndLogEx(INFO, "Applying up threshold: " _YELLOW_("%i") ", down threshold: " _YELLOW_("%i") "\n", up, down);
 
     directionalThreshold(g_GraphBuffer, g_GraphBuffer, g_GraphTraceLen, up, down);
+    GraphChanged();
 
     // set signal properties low/high/mean/amplitude and isnoice detection
     uint8_t *bits = calloc(g_GraphTraceLen, sizeof(uint8_t));
@@ -2367,6 +2929,7 @@ static int CmdZerocrossings(const char *Cmd) {
             }
         }
     }
+    GraphChanged();
 
     uint8_t *bits = calloc(g_GraphTraceLen, sizeof(uint8_t));
     if (bits == NULL) {
@@ -2561,6 +3124,7 @@ static int CmdFSKToNRZ(const char *Cmd) {
     g_DemodBufferLen = 0;
     int ans = FSKToNRZ(g_GraphBuffer, &g_GraphTraceLen, clk, fc_low, fc_high);
     CmdNorm("");
+    GraphChanged();
     RepaintGraphWindow();
     return ans;
 }
@@ -2582,6 +3146,7 @@ static int CmdDataIIR(const char *Cmd) {
     CLIParserFree(ctx);
 
     iceSimple_Filter(g_GraphBuffer, g_GraphTraceLen, k);
+    GraphChanged();
 
     uint8_t *bits = calloc(g_GraphTraceLen, sizeof(uint8_t));
     if (bits == NULL) {
@@ -2789,6 +3354,94 @@ static int CmdAsn1Decoder(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+static int CmdBatch(const char *Cmd) {
+    CLIParserContext *ctx;
+    CLIParserInit(&ctx, "data batch",
+                  "Decode every .pm3 and .trace file in a directory, without loading them into the graph or trace buffer.\n"
+                  "LF captures are checked for EM410x, HID Prox, AWID and IO Prox, HF traces are annotated like `trace list`.\n"
+                  "LF files are decoded in parallel, HF traces one at a time since the annotators keep protocol state.\n"
+                  "Written as one JSON line per file, in directory order",
+                  "data batch -d traces -o traces.jsonl\n"
+                  "data batch -d traces -p \"lf_EM*\" -o em.jsonl\n"
+                  "data batch -d traces -p \"hf_14a_*\" -t 14a -o 14a.jsonl --threads 4"
+                 );
+
+    void *argtable[] = {
+        arg_param_begin,
+        arg_str1("d", "dir", "<dir>", "directory with capture files"),
+        arg_str1("o", "out", "<fn>", "JSON lines output file"),
+        arg_str0("p", "pattern", "<str>", "only files matching pattern, * and ? wildcards"),
+        arg_str0("t", "type", "<str>", "protocol to annotate .trace files, see `trace list -h` (def: raw)"),
+        arg_int0(NULL, "threads", "<dec>", "number of threads (def: all cores)"),
+        arg_param_end
+    };
+    CLIExecWithReturn(ctx, Cmd, argtable, false);
+
+    int dlen = 0;
+    char dir[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 1), (uint8_t *)dir, FILE_PATH_SIZE, &dlen);
+
+    int fnlen = 0;
+    char filename[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 2), (uint8_t *)filename, FILE_PATH_SIZE, &fnlen);
+
+    int plen = 0;
+    char pattern[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 3), (uint8_t *)pattern, FILE_PATH_SIZE, &plen);
+
+    int tlen = 0;
+    char type[10] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 4), (uint8_t *)type, sizeof(type), &tlen);
+    str_lower(type);
+
+    int threads = arg_get_int_def(ctx, 5, 0);
+    CLIParserFree(ctx);
+
+    if (threads < 0) {
+        PrintAndLogEx(FAILED, "number of threads must be positive");
+        return PM3_EINVARG;
+    }
+
+    uint8_t protocol;
+    if (TraceProtocolFromName(type, &protocol) != PM3_SUCCESS) {
+        PrintAndLogEx(FAILED, "Unknown protocol \"%s\"", type);
+        return PM3_EINVARG;
+    }
+
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        PrintAndLogEx(FAILED, "Could not create file " _YELLOW_("%s"), filename);
+        return PM3_EFILE;
+    }
+
+    batch_opts_t opts = {
+        .pattern = (plen) ? pattern : NULL,
+        .hf_type = type,
+        .threads = threads,
+    };
+
+    batch_stats_t stats;
+    uint64_t t1 = msclock();
+    int res = batch_decode_dir(dir, &opts, f, &stats);
+    t1 = msclock() - t1;
+    fclose(f);
+
+    if (res != PM3_SUCCESS) {
+        return res;
+    }
+
+    PrintAndLogEx(SUCCESS, "Decoded " _YELLOW_("%u") " files ( lf " _YELLOW_("%u") ", %u with a known tag, hf " _YELLOW_("%u") ", failed " _YELLOW_("%u") " ) in " _YELLOW_("%.3f") " seconds"
+                  , stats.files
+                  , stats.lf
+                  , stats.found
+                  , stats.hf
+                  , stats.failed
+                  , (float)t1 / 1000.0
+                 );
+    PrintAndLogEx(SUCCESS, "Saved to " _YELLOW_("%s"), filename);
+    return PM3_SUCCESS;
+}
+
 static int CmdDiff(const char *Cmd) {
 
     CLIParserContext *ctx;
@@ -3306,6 +3959,7 @@ static int CmdCenterThreshold(const char *Cmd) {
     PrintAndLogEx(INFO, "Applying up threshold: " _YELLOW_("%i") ", down threshold: " _YELLOW_("%i") "\n", up, down);
 
     centerThreshold(g_GraphBuffer, g_GraphBuffer, g_GraphTraceLen, up, down);
+    GraphChanged();
 
     // set signal properties low/high/mean/amplitude and isnoice detection
     uint8_t *bits = calloc(g_GraphTraceLen, sizeof(uint8_t));
@@ -3357,6 +4011,7 @@ static int CmdEnvelope(const char *Cmd) {
     CLIParserFree(ctx);
 
     envelope_square(g_GraphBuffer, g_GraphBuffer, g_GraphTraceLen);
+    GraphChanged();
 
     uint8_t *bits = calloc(g_GraphTraceLen, sizeof(uint8_t));
     if (bits == NULL) {
@@ -3835,6 +4490,204 @@ static int CmdTestSaveState32S(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+static uint32_t lfdemod_digest_add(uint32_t h, int32_t v) {
+    // FNV-1a
+    for (uint8_t i = 0; i < 4; i++) {
+        h ^= (uint8_t)(v >> (i * 8));
+        h *= 0x01000193;
+    }
+    return h;
+}
+
+static uint32_t lfdemod_digest_buf(uint32_t h, const uint8_t *d, size_t n) {
+    h = lfdemod_digest_add(h, (int32_t)n);
+    for (size_t i = 0; i < n; i++) {
+        h = lfdemod_digest_add(h, d[i]);
+    }
+    return h;
+}
+
+// runs the clock detect and raw demods over the samples and folds every result into one digest
+static uint32_t lfdemod_digest(const uint8_t *samples, size_t len, uint8_t *work) {
+    uint32_t h = 0x811c9dc5;
+
+    computeSignalProperties(samples, len);
+    signal_t *sp = getSignalProperties();
+    h = lfdemod_digest_add(h, sp->low);
+    h = lfdemod_digest_add(h, sp->high);
+    h = lfdemod_digest_add(h, sp->mean);
+    h = lfdemod_digest_add(h, sp->amplitude);
+    h = lfdemod_digest_add(h, sp->isnoise);
+
+    int clk = 0;
+    memcpy(work, samples, len);
+    h = lfdemod_digest_add(h, DetectASKClock(work, len, &clk, 0));
+    h = lfdemod_digest_add(h, clk);
+
+    int hi = 0, lo = 0;
+    getHiLo(&hi, &lo, 75, 75);
+    clk = 0;
+    memcpy(work, samples, len);
+    h = lfdemod_digest_add(h, DetectStrongAskClock(work, len, hi, lo, &clk));
+    h = lfdemod_digest_add(h, clk);
+
+    memcpy(work, samples, len);
+    h = lfdemod_digest_add(h, countFC(work, len, false));
+    uint16_t fcs = countFC(work, len, true);
+    h = lfdemod_digest_add(h, fcs);
+    uint8_t fchigh = (fcs) ? (fcs >> 8) & 0xFF : 10;
+    uint8_t fclow = (fcs) ? fcs & 0xFF : 8;
+
+    int edge = 0;
+    uint8_t rflen = detectFSKClk(work, len, fchigh, fclow, &edge);
+    h = lfdemod_digest_add(h, rflen);
+    h = lfdemod_digest_add(h, edge);
+
+    size_t firstphase = 0;
+    uint8_t curphase = 0, fc = 0;
+    h = lfdemod_digest_add(h, DetectPSKClock(work, len, 0, &firstphase, &curphase, &fc));
+    h = lfdemod_digest_add(h, (int32_t)firstphase);
+    h = lfdemod_digest_add(h, curphase);
+    h = lfdemod_digest_add(h, fc);
+
+    size_t nrzidx = 0;
+    h = lfdemod_digest_add(h, DetectNRZClock(work, len, 0, &nrzidx));
+    h = lfdemod_digest_add(h, (int32_t)nrzidx);
+
+    size_t size = len, ststart = 0, stend = 0;
+    clk = 0;
+    h = lfdemod_digest_add(h, DetectST(work, &size, &clk, &ststart, &stend));
+    h = lfdemod_digest_add(h, (int32_t)size);
+    h = lfdemod_digest_add(h, clk);
+    h = lfdemod_digest_add(h, (int32_t)ststart);
+    h = lfdemod_digest_add(h, (int32_t)stend);
+
+    // ask/manchester and ask/raw
+    for (uint8_t type = 0; type < 2; type++) {
+        int invert = 0, start = 0;
+        clk = 0;
+        size = len;
+        memcpy(work, samples, len);
+        h = lfdemod_digest_add(h, askdemod_ext(work, &size, &clk, &invert, 100, 0, type, &start));
+        h = lfdemod_digest_add(h, clk);
+        h = lfdemod_digest_add(h, invert);
+        h = lfdemod_digest_add(h, start);
+        h = lfdemod_digest_buf(h, work, size);
+    }
+
+    int start = 0;
+    memcpy(work, samples, len);
+    size = fskdemod(work, len, (rflen) ? rflen : 50, 0, fchigh, fclow, &start);
+    h = lfdemod_digest_add(h, start);
+    h = lfdemod_digest_buf(h, work, size);
+
+    int invert = 0;
+    clk = 0;
+    start = 0;
+    size = len;
+    memcpy(work, samples, len);
+    h = lfdemod_digest_add(h, pskRawDemod_ext(work, &size, &clk, &invert, &start));
+    h = lfdemod_digest_add(h, clk);
+    h = lfdemod_digest_add(h, start);
+    h = lfdemod_digest_buf(h, work, size);
+
+    clk = 0;
+    start = 0;
+    size = len;
+    memcpy(work, samples, len);
+    h = lfdemod_digest_add(h, nrzRawDemod(work, &size, &clk, &invert, &start));
+    h = lfdemod_digest_add(h, clk);
+    h = lfdemod_digest_add(h, start);
+    h = lfdemod_digest_buf(h, work, size);
+
+    memcpy(work, samples, len);
+    removeSignalOffset(work, len);
+    h = lfdemod_digest_buf(h, work, len);
+
+    // leave signal properties as they were
+    computeSignalProperties(samples, len);
+    return h;
+}
+
+static int CmdTestLFDemod(const char *Cmd) {
+    CLIParserContext *ctx;
+    CLIParserInit(&ctx, "data test_lfdemod",
+                  "Runs clock detection and raw demods over the GraphBuffer once per available instruction set.\n"
+                  "All of them must give the same digest,  which is compared against traces/golden_lfdemod.txt by pm3_tests.sh",
+                  "data test_lfdemod");
+    void *argtable[] = {
+        arg_param_begin,
+        arg_param_end
+    };
+    CLIExecWithReturn(ctx, Cmd, argtable, true);
+    CLIParserFree(ctx);
+
+    if (g_GraphTraceLen < SIGNAL_MIN_SAMPLES) {
+        PrintAndLogEx(FAILED, "Data in Graphbuffer was too small.");
+        return PM3_ESOFT;
+    }
+
+    uint8_t *samples = calloc(g_GraphTraceLen, sizeof(uint8_t));
+    uint8_t *work = calloc(g_GraphTraceLen, sizeof(uint8_t));
+    if (samples == NULL || work == NULL) {
+        PrintAndLogEx(FAILED, "failed to allocate memory");
+        free(samples);
+        free(work);
+        return PM3_EMALLOC;
+    }
+    size_t len = getFromGraphBuffer(samples);
+
+    static const struct {
+        LFSIMDInstr instr;
+        const char *name;
+    } sets[] = {
+        { LF_SIMD_NONE, "none" },
+#if defined(LF_HAS_SIMD_X86)
+        { LF_SIMD_SSE2, "SSE2" },
+        { LF_SIMD_AVX2, "AVX2" },
+#endif
+#if defined(LF_HAS_SIMD_NEON)
+        { LF_SIMD_NEON, "NEON" },
+#endif
+    };
+
+    // demods would print at debug level
+    uint8_t dbg = g_debugMode;
+    g_debugMode = 0;
+
+    int res = PM3_SUCCESS;
+    uint32_t reference = 0;
+    for (uint8_t i = 0; i < ARRAYLEN(sets); i++) {
+        // LFSIMDInstr lists instruction sets from best to worst,  skip the ones better than the cpu supports
+        if (sets[i].instr < GetLFSIMDInstrAuto()) {
+            PrintAndLogEx(INFO, "%-5s not supported", sets[i].name);
+            continue;
+        }
+
+        SetLFSIMDInstr(sets[i].instr);
+        uint32_t digest = lfdemod_digest(samples, len, work);
+        PrintAndLogEx(INFO, "%-5s %08x", sets[i].name, digest);
+
+        if (i == 0) {
+            reference = digest;
+        } else if (digest != reference) {
+            res = PM3_ESOFT;
+        }
+    }
+    SetLFSIMDInstr(LF_SIMD_AUTO);
+    g_debugMode = dbg;
+
+    if (res == PM3_SUCCESS) {
+        PrintAndLogEx(SUCCESS, "digest %08x", reference);
+    } else {
+        PrintAndLogEx(FAILED, "instruction sets " _RED_("mismatch"));
+    }
+
+    free(samples);
+    free(work);
+    return res;
+}
+
 static command_t CommandTable[] = {
     {"help",             CmdHelp,                 AlwaysAvailable,  "This help"},
     {"-----------",      CmdHelp,                 AlwaysAvailable, "------------------------- " _CYAN_("General") "-------------------------"},
@@ -3881,6 +4734,7 @@ static command_t CommandTable[] = {
     {"-----------",      CmdHelp,                 AlwaysAvailable, "------------------------- " _CYAN_("Operations") "-------------------------"},
     {"asn1",             CmdAsn1Decoder,          AlwaysAvailable,  "ASN1 decoder"},
     {"atr",              CmdAtrLookup,            AlwaysAvailable,  "ATR lookup"},
+    {"batch",            CmdBatch,                AlwaysAvailable,  "Decode a directory of LF / HF capture files to JSON lines"},
     {"bitsamples",       CmdBitsamples,           IfPm3Present,     "Get raw samples as bitstring"},
     {"bmap",             CmdBinaryMap,            AlwaysAvailable,  "Convert hex value according a binary template"},
     {"crypto",           CmdCryptography,         AlwaysAvailable,  "Encrypt and decrypt data"},
@@ -3892,6 +4746,7 @@ static command_t CommandTable[] = {
     {"test_ss8",         CmdTestSaveState8,       IfClientDebugEnabled, "Test the implementation of Buffer Save States (8-bit buffer)"},
     {"test_ss32",        CmdTestSaveState32,      IfClientDebugEnabled, "Test the implementation of Buffer Save States (32-bit buffer)"},
     {"test_ss32s",       CmdTestSaveState32S,     IfClientDebugEnabled, "Test the implementation of Buffer Save States (32-bit signed buffer)"},
+    {"test_lfdemod",     CmdTestLFDemod,          IfClientDebugEnabled, "Test LF clock detection and raw demods against every instruction set"},
 
     {NULL, NULL, NULL, NULL}
 };
@@ -21,6 +21,7 @@
 
 #include "common.h"
 #include <stdbool.h>
+#include "graph.h"          // demod_ctx_current
 
 #ifdef __cplusplus
 extern "C" {
@@ -88,16 +89,17 @@ int getSamplesEx(uint32_t start, uint32_t end, bool verbose, bool ignore_lf_conf
 int getSamplesFromBufEx(uint8_t *data, size_t sample_num, uint8_t bits_per_sample, bool verbose);
 
 void setClockGrid(uint32_t clk, int offset);
+void demod_cache_enable(bool enable);
 int directionalThreshold(const int *in, int *out, size_t len, int8_t up, int8_t down);
 int centerThreshold(const int *in, int *out, size_t len, int8_t up, int8_t down);
 int AskEdgeDetect(const int *in, int *out, int len, int threshold);
 
 #define MAX_DEMOD_BUF_LEN (1024*128)
-extern uint8_t g_DemodBuffer[MAX_DEMOD_BUF_LEN];
-extern size_t g_DemodBufferLen;
+#define g_DemodBuffer    (demod_ctx_current()->demod)
+#define g_DemodBufferLen (demod_ctx_current()->demod_len)
 
-extern int g_DemodClock;
-extern int32_t g_DemodStartIdx;
+#define g_DemodClock     (demod_ctx_current()->demod_clock)
+#define g_DemodStartIdx  (demod_ctx_current()->demod_start_idx)
 
 #ifdef __cplusplus
 }
@@ -530,11 +530,13 @@ int handle_hf_plot(bool show_plot) {
         return PM3_ETIMEOUT;
     }
 
+    GraphReserve(FPGA_TRACE_SIZE);
     for (size_t i = 0; i < FPGA_TRACE_SIZE; i++) {
         g_GraphBuffer[i] = ((int)buf[i]) - 128;
     }
 
     g_GraphTraceLen = FPGA_TRACE_SIZE;
+    GraphChanged();
 
     if (show_plot) {
         ShowGraphWindow();
@@ -1955,19 +1955,34 @@ static int CmdHF15Dump(const char *Cmd) {
 
     int blocknum = 0;
 
+    // the next blocks are read while this one is checked,  a retry starts over from the failed block
+    uint8_t window = GetCommunicationWindow();
+    uint32_t seqs[256] = {0};
+    int sent = 0, last = -1;
+    clearCommandBuffer();
+
     for (int retry = 0; (retry < 2 && blocknum < tag->pagesCount); retry++) {
-        if (used_uid) {
-            packet->raw[10] = (uint8_t)blocknum & 0xFF;
-            AddCrc15(packet->raw, 11);
-        } else {
-            packet->raw[2] = (uint8_t)blocknum & 0xFF;
-            AddCrc15(packet->raw, 3);
+
+        if (blocknum == last) {
+            DrainCommandWindow(2000);
+            sent = blocknum;
         }
+        last = blocknum;
 
-        clearCommandBuffer();
-        SendCommandNG(CMD_HF_ISO15693_COMMAND, (uint8_t *)packet, ISO15_RAW_LEN(packet->rawlen));
+        while (sent < tag->pagesCount && sent < blocknum + window) {
+            if (used_uid) {
+                packet->raw[10] = (uint8_t)sent & 0xFF;
+                AddCrc15(packet->raw, 11);
+            } else {
+                packet->raw[2] = (uint8_t)sent & 0xFF;
+                AddCrc15(packet->raw, 3);
+            }
 
-        if (WaitForResponseTimeout(CMD_HF_ISO15693_COMMAND, &resp, 2000)) {
+            seqs[sent] = SendCommandNGSeq(CMD_HF_ISO15693_COMMAND, (uint8_t *)packet, ISO15_RAW_LEN(packet->rawlen));
+            sent++;
+        }
+
+        if (WaitForResponseSeq(seqs[blocknum], &resp, 2000)) {
 
             if (resp.length < 2) {
                 PrintAndLogEx(NORMAL, "");
@@ -2007,6 +2022,9 @@ static int CmdHF15Dump(const char *Cmd) {
         }
     }
 
+    // reads past the end of the tag memory are still answered
+    DrainCommandWindow(2000);
+
     free(packet);
     DropField();
 
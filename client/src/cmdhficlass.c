@@ -3583,13 +3583,40 @@ static void add_key(uint8_t *key) {
     }
 }
 
+// number of threads used by the key generators,  0 = use all available cores
+static size_t iclass_tc = 0;
+
+void iclass_set_generator_threads(int threads) {
+    iclass_tc = (threads > 0) ? threads : 0;
+}
+
+static size_t iclass_generator_threads(void) {
+    if (iclass_tc > 0) {
+        return iclass_tc;
+    }
+    return num_CPUs();
+}
+
+static void print_generator_rate(uint32_t keycnt, uint64_t ms, size_t threads) {
+    if (ms == 0) {
+        ms = 1;
+    }
+    PrintAndLogEx(SUCCESS, "Generated " _YELLOW_("%u") " keys in " _YELLOW_("%.3f") " seconds using " _YELLOW_("%zu") " threads ( " _YELLOW_("%.0f") " keys/s )"
+                  , keycnt
+                  , (float)ms / 1000.0
+                  , threads
+                  , (double)keycnt * 1000.0 / (double)ms
+                 );
+}
+
 static int CmdHFiClassCheckKeys(const char *Cmd) {
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "hf iclass chk",
                   "Checkkeys loads a dictionary text file with 8byte hex keys to test authenticating against a iClass tag",
                   "hf iclass chk -f iclass_default_keys.dic\n"
                   "hf iclass chk -f iclass_elite_keys.dic --elite\n"
-                  "hf iclass chk --vb6kdf\n");
+                  "hf iclass chk --vb6kdf\n"
+                  "hf iclass chk -f iclass_elite_keys.dic --elite --threads 4\n");
 
     void *argtable[] = {
         arg_param_begin,
@@ -3599,6 +3626,7 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
         arg_lit0(NULL, "raw", "no computations applied to key (raw)"),
         arg_lit0(NULL, "shallow", "use shallow (ASK) reader modulation instead of OOK"),
         arg_lit0(NULL, "vb6kdf", "use the VB6 elite KDF instead of a file"),
+        arg_int0(NULL, "threads", "<dec>", "number of threads used to generate keys (def: all cores)"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, false);
@@ -3616,9 +3644,16 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
 
     bool use_credit_key = arg_get_lit(ctx, 2);
     bool shallow_mod = arg_get_lit(ctx, 5);
+    int threads = arg_get_int_def(ctx, 7, 0);
 
     CLIParserFree(ctx);
 
+    if (threads < 0) {
+        PrintAndLogEx(ERR, "Number of threads must be positive");
+        return PM3_EINVARG;
+    }
+    iclass_set_generator_threads(threads);
+
     uint8_t CSN[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
     uint8_t CCNR[12] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
@@ -3691,7 +3726,9 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
     if (use_raw)
         PrintAndLogEx(NORMAL, "using " _YELLOW_("raw mode"));
 
-    GenerateMacFrom(CSN, CCNR, use_raw, use_elite, keyBlock, keycount, pre);
+    uint64_t t2 = msclock();
+    size_t tc = GenerateMacFrom(CSN, CCNR, use_raw, use_elite, keyBlock, keycount, pre);
+    print_generator_rate(keycount, msclock() - t2, tc);
 
     PrintAndLogEx(SUCCESS, "Searching for " _YELLOW_("%s") " key...", (use_credit_key) ? "CREDIT" : "DEBIT");
 
@@ -3891,7 +3928,7 @@ static int CmdHFiClassRecover(uint8_t key[8]) {
 }
 
 typedef struct {
-    uint32_t start_index;
+    uint64_t start_index;
     uint32_t keycount;
     const uint8_t *startingKey;
     uint8_t (*keyBlock)[PICOPASS_BLOCK_SIZE];
@@ -3899,13 +3936,13 @@ typedef struct {
 
 void *generate_key_blocks(void *arg) {
     ThreadData *data = (ThreadData *)arg;
-    uint32_t start_index = data->start_index;
+    uint64_t start_index = data->start_index;
     uint32_t keycount = data->keycount;
     const uint8_t *startingKey = data->startingKey;
     uint8_t (*keyBlock)[PICOPASS_BLOCK_SIZE] = data->keyBlock;
 
     for (uint32_t i = 0; i < keycount; i++) {
-        uint32_t carry = start_index + i;
+        uint64_t carry = start_index + i;
         memcpy(keyBlock[i], startingKey, PICOPASS_BLOCK_SIZE);
 
         for (int j = PICOPASS_BLOCK_SIZE - 1; j >= 0; j--) {
@@ -3929,7 +3966,8 @@ static int CmdHFiClassLegRecLookUp(const char *Cmd) {
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "hf iclass legbrute",
                   "This command take sniffed trace data and partial raw key and bruteforces the remaining 40 bits of the raw key.",
-                  "hf iclass legbrute --csn 8D7BD711FEFF12E0 --epurse feffffffffffffff --macs 00000000BD478F76 --pk B4F12AADC5301225"
+                  "hf iclass legbrute --csn 8D7BD711FEFF12E0 --epurse feffffffffffffff --macs 00000000BD478F76 --pk B4F12AADC5301225\n"
+                  "hf iclass legbrute --csn 8D7BD711FEFF12E0 --epurse feffffffffffffff --macs 00000000BD478F76 --pk B4F12AADC5301225 --index 1200"
                  );
 
     void *argtable[] = {
@@ -3938,6 +3976,7 @@ static int CmdHFiClassLegRecLookUp(const char *Cmd) {
         arg_str1(NULL, "epurse", "<hex>", "Specify ePurse as 8 hex bytes"),
         arg_str1(NULL, "macs", "<hex>", "MACs"),
         arg_str1(NULL, "pk", "<hex>", "Partial Key"),
+        arg_u64_0(NULL, "index", "<dec>", "Where to start the search, in millions of keys (resume)"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, false);
@@ -3990,6 +4029,8 @@ static int CmdHFiClassLegRecLookUp(const char *Cmd) {
         }
     }
 
+    uint64_t block_index = arg_get_u64_def(ctx, 5, 0);
+
     CLIParserFree(ctx);
     //Standalone Command End
 
@@ -4008,33 +4049,55 @@ static int CmdHFiClassLegRecLookUp(const char *Cmd) {
     PrintAndLogEx(SUCCESS, "TAG MAC: %s", sprint_hex(MAC_TAG, sizeof(MAC_TAG)));
     PrintAndLogEx(SUCCESS, "Starting Key: %s", sprint_hex(startingKey, 8));
 
-    uint32_t keycount = 1000000;
+    // 5 bits per key byte are bruteforced
+    const uint64_t keyspace = 1ULL << 40;
+    const uint32_t keycount = 1000000;
+    const uint64_t max_blocks = (keyspace + keycount - 1) / keycount;
+
+    if (block_index >= max_blocks) {
+        PrintAndLogEx(ERR, "Index must be smaller than %" PRIu64, max_blocks);
+        return PM3_EINVARG;
+    }
+
     uint32_t keys_per_thread = 200000;
     uint32_t num_threads = keycount / keys_per_thread;
     pthread_t threads[num_threads];
     ThreadData thread_data[num_threads];
-    iclass_prekey_t *prekey = NULL;
-    iclass_prekey_t lookup;
+
+    // Only the MAC of the current block is of interest, earlier blocks are already
+    // known not to contain it. One block is generated, searched and overwritten at a
+    // time, so memory use stays fixed no matter how long the search runs.
+    uint8_t *keyBlock = calloc(keycount, PICOPASS_BLOCK_SIZE);
+    iclass_prekey_t *prekey = calloc(keycount, sizeof(iclass_prekey_t));
+    if (keyBlock == NULL || prekey == NULL) {
+        PrintAndLogEx(ERR, "Memory allocation failed");
+        free(keyBlock);
+        free(prekey);
+        return PM3_EMALLOC;
+    }
+
     iclass_prekey_t *item = NULL;
 
-    memcpy(lookup.mac, MAC_TAG, 4);
+    PrintAndLogEx(INFO, "Press " _GREEN_("<Enter>") " to abort");
+    PrintAndLogEx(INFO, "Searching for " _YELLOW_("%s") " key, starting at index " _YELLOW_("%" PRIu64), "DEBIT", block_index);
+
+    uint64_t t1 = msclock();
+    uint64_t start_block = block_index;
 
-    uint32_t block_index = 0;
+    for (; block_index < max_blocks; block_index++) {
+
+        if (kbd_enter_pressed()) {
+            PrintAndLogEx(NORMAL, "");
+            PrintAndLogEx(WARNING, "\naborted via keyboard!");
+            PrintAndLogEx(HINT, "Resume the search with `" _YELLOW_("--index %" PRIu64) "`", block_index);
+            break;
+        }
 
-    while (item == NULL) {
         for (uint32_t t = 0; t < num_threads; t++) {
             thread_data[t].start_index = block_index * keycount + t * keys_per_thread;
             thread_data[t].keycount = keys_per_thread;
             thread_data[t].startingKey = startingKey;
-            thread_data[t].keyBlock = calloc(keys_per_thread, PICOPASS_BLOCK_SIZE);
-
-            if (thread_data[t].keyBlock == NULL) {
-                PrintAndLogEx(ERR, "Memory allocation failed for keyBlock in thread %d.", t);
-                for (uint32_t i = 0; i < t; i++) {
-                    free(thread_data[i].keyBlock);
-                }
-                return PM3_EINVARG;
-            }
+            thread_data[t].keyBlock = (uint8_t (*)[PICOPASS_BLOCK_SIZE])(keyBlock + (t * keys_per_thread * PICOPASS_BLOCK_SIZE));
 
             pthread_create(&threads[t], NULL, generate_key_blocks, (void *)&thread_data[t]);
         }
@@ -4043,47 +4106,40 @@ static int CmdHFiClassLegRecLookUp(const char *Cmd) {
             pthread_join(threads[t], NULL);
         }
 
-        if (prekey == NULL) {
-            prekey = calloc(keycount, sizeof(iclass_prekey_t));
-        } else {
-            prekey = realloc(prekey, (block_index + 1) * keycount * sizeof(iclass_prekey_t));
-        }
+        GenerateMacKeyFrom(csn, CCNR, true, false, keyBlock, keycount, prekey);
 
-        if (prekey == NULL) {
-            PrintAndLogEx(ERR, "Memory allocation failed for prekey.");
-            for (uint32_t t = 0; t < num_threads; t++) {
-                free(thread_data[t].keyBlock);
+        // a single MAC is searched for,  a linear scan is cheaper than sorting the block
+        for (uint32_t i = 0; i < keycount; i++) {
+            if (memcmp(prekey[i].mac, MAC_TAG, 4) == 0) {
+                item = &prekey[i];
+                break;
             }
-            return PM3_EINVARG;
         }
 
-        PrintAndLogEx(INFO, "Generating diversified keys...");
-        for (uint32_t t = 0; t < num_threads; t++) {
-            GenerateMacKeyFrom(csn, CCNR, true, false, (uint8_t *)thread_data[t].keyBlock, keys_per_thread, prekey + (block_index * keycount) + (t * keys_per_thread));
+        if (item != NULL) {
+            break;
         }
 
-        PrintAndLogEx(INFO, "Sorting...");
-
-        // Sort mac list
-        qsort(prekey, (block_index + 1) * keycount, sizeof(iclass_prekey_t), cmp_uint32);
-
-        PrintAndLogEx(SUCCESS, "Searching for " _YELLOW_("%s") " key...", "DEBIT");
-
-        // Binary search
-        item = (iclass_prekey_t *)bsearch(&lookup, prekey, (block_index + 1) * keycount, sizeof(iclass_prekey_t), cmp_uint32);
-
-        for (uint32_t t = 0; t < num_threads; t++) {
-            free(thread_data[t].keyBlock);
+        uint64_t ms = msclock() - t1;
+        if (ms == 0) {
+            ms = 1;
         }
-
-        block_index++;
+        PrintAndLogEx(INPLACE, "index %" PRIu64 " / %" PRIu64 "  ( %.0f keys/s )"
+                      , block_index + 1
+                      , max_blocks
+                      , (double)((block_index + 1 - start_block) * keycount) * 1000.0 / (double)ms
+                     );
     }
 
+    PrintAndLogEx(NORMAL, "");
     if (item != NULL) {
         PrintAndLogEx(SUCCESS, "Found valid RAW key " _GREEN_("%s"), sprint_hex(item->key, 8));
+    } else if (block_index == max_blocks) {
+        PrintAndLogEx(FAILED, "Key not found");
     }
 
     free(prekey);
+    free(keyBlock);
     PrintAndLogEx(NORMAL, "");
     return PM3_SUCCESS;
 }
@@ -4133,7 +4189,8 @@ static int CmdHFiClassLookUp(const char *Cmd) {
                   "This command take sniffed trace data and try to recovery a iCLASS Standard or iCLASS Elite key.",
                   "hf iclass lookup --csn 9655a400f8ff12e0 --epurse f0ffffffffffffff --macs 0000000089cb984b -f iclass_default_keys.dic\n"
                   "hf iclass lookup --csn 9655a400f8ff12e0 --epurse f0ffffffffffffff --macs 0000000089cb984b -f iclass_default_keys.dic --elite\n"
-                  "hf iclass lookup --csn 9655a400f8ff12e0 --epurse f0ffffffffffffff --macs 0000000089cb984b --vb6rng"
+                  "hf iclass lookup --csn 9655a400f8ff12e0 --epurse f0ffffffffffffff --macs 0000000089cb984b --vb6rng\n"
+                  "hf iclass lookup --csn 9655a400f8ff12e0 --epurse f0ffffffffffffff --macs 0000000089cb984b -f iclass_default_keys.dic --threads 4"
                  );
 
     void *argtable[] = {
@@ -4145,6 +4202,7 @@ static int CmdHFiClassLookUp(const char *Cmd) {
         arg_lit0(NULL, "elite", "Elite computations applied to key"),
         arg_lit0(NULL, "raw", "no computations applied to key"),
         arg_lit0(NULL, "vb6rng", "use the VB6 rng for elite keys instead of a dictionary file"),
+        arg_int0(NULL, "threads", "<dec>", "number of threads used to generate keys (def: all cores)"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, false);
@@ -4197,8 +4255,16 @@ static int CmdHFiClassLookUp(const char *Cmd) {
         }
     }
 
+    int threads = arg_get_int_def(ctx, 8, 0);
+
     CLIParserFree(ctx);
 
+    if (threads < 0) {
+        PrintAndLogEx(ERR, "Number of threads must be positive");
+        return PM3_EINVARG;
+    }
+    iclass_set_generator_threads(threads);
+
     uint8_t CCNR[12];
     uint8_t MAC_TAG[4] = { 0, 0, 0, 0 };
 
@@ -4248,7 +4314,9 @@ static int CmdHFiClassLookUp(const char *Cmd) {
     }
 
     PrintAndLogEx(INFO, "Generating diversified keys...");
-    GenerateMacKeyFrom(csn, CCNR, use_raw, use_elite, keyBlock, keycount, prekey);
+    uint64_t t2 = msclock();
+    size_t tc = GenerateMacKeyFrom(csn, CCNR, use_raw, use_elite, keyBlock, keycount, prekey);
+    print_generator_rate(keycount, msclock() - t2, tc);
 
     if (use_elite)
         PrintAndLogEx(INFO, "Using " _YELLOW_("elite algo"));
@@ -4282,11 +4350,14 @@ static int CmdHFiClassLookUp(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+// keys are handed out to the generator threads in chunks of this size
+#define ICLASS_GEN_CHUNK    256
+
 typedef struct {
-    uint8_t thread_idx;
     uint8_t use_raw;
     uint8_t use_elite;
     uint32_t keycnt;
+    uint32_t *next;
     uint8_t csn[8];
     uint8_t cc_nr[12];
     uint8_t *keys;
@@ -4294,15 +4365,15 @@ typedef struct {
         iclass_premac_t *premac;
         iclass_prekey_t *prekey;
     } list;
-} PACKED iclass_thread_arg_t;
+} iclass_thread_arg_t;
 
-static size_t iclass_tc = 1;
-
-static pthread_mutex_t generator_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Key diversification and MAC calculation are reentrant, so the worker threads
+// run without any lock. Each worker grabs the next chunk of keys from the shared
+// counter, which keeps all cores busy even when the key count isn't a multiple of
+// the thread count.
 static void *bf_generate_mac(void *thread_arg) {
 
     iclass_thread_arg_t *targ = (iclass_thread_arg_t *)thread_arg;
-    const uint8_t idx = targ->thread_idx;
     const uint8_t use_raw = targ->use_raw;
     const uint8_t use_elite = targ->use_elite;
     const uint32_t keycnt = targ->keycnt;
@@ -4315,63 +4386,32 @@ static void *bf_generate_mac(void *thread_arg) {
     memcpy(csn, targ->csn, sizeof(csn));
     memcpy(cc_nr, targ->cc_nr, sizeof(cc_nr));
 
-    uint8_t key[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
     uint8_t div_key[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
-    for (uint32_t i = idx; i < keycnt; i += iclass_tc) {
-
-        memcpy(key, keys + 8 * i, 8);
-
-        pthread_mutex_lock(&generator_mutex);
-        if (use_raw)
-            memcpy(div_key, key, 8);
-        else
-            HFiClassCalcDivKey(csn, key, div_key, use_elite);
-
-        doMAC(cc_nr, div_key, list[i].mac);
-        pthread_mutex_unlock(&generator_mutex);
-    }
-    return NULL;
-}
-
-// precalc diversified keys and their MAC
-void GenerateMacFrom(uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys, uint32_t keycnt, iclass_premac_t *list) {
-
-    pthread_mutex_init(&generator_mutex, NULL);
+    for (;;) {
+        uint32_t start = __atomic_fetch_add(targ->next, ICLASS_GEN_CHUNK, __ATOMIC_RELAXED);
+        if (start >= keycnt) {
+            break;
+        }
 
-    iclass_tc = num_CPUs();
-    pthread_t threads[iclass_tc];
-    iclass_thread_arg_t args[iclass_tc];
-    // init thread arguments
-    for (size_t i = 0; i < iclass_tc; i++) {
-        args[i].thread_idx = i;
-        args[i].use_raw = use_raw;
-        args[i].use_elite = use_elite;
-        args[i].keycnt = keycnt;
-        args[i].keys = keys;
-        args[i].list.premac = list;
+        uint32_t stop = MIN(start + ICLASS_GEN_CHUNK, keycnt);
+        for (uint32_t i = start; i < stop; i++) {
 
-        memcpy(args[i].csn, CSN, sizeof(args[i].csn));
-        memcpy(args[i].cc_nr, CCNR, sizeof(args[i].cc_nr));
-    }
+            uint8_t *key = keys + 8 * i;
+            if (use_raw)
+                memcpy(div_key, key, 8);
+            else
+                HFiClassCalcDivKey(csn, key, div_key, use_elite);
 
-    for (int i = 0; i < iclass_tc; i++) {
-        int res = pthread_create(&threads[i], NULL, bf_generate_mac, (void *)&args[i]);
-        if (res) {
-            PrintAndLogEx(NORMAL, "");
-            PrintAndLogEx(WARNING, "Failed to create pthreads. Quitting");
-            return;
+            doMAC(cc_nr, div_key, list[i].mac);
         }
     }
-
-    for (int i = 0; i < iclass_tc; i++)
-        pthread_join(threads[i], NULL);
+    return NULL;
 }
 
 static void *bf_generate_mackey(void *thread_arg) {
 
     iclass_thread_arg_t *targ = (iclass_thread_arg_t *)thread_arg;
-    const uint8_t idx = targ->thread_idx;
     const uint8_t use_raw = targ->use_raw;
     const uint8_t use_elite = targ->use_elite;
     const uint32_t keycnt = targ->keycnt;
@@ -4386,53 +4426,77 @@ static void *bf_generate_mackey(void *thread_arg) {
 
     uint8_t div_key[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
-    for (uint32_t i = idx; i < keycnt; i += iclass_tc) {
+    for (;;) {
+        uint32_t start = __atomic_fetch_add(targ->next, ICLASS_GEN_CHUNK, __ATOMIC_RELAXED);
+        if (start >= keycnt) {
+            break;
+        }
 
-        memcpy(list[i].key, keys + 8 * i, 8);
+        uint32_t stop = MIN(start + ICLASS_GEN_CHUNK, keycnt);
+        for (uint32_t i = start; i < stop; i++) {
 
-        pthread_mutex_lock(&generator_mutex);
-        if (use_raw)
-            memcpy(div_key, list[i].key, 8);
-        else
-            HFiClassCalcDivKey(csn, list[i].key, div_key, use_elite);
+            memcpy(list[i].key, keys + 8 * i, 8);
 
-        doMAC(cc_nr, div_key, list[i].mac);
-        pthread_mutex_unlock(&generator_mutex);
+            if (use_raw)
+                memcpy(div_key, list[i].key, 8);
+            else
+                HFiClassCalcDivKey(csn, list[i].key, div_key, use_elite);
+
+            doMAC(cc_nr, div_key, list[i].mac);
+        }
     }
     return NULL;
 }
 
-void GenerateMacKeyFrom(uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys, uint32_t keycnt, iclass_prekey_t *list) {
+// returns the number of threads actually started
+static size_t iclass_run_generator(void *(*worker)(void *), uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys, uint32_t keycnt, void *list) {
+
+    // no need to start more threads than there are chunks of work
+    size_t tc = MIN(iclass_generator_threads(), (keycnt + ICLASS_GEN_CHUNK - 1) / ICLASS_GEN_CHUNK);
+    if (tc < 1) {
+        tc = 1;
+    }
 
-    pthread_mutex_init(&generator_mutex, NULL);
-    iclass_tc = num_CPUs();
-    pthread_t threads[iclass_tc];
-    iclass_thread_arg_t args[iclass_tc];
+    uint32_t next = 0;
+    pthread_t threads[tc];
+    iclass_thread_arg_t args[tc];
     // init thread arguments
-    for (size_t i = 0; i < iclass_tc; i++) {
-        args[i].thread_idx = i;
+    for (size_t i = 0; i < tc; i++) {
         args[i].use_raw = use_raw;
         args[i].use_elite = use_elite;
         args[i].keycnt = keycnt;
+        args[i].next = &next;
         args[i].keys = keys;
-        args[i].list.prekey = list;
+        args[i].list.premac = list;
 
         memcpy(args[i].csn, CSN, sizeof(args[i].csn));
         memcpy(args[i].cc_nr, CCNR, sizeof(args[i].cc_nr));
     }
 
-    for (size_t i = 0; i < iclass_tc; i++) {
-        int res = pthread_create(&threads[i], NULL, bf_generate_mackey, (void *)&args[i]);
+    size_t started = 0;
+    for (; started < tc; started++) {
+        int res = pthread_create(&threads[started], NULL, worker, (void *)&args[started]);
         if (res) {
             PrintAndLogEx(NORMAL, "");
             PrintAndLogEx(WARNING, "Failed to create pthreads. Quitting");
-            return;
+            break;
         }
     }
 
-    for (int i = 0; i < iclass_tc; i++)
+    // the threads already running will pick up the remaining work
+    for (size_t i = 0; i < started; i++)
         pthread_join(threads[i], NULL);
 
+    return started;
+}
+
+// precalc diversified keys and their MAC
+size_t GenerateMacFrom(uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys, uint32_t keycnt, iclass_premac_t *list) {
+    return iclass_run_generator(bf_generate_mac, CSN, CCNR, use_raw, use_elite, keys, keycnt, list);
+}
+
+size_t GenerateMacKeyFrom(uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys, uint32_t keycnt, iclass_prekey_t *list) {
+    return iclass_run_generator(bf_generate_mackey, CSN, CCNR, use_raw, use_elite, keys, keycnt, list);
 }
 
 // print diversified keys
@@ -5081,7 +5145,11 @@ static int CmdHelp(const char *Cmd) {
 
 int CmdHFiClass(const char *Cmd) {
     clearCommandBuffer();
-    return CmdsParse(CommandTable, Cmd);
+    // --threads only applies to the command it is given to
+    iclass_set_generator_threads(0);
+    int res = CmdsParse(CommandTable, Cmd);
+    iclass_set_generator_threads(0);
+    return res;
 }
 
 // static void test_credential_type(void) {
@@ -30,6 +30,8 @@
 #include "crapto1/crapto1.h"
 #include "protocols.h"
 #include "cmdhficlass.h"
+#include "mifare/mfkey.h"   // mfkey_nested_dict
+#include "util.h"           // num_CPUs
 
 enum MifareAuthSeq {
     masNone,
@@ -52,6 +54,44 @@ void ClearAuthData(void) {
     AuthData.ks3 = 0;
 }
 
+// keys recovered so far in the trace, per uid. Tried before the dictionary on the next nested authentication
+typedef struct {
+    uint32_t uid;
+    uint64_t key;
+} mf_trace_key_t;
+
+static mf_trace_key_t *gs_mf_keys = NULL;
+static uint32_t gs_mf_keys_count = 0;
+static uint32_t gs_mf_keys_size = 0;
+
+void ClearMfKeyCache(void) {
+    free(gs_mf_keys);
+    gs_mf_keys = NULL;
+    gs_mf_keys_count = 0;
+    gs_mf_keys_size = 0;
+}
+
+static void mf_key_cache_add(uint32_t uid, uint64_t key) {
+    for (uint32_t i = 0; i < gs_mf_keys_count; i++) {
+        if (gs_mf_keys[i].uid == uid && gs_mf_keys[i].key == key) {
+            return;
+        }
+    }
+
+    if (gs_mf_keys_count == gs_mf_keys_size) {
+        uint32_t nsize = gs_mf_keys_size ? gs_mf_keys_size * 2 : 16;
+        mf_trace_key_t *tmp = realloc(gs_mf_keys, nsize * sizeof(mf_trace_key_t));
+        if (tmp == NULL) {
+            return;
+        }
+        gs_mf_keys = tmp;
+        gs_mf_keys_size = nsize;
+    }
+    gs_mf_keys[gs_mf_keys_count].uid = uid;
+    gs_mf_keys[gs_mf_keys_count].key = key;
+    gs_mf_keys_count++;
+}
+
 
 static int gs_ntag_i2c_state = 0;
 static int gs_mfuc_state = 0;
@@ -2162,6 +2202,7 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
                           validate_prng_nonce(AuthData.nt) ? _GREEN_("WEAK") : _YELLOW_("HARD"));
 
             AuthData.first_auth = false;
+            mf_key_cache_add(AuthData.uid, mfLastKey);
 
             traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
         } else {
@@ -2178,9 +2219,22 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
                 };
             }
 
-            // check default keys
+            // check keys already recovered for this card
+            for (uint32_t i = 0; !traceCrypto1 && i < gs_mf_keys_count; i++) {
+                if (gs_mf_keys[i].uid != AuthData.uid || gs_mf_keys[i].key == mfLastKey) {
+                    continue;
+                }
+                if (NestedCheckKey(gs_mf_keys[i].key, &AuthData, cmd, cmdsize, parity)) {
+                    mfLastKey = gs_mf_keys[i].key;
+                    PrintAndLogEx(NORMAL, "            |            |  *  |%60s " _GREEN_("%012" PRIX64) "|     |", "known key", mfLastKey);
+                    traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
+                }
+            }
+
+            // check default keys, bitsliced search for the keystream, then the full check on the hit
             if (!traceCrypto1 && dicKeys != NULL && dicKeysCount > 0) {
-                for (int i = 0; i < dicKeysCount; i++) {
+                int32_t i = -1;
+                while ((i = mfkey_nested_dict(AuthData.uid, AuthData.nt_enc, AuthData.nr_enc, AuthData.ar_enc, dicKeys, dicKeysCount, i + 1, num_CPUs())) >= 0) {
                     if (NestedCheckKey(dicKeys[i], &AuthData, cmd, cmdsize, parity)) {
                         PrintAndLogEx(NORMAL, "            |            |  *  |%60s " _GREEN_("%012" PRIX64) "|     |", "key", dicKeys[i]);
 
@@ -2193,17 +2247,18 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
 
             // nested
             if (!traceCrypto1 && validate_prng_nonce(AuthData.nt)) {
+                // one set of recovery buffers for all nonce candidates
+                struct Crypto1Recovery *recovery = crypto1_recovery_create();
                 uint32_t ntx = prng_successor(AuthData.nt, 90);
-                for (int i = 0; i < 16383; i++) {
+                for (int i = 0; recovery && i < 16383; i++) {
                     ntx = prng_successor(ntx, 1);
                     if (NTParityChk(&AuthData, ntx)) {
 
                         uint32_t ks2 = AuthData.ar_enc ^ prng_successor(ntx, 64);
                         uint32_t ks3 = AuthData.at_enc ^ prng_successor(ntx, 96);
-                        struct Crypto1State *pcs = lfsr_recovery64(ks2, ks3);
+                        struct Crypto1State *pcs = lfsr_recovery64_r(recovery, ks2, ks3);
                         memcpy(mfData, cmd, cmdsize);
                         mf_crypto1_decrypt(pcs, mfData, cmdsize, 0);
-                        crypto1_destroy(pcs);
 
                         if (CheckCrypto1Parity(cmd, cmdsize, mfData, parity) && check_crc(CRC_14443_A, mfData, cmdsize)) {
                             AuthData.ks2 = ks2;
@@ -2220,6 +2275,11 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
                         }
                     }
                 }
+                crypto1_recovery_destroy(recovery);
+            }
+
+            if (traceCrypto1) {
+                mf_key_cache_add(AuthData.uid, mfLastKey);
             }
 
             //hardnested
@@ -2315,12 +2375,14 @@ bool NTParityChk(AuthData_t *ad, uint32_t ntx) {
 
 bool NestedCheckKey(uint64_t key, AuthData_t *ad, uint8_t *cmd, uint8_t cmdsize, uint8_t *parity) {
     uint8_t buf[32] = {0};
-    struct Crypto1State *pcs;
+    // called for every dictionary key,  keep the cipher state on the stack
+    struct Crypto1State state;
+    struct Crypto1State *pcs = &state;
 
     AuthData.ks2 = 0;
     AuthData.ks3 = 0;
 
-    pcs = crypto1_create(key);
+    crypto1_init(pcs, key);
     uint32_t nt1 = crypto1_word(pcs, ad->nt_enc ^ ad->uid, 1) ^ ad->nt_enc;
     uint32_t ar = prng_successor(nt1, 64);
     uint32_t at = prng_successor(nt1, 96);
@@ -2331,13 +2393,11 @@ bool NestedCheckKey(uint64_t key, AuthData_t *ad, uint8_t *cmd, uint8_t cmdsize,
     uint32_t at1 = crypto1_word(pcs, 0, 0) ^ ad->at_enc;
 
     if (!(ar == ar1 && at == at1 && NTParityChk(ad, nt1))) {
-        crypto1_destroy(pcs);
         return false;
     }
 
     memcpy(buf, cmd, cmdsize);
     mf_crypto1_decrypt(pcs, buf, cmdsize, 0);
-    crypto1_destroy(pcs);
 
     if (!CheckCrypto1Parity(cmd, cmdsize, buf, parity))
         return false;
@@ -37,6 +37,8 @@ typedef struct {
 } AuthData_t;
 
 void ClearAuthData(void);
+// forget the keys recovered from the previous trace
+void ClearMfKeyCache(void);
 
 uint8_t iso14443A_CRC_check(bool isResponse, uint8_t *d, uint8_t n);
 uint8_t iso14443B_CRC_check(uint8_t *d, uint8_t n);
@@ -27,7 +27,7 @@
 #include "cmdtrace.h"
 #include "mifare/mifaredefault.h"  // mifare default key array
 #include "cliparser.h"             // argtable
-#include "hardnested_bf_core.h"    // SetSIMDInstr
+#include "hardnested_bf_core.h"    // SetSIMDInstr, brute_force_set_checkpoint
 #include "mifare/mad.h"
 #include "nfc/ndef.h"
 #include "protocols.h"
@@ -44,6 +44,7 @@
 #include "preferences.h"
 #include "mifare/gen4.h"
 #include "generator.h"              // keygens.
+#include "mifare/mfkeytest.h"       // MfkeyTest
 
 static int CmdHelp(const char *Cmd);
 
@@ -620,6 +621,27 @@ static int mfc_read_tag(iso14a_card_select_t *card, uint8_t *carddata, uint8_t n
 
     uint8_t rights[40][4] = {0};
 
+    // first try of every read is pipelined,  retries are sent one by one
+    mf_readblock_t *first = calloc(MIFARE_4K_MAXBLOCK, sizeof(mf_readblock_t));
+    PacketResponseNG *first_resp = calloc(MIFARE_4K_MAXBLOCK, sizeof(PacketResponseNG));
+    bool first_received[MIFARE_4K_MAXBLOCK] = {false};
+    if (first == NULL || first_resp == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        free(first);
+        free(first_resp);
+        free(fptr);
+        free(keyA);
+        free(keyB);
+        return PM3_EMALLOC;
+    }
+
+    for (uint8_t sectorNo = 0; sectorNo < numSectors; sectorNo++) {
+        first[sectorNo].blockno = mfFirstBlockOfSector(sectorNo) + mfNumBlocksPerSector(sectorNo) - 1;
+        first[sectorNo].keytype = MF_KEY_A;
+        memcpy(first[sectorNo].key, keyA + (sectorNo * MIFARE_KEY_SIZE), MIFARE_KEY_SIZE);
+    }
+    SendCommandNGWindowed(CMD_HF_MIFARE_READBL, (uint8_t *)first, sizeof(mf_readblock_t), numSectors, first_resp, first_received, 1500);
+
     mf_readblock_t payload;
     uint8_t current_key;
     for (uint8_t sectorNo = 0; sectorNo < numSectors; sectorNo++) {
@@ -630,21 +652,30 @@ static int mfc_read_tag(iso14a_card_select_t *card, uint8_t *carddata, uint8_t n
 
             if (kbd_enter_pressed()) {
                 PrintAndLogEx(WARNING, "\naborted via keyboard!\n");
+                free(first);
+                free(first_resp);
                 free(fptr);
                 free(keyA);
                 free(keyB);
                 return PM3_EOPABORTED;
             }
 
-            payload.blockno = mfFirstBlockOfSector(sectorNo) + mfNumBlocksPerSector(sectorNo) - 1;
-            payload.keytype = current_key;
+            bool received;
+            if (tries == 0 && first_received[sectorNo]) {
+                memcpy(&resp, &first_resp[sectorNo], sizeof(PacketResponseNG));
+                received = true;
+            } else {
+                payload.blockno = mfFirstBlockOfSector(sectorNo) + mfNumBlocksPerSector(sectorNo) - 1;
+                payload.keytype = current_key;
 
-            memcpy(payload.key, (current_key == MF_KEY_A) ? keyA + (sectorNo * MIFARE_KEY_SIZE) : keyB + (sectorNo * MIFARE_KEY_SIZE), MIFARE_KEY_SIZE);
+                memcpy(payload.key, (current_key == MF_KEY_A) ? keyA + (sectorNo * MIFARE_KEY_SIZE) : keyB + (sectorNo * MIFARE_KEY_SIZE), MIFARE_KEY_SIZE);
 
-            clearCommandBuffer();
-            SendCommandNG(CMD_HF_MIFARE_READBL, (uint8_t *)&payload, sizeof(mf_readblock_t));
+                clearCommandBuffer();
+                SendCommandNG(CMD_HF_MIFARE_READBL, (uint8_t *)&payload, sizeof(mf_readblock_t));
+                received = WaitForResponseTimeout(CMD_HF_MIFARE_READBL, &resp, 1500);
+            }
 
-            if (WaitForResponseTimeout(CMD_HF_MIFARE_READBL, &resp, 1500)) {
+            if (received) {
 
                 uint8_t *data = resp.data.asBytes;
                 if (resp.status == PM3_SUCCESS) {
@@ -674,6 +705,28 @@ static int mfc_read_tag(iso14a_card_select_t *card, uint8_t *carddata, uint8_t n
     PrintAndLogEx(SUCCESS, "Finished reading sector access bits");
     PrintAndLogEx(INFO, "Dumping all blocks from card...");
 
+    // same keys as the first try below
+    uint16_t first_cnt = 0;
+    uint16_t first_idx[MIFARE_4K_MAXBLOCK] = {0};
+    for (uint8_t sectorNo = 0; sectorNo < numSectors; sectorNo++) {
+        for (uint8_t blockNo = 0; blockNo < mfNumBlocksPerSector(sectorNo); blockNo++) {
+            uint8_t data_area = (sectorNo < 32) ? blockNo : blockNo / 5;
+            if (rights[sectorNo][data_area] == 0x07) {
+                continue;
+            }
+
+            bool key_b = (mfIsSectorTrailerBasedOnBlocks(sectorNo, blockNo) == false)
+                         && ((rights[sectorNo][data_area] == 0x03) || (rights[sectorNo][data_area] == 0x05));
+
+            first_idx[mfFirstBlockOfSector(sectorNo) + blockNo] = first_cnt;
+            first[first_cnt].blockno = mfFirstBlockOfSector(sectorNo) + blockNo;
+            first[first_cnt].keytype = (key_b) ? MF_KEY_B : MF_KEY_A;
+            memcpy(first[first_cnt].key, (key_b) ? keyB + (sectorNo * MIFARE_KEY_SIZE) : keyA + (sectorNo * MIFARE_KEY_SIZE), MIFARE_KEY_SIZE);
+            first_cnt++;
+        }
+    }
+    SendCommandNGWindowed(CMD_HF_MIFARE_READBL, (uint8_t *)first, sizeof(mf_readblock_t), first_cnt, first_resp, first_received, 1500);
+
     for (uint8_t sectorNo = 0; sectorNo < numSectors; sectorNo++) {
         for (uint8_t blockNo = 0; blockNo < mfNumBlocksPerSector(sectorNo); blockNo++) {
             bool received = false;
@@ -684,9 +737,14 @@ static int mfc_read_tag(iso14a_card_select_t *card, uint8_t *carddata, uint8_t n
                 continue;
             }
 
+            uint16_t fi = first_idx[mfFirstBlockOfSector(sectorNo) + blockNo];
+
             for (uint8_t tries = 0; tries < MIFARE_SECTOR_RETRY; tries++) {
 
-                if (mfIsSectorTrailerBasedOnBlocks(sectorNo, blockNo)) {
+                if (tries == 0 && first_received[fi]) {
+                    memcpy(&resp, &first_resp[fi], sizeof(PacketResponseNG));
+                    received = true;
+                } else if (mfIsSectorTrailerBasedOnBlocks(sectorNo, blockNo)) {
 
                     // sector trailer. At least the Access Conditions can always be read with key A.
                     payload.blockno = mfFirstBlockOfSector(sectorNo) + blockNo;
@@ -757,6 +815,8 @@ static int mfc_read_tag(iso14a_card_select_t *card, uint8_t *carddata, uint8_t n
         }
     }
 
+    free(first);
+    free(first_resp);
     free(fptr);
     free(keyA);
     free(keyB);
@@ -2249,7 +2309,9 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
                   "hf mf hardnested -r\n"
                   "hf mf hardnested -r --tk a0a1a2a3a4a5\n"
                   "hf mf hardnested -t --tk a0a1a2a3a4a5\n"
+                  "hf mf hardnested -t --tk a0a1a2a3a4a5 -w -f sim_nonces.bin   --> replay with -r -f sim_nonces.bin\n"
                   "hf mf hardnested --blk 0 -a -k a0a1a2a3a4a5 --tblk 4 --ta --tk FFFFFFFFFFFF\n"
+                  "hf mf hardnested -r --threads 4 --checkpoint hardnested_bf.chk   --> press <Enter> to pause, same command to resume\n"
                  );
 
     void *argtable[] = {
@@ -2266,8 +2328,10 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
         arg_str0("f",  "file",  "<fn>",  "R/W <name> instead of default name"),
         arg_lit0("r",  "read",           "Read `hf-mf-<UID>-nonces.bin` if tag present, otherwise `nonces.bin`, and start attack"),
         arg_lit0("s",  "slow",           "Slower acquisition (required by some non standard cards)"),
-        arg_lit0("t",  "tests",          "Run tests"),
+        arg_lit0("t",  "tests",          "Run tests (starts with a benchmark of all SIMD cores)"),
         arg_lit0("w",  "wr",             "Acquire nonces and UID, and write them to file `hf-mf-<UID>-nonces.bin`"),
+        arg_int0(NULL, "threads", "<dec>", "Number of threads, 1..256 (def: one per CPU)"),
+        arg_str0(NULL, "checkpoint", "<fn>", "Save brute force progress to <fn>, resume from it if it exists"),
 
         arg_lit0(NULL, "in", "None (use CPU regular instruction set)"),
 #if defined(COMPILER_HAS_SIMD_X86)
@@ -2329,21 +2393,33 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
     bool tests = arg_get_lit(ctx, 13);
     bool nonce_file_write = arg_get_lit(ctx, 14);
 
-    bool in = arg_get_lit(ctx, 15);
+    bool threads_set = arg_get_int_count(ctx, 15);
+    int num_threads = arg_get_int_def(ctx, 15, 0);
+
+    int cpfnlen = 0;
+    char checkpoint_fn[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 16), (uint8_t *)checkpoint_fn, FILE_PATH_SIZE, &cpfnlen);
+
+    bool in = arg_get_lit(ctx, 17);
 #if defined(COMPILER_HAS_SIMD_X86)
-    bool im = arg_get_lit(ctx, 16);
-    bool is = arg_get_lit(ctx, 17);
-    bool ia = arg_get_lit(ctx, 18);
-    bool i2 = arg_get_lit(ctx, 19);
+    bool im = arg_get_lit(ctx, 18);
+    bool is = arg_get_lit(ctx, 19);
+    bool ia = arg_get_lit(ctx, 20);
+    bool i2 = arg_get_lit(ctx, 21);
 #endif
 #if defined(COMPILER_HAS_SIMD_AVX512)
-    bool i5 = arg_get_lit(ctx, 20);
+    bool i5 = arg_get_lit(ctx, 22);
 #endif
 #if defined(COMPILER_HAS_SIMD_NEON)
-    bool ie = arg_get_lit(ctx, 16);
+    bool ie = arg_get_lit(ctx, 18);
 #endif
     CLIParserFree(ctx);
 
+    if (threads_set && (num_threads < 1 || num_threads > HARDNESTED_MAX_THREADS)) {
+        PrintAndLogEx(WARNING, "Number of threads must be between 1 and %u", HARDNESTED_MAX_THREADS);
+        return PM3_EINVARG;
+    }
+
     // set SIM instructions
     SetSIMDInstr(SIMD_AUTO);
 
@@ -2374,7 +2450,7 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
 
     bool known_target_key = (trg_keylen);
 
-    if (nonce_file_read) {
+    if (nonce_file_read && fnlen == 0) {
         char *fptr = GenerateFilename("hf-mf-", "-nonces.bin");
         if (fptr == NULL)
             strncpy(filename, "nonces.bin", FILE_PATH_SIZE - 1);
@@ -2383,7 +2459,7 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
         free(fptr);
     }
 
-    if (nonce_file_write) {
+    if (nonce_file_write && fnlen == 0) {
         char *fptr = GenerateFilename("hf-mf-", "-nonces.bin");
         if (fptr == NULL) {
             return PM3_EFILE;
@@ -2437,8 +2513,14 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
                   slow ? "Yes" : "No",
                   tests);
 
+    hardnested_set_num_threads(num_threads);
+    brute_force_set_checkpoint(cpfnlen ? checkpoint_fn : NULL);
+
     uint64_t foundkey = 0;
     int16_t isOK = mfnestedhard(blockno, keytype, key, trg_blockno, trg_keytype, known_target_key ? trg_key : NULL, nonce_file_read, nonce_file_write, slow, tests, &foundkey, filename);
+
+    hardnested_set_num_threads(0);
+    brute_force_set_checkpoint(NULL);
     switch (isOK) {
         case PM3_ETIMEOUT :
             PrintAndLogEx(ERR, "Error: No response from Proxmark3\n");
@@ -7029,6 +7111,22 @@ static int CmdHF14AMfList(const char *Cmd) {
     return CmdTraceListAlias(Cmd, "hf mf", "mf -c");
 }
 
+static int CmdHF14AMfTest(const char *Cmd) {
+    CLIParserContext *ctx;
+    CLIParserInit(&ctx, "hf mf test",
+                  "Regression crypto tests",
+                  "hf mf test");
+
+    void *argtable[] = {
+        arg_param_begin,
+        arg_param_end
+    };
+    CLIExecWithReturn(ctx, Cmd, argtable, true);
+    CLIParserFree(ctx);
+    MfkeyTest(true);
+    return PM3_SUCCESS;
+}
+
 static int CmdHf14AGen3UID(const char *Cmd) {
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "hf mf gen3uid",
@@ -7138,6 +7236,12 @@ static int CmdHf14AGen3Freeze(const char *Cmd) {
 
 #define FURUI_MAX_TRACES    8
 static int mfc_furui_recovery(uint8_t items, uint8_t tracedata[FURUI_MAX_TRACES][18]) {
+    struct Crypto1Recovery *recovery = crypto1_recovery_create();
+    if (recovery == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+
     // recover key from collected traces
     // outer loop
     for (uint8_t i = 0; i < items; i++) {
@@ -7169,7 +7273,7 @@ static int mfc_furui_recovery(uint8_t items, uint8_t tracedata[FURUI_MAX_TRACES]
                 data.state = FIRST;
 
                 uint64_t key64 = -1;
-                if (mfkey32_moebius(&data, &key64)) {
+                if (mfkey32_moebius_r(recovery, &data, &key64)) {
                     PrintAndLogEx(SUCCESS, "UID: %s Sector %02x key %c [ "_GREEN_("%012" PRIX64) " ]",
                                   sprint_hex_inrow(tracedata[i], 4),
                                   data.sector,
@@ -7181,10 +7285,17 @@ static int mfc_furui_recovery(uint8_t items, uint8_t tracedata[FURUI_MAX_TRACES]
             }
         }
     }
+    crypto1_recovery_destroy(recovery);
     return PM3_SUCCESS;
 }
 
 static int mfc_supercard_gen2_recovery(uint8_t items, uint8_t tracedata[FURUI_MAX_TRACES][18]) {
+    struct Crypto1Recovery *recovery = crypto1_recovery_create();
+    if (recovery == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+
     for (uint8_t i = 0; i < items; i++) {
         uint8_t *tmp = tracedata[i];
 
@@ -7217,7 +7328,7 @@ static int mfc_supercard_gen2_recovery(uint8_t items, uint8_t tracedata[FURUI_MA
                 data.state = FIRST;
 
                 uint64_t key64 = -1;
-                if (mfkey32_moebius(&data, &key64)) {
+                if (mfkey32_moebius_r(recovery, &data, &key64)) {
                     PrintAndLogEx(SUCCESS, "UID: %s Sector %02x key %c [ "_GREEN_("%012" PRIX64) " ]",
                                   sprint_hex_inrow(tmp, 4),
                                   data.sector,
@@ -7229,6 +7340,7 @@ static int mfc_supercard_gen2_recovery(uint8_t items, uint8_t tracedata[FURUI_MA
             }
         }
     }
+    crypto1_recovery_destroy(recovery);
     return PM3_SUCCESS;
 }
 
@@ -9839,6 +9951,7 @@ static int CmdHF14AMfISEN(const char *Cmd) {
 static command_t CommandTable[] = {
     {"help",        CmdHelp,                AlwaysAvailable, "This help"},
     {"list",        CmdHF14AMfList,         AlwaysAvailable, "List MIFARE history"},
+    {"test",        CmdHF14AMfTest,         AlwaysAvailable, "Regression crypto tests"},
     {"-----------", CmdHelp,                IfPm3Iso14443a,  "----------------------- " _CYAN_("recovery") " -----------------------"},
     {"info",        CmdHF14AMfInfo,         IfPm3Iso14443a,  "mfc card Info"},
     {"isen",        CmdHF14AMfISEN,         IfPm3Iso14443a,  "mfc card Info Static Encrypted Nonces"},
@@ -30,6 +30,12 @@
 #include <locale.h>
 #include <math.h>
 #include <time.h> // MingW
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include <lz4frame.h>
 #include <bzlib.h>
 
@@ -45,8 +51,8 @@
 #include "hardnested_bitarray_core.h"
 #include "fileutils.h"
 
-#define NUM_CHECK_BITFLIPS_THREADS      (num_CPUs())
-#define NUM_REDUCTION_WORKING_THREADS   (num_CPUs())
+#define NUM_CHECK_BITFLIPS_THREADS      (hardnested_num_threads())
+#define NUM_REDUCTION_WORKING_THREADS   (hardnested_num_threads())
 
 // ignore bitflip arrays which have nearly only valid states
 #define IGNORE_BITFLIP_THRESHOLD        0.9901
@@ -55,6 +61,16 @@
 #define STATE_FILE_TEMPLATE_RAW         "bitflip_%d_%03" PRIx16 "_states.bin"
 #define STATE_FILE_TEMPLATE_LZ4         "bitflip_%d_%03" PRIx16 "_states.bin.lz4"
 #define STATE_FILE_TEMPLATE_BZ2         "bitflip_%d_%03" PRIx16 "_states.bin.bz2"
+#define STATE_FILE_NAME_LEN             40
+
+// all precalculated bitarrays in one file in the user directory, mapped instead of loaded on later runs
+#define STATE_CACHE_SUBDIR              "cache" PATHSEP
+#define STATE_CACHE_FILE                "hardnested_tables.bin"
+#define STATE_CACHE_MAGIC               "PM3HNTBL"
+#define STATE_CACHE_VERSION             1
+// bitarrays start at multiples of 64kB, a multiple of all common page sizes
+#define STATE_CACHE_ALIGN               0x10000
+#define STATE_BITARRAY_SIZE             (sizeof(uint32_t) * (1 << 19))
 
 #define DEBUG_KEY_ELIMINATION
 // #define DEBUG_REDUCTION
@@ -121,11 +137,21 @@ static void get_SIMD_instruction_set(char *instruction_set) {
     }
 }
 
+static uint32_t num_threads_setting = 0;  // 0 = one per CPU
+
+void hardnested_set_num_threads(uint32_t num_threads) {
+    num_threads_setting = num_threads;
+}
+
+uint32_t hardnested_num_threads(void) {
+    return (num_threads_setting) ? num_threads_setting : num_CPUs();
+}
+
 static void print_progress_header(void) {
     char progress_text[80];
     char instr_set[12] = "";
     get_SIMD_instruction_set(instr_set);
-    snprintf(progress_text, sizeof(progress_text), "Start using " _YELLOW_("%d") " threads and " _YELLOW_("%s") " SIMD core", num_CPUs(), instr_set);
+    snprintf(progress_text, sizeof(progress_text), "Start using " _YELLOW_("%u") " threads and " _YELLOW_("%s") " SIMD core", hardnested_num_threads(), instr_set);
 
     PrintAndLogEx(INFO, "Hardnested attack starting...");
     PrintAndLogEx(INFO, "---------+---------+---------------------------------------------------------+-----------------+-------");
@@ -174,50 +200,6 @@ static inline uint32_t test_bit24(const uint32_t *bitarray, uint32_t index) {
     return bitarray[index >> 5] & (0x80000000 >> (index & 0x0000001f));
 }
 
-static inline uint32_t next_state(uint32_t *bitarray, uint32_t state) {
-    if (++state == (1 << 24)) {
-        return (1 << 24);
-    }
-
-    uint32_t index = state >> 5;
-    uint_fast8_t bit = state & 0x1F;
-    uint32_t line = bitarray[index] << bit;
-
-    while (bit <= 0x1F) {
-        if (line & 0x80000000) {
-            return state;
-        }
-        state++;
-        bit++;
-        line <<= 1;
-    }
-    index++;
-    while (state < (1 << 24) && bitarray[index] == 0x00000000) {
-        index++;
-        state += 0x20;
-    }
-
-    if (state >= (1 << 24)) {
-        return (1 << 24);
-    }
-#if defined __GNUC__
-    return state + __builtin_clz(bitarray[index]);
-#else
-    bit = 0x00;
-    line = bitarray[index];
-    while (bit <= 0x1F) {
-        if (line & 0x80000000) {
-            return state;
-        }
-        state++;
-        bit++;
-        line <<= 1;
-    }
-    return (1 << 24);
-#endif
-}
-
-
 #define BITFLIP_2ND_BYTE 0x0200
 
 
@@ -254,48 +236,66 @@ static void init_bunzip2(bz_stream *compressed_stream, char *input_buffer, uint3
 
 }
 
+typedef enum {
+    STATE_FILE_NONE,
+    STATE_FILE_RAW,
+    STATE_FILE_LZ4,
+    STATE_FILE_BZ2
+} state_file_format_t;
+
+// locates the bitflip table file,  the uncompressed one first
+static state_file_format_t search_state_file(char **path, odd_even_t odd_even, uint16_t bitflip, char *state_file_name) {
+    const char *templates[] = {STATE_FILE_TEMPLATE_RAW, STATE_FILE_TEMPLATE_LZ4, STATE_FILE_TEMPLATE_BZ2};
+    const state_file_format_t formats[] = {STATE_FILE_RAW, STATE_FILE_LZ4, STATE_FILE_BZ2};
+    char state_files_path[strlen(STATE_FILES_DIRECTORY) + STATE_FILE_NAME_LEN];
+
+    for (uint8_t i = 0; i < ARRAYLEN(templates); i++) {
+        snprintf(state_file_name, STATE_FILE_NAME_LEN, templates[i], odd_even, bitflip);
+        snprintf(state_files_path, sizeof(state_files_path), "%s%s", STATE_FILES_DIRECTORY, state_file_name);
+        if (searchFile(path, RESOURCES_SUBDIR, state_files_path, "", true) == PM3_SUCCESS) {
+            return formats[i];
+        }
+    }
+    return STATE_FILE_NONE;
+}
+
+static bool map_state_cache(void);
+static void save_state_cache(void);
+static void unmap_state_cache_bitflips(void);
+static void unmap_state_cache_sums(void);
+static bool state_cache_bitflips_mapped = false;
+static bool state_cache_sums_mapped = false;
+
 static void init_bitflip_bitarrays(void) {
 #if defined (DEBUG_REDUCTION)
     uint8_t line = 0;
 #endif
     uint64_t init_bitflip_bitarrays_starttime = msclock();
 
-    char state_file_name[MAX(strlen(STATE_FILE_TEMPLATE_RAW), MAX(strlen(STATE_FILE_TEMPLATE_LZ4), strlen(STATE_FILE_TEMPLATE_BZ2))) + 1];
-    char state_files_path[strlen(get_my_executable_directory()) + strlen(STATE_FILES_DIRECTORY) + sizeof(state_file_name)];
+    if (map_state_cache()) {
+        char progress_text[80];
+        snprintf(progress_text, sizeof(progress_text), "Mapped precalculated tables cache in %"PRIu64" ms", msclock() - init_bitflip_bitarrays_starttime);
+        hardnested_print_progress(0, progress_text, (float)(1LL << 47), 0);
+        goto sort_effective_bitflips;
+    }
+
+    char state_file_name[STATE_FILE_NAME_LEN];
     uint16_t nraw = 0, nlz4 = 0, nbz2 = 0;
     for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
         num_effective_bitflips[odd_even] = 0;
         for (uint16_t bitflip = 0x001; bitflip < 0x400; bitflip++) {
-            bool open_uncompressed = false;
-            bool open_lz4compressed = false;
-            bool open_bz2compressed = false;
 
             bitflip_bitarrays[odd_even][bitflip] = NULL;
             count_bitflip_bitarrays[odd_even][bitflip] = 1 << 24;
 
             char *path;
-            snprintf(state_file_name, sizeof(state_file_name), STATE_FILE_TEMPLATE_RAW, odd_even, bitflip);
-            strncpy(state_files_path, STATE_FILES_DIRECTORY, sizeof(state_files_path) - 1);
-            strncat(state_files_path, state_file_name, sizeof(state_files_path) - (strlen(STATE_FILES_DIRECTORY) + 1));
-            if (searchFile(&path, RESOURCES_SUBDIR, state_files_path, "", true) == PM3_SUCCESS) {
-                open_uncompressed = true;
-            } else {
-                snprintf(state_file_name, sizeof(state_file_name), STATE_FILE_TEMPLATE_LZ4, odd_even, bitflip);
-                strncpy(state_files_path, STATE_FILES_DIRECTORY, sizeof(state_files_path) - 1);
-                strncat(state_files_path, state_file_name, sizeof(state_files_path) - (strlen(STATE_FILES_DIRECTORY) + 1));
-                if (searchFile(&path, RESOURCES_SUBDIR, state_files_path, "", true) == PM3_SUCCESS) {
-                    open_lz4compressed = true;
-                } else {
-                    snprintf(state_file_name, sizeof(state_file_name), STATE_FILE_TEMPLATE_BZ2, odd_even, bitflip);
-                    strncpy(state_files_path, STATE_FILES_DIRECTORY, sizeof(state_files_path) - 1);
-                    strncat(state_files_path, state_file_name, sizeof(state_files_path) - (strlen(STATE_FILES_DIRECTORY) + 1));
-                    if (searchFile(&path, RESOURCES_SUBDIR, state_files_path, "", true) == PM3_SUCCESS) {
-                        open_bz2compressed = true;
-                    } else {
-                        continue;
-                    }
-                }
+            state_file_format_t format = search_state_file(&path, odd_even, bitflip, state_file_name);
+            if (format == STATE_FILE_NONE) {
+                continue;
             }
+            bool open_uncompressed = (format == STATE_FILE_RAW);
+            bool open_lz4compressed = (format == STATE_FILE_LZ4);
+            bool open_bz2compressed = (format == STATE_FILE_BZ2);
 
             FILE *statesfile = fopen(path, "rb");
             free(path);
@@ -490,6 +490,9 @@ static void init_bitflip_bitarrays(void) {
         snprintf(progress_text, sizeof(progress_text), "Loaded %u RAW / %u LZ4 / %u BZ2 in %"PRIu64" ms", nraw, nlz4, nbz2, msclock() - init_bitflip_bitarrays_starttime);
         hardnested_print_progress(0, progress_text, (float)(1LL << 47), 0);
     }
+
+sort_effective_bitflips:
+    ;
     uint16_t i = 0;
     uint16_t j = 0;
     num_all_effective_bitflips = 0;
@@ -532,6 +535,10 @@ static void init_bitflip_bitarrays(void) {
 }
 
 static void free_bitflip_bitarrays(void) {
+    if (state_cache_bitflips_mapped) {
+        unmap_state_cache_bitflips();
+        return;
+    }
     for (int16_t bitflip = 0x3ff; bitflip > 0x000; bitflip--) {
         free_bitarray(bitflip_bitarrays[ODD_STATE][bitflip]);
     }
@@ -571,6 +578,10 @@ static uint16_t PartialSumProperty(uint32_t state, odd_even_t odd_even) {
 }
 
 static void init_part_sum_bitarrays(void) {
+    // already mapped together with the bitflip bitarrays
+    if (state_cache_sums_mapped) {
+        return;
+    }
     for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
         for (uint16_t part_sum_a0 = 0; part_sum_a0 < NUM_PART_SUMS; part_sum_a0++) {
             part_sum_a0_bitarrays[odd_even][part_sum_a0] = (uint32_t *)malloc_bitarray(sizeof(uint32_t) * (1 << 19));
@@ -613,6 +624,10 @@ static void init_part_sum_bitarrays(void) {
 }
 
 static void free_part_sum_bitarrays(void) {
+    if (state_cache_sums_mapped) {
+        unmap_state_cache_sums();
+        return;
+    }
     for (int16_t part_sum_a8 = (NUM_PART_SUMS - 1); part_sum_a8 >= 0; part_sum_a8--) {
         free_bitarray(part_sum_a8_bitarrays[ODD_STATE][part_sum_a8]);
     }
@@ -628,6 +643,9 @@ static void free_part_sum_bitarrays(void) {
 }
 
 static void init_sum_bitarrays(void) {
+    if (state_cache_sums_mapped) {
+        return;
+    }
     for (uint16_t sum_a0 = 0; sum_a0 < NUM_SUMS; sum_a0++) {
         for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
             sum_a0_bitarrays[odd_even][sum_a0] = (uint32_t *)malloc_bitarray(sizeof(uint32_t) * (1 << 19));
@@ -648,15 +666,312 @@ static void init_sum_bitarrays(void) {
         }
     }
 
+    // all bitarrays are complete now,  keep them for the next run
+    save_state_cache();
 }
 
 static void free_sum_bitarrays(void) {
+    // unmapped together with the part sum bitarrays
+    if (state_cache_sums_mapped) {
+        return;
+    }
     for (int8_t sum_a0 = NUM_SUMS - 1; sum_a0 >= 0; sum_a0--) {
         free_bitarray(sum_a0_bitarrays[ODD_STATE][sum_a0]);
         free_bitarray(sum_a0_bitarrays[EVEN_STATE][sum_a0]);
     }
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// precalculated tables cache
+//
+// Decompressing the bitflip files and building the sum bitarrays takes seconds on every run. The first run
+// writes all of them into one file,  later runs only map it and concurrent runs share the physical pages.
+// File layout, every part starts at a multiple of STATE_CACHE_ALIGN:
+//   header                     count and slot of each bitflip bitarray
+//   bitflip bitarrays          num_bitflip_slots bitarrays,  mapped shared and read only
+//   part sum / sum bitarrays   part_sum_a0[2][NUM_PART_SUMS], part_sum_a8[2][NUM_PART_SUMS], sum_a0[2][NUM_SUMS],
+//                              mapped copy-on-write as update_sum_bitarrays() narrows the part sums down in place
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t bitarray_size;
+    float ignore_threshold;
+    uint32_t num_bitflip_slots;
+    int64_t tables_mtime;           // modification time of the hardnested_tables directory
+    uint32_t count[2][0x400];
+    uint16_t slot[2][0x400];        // 1-based slot of the bitflip bitarray,  0 = ignored or missing
+} PACKED state_cache_header_t;
+
+#define STATE_CACHE_NUM_SUM_BITARRAYS   (2 * (2 * NUM_PART_SUMS + NUM_SUMS))
+
+#ifndef _WIN32
+
+static uint8_t *state_cache_bitflips = NULL;
+static size_t state_cache_bitflips_len = 0;
+static uint8_t *state_cache_sums = NULL;
+static size_t state_cache_sums_len = 0;
+
+static size_t state_cache_align(size_t n) {
+    return (n + STATE_CACHE_ALIGN - 1) & ~((size_t)STATE_CACHE_ALIGN - 1);
+}
+
+// the cache is stale when the tables directory changed
+static int64_t state_tables_mtime(void) {
+    char *path;
+    char state_file_name[STATE_FILE_NAME_LEN];
+    if (search_state_file(&path, EVEN_STATE, 0x001, state_file_name) == STATE_FILE_NONE) {
+        return -1;
+    }
+
+    char *sep = strrchr(path, '/');
+    if (sep != NULL) {
+        *sep = '\0';
+    }
+
+    struct stat st;
+    int64_t mtime = (stat(sep ? path : ".", &st) == 0) ? (int64_t)st.st_mtime : -1;
+    free(path);
+    return mtime;
+}
+
+// points the bitarray tables into the two mappings
+static void assign_state_cache(const state_cache_header_t *header) {
+
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+        num_effective_bitflips[odd_even] = 0;
+        for (uint16_t bitflip = 0x001; bitflip < 0x400; bitflip++) {
+            uint16_t slot = header->slot[odd_even][bitflip];
+            count_bitflip_bitarrays[odd_even][bitflip] = header->count[odd_even][bitflip];
+            bitflip_bitarrays[odd_even][bitflip] = NULL;
+            if (slot) {
+                bitflip_bitarrays[odd_even][bitflip] = (uint32_t *)(state_cache_bitflips + (slot - 1) * STATE_BITARRAY_SIZE);
+                effective_bitflip[odd_even][num_effective_bitflips[odd_even]++] = bitflip;
+            }
+        }
+        effective_bitflip[odd_even][num_effective_bitflips[odd_even]] = 0x400; // EndOfList marker
+    }
+
+    uint32_t *bitarray = (uint32_t *)state_cache_sums;
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+        for (uint16_t part_sum = 0; part_sum < NUM_PART_SUMS; part_sum++) {
+            part_sum_a0_bitarrays[odd_even][part_sum] = bitarray;
+            bitarray += STATE_BITARRAY_SIZE / sizeof(uint32_t);
+        }
+        for (uint16_t part_sum = 0; part_sum < NUM_PART_SUMS; part_sum++) {
+            part_sum_a8_bitarrays[odd_even][part_sum] = bitarray;
+            bitarray += STATE_BITARRAY_SIZE / sizeof(uint32_t);
+        }
+        for (uint16_t sum = 0; sum < NUM_SUMS; sum++) {
+            sum_a0_bitarrays[odd_even][sum] = bitarray;
+            bitarray += STATE_BITARRAY_SIZE / sizeof(uint32_t);
+        }
+    }
+}
+
+static bool map_state_cache(void) {
+
+    int64_t mtime = state_tables_mtime();
+    if (mtime < 0) {
+        return false;
+    }
+
+    char *path;
+    if (searchHomeFilePath(&path, STATE_CACHE_SUBDIR, STATE_CACHE_FILE, false) != PM3_SUCCESS) {
+        return false;
+    }
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) {
+        return false;
+    }
+
+    state_cache_header_t header;
+    struct stat st;
+    bool ok = (pread(fd, &header, sizeof(header), 0) == sizeof(header))
+              && (memcmp(header.magic, STATE_CACHE_MAGIC, sizeof(header.magic)) == 0)
+              && (header.version == STATE_CACHE_VERSION)
+              && (header.bitarray_size == STATE_BITARRAY_SIZE)
+              && (header.ignore_threshold == (float)IGNORE_BITFLIP_THRESHOLD)
+              && (header.tables_mtime == mtime)
+              && (header.num_bitflip_slots > 0)
+              && (header.num_bitflip_slots <= 2 * 0x3ff)
+              && (fstat(fd, &st) == 0);
+
+    size_t header_len = state_cache_align(sizeof(header));
+    size_t bitflips_len = (size_t)header.num_bitflip_slots * STATE_BITARRAY_SIZE;
+    size_t sums_len = STATE_CACHE_NUM_SUM_BITARRAYS * STATE_BITARRAY_SIZE;
+    ok = ok && ((uint64_t)st.st_size == header_len + bitflips_len + sums_len);
+
+    for (odd_even_t odd_even = EVEN_STATE; ok && odd_even <= ODD_STATE; odd_even++) {
+        for (uint16_t bitflip = 0x001; bitflip < 0x400; bitflip++) {
+            ok &= (header.slot[odd_even][bitflip] <= header.num_bitflip_slots);
+        }
+    }
+
+    if (ok) {
+        state_cache_bitflips = mmap(NULL, bitflips_len, PROT_READ, MAP_SHARED, fd, header_len);
+        state_cache_sums = mmap(NULL, sums_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, header_len + bitflips_len);
+        ok = (state_cache_bitflips != MAP_FAILED) && (state_cache_sums != MAP_FAILED);
+        if (ok == false) {
+            PrintAndLogEx(WARNING, "Could not map the precalculated tables cache, loading the tables instead");
+            if (state_cache_bitflips != MAP_FAILED) {
+                munmap(state_cache_bitflips, bitflips_len);
+            }
+            if (state_cache_sums != MAP_FAILED) {
+                munmap(state_cache_sums, sums_len);
+            }
+        }
+    }
+    close(fd);
+
+    if (ok == false) {
+        state_cache_bitflips = NULL;
+        state_cache_sums = NULL;
+        return false;
+    }
+
+    state_cache_bitflips_len = bitflips_len;
+    state_cache_sums_len = sums_len;
+    state_cache_bitflips_mapped = true;
+    state_cache_sums_mapped = true;
+    assign_state_cache(&header);
+    return true;
+}
+
+static void unmap_state_cache_bitflips(void) {
+    munmap(state_cache_bitflips, state_cache_bitflips_len);
+    state_cache_bitflips = NULL;
+    state_cache_bitflips_mapped = false;
+    memset(bitflip_bitarrays, 0, sizeof(bitflip_bitarrays));
+}
+
+static void unmap_state_cache_sums(void) {
+    munmap(state_cache_sums, state_cache_sums_len);
+    state_cache_sums = NULL;
+    state_cache_sums_mapped = false;
+    memset(part_sum_a0_bitarrays, 0, sizeof(part_sum_a0_bitarrays));
+    memset(part_sum_a8_bitarrays, 0, sizeof(part_sum_a8_bitarrays));
+    memset(sum_a0_bitarrays, 0, sizeof(sum_a0_bitarrays));
+}
+
+// writes one bitarray,  all zero pages are skipped and left as holes of the sparse file
+static bool write_state_bitarray(FILE *f, const uint32_t *bitarray) {
+    static const uint8_t zeros[0x1000] = {0};
+    const uint8_t *p = (const uint8_t *)bitarray;
+    for (size_t i = 0; i < STATE_BITARRAY_SIZE; i += sizeof(zeros)) {
+        if (memcmp(p + i, zeros, sizeof(zeros)) == 0) {
+            if (fseeko(f, sizeof(zeros), SEEK_CUR) != 0) {
+                return false;
+            }
+        } else if (fwrite(p + i, 1, sizeof(zeros), f) != sizeof(zeros)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void save_state_cache(void) {
+
+    int64_t mtime = state_tables_mtime();
+    if (mtime < 0) {
+        return;
+    }
+
+    state_cache_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STATE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = STATE_CACHE_VERSION;
+    header.bitarray_size = STATE_BITARRAY_SIZE;
+    header.ignore_threshold = IGNORE_BITFLIP_THRESHOLD;
+    header.tables_mtime = mtime;
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+        for (uint16_t bitflip = 0x001; bitflip < 0x400; bitflip++) {
+            header.count[odd_even][bitflip] = count_bitflip_bitarrays[odd_even][bitflip];
+            if (bitflip_bitarrays[odd_even][bitflip] != NULL) {
+                header.slot[odd_even][bitflip] = ++header.num_bitflip_slots;
+            }
+        }
+    }
+    if (header.num_bitflip_slots == 0) {
+        return;
+    }
+
+    char *path;
+    if (searchHomeFilePath(&path, STATE_CACHE_SUBDIR, STATE_CACHE_FILE, true) != PM3_SUCCESS) {
+        return;
+    }
+
+    // written under a temporary name,  concurrent runs only ever see a complete cache
+    size_t tmplen = strlen(path) + 16;
+    char *tmppath = calloc(tmplen, sizeof(char));
+    if (tmppath == NULL) {
+        free(path);
+        return;
+    }
+    snprintf(tmppath, tmplen, "%s.%d", path, (int)getpid());
+
+    uint64_t save_start = msclock();
+    FILE *f = fopen(tmppath, "wb");
+    bool ok = (f != NULL);
+    ok = ok && (fwrite(&header, 1, sizeof(header), f) == sizeof(header));
+    ok = ok && (fseeko(f, state_cache_align(sizeof(header)), SEEK_SET) == 0);
+
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+        for (uint16_t bitflip = 0x001; ok && bitflip < 0x400; bitflip++) {
+            if (header.slot[odd_even][bitflip]) {
+                ok = write_state_bitarray(f, bitflip_bitarrays[odd_even][bitflip]);
+            }
+        }
+    }
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+        for (uint16_t part_sum = 0; ok && part_sum < NUM_PART_SUMS; part_sum++) {
+            ok = write_state_bitarray(f, part_sum_a0_bitarrays[odd_even][part_sum]);
+        }
+        for (uint16_t part_sum = 0; ok && part_sum < NUM_PART_SUMS; part_sum++) {
+            ok = write_state_bitarray(f, part_sum_a8_bitarrays[odd_even][part_sum]);
+        }
+        for (uint16_t sum = 0; ok && sum < NUM_SUMS; sum++) {
+            ok = write_state_bitarray(f, sum_a0_bitarrays[odd_even][sum]);
+        }
+    }
+
+    if (f != NULL) {
+        // a trailing hole doesn't extend the file by itself
+        ok = ok && (fflush(f) == 0) && (ftruncate(fileno(f), ftello(f)) == 0);
+        ok = (fclose(f) == 0) && ok;
+    }
+    ok = ok && (rename(tmppath, path) == 0);
+
+    if (ok) {
+        char progress_text[80];
+        snprintf(progress_text, sizeof(progress_text), "Saved precalculated tables cache in %"PRIu64" ms", msclock() - save_start);
+        hardnested_print_progress(0, progress_text, (float)(1LL << 47), 0);
+    } else {
+        PrintAndLogEx(WARNING, "Could not save the precalculated tables cache to " _YELLOW_("%s"), path);
+        remove(tmppath);
+    }
+    free(tmppath);
+    free(path);
+}
+
+#else // _WIN32 has no mmap,  always load the tables
+
+static bool map_state_cache(void) {
+    return false;
+}
+
+static void save_state_cache(void) {
+}
+
+static void unmap_state_cache_bitflips(void) {
+}
+
+static void unmap_state_cache_sums(void) {
+}
+
+#endif
+
 #ifdef DEBUG_KEY_ELIMINATION
 static char failstr[250] = "";
 #endif
@@ -756,6 +1071,8 @@ static void init_nonce_memory(void) {
         }
         set_bitarray24(nonces[i].states_bitarray[ODD_STATE]);
         nonces[i].num_states_bitarray[ODD_STATE] = 1 << 24;
+        nonces[i].states_set[EVEN_STATE] = NULL;
+        nonces[i].states_set[ODD_STATE] = NULL;
         nonces[i].all_bitflips_dirty[EVEN_STATE] = false;
         nonces[i].all_bitflips_dirty[ODD_STATE] = false;
     }
@@ -777,9 +1094,47 @@ static void free_nonces_memory(void) {
         free_nonce_list(nonces[i].first);
     }
     for (int i = 255; i >= 0; i--) {
-        free_bitarray(nonces[i].states_bitarray[ODD_STATE]);
-        free_bitarray(nonces[i].states_bitarray[EVEN_STATE]);
+        if (nonces[i].states_bitarray[ODD_STATE] != NULL) {
+            free_bitarray(nonces[i].states_bitarray[ODD_STATE]);
+        }
+        if (nonces[i].states_bitarray[EVEN_STATE] != NULL) {
+            free_bitarray(nonces[i].states_bitarray[EVEN_STATE]);
+        }
+        stateset_free(nonces[i].states_set[ODD_STATE]);
+        stateset_free(nonces[i].states_set[EVEN_STATE]);
+    }
+}
+
+// The states_bitarrays are needed in dense form while acquiring nonces, because they are ANDed
+// with the bitflip bitarrays. Afterwards less than 1% of their bits are set, so they are
+// converted to compressed statesets to free most of the 1 GiB they take.
+static void compress_nonce_states(void) {
+    size_t compressed_size = 0;
+    for (uint16_t i = 0; i < 256; i++) {
+        for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+            if (nonces[i].states_bitarray[odd_even] == NULL) {
+                continue;
+            }
+            nonces[i].states_set[odd_even] = stateset_from_bitarray(nonces[i].states_bitarray[odd_even]);
+            if (nonces[i].states_set[odd_even] == NULL) {
+                PrintAndLogEx(ERR, "Out of memory error in compress_nonce_states(). Aborting...\n");
+                exit(4);
+            }
+            free_bitarray(nonces[i].states_bitarray[odd_even]);
+            nonces[i].states_bitarray[odd_even] = NULL;
+            compressed_size += nonces[i].states_set[odd_even]->size + sizeof(stateset_t);
+        }
+    }
+    char progress_text[80];
+    snprintf(progress_text, sizeof(progress_text), "Compressed candidate states to %zu MiB (from 1024 MiB)", compressed_size >> 20);
+    hardnested_print_progress(num_acquired_nonces, progress_text, nonces[best_first_bytes[0]].expected_num_brute_force, 0);
+}
+
+static inline bool nonce_state_possible(uint8_t byte, uint32_t state, odd_even_t odd_even) {
+    if (nonces[byte].states_set[odd_even] != NULL) {
+        return stateset_contains(nonces[byte].states_set[odd_even], state);
     }
+    return test_bit24(nonces[byte].states_bitarray[odd_even], state);
 }
 
 static double p_hypergeometric(uint16_t i_K, uint16_t n, uint16_t k) {
@@ -881,6 +1236,13 @@ static uint32_t estimated_num_states_part_sum_coarse(uint16_t part_sum_a0_idx, u
 }
 
 static uint32_t estimated_num_states_part_sum(uint8_t first_byte, uint16_t part_sum_a0_idx, uint16_t part_sum_a8_idx, odd_even_t odd_even) {
+    if (nonces[first_byte].states_set[odd_even] != NULL) {
+        return stateset_filter(nonces[first_byte].states_set[odd_even],
+                               odd_even == ODD_STATE ? NULL : nonces[first_byte ^ 0x80].states_set[odd_even],
+                               part_sum_a0_bitarrays[odd_even][part_sum_a0_idx],
+                               part_sum_a8_bitarrays[odd_even][part_sum_a8_idx],
+                               NULL);
+    }
     if (odd_even == ODD_STATE) {
         return count_bitarray_AND3(part_sum_a0_bitarrays[odd_even][part_sum_a0_idx],
                                    part_sum_a8_bitarrays[odd_even][part_sum_a8_idx],
@@ -1464,7 +1826,7 @@ static void simulate_MFplus_RNG(uint32_t test_cuid, uint64_t test_key, uint32_t
     }
 }
 
-static int simulate_acquire_nonces(void) {
+static int simulate_acquire_nonces(bool nonce_file_write, char *filename) {
     time_t time1 = time(NULL);
     last_sample_clock = 0;
     sample_period = 1000; // for simulation
@@ -1484,6 +1846,22 @@ static int simulate_acquire_nonces(void) {
     hardnested_print_progress(0, progress_text, (float)(1LL << 47), 0);
     fprintf(fstats, "%012" PRIx64 ";%" PRIx32 ";", known_target_key, cuid);
 
+    // same layout as acquire_nonces() writes, so the simulated nonces can be replayed with -r
+    FILE *fnonces = NULL;
+    uint8_t write_buf[9];
+    if (nonce_file_write) {
+        if ((fnonces = fopen(filename, "wb")) == NULL) {
+            PrintAndLogEx(WARNING, "Could not create file " _YELLOW_("%s"), filename);
+            return PM3_EFILE;
+        }
+        snprintf(progress_text, sizeof(progress_text), "Writing simulated nonces to binary file " _YELLOW_("%s"), filename);
+        hardnested_print_progress(0, progress_text, (float)(1LL << 47), 0);
+        num_to_bytes(cuid, 4, write_buf);
+        write_buf[4] = 0; // trgBlockNo
+        write_buf[5] = 0; // trgKeyType
+        fwrite(write_buf, 1, 6, fnonces);
+    }
+
     num_acquired_nonces = 0;
 
     do {
@@ -1493,6 +1871,17 @@ static int simulate_acquire_nonces(void) {
         for (uint16_t i = 0; i < 113; i++) {
             simulate_MFplus_RNG(cuid, known_target_key, &nt_enc, &par_enc);
             num_acquired_nonces += add_nonce(nt_enc, par_enc);
+            if (fnonces != NULL) {
+                // nonces are stored in pairs, parities of both in one byte
+                if ((total_num_nonces & 1) == 0) {
+                    num_to_bytes(nt_enc, 4, write_buf);
+                    write_buf[8] = par_enc << 4;
+                } else {
+                    num_to_bytes(nt_enc, 4, write_buf + 4);
+                    write_buf[8] |= par_enc & 0x0f;
+                    fwrite(write_buf, 1, 9, fnonces);
+                }
+            }
             total_num_nonces++;
         }
 
@@ -1512,6 +1901,9 @@ static int simulate_acquire_nonces(void) {
 
                 if (got_match == false) {
                     PrintAndLogEx(FAILED, "No match for the First_Byte_Sum (%u), is the card a genuine MFC Ev1? ", first_byte_Sum);
+                    if (fnonces != NULL) {
+                        fclose(fnonces);
+                    }
                     return PM3_ESOFT;
                 }
 
@@ -1535,6 +1927,11 @@ static int simulate_acquire_nonces(void) {
         }
     } while (!acquisition_completed);
 
+    if (fnonces != NULL && fclose(fnonces) != 0) {
+        PrintAndLogEx(WARNING, "Error writing file " _YELLOW_("%s"), filename);
+        return PM3_EFILE;
+    }
+
     time_t end_time = time(NULL);
     // PrintAndLogEx(INFO, "Acquired a total of %" PRId32" nonces in %1.0f seconds (%1.0f nonces/minute)",
     // num_acquired_nonces,
@@ -1841,8 +2238,7 @@ static inline bool bitflips_match(uint8_t byte, uint32_t state, odd_even_t odd_e
 static inline bool bitflips_match(uint8_t byte, uint32_t state, odd_even_t odd_even)
 #endif
 {
-    uint32_t *bitset = nonces[byte].states_bitarray[odd_even];
-    bool possible = test_bit24(bitset, state);
+    bool possible = nonce_state_possible(byte, state, odd_even);
     if (!possible) {
 #ifdef DEBUG_KEY_ELIMINATION
         if (!quiet && known_target_key != -1 && state == test_state[odd_even]) {
@@ -1908,16 +2304,36 @@ static bool all_bitflips_match(uint8_t byte, uint32_t state, odd_even_t odd_even
     return true;
 }
 
-static void bitarray_to_list(uint8_t byte, uint32_t *bitarray, uint32_t *state_list, uint32_t *len, odd_even_t odd_even) {
+// list the states of the compressed set which are also in set2 and in the bitarrays A and B
+// and pass all_bitflips_match(), with End Of List marker. Returns NULL if there are none.
+static uint32_t *stateset_to_list(uint8_t byte, const stateset_t *set, const stateset_t *set2, const uint32_t *A, const uint32_t *B, uint32_t *len, odd_even_t odd_even) {
+    uint32_t num_states = stateset_filter(set, set2, A, B, NULL);
+    uint32_t *state_list = (uint32_t *)calloc(num_states + 1, sizeof(uint32_t));
+    if (state_list == NULL) {
+        PrintAndLogEx(ERR, "Out of memory error in stateset_to_list() - statelist.\n");
+        exit(4);
+    }
+    stateset_filter(set, set2, A, B, state_list);
+
     uint32_t *p = state_list;
-    for (uint32_t state = next_state(bitarray, -1L); state < (1 << 24); state = next_state(bitarray, state)) {
-        if (all_bitflips_match(byte, state, odd_even)) {
-            *p++ = state;
+    for (uint32_t i = 0; i < num_states; i++) {
+        if (all_bitflips_match(byte, state_list[i], odd_even)) {
+            *p++ = state_list[i];
         }
     }
     // add End Of List marker
     *p = 0xffffffff;
     *len = p - state_list;
+
+    if (*len == 0) {
+        free(state_list);
+        return NULL;
+    }
+    // slim down the allocated memory.
+    if (*len < num_states) {
+        state_list = realloc(state_list, sizeof(uint32_t) * (*len + 1));
+    }
+    return state_list;
 }
 
 static void add_cached_states(statelist_t *cands, uint16_t part_sum_a0, uint16_t part_sum_a8, odd_even_t odd_even) {
@@ -1928,36 +2344,11 @@ static void add_cached_states(statelist_t *cands, uint16_t part_sum_a0, uint16_t
 
 static void add_matching_states(statelist_t *cands, uint8_t part_sum_a0, uint8_t part_sum_a8, odd_even_t odd_even) {
 
-    const uint32_t worstcase_size = 1 << 20;
-
-    cands->states[odd_even] = (uint32_t *)calloc(sizeof(uint32_t) * worstcase_size, sizeof(uint8_t));
-    if (cands->states[odd_even] == NULL) {
-        PrintAndLogEx(ERR, "Out of memory error in add_matching_states() - statelist.\n");
-        exit(4);
-    }
-
-    uint32_t *cands_bitarray = (uint32_t *)malloc_bitarray(sizeof(uint32_t) * worstcase_size);
-    if (cands_bitarray == NULL) {
-        PrintAndLogEx(ERR, "Out of memory error in add_matching_states() - bitarray.\n");
-        free(cands->states[odd_even]);
-        exit(4);
-    }
-
     uint32_t *bitarray_a0 = part_sum_a0_bitarrays[odd_even][part_sum_a0 / 2];
     uint32_t *bitarray_a8 = part_sum_a8_bitarrays[odd_even][part_sum_a8 / 2];
-    uint32_t *bitarray_bitflips = nonces[best_first_bytes[0]].states_bitarray[odd_even];
+    const stateset_t *set_bitflips = nonces[best_first_bytes[0]].states_set[odd_even];
 
-    bitarray_AND4(cands_bitarray, bitarray_a0, bitarray_a8, bitarray_bitflips);
-
-    bitarray_to_list(best_first_bytes[0], cands_bitarray, cands->states[odd_even], &(cands->len[odd_even]), odd_even);
-
-    if (cands->len[odd_even] == 0) {
-        free(cands->states[odd_even]);
-        cands->states[odd_even] = NULL;
-    } else if (cands->len[odd_even] + 1 < worstcase_size) {
-        cands->states[odd_even] = realloc(cands->states[odd_even], sizeof(uint32_t) * (cands->len[odd_even] + 1));
-    }
-    free_bitarray(cands_bitarray);
+    cands->states[odd_even] = stateset_to_list(best_first_bytes[0], set_bitflips, NULL, bitarray_a0, bitarray_a8, &(cands->len[odd_even]), odd_even);
 
     pthread_mutex_lock(&statelist_cache_mutex);
     sl_cache[part_sum_a0 / 2][part_sum_a8 / 2][odd_even].sl = cands->states[odd_even];
@@ -1991,19 +2382,7 @@ static void add_bitflip_candidates(uint8_t byte) {
     statelist_t *candidates1 = add_more_candidates();
 
     for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
-        uint32_t worstcase_size = nonces[byte].num_states_bitarray[odd_even] + 1;
-        candidates1->states[odd_even] = (uint32_t *)calloc(worstcase_size, sizeof(uint32_t));
-        if (candidates1->states[odd_even] == NULL) {
-            PrintAndLogEx(ERR, "Out of memory error in add_bitflip_candidates()");
-            exit(4);
-        }
-
-        bitarray_to_list(byte, nonces[byte].states_bitarray[odd_even], candidates1->states[odd_even], &(candidates1->len[odd_even]), odd_even);
-
-        // slim down the allocated memory.
-        if (candidates1->len[odd_even] + 1 < worstcase_size) {
-            candidates1->states[odd_even] = realloc(candidates1->states[odd_even], sizeof(uint32_t) * (candidates1->len[odd_even] + 1));
-        }
+        candidates1->states[odd_even] = stateset_to_list(byte, nonces[byte].states_set[odd_even], NULL, NULL, NULL, &(candidates1->len[odd_even]), odd_even);
     }
     return;
 }
@@ -2301,8 +2680,7 @@ static void Tests(void) {
         return;
 
     for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
-        uint32_t *bitset = nonces[best_first_bytes[0]].states_bitarray[odd_even];
-        if (!test_bit24(bitset, test_state[odd_even])) {
+        if (!nonce_state_possible(best_first_bytes[0], test_state[odd_even], odd_even)) {
             PrintAndLogEx(WARNING, "BUG: known target key's " _YELLOW_("%s") " state is not member of first nonce byte's ( 0x%02x ) states_bitarray!",
                           odd_even == EVEN_STATE ? "even" : "odd ",
                           best_first_bytes[0]);
@@ -2323,8 +2701,7 @@ static void Tests2(void) {
         return;
 
     for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
-        uint32_t *bitset = nonces[best_first_byte_smallest_bitarray].states_bitarray[odd_even];
-        if (!test_bit24(bitset, test_state[odd_even])) {
+        if (!nonce_state_possible(best_first_byte_smallest_bitarray, test_state[odd_even], odd_even)) {
             PrintAndLogEx(WARNING, "BUG: known target key's " _YELLOW_("%s") " state is not member of first nonce byte's ( 0x%02x ) states_bitarray!",
                           odd_even == EVEN_STATE ? "even" : "odd ",
                           best_first_byte_smallest_bitarray);
@@ -2392,6 +2769,58 @@ static void init_it_all(void) {
     memset(sum_a0_bitarrays, 0, sizeof(sum_a0_bitarrays));
 }
 
+// time the brute force and the bitarray cores of every SIMD instruction set this CPU supports
+static void print_SIMD_benchmark_matrix(void) {
+    SIMDExecInstr selected = GetSIMDInstrSetting();
+    SetSIMDInstr(SIMD_AUTO);
+    SIMDExecInstr best = GetSIMDInstrAuto();
+
+    uint32_t *bitarrays[4];
+    for (uint8_t i = 0; i < ARRAYLEN(bitarrays); i++) {
+        bitarrays[i] = malloc_bitarray(sizeof(uint32_t) * (1 << 19));
+        if (bitarrays[i] == NULL) {
+            PrintAndLogEx(WARNING, "Out of memory error in print_SIMD_benchmark_matrix()");
+            for (uint8_t j = 0; j < i; j++) {
+                free_bitarray(bitarrays[j]);
+            }
+            SetSIMDInstr(selected);
+            return;
+        }
+        for (uint32_t j = 0; j < (1 << 19); j++) {
+            bitarrays[i][j] = (uint32_t)rand() << 16 ^ (uint32_t)rand();
+        }
+    }
+
+    PrintAndLogEx(INFO, "SIMD benchmark using " _YELLOW_("%u") " threads", hardnested_num_threads());
+    PrintAndLogEx(INFO, "----------+---------------------------------+---------------------");
+    PrintAndLogEx(INFO, " SIMD     | brute force                     | count_bitarray_AND4");
+    PrintAndLogEx(INFO, "----------+---------------------------------+---------------------");
+    for (SIMDExecInstr instr = best; instr <= SIMD_NONE; instr++) {
+        char instr_set[12] = {0};
+        SetSIMDInstr(instr);
+        get_SIMD_instruction_set(instr_set);
+
+        float bf_rate = brute_force_benchmark();
+
+        uint32_t bitarray_ops = 0;
+        uint64_t bitarray_start = msclock();
+        uint64_t bitarray_time;
+        do {
+            count_bitarray_AND4(bitarrays[0], bitarrays[1], bitarrays[2], bitarrays[3]);
+            bitarray_ops++;
+            bitarray_time = msclock() - bitarray_start;
+        } while (bitarray_time < 250);
+
+        PrintAndLogEx(INFO, " %-8s | %7.1f million (2^%4.1f) keys/s | %8.0f ops/s", instr_set, bf_rate / 1000000, log(bf_rate) / log(2.0), bitarray_ops * 1000.0 / bitarray_time);
+    }
+    PrintAndLogEx(INFO, "----------+---------------------------------+---------------------");
+
+    for (uint8_t i = 0; i < ARRAYLEN(bitarrays); i++) {
+        free_bitarray(bitarrays[i]);
+    }
+    SetSIMDInstr(selected);
+}
+
 int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, int tests, uint64_t *foundkey, char *filename) {
     char progress_text[80];
     char instr_set[12] = {0};
@@ -2415,7 +2844,9 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
             return PM3_EFILE;
         }
 
-        for (uint32_t i = 0; i < tests; i++) {
+        print_SIMD_benchmark_matrix();
+
+        for (uint32_t i = 0; i < tests && !brute_force_aborted(); i++) {
             start_time = msclock();
             print_progress_header();
             snprintf(progress_text, sizeof(progress_text), "Brute force benchmark: %1.0f million (2^%1.1f) keys/s", brute_force_per_second / 1000000, log(brute_force_per_second) / log(2.0));
@@ -2436,7 +2867,7 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
             init_nonce_memory();
             update_reduction_rate(0.0, true);
 
-            int res = simulate_acquire_nonces();
+            int res = simulate_acquire_nonces(nonce_file_write, filename);
             if (res != PM3_SUCCESS) {
                 return res;
             }
@@ -2445,6 +2876,7 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
 
             Tests();
             free_bitflip_bitarrays();
+            compress_nonce_states();
 
             fprintf(fstats, "%" PRIu16 ";%1.1f;", sums[first_byte_Sum], log(p_K0[first_byte_Sum]) / log(2.0));
             fprintf(fstats, "%" PRIu16 ";%1.1f;", sums[nonces[best_first_bytes[0]].sum_a8_guess[0].sum_a8_idx], log(p_K[nonces[best_first_bytes[0]].sum_a8_guess[0].sum_a8_idx]) / log(2.0));
@@ -2483,7 +2915,7 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
             } else {
                 pre_XOR_nonces();
                 prepare_bf_test_nonces(nonces, best_first_bytes[0]);
-                for (uint8_t j = 0; j < NUM_SUMS && !key_found; j++) {
+                for (uint8_t j = 0; j < NUM_SUMS && !key_found && !brute_force_aborted(); j++) {
                     float expected_brute_force = nonces[best_first_bytes[0]].expected_num_brute_force;
                     snprintf(progress_text, sizeof(progress_text), "(%d. guess: Sum(a8) = %" PRIu16 ")", j + 1, sums[nonces[best_first_bytes[0]].sum_a8_guess[j].sum_a8_idx]);
                     hardnested_print_progress(num_acquired_nonces, progress_text, expected_brute_force, 0);
@@ -2581,6 +3013,7 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
         Tests();
 
         free_bitflip_bitarrays();
+        compress_nonce_states();
         bool key_found = false;
         num_keys_tested = 0;
         uint32_t num_odd = nonces[best_first_byte_smallest_bitarray].num_states_bitarray[ODD_STATE];
@@ -2613,7 +3046,7 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
             pre_XOR_nonces();
             prepare_bf_test_nonces(nonces, best_first_bytes[0]);
 
-            for (uint8_t j = 0; j < NUM_SUMS && !key_found; j++) {
+            for (uint8_t j = 0; j < NUM_SUMS && !key_found && !brute_force_aborted(); j++) {
                 float expected_brute_force = nonces[best_first_bytes[0]].expected_num_brute_force;
                 snprintf(progress_text, sizeof(progress_text), "(%d. guess: Sum(a8) = %" PRIu16 ")", j + 1, sums[nonces[best_first_bytes[0]].sum_a8_guess[j].sum_a8_idx]);
                 hardnested_print_progress(num_acquired_nonces, progress_text, expected_brute_force, 0);
@@ -2644,6 +3077,9 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
         free_sum_bitarrays();
         free_part_sum_bitarrays();
 
+        if (brute_force_aborted()) {
+            return PM3_EOPABORTED;
+        }
         return (key_found) ? PM3_SUCCESS : PM3_EFAILED;
     }
 
@@ -21,7 +21,12 @@
 
 #include "common.h"
 
+// thread stacks and per thread state are sized by the thread count
+#define HARDNESTED_MAX_THREADS  256
+
 int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, int tests, uint64_t *foundkey, char *filename);
+void hardnested_set_num_threads(uint32_t num_threads);
+uint32_t hardnested_num_threads(void);
 void hardnested_print_progress(uint32_t nonces, const char *activity, float brute_force, uint64_t min_diff_print_time);
 
 #endif
@@ -1068,10 +1068,12 @@ static int CmdTune(const char *Cmd) {
     // graph LF measurements
     // even here, these values has 3% error.
     uint16_t test1 = 0;
+    GraphReserve(256);
     for (int i = 0; i < 256; i++) {
         g_GraphBuffer[i] = package->results[i] - 128;
         test1 += package->results[i];
     }
+    GraphChanged();
 
     if (test1 > 0) {
         PrintAndLogEx(NORMAL, "");
@@ -1287,27 +1289,130 @@ static int CmdTimeout(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+static int CmdWindow(const char *Cmd) {
+
+    CLIParserContext *ctx;
+    CLIParserInit(&ctx, "hw window",
+                  "Set how many commands the client keeps in flight when a command can pipeline them.\n"
+                  "Used by block reads like `hf mf dump` and `hf 15 dump`,  1 sends one command at the time",
+                  "hw window           --> Show current window\n"
+                  "hw window -n 8      --> Keep up to 8 commands in flight\n"
+                  "hw window -n 1      --> Wait for every reply before sending the next command\n"
+                 );
+
+    void *argtable[] = {
+        arg_param_begin,
+        arg_int0("n", NULL, "<dec>", "number of commands in flight (1-16)"),
+        arg_param_end
+    };
+    CLIExecWithReturn(ctx, Cmd, argtable, true);
+    int32_t arg = arg_get_int_def(ctx, 1, -1);
+    CLIParserFree(ctx);
+
+    uint8_t oldWindow = GetCommunicationWindow();
+
+    // window is not given, just show the current one then return
+    if (arg < 0) {
+        PrintAndLogEx(INFO, "Current communication window... " _GREEN_("%u"), oldWindow);
+        return PM3_SUCCESS;
+    }
+
+    if (arg < 1 || arg > CMD_WINDOW_MAX) {
+        PrintAndLogEx(WARNING, "Window must be between 1 and %u", CMD_WINDOW_MAX);
+        return PM3_EINVARG;
+    }
+
+    SetCommunicationWindow(arg);
+    PrintAndLogEx(INFO, "Old communication window... %u", oldWindow);
+    PrintAndLogEx(INFO, "New communication window... " _GREEN_("%u"), GetCommunicationWindow());
+    return PM3_SUCCESS;
+}
+
+// every ping gets its own payload,  so a reply matched to the wrong command shows up
+static int ping_windowed(uint32_t len, uint32_t num) {
+
+    uint8_t *payloads = calloc(num, MAX(len, 1));
+    PacketResponseNG *resps = calloc(num, sizeof(PacketResponseNG));
+    bool *received = calloc(num, sizeof(bool));
+    if (payloads == NULL || resps == NULL || received == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        free(payloads);
+        free(resps);
+        free(received);
+        return PM3_EMALLOC;
+    }
+
+    for (uint32_t i = 0; i < num; i++) {
+        for (uint32_t j = 0; j < len; j++) {
+            payloads[(i * len) + j] = (i + j) & 0xFF;
+        }
+    }
+
+    PrintAndLogEx(INFO, "Sending " _YELLOW_("%u") " pings with payload len " _YELLOW_("%u") " through a window of " _YELLOW_("%u"),
+                  num, len, GetCommunicationWindow());
+
+    uint64_t tms = msclock();
+    size_t got = SendCommandNGWindowed(CMD_PING, payloads, len, num, resps, received, 1000);
+    tms = msclock() - tms;
+
+    uint32_t bad = 0;
+    for (uint32_t i = 0; i < got; i++) {
+        if (resps[i].length != len || memcmp(payloads + (i * len), resps[i].data.asBytes, len) != 0) {
+            bad++;
+        }
+    }
+
+    int res = PM3_SUCCESS;
+    if (got != num) {
+        PrintAndLogEx(WARNING, "Ping response " _RED_("timeout") " after %zu of %u replies", got, num);
+        res = PM3_ETIMEOUT;
+    } else {
+        PrintAndLogEx((bad) ? ERR : SUCCESS, "Pipelined pings " _GREEN_("received") " in " _YELLOW_("%" PRIu64) " ms and content ( %s )",
+                      tms, (bad) ? _RED_("fail") : _GREEN_("ok"));
+        if (bad) {
+            res = PM3_ESOFT;
+        }
+    }
+
+    free(payloads);
+    free(resps);
+    free(received);
+    return res;
+}
+
 static int CmdPing(const char *Cmd) {
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "hw ping",
                   "Test if the Proxmark3 is responsive",
                   "hw ping\n"
-                  "hw ping --len 32"
+                  "hw ping --len 32\n"
+                  "hw ping --num 64     --> send 64 pings, keeping `hw window` of them in flight"
                  );
 
     void *argtable[] = {
         arg_param_begin,
         arg_u64_0("l", "len", "<dec>", "length of payload to send"),
+        arg_u64_0("n", "num", "<dec>", "number of pipelined pings to send (1-1000)"),
         arg_param_end
     };
 
     CLIExecWithReturn(ctx, Cmd, argtable, true);
     uint32_t len = arg_get_u32_def(ctx, 1, 32);
+    uint32_t num = arg_get_u32_def(ctx, 2, 1);
     CLIParserFree(ctx);
 
     if (len > PM3_CMD_DATA_SIZE)
         len = PM3_CMD_DATA_SIZE;
 
+    if (num < 1 || num > 1000) {
+        PrintAndLogEx(WARNING, "Number of pings must be between 1 and 1000");
+        return PM3_EINVARG;
+    }
+
+    if (num > 1) {
+        return ping_windowed(len, num);
+    }
+
     if (len) {
         PrintAndLogEx(INFO, "Ping sent with payload len... " _YELLOW_("%d"), len);
     } else {
@@ -1457,6 +1562,7 @@ static command_t CommandTable[] = {
     {"tearoff",       CmdTearoff,      IfPm3Present,     "Program a tearoff hook for the next command supporting tearoff"},
     {"timeout",       CmdTimeout,      AlwaysAvailable,  "Set the communication timeout on the client side"},
     {"version",       CmdVersion,      AlwaysAvailable,  "Show version information about the client and Proxmark3"},
+    {"window",        CmdWindow,       AlwaysAvailable,  "Set the number of pipelined commands in flight on the client side"},
     {"-------------", CmdHelp,         AlwaysAvailable,  "----------------------- " _CYAN_("Hardware") " -----------------------"},
     {"break",         CmdBreak,        IfPm3Present,     "Send break loop usb command"},
     {"bootloader",    CmdBootloader,   IfPm3Present,     "Reboot into bootloader mode"},
@@ -520,6 +520,7 @@ int CmdFlexdemod(const char *Cmd) {
 
     // iceman,  use g_DemodBuffer?  blue line?
     // HACK writing back to graphbuffer.
+    GraphReserve(32 * 64);
     g_GraphTraceLen = 32 * 64;
     i = 0;
     for (bit = 0; bit < 64; bit++) {
@@ -531,6 +532,7 @@ int CmdFlexdemod(const char *Cmd) {
             phase = !phase;
         }
     }
+    GraphChanged();
     RepaintGraphWindow();
     free(data);
     return PM3_SUCCESS;
@@ -1525,12 +1527,14 @@ int CmdVchDemod(const char *Cmd) {
     // clone
     if (strcmp(Cmd, "clone") == 0) {
         g_GraphTraceLen = 0;
+        GraphReserve(strlen(bits) * 16);
         char *s;
         for (s = bits; *s; s++) {
             for (j = 0; j < 16; j++) {
                 g_GraphBuffer[g_GraphTraceLen++] = (*s == '1') ? 1 : 0;
             }
         }
+        GraphChanged();
         RepaintGraphWindow();
     }
     return PM3_SUCCESS;
@@ -1743,6 +1747,9 @@ int CmdLFfind(const char *Cmd) {
 
     int retval = PM3_SUCCESS;
 
+    // decoders below share identical raw demods,  let them reuse each others results
+    demod_cache_enable(true);
+
     // ask / man
     if (demodEM410x(true) == PM3_SUCCESS) {
         PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("EM410x ID") " found!");
@@ -2050,6 +2057,8 @@ int CmdLFfind(const char *Cmd) {
     }
 
 out:
+    demod_cache_enable(false);
+
     // identify chipset
     if (check_chiptype(is_online) == false) {
         PrintAndLogEx(DEBUG, "Automatic chip type detection " _RED_("failed"));
@@ -579,6 +579,7 @@ static int CmdIndalaDemodAlt(const char *Cmd) {
     // Remodulating for tag cloning
     // HACK: 2015-01-04 this will have an impact on our new way of seening lf commands (demod)
     // since this changes graphbuffer data.
+    GraphReserve(32 * uidlen);
     g_GraphTraceLen = 32 * uidlen;
     i = 0;
     int phase;
@@ -593,6 +594,7 @@ static int CmdIndalaDemodAlt(const char *Cmd) {
             phase = !phase;
         }
     }
+    GraphChanged();
 
     RepaintGraphWindow();
     return PM3_SUCCESS;
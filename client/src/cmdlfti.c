@@ -135,6 +135,7 @@ int demodTI(bool verbose) {
     }
 
     g_GraphTraceLen -= (convLen + 16);
+    GraphChanged();
 
     RepaintGraphWindow();
 
@@ -15,9 +15,15 @@
 //-----------------------------------------------------------------------------
 // Trace commands
 //-----------------------------------------------------------------------------
+// this define is needed for scandir/alphasort to work
+#define _GNU_SOURCE
 #include "cmdtrace.h"
 
 #include <ctype.h>
+#include <dirent.h>
+#include <time.h>
+#include <utime.h>
+#include <sys/stat.h>
 
 #include "cmdparser.h"    // command_t
 #include "protocols.h"
@@ -30,23 +36,42 @@
 #include "cmdlfhitag.h"         // annotate hitag
 #include "pm3_cmd.h"            // tracelog_hdr_t
 #include "cliparser.h"          // args..
+#include "emv/emvjson.h"        // JsonSaveBufAsHexCompact
+#include "pcapng.h"             // pcapng_save_trace, pcapng_load_trace
+#include "util.h"               // str_endswith
+#include "ui.h"                 // SetConsoleToStderr
+#include "mbedtls/sha256.h"     // annotation cache key
+#ifdef _WIN32
+#include "scandir.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 static int CmdHelp(const char *Cmd);
 
 // trace pointer
 static uint8_t *gs_trace;
-static uint16_t gs_traceLen = 0;
-
-static bool is_last_record(uint16_t tracepos, uint16_t traceLen) {
+static uint32_t gs_traceLen = 0;
+// gs_trace is a private mapping of a .trace file instead of a heap buffer
+static bool gs_trace_mapped = false;
+// record offsets in gs_trace, built once per trace when first needed
+static uint32_t *gs_trace_index = NULL;
+static uint32_t gs_trace_records = 0;
+// record timestamps never decrease, time ranges can be found by binary search
+static bool gs_trace_sorted = false;
+
+static bool is_last_record(uint32_t tracepos, uint32_t traceLen) {
     return ((tracepos + TRACELOG_HDR_LEN) >= traceLen);
 }
 
-static bool next_record_is_response(uint16_t tracepos, uint8_t *trace) {
+static bool next_record_is_response(uint32_t tracepos, uint8_t *trace) {
     const tracelog_hdr_t *hdr = (tracelog_hdr_t *)(trace + tracepos);
     return (hdr->isResponse);
 }
 
-static bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint16_t *tracepos, uint16_t traceLen,
+static bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint32_t *tracepos, uint32_t traceLen,
                                       uint8_t *trace, const uint8_t *frame, uint8_t *topaz_reader_command, uint16_t *data_len) {
 
 #define MAX_TOPAZ_READER_CMD_LEN 16
@@ -91,14 +116,33 @@ static uint8_t calc_pos(const uint8_t *d) {
     return pos;
 }
 
+// release the client trace buffer, heap or mapped, and its record index
+static void trace_free(void) {
+    if (gs_trace) {
+#ifndef _WIN32
+        if (gs_trace_mapped) {
+            munmap(gs_trace, gs_traceLen);
+        } else
+#endif
+        {
+            free(gs_trace);
+        }
+    }
+    gs_trace = NULL;
+    gs_traceLen = 0;
+    gs_trace_mapped = false;
+
+    free(gs_trace_index);
+    gs_trace_index = NULL;
+    gs_trace_records = 0;
+    gs_trace_sorted = false;
+}
+
 // Copy an existing buffer into client trace buffer
 // I think this is cleaner than further globalizing gs_trace, and may lend itself to more modularity later?
-bool ImportTraceBuffer(const uint8_t *trace_src, uint16_t trace_len) {
+bool ImportTraceBuffer(const uint8_t *trace_src, uint32_t trace_len) {
     if (trace_len == 0 || trace_src == NULL) return (false);
-    if (gs_trace) {
-        free(gs_trace);
-        gs_traceLen = 0;
-    }
+    trace_free();
     gs_trace = calloc(trace_len, sizeof(uint8_t));
     if (gs_trace == NULL) {
         return (false);
@@ -108,13 +152,139 @@ bool ImportTraceBuffer(const uint8_t *trace_src, uint16_t trace_len) {
     return (true);
 }
 
+// Walk the trace once and remember where every record starts.
+// A truncated last record is left out, just like `trace list` stops at it.
+static int trace_build_index(void) {
+    if (gs_trace_index != NULL || gs_traceLen == 0) {
+        return PM3_SUCCESS;
+    }
+
+    uint32_t count = 0;
+    uint32_t tracepos = 0;
+    while (is_last_record(tracepos, gs_traceLen) == false) {
+        const tracelog_hdr_t *hdr = (tracelog_hdr_t *)(gs_trace + tracepos);
+        uint64_t next = (uint64_t)tracepos + TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr);
+        if (next > gs_traceLen) {
+            break;
+        }
+        tracepos = next;
+        count++;
+    }
+
+    // one extra slot holding the end of the last record
+    gs_trace_index = calloc(count + 1, sizeof(uint32_t));
+    if (gs_trace_index == NULL) {
+        PrintAndLogEx(FAILED, "Cannot allocate memory for trace index");
+        return PM3_EMALLOC;
+    }
+
+    gs_trace_sorted = true;
+    uint32_t prev_ts = 0;
+    tracepos = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const tracelog_hdr_t *hdr = (tracelog_hdr_t *)(gs_trace + tracepos);
+        gs_trace_index[i] = tracepos;
+        if (i && hdr->timestamp < prev_ts) {
+            gs_trace_sorted = false;
+        }
+        prev_ts = hdr->timestamp;
+        tracepos += TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr);
+    }
+    gs_trace_index[count] = tracepos;
+    gs_trace_records = count;
+    return PM3_SUCCESS;
+}
+
+// first record starting at or after `ticks` carrier periods from the start of the trace
+static uint32_t trace_index_find_time(uint64_t ticks) {
+    if (gs_trace_records == 0) {
+        return 0;
+    }
+
+    uint32_t first_ts = ((tracelog_hdr_t *)gs_trace)->timestamp;
+
+    if (gs_trace_sorted) {
+        uint32_t lo = 0, hi = gs_trace_records;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            const tracelog_hdr_t *hdr = (tracelog_hdr_t *)(gs_trace + gs_trace_index[mid]);
+            if ((uint64_t)(hdr->timestamp - first_ts) < ticks) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // concatenated traces restart their timestamps
+    for (uint32_t i = 0; i < gs_trace_records; i++) {
+        const tracelog_hdr_t *hdr = (tracelog_hdr_t *)(gs_trace + gs_trace_index[i]);
+        if ((uint64_t)(hdr->timestamp - first_ts) >= ticks) {
+            return i;
+        }
+    }
+    return gs_trace_records;
+}
+
+// Map a .trace file into memory instead of reading it, so large captures only take page cache.
+// Falls back to loading the file where mmap is not available.
+static int trace_load_file(const char *preferredName) {
+#ifndef _WIN32
+    char *path;
+    if (searchFile(&path, RESOURCES_SUBDIR, preferredName, ".trace", false) != PM3_SUCCESS) {
+        return PM3_EFILE;
+    }
+
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) {
+        return PM3_EFILE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size > UINT32_MAX) {
+        PrintAndLogEx(FAILED, "error, trace file is empty or larger than 4 GiB");
+        close(fd);
+        return PM3_EFILE;
+    }
+
+    // private mapping, some CRC checks modify the frame in place
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        PrintAndLogEx(FAILED, "error, cannot map trace file");
+        return PM3_EFILE;
+    }
+
+    gs_trace = map;
+    gs_traceLen = st.st_size;
+    gs_trace_mapped = true;
+    return PM3_SUCCESS;
+#else
+    size_t len = 0;
+    int res = loadFile_safe(preferredName, ".trace", (void **)&gs_trace, &len);
+    if (res != PM3_SUCCESS) {
+        return res;
+    }
+    if ((uint64_t)len > UINT32_MAX) {
+        free(gs_trace);
+        gs_trace = NULL;
+        PrintAndLogEx(FAILED, "error, trace file is larger than 4 GiB");
+        return PM3_EFILE;
+    }
+    gs_traceLen = len;
+    return PM3_SUCCESS;
+#endif
+}
+
 static uint8_t extract_uid[10] = {0};
 static uint8_t extract_uidlen = 0;
 static uint8_t extract_epurse[8] = {0};
 
 #define SKIP_TO_NEXT(a)  (TRACELOG_HDR_LEN + (a)->data_len + TRACELOG_PARITY_LEN((a)))
 
-static uint16_t extractChall_ev2(uint16_t tracepos, uint8_t *trace, uint8_t cmdpos, uint8_t long_jmp) {
+static uint32_t extractChall_ev2(uint32_t tracepos, uint8_t *trace, uint8_t cmdpos, uint8_t long_jmp) {
     tracelog_hdr_t *next_hdr = (tracelog_hdr_t *)(trace + tracepos);
     if (next_hdr->data_len != 21) {
         return 0;
@@ -135,7 +305,7 @@ static uint16_t extractChall_ev2(uint16_t tracepos, uint8_t *trace, uint8_t cmdp
     return tracepos;
 }
 
-static uint16_t extractChallenges(uint16_t tracepos, uint16_t traceLen, uint8_t *trace) {
+static uint32_t extractChallenges(uint32_t tracepos, uint32_t traceLen, uint8_t *trace) {
 
     // sanity check
     if (is_last_record(tracepos, traceLen)) {
@@ -404,7 +574,7 @@ static uint16_t extractChallenges(uint16_t tracepos, uint16_t traceLen, uint8_t
             }
             case MFDES_AUTHENTICATE_EV2F: {
                 PrintAndLogEx(INFO, "AUTH EV2 First");
-                uint16_t tmp = extractChall_ev2(tracepos, trace, pos, long_jmp);
+                uint32_t tmp = extractChall_ev2(tracepos, trace, pos, long_jmp);
                 if (tmp == 0)
                     break;
                 else
@@ -413,7 +583,7 @@ static uint16_t extractChallenges(uint16_t tracepos, uint16_t traceLen, uint8_t
             }
             case MFDES_AUTHENTICATE_EV2NF: {
                 PrintAndLogEx(INFO, "AUTH EV2 Non First");
-                uint16_t tmp = extractChall_ev2(tracepos, trace, pos, long_jmp);
+                uint32_t tmp = extractChall_ev2(tracepos, trace, pos, long_jmp);
                 if (tmp == 0)
                     break;
                 else
@@ -425,13 +595,136 @@ static uint16_t extractChallenges(uint16_t tracepos, uint16_t traceLen, uint8_t
     return tracepos;
 }
 
-static uint16_t printHexLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, uint8_t protocol) {
+// CRC status of a frame, see the CRC column in printTraceLine
+static uint8_t trace_crc_status(uint8_t protocol, bool isResponse, uint8_t *frame, uint16_t data_len, const uint8_t *parityBytes) {
+    uint8_t crcStatus = 2;
+
+    if (data_len > 2) {
+        switch (protocol) {
+            case ICLASS:
+                crcStatus = iclass_CRC_check(isResponse, frame, data_len);
+                break;
+            case ISO_14443B:
+            case TOPAZ:
+                crcStatus = iso14443B_CRC_check(frame, data_len);
+                break;
+            case FELICA:
+                crcStatus = !felica_CRC_check(frame + 2, data_len - 4);
+                break;
+            case PROTO_MIFARE:
+            case PROTO_MFPLUS:
+                crcStatus = mifare_CRC_check(isResponse, frame, data_len);
+                break;
+            case ISO_14443A:
+            case MFDES:
+            case LTO:
+            case SEOS:
+                crcStatus = iso14443A_CRC_check(isResponse, frame, data_len);
+                break;
+            case ISO_7816_4:
+                crcStatus = iso14443A_CRC_check(isResponse, frame, data_len) == 1 ? 3 : 0;
+                crcStatus = iso14443B_CRC_check(frame, data_len) == 1 ? 4 : crcStatus;
+                break;
+            case THINFILM:
+                frame[data_len - 1] ^= frame[data_len - 2];
+                frame[data_len - 2] ^= frame[data_len - 1];
+                frame[data_len - 1] ^= frame[data_len - 2];
+                crcStatus = iso14443A_CRC_check(true, frame, data_len);
+                frame[data_len - 1] ^= frame[data_len - 2];
+                frame[data_len - 2] ^= frame[data_len - 1];
+                frame[data_len - 1] ^= frame[data_len - 2];
+                break;
+            case ISO_15693:
+                crcStatus = iso15693_CRC_check(frame, data_len);
+                break;
+            case PROTO_HITAG1:
+            case PROTO_HITAGS:
+                crcStatus = hitag1_CRC_check(frame, (data_len * 8) - ((8 - parityBytes[0]) % 8));
+            case PROTO_CRYPTORF:
+            case PROTO_HITAG2:
+            default:
+                break;
+        }
+    }
+    return crcStatus;
+}
+
+static void annotate_frame(uint8_t protocol, bool isResponse, uint8_t *frame, uint16_t data_len, uint8_t *parityBytes, uint16_t parity_len,
+                           char *exp, size_t size, const uint64_t *keys, uint32_t keycnt) {
+    // Always annotate these protocols both reader/tag messages
+    switch (protocol) {
+        case ISO_14443A:
+        case ISO_7816_4:
+            annotateIso14443a(exp, size, frame, data_len, isResponse);
+            break;
+        case PROTO_MIFARE:
+        case PROTO_MFPLUS:
+            annotateMifare(exp, size, frame, data_len, parityBytes, parity_len, isResponse);
+            break;
+        case PROTO_HITAG1:
+            annotateHitag1(exp, size, frame, data_len, isResponse);
+            break;
+        case PROTO_HITAG2:
+            annotateHitag2(exp, size, frame, data_len, parityBytes[0], isResponse, keys, keycnt, false);
+            break;
+        case PROTO_HITAGS:
+            annotateHitagS(exp, size, frame, data_len, isResponse);
+            break;
+        case ICLASS:
+            annotateIclass(exp, size, frame, data_len, isResponse);
+            break;
+        default:
+            break;
+    }
+
+    if (isResponse == false) {
+        switch (protocol) {
+            case LEGIC:
+                annotateLegic(exp, size, frame, data_len);
+                break;
+            case MFDES:
+                annotateMfDesfire(exp, size, frame, data_len);
+                break;
+            case PROTO_MFPLUS:
+                annotateMfPlus(exp, size, frame, data_len);
+                break;
+            case ISO_14443B:
+                annotateIso14443b(exp, size, frame, data_len);
+                break;
+            case TOPAZ:
+                annotateTopaz(exp, size, frame, data_len);
+                break;
+            case ISO_7816_4:
+                annotateIso7816(exp, size, frame, data_len);
+                break;
+            case ISO_15693:
+                annotateIso15693(exp, size, frame, data_len);
+                break;
+            case FELICA:
+                annotateFelica(exp, size, frame, data_len);
+                break;
+            case LTO:
+                annotateLTO(exp, size, frame, data_len);
+                break;
+            case PROTO_CRYPTORF:
+                annotateCryptoRF(exp, size, frame, data_len);
+                break;
+            case SEOS:
+                annotateSeos(exp, size, frame, data_len);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static uint32_t printHexLine(uint32_t tracepos, uint32_t traceLen, uint8_t *trace, uint8_t protocol) {
     // sanity check
     if (is_last_record(tracepos, traceLen)) return traceLen;
 
     tracelog_hdr_t *hdr = (tracelog_hdr_t *)(trace + tracepos);
 
-    if (TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr) > traceLen) {
+    if (tracepos + TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr) > traceLen) {
         return traceLen;
     }
 
@@ -443,7 +736,7 @@ static uint16_t printHexLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trac
         return tracepos;
     }
 
-    uint16_t ret;
+    uint32_t ret;
 
     switch (protocol) {
         case ISO_14443A: {
@@ -452,6 +745,7 @@ static uint16_t printHexLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trac
              * to convert to pcap(ng) via text2pcap or to import into Wireshark
              * we use format timestamp, newline, offset (0x000000), pseudo header, data
              * `text2pcap -t "%S." -l 264 -n <input-text-file> <output-pcapng-file>`
+             * `trace save --pcapng` writes the same pseudo header without the text round trip
              */
             int line_len = (hdr->data_len * 3) + 1;
             char line[line_len];
@@ -491,7 +785,7 @@ static uint16_t printHexLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trac
     return ret;
 }
 
-static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes, uint32_t *prev_eot, bool use_us,
+static uint32_t printTraceLine(uint32_t tracepos, uint32_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes, uint32_t *prev_eot, bool use_us,
                                const uint64_t *mfDicKeys, uint32_t mfDicKeysCount) {
     // sanity check
     if (is_last_record(tracepos, traceLen)) {
@@ -535,55 +829,8 @@ static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *tr
     }
 
     //Check the CRC status
-    uint8_t crcStatus = 2;
+    uint8_t crcStatus = trace_crc_status(protocol, hdr->isResponse, frame, data_len, parityBytes);
 
-    if (data_len > 2) {
-        switch (protocol) {
-            case ICLASS:
-                crcStatus = iclass_CRC_check(hdr->isResponse, frame, data_len);
-                break;
-            case ISO_14443B:
-            case TOPAZ:
-                crcStatus = iso14443B_CRC_check(frame, data_len);
-                break;
-            case FELICA:
-                crcStatus = !felica_CRC_check(frame + 2, data_len - 4);
-                break;
-            case PROTO_MIFARE:
-            case PROTO_MFPLUS:
-                crcStatus = mifare_CRC_check(hdr->isResponse, frame, data_len);
-                break;
-            case ISO_14443A:
-            case MFDES:
-            case LTO:
-            case SEOS:
-                crcStatus = iso14443A_CRC_check(hdr->isResponse, frame, data_len);
-                break;
-            case ISO_7816_4:
-                crcStatus = iso14443A_CRC_check(hdr->isResponse, frame, data_len) == 1 ? 3 : 0;
-                crcStatus = iso14443B_CRC_check(frame, data_len) == 1 ? 4 : crcStatus;
-                break;
-            case THINFILM:
-                frame[data_len - 1] ^= frame[data_len - 2];
-                frame[data_len - 2] ^= frame[data_len - 1];
-                frame[data_len - 1] ^= frame[data_len - 2];
-                crcStatus = iso14443A_CRC_check(true, frame, data_len);
-                frame[data_len - 1] ^= frame[data_len - 2];
-                frame[data_len - 2] ^= frame[data_len - 1];
-                frame[data_len - 1] ^= frame[data_len - 2];
-                break;
-            case ISO_15693:
-                crcStatus = iso15693_CRC_check(frame, data_len);
-                break;
-            case PROTO_HITAG1:
-            case PROTO_HITAGS:
-                crcStatus = hitag1_CRC_check(frame, (data_len * 8) - ((8 - parityBytes[0]) % 8));
-            case PROTO_CRYPTORF:
-            case PROTO_HITAG2:
-            default:
-                break;
-        }
-    }
     //0 CRC-command, CRC not ok
     //1 CRC-command, CRC ok
     //2 Not crc-command
@@ -775,71 +1022,7 @@ static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *tr
         *prev_eot = end_of_transmission_timestamp;
     }
 
-    // Always annotate these protocols both reader/tag messages
-    switch (protocol) {
-        case ISO_14443A:
-        case ISO_7816_4:
-            annotateIso14443a(explanation, sizeof(explanation), frame, data_len, hdr->isResponse);
-            break;
-        case PROTO_MIFARE:
-        case PROTO_MFPLUS:
-            annotateMifare(explanation, sizeof(explanation), frame, data_len, parityBytes, TRACELOG_PARITY_LEN(hdr), hdr->isResponse);
-            break;
-        case PROTO_HITAG1:
-            annotateHitag1(explanation, sizeof(explanation), frame, data_len, hdr->isResponse);
-            break;
-        case PROTO_HITAG2:
-            annotateHitag2(explanation, sizeof(explanation), frame, data_len, parityBytes[0], hdr->isResponse, mfDicKeys, mfDicKeysCount, false);
-            break;
-        case PROTO_HITAGS:
-            annotateHitagS(explanation, sizeof(explanation), frame, data_len, hdr->isResponse);
-            break;
-        case ICLASS:
-            annotateIclass(explanation, sizeof(explanation), frame, data_len, hdr->isResponse);
-            break;
-        default:
-            break;
-    }
-
-    if (hdr->isResponse == false) {
-        switch (protocol) {
-            case LEGIC:
-                annotateLegic(explanation, sizeof(explanation), frame, data_len);
-                break;
-            case MFDES:
-                annotateMfDesfire(explanation, sizeof(explanation), frame, data_len);
-                break;
-            case PROTO_MFPLUS:
-                annotateMfPlus(explanation, sizeof(explanation), frame, data_len);
-                break;
-            case ISO_14443B:
-                annotateIso14443b(explanation, sizeof(explanation), frame, data_len);
-                break;
-            case TOPAZ:
-                annotateTopaz(explanation, sizeof(explanation), frame, data_len);
-                break;
-            case ISO_7816_4:
-                annotateIso7816(explanation, sizeof(explanation), frame, data_len);
-                break;
-            case ISO_15693:
-                annotateIso15693(explanation, sizeof(explanation), frame, data_len);
-                break;
-            case FELICA:
-                annotateFelica(explanation, sizeof(explanation), frame, data_len);
-                break;
-            case LTO:
-                annotateLTO(explanation, sizeof(explanation), frame, data_len);
-                break;
-            case PROTO_CRYPTORF:
-                annotateCryptoRF(explanation, sizeof(explanation), frame, data_len);
-                break;
-            case SEOS:
-                annotateSeos(explanation, sizeof(explanation), frame, data_len);
-                break;
-            default:
-                break;
-        }
-    }
+    annotate_frame(protocol, hdr->isResponse, frame, data_len, parityBytes, TRACELOG_PARITY_LEN(hdr), explanation, sizeof(explanation), mfDicKeys, mfDicKeysCount);
 
     int str_padder = 72;
     int num_lines = MIN((data_len - 1) / TRACE_MAX_HEX_BYTES + 1, TRACE_MAX_HEX_BYTES);
@@ -1066,6 +1249,533 @@ static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *tr
     return tracepos;
 }
 
+// One decoded trace record, shared by the JSON outputs
+typedef struct {
+    uint32_t start;             // carrier periods since the first record
+    uint32_t end;
+    bool isResponse;
+    const uint8_t *data;
+    uint16_t data_len;
+    const char *crc;            // NULL when the protocol has no CRC on this frame
+    char note[60];              // annotation without colors, empty if none
+    char code[60];              // command name of the annotation, e.g. READBLOCK for "READBLOCK(8)"
+    uint8_t plain[32];          // decrypted MIFARE Classic data
+    size_t plain_len;
+} trace_frame_t;
+
+static const char *trace_crc_strings[] = { "fail", "ok", NULL, "A ok", "B ok" };
+
+// The annotators only give free text,  their command name is the part before any arguments.
+// "AUTH-A(4)" -> "AUTH-A",  "Get Version" -> "Get_Version"
+static void trace_note_code(char *code, const char *note) {
+    size_t n = strcspn(note, "(:[=");
+    while (n && note[n - 1] == ' ') {
+        n--;
+    }
+    for (size_t i = 0; i < n; i++) {
+        code[i] = (note[i] == ' ') ? '_' : note[i];
+    }
+    code[n] = '\0';
+}
+
+static void trace_decode_reset(uint8_t protocol) {
+    if (protocol == ISO_14443A || protocol == PROTO_MIFARE || protocol == PROTO_MFPLUS) {
+        ClearAuthData();
+        ClearMfKeyCache();
+    }
+
+    if (protocol == PROTO_HITAG1 || protocol == PROTO_HITAG2 || protocol == PROTO_HITAGS) {
+        annotateHitag2_init();
+    }
+}
+
+// Decode the record at *tracepos with the same CRC checks and annotations as `trace list`,
+// and move *tracepos to the next record. False when there is no complete record left.
+static bool trace_decode_frame(uint8_t *trace, uint32_t *tracepos, uint32_t traceLen, uint32_t first_ts, uint8_t protocol,
+                                   const uint64_t *dicKeys, uint32_t dicKeysCount, uint8_t *topaz_buf, trace_frame_t *fr) {
+
+    if (is_last_record(*tracepos, traceLen)) {
+        return false;
+    }
+
+    tracelog_hdr_t *hdr = (tracelog_hdr_t *)(trace + *tracepos);
+    uint32_t duration = hdr->duration;
+    uint16_t data_len = hdr->data_len;
+
+    if (*tracepos + TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr) > traceLen) {
+        return false;
+    }
+
+    if (protocol == ICLASS || protocol == ISO_15693) {
+        duration *= 32;
+    }
+
+    uint8_t *frame = hdr->frame;
+    uint8_t *parityBytes = hdr->frame + data_len;
+
+    *tracepos += TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr);
+
+    if (protocol == TOPAZ && hdr->isResponse == false) {
+        if (merge_topaz_reader_frames(hdr->timestamp, &duration, tracepos, traceLen, trace, frame, topaz_buf, &data_len)) {
+            frame = topaz_buf;
+        }
+    }
+
+    fr->start = hdr->timestamp - first_ts;
+    fr->end = hdr->timestamp + duration - first_ts;
+    fr->isResponse = hdr->isResponse;
+    fr->data = frame;
+    fr->data_len = data_len;
+    fr->crc = NULL;
+    fr->note[0] = '\0';
+    fr->code[0] = '\0';
+    fr->plain_len = 0;
+
+    if (protocol == (uint8_t) -1) {
+        return true;
+    }
+
+    fr->crc = trace_crc_strings[trace_crc_status(protocol, hdr->isResponse, frame, data_len, parityBytes)];
+
+    char explanation[sizeof(fr->note)] = {0};
+    annotate_frame(protocol, hdr->isResponse, frame, data_len, parityBytes, TRACELOG_PARITY_LEN(hdr), explanation, sizeof(explanation), dicKeys, dicKeysCount);
+    if (explanation[0]) {
+        // annotations carry colors for the console
+        memcpy_filter_ansi(fr->note, explanation, sizeof(explanation), true);
+        trace_note_code(fr->code, fr->note);
+    }
+
+    if (protocol == PROTO_MIFARE || protocol == PROTO_MFPLUS) {
+        if (DecodeMifareData(frame, data_len, parityBytes, hdr->isResponse, fr->plain, &fr->plain_len, dicKeys, dicKeysCount) == false) {
+            fr->plain_len = 0;
+        }
+    }
+    return true;
+}
+
+// Decode a trace into an array of frame objects, one per record.
+// Same CRC checks and annotations as `trace list`, but without any printing of the frames.
+// Annotators keep their protocol state in cmdhflist.c, callers must not decode two traces at the same time.
+int TraceDecodeJSON(uint8_t *trace, uint32_t traceLen, uint8_t protocol, const uint64_t *dicKeys, uint32_t dicKeysCount, json_t *frames) {
+
+    if (trace == NULL || frames == NULL) {
+        return PM3_EINVARG;
+    }
+
+    trace_decode_reset(protocol);
+
+    const tracelog_hdr_t *first_hdr = (tracelog_hdr_t *)trace;
+
+    uint32_t tracepos = 0;
+    while (is_last_record(tracepos, traceLen) == false) {
+
+        uint8_t topaz_reader_command[9];
+        trace_frame_t fr;
+        if (trace_decode_frame(trace, &tracepos, traceLen, first_hdr->timestamp, protocol, dicKeys, dicKeysCount, topaz_reader_command, &fr) == false) {
+            break;
+        }
+
+        json_t *elm = json_object();
+        json_object_set_new(elm, "start", json_integer(fr.start));
+        json_object_set_new(elm, "end", json_integer(fr.end));
+        json_object_set_new(elm, "src", json_string(fr.isResponse ? "tag" : "rdr"));
+        JsonSaveBufAsHexCompact(elm, "data", (uint8_t *)fr.data, fr.data_len);
+
+        if (fr.crc) {
+            json_object_set_new(elm, "crc", json_string(fr.crc));
+        }
+        if (fr.code[0]) {
+            json_object_set_new(elm, "code", json_string(fr.code));
+        }
+        if (fr.note[0]) {
+            json_object_set_new(elm, "note", json_string(fr.note));
+        }
+        if (fr.plain_len) {
+            JsonSaveBufAsHexCompact(elm, "plain", fr.plain, fr.plain_len);
+        }
+
+        json_array_append_new(frames, elm);
+    }
+    return PM3_SUCCESS;
+}
+
+// JSON Lines output of `trace list`, one frame object per line with the fields of TraceDecodeJSON.
+// Lines are formatted once into a buffer and written through large stdio buffers, to the output and to
+// an annotation cache in the user directory. The cache is keyed by a hash of the client build, listed records,
+// protocol and dictionary, so listing the same trace again only copies the cached lines.
+#define TRACE_JSONL_BUFSIZE     (1 << 20)
+#define TRACE_CACHE_SUBDIR      "cache" PATHSEP
+#define TRACE_CACHE_VERSION     "pm3 trace jsonl v2"
+#define TRACE_CACHE_MAX_AGE     (30 * 24 * 3600)        // seconds since last use
+#define TRACE_CACHE_MAX_SIZE    (256 * 1024 * 1024)     // bytes
+
+static const char hexchars[] = "0123456789abcdef";
+
+static char *jsonl_put_hex(char *p, const uint8_t *d, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        *p++ = hexchars[d[i] >> 4];
+        *p++ = hexchars[d[i] & 0x0F];
+    }
+    return p;
+}
+
+static char *jsonl_put_str(char *p, const char *str) {
+    *p++ = '"';
+    for (; *str; str++) {
+        uint8_t c = *str;
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = c;
+        } else if (c < 0x20) {
+            p += sprintf(p, "\\u%04x", c);
+        } else {
+            *p++ = c;
+        }
+    }
+    *p++ = '"';
+    return p;
+}
+
+// worst case line length for a frame
+static size_t jsonl_line_size(void) {
+    return 128 + 2 * 0x7FFF + 6 * sizeof(((trace_frame_t *)0)->note) + 6 * sizeof(((trace_frame_t *)0)->code) + 2 * sizeof(((trace_frame_t *)0)->plain);
+}
+
+static size_t jsonl_format_frame(char *line, const trace_frame_t *fr) {
+    char *p = line;
+    p += sprintf(p, "{\"start\":%u,\"end\":%u,\"src\":\"%s\",\"data\":\"", fr->start, fr->end, fr->isResponse ? "tag" : "rdr");
+    p = jsonl_put_hex(p, fr->data, fr->data_len);
+    *p++ = '"';
+    if (fr->crc) {
+        p += sprintf(p, ",\"crc\":\"%s\"", fr->crc);
+    }
+    if (fr->code[0]) {
+        p += sprintf(p, ",\"code\":");
+        p = jsonl_put_str(p, fr->code);
+    }
+    if (fr->note[0]) {
+        p += sprintf(p, ",\"note\":");
+        p = jsonl_put_str(p, fr->note);
+    }
+    if (fr->plain_len) {
+        p += sprintf(p, ",\"plain\":\"");
+        p = jsonl_put_hex(p, fr->plain, fr->plain_len);
+        *p++ = '"';
+    }
+    *p++ = '}';
+    *p++ = '\n';
+    return p - line;
+}
+
+static char *trace_cache_path(uint32_t tracepos, uint32_t trace_end, uint8_t protocol, const uint64_t *dicKeys, uint32_t dicKeysCount) {
+
+    uint8_t digest[32] = {0};
+    mbedtls_sha256_context sctx;
+    mbedtls_sha256_init(&sctx);
+    mbedtls_sha256_starts(&sctx, 0);
+    mbedtls_sha256_update(&sctx, (const uint8_t *)TRACE_CACHE_VERSION, strlen(TRACE_CACHE_VERSION));
+    // annotators change between builds,  a dirty tree keeps its git version so take the build time too
+    mbedtls_sha256_update(&sctx, (const uint8_t *)g_version_information.gitversion, strnlen(g_version_information.gitversion, sizeof(g_version_information.gitversion)));
+    mbedtls_sha256_update(&sctx, (const uint8_t *)g_version_information.buildtime, strnlen(g_version_information.buildtime, sizeof(g_version_information.buildtime)));
+    mbedtls_sha256_update(&sctx, &protocol, sizeof(protocol));
+    // times are relative to the first record of the whole trace
+    mbedtls_sha256_update(&sctx, gs_trace, MIN(TRACELOG_HDR_LEN, gs_traceLen));
+    mbedtls_sha256_update(&sctx, gs_trace + tracepos, trace_end - tracepos);
+    if (dicKeys && dicKeysCount) {
+        mbedtls_sha256_update(&sctx, (const uint8_t *)dicKeys, (size_t)dicKeysCount * sizeof(uint64_t));
+    }
+    mbedtls_sha256_finish(&sctx, digest);
+    mbedtls_sha256_free(&sctx);
+
+    char fn[64] = "trace_";
+    char *p = jsonl_put_hex(fn + strlen(fn), digest, 16);
+    strcpy(p, ".jsonl");
+
+    char *path = NULL;
+    if (searchHomeFilePath(&path, TRACE_CACHE_SUBDIR, fn, true) != PM3_SUCCESS) {
+        return NULL;
+    }
+    return path;
+}
+
+static int trace_copy_cache(const char *path, FILE *out) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return PM3_EFILE;
+    }
+
+    uint8_t *buf = malloc(TRACE_JSONL_BUFSIZE);
+    if (buf == NULL) {
+        fclose(f);
+        return PM3_EMALLOC;
+    }
+
+    int res = PM3_SUCCESS;
+    size_t n;
+    while ((n = fread(buf, 1, TRACE_JSONL_BUFSIZE, f)) > 0) {
+        if (fwrite(buf, 1, n, out) != n) {
+            res = PM3_EIO;
+            break;
+        }
+    }
+    free(buf);
+    fclose(f);
+
+    // last use time,  for trace_cache_prune
+    if (res == PM3_SUCCESS) {
+        utime(path, NULL);
+    }
+    return res;
+}
+
+static int trace_cache_select(const struct dirent *d) {
+    return str_startswith(d->d_name, "trace_") && str_endswith(d->d_name, ".jsonl");
+}
+
+typedef struct {
+    char *path;
+    off_t size;
+    time_t mtime;
+} trace_cache_file_t;
+
+static int trace_cache_cmp(const void *a, const void *b) {
+    time_t ta = ((const trace_cache_file_t *)a)->mtime;
+    time_t tb = ((const trace_cache_file_t *)b)->mtime;
+    return (ta > tb) - (ta < tb);
+}
+
+// Drop cache files not used for TRACE_CACHE_MAX_AGE,
+// then the least recently used ones until the cache fits in TRACE_CACHE_MAX_SIZE
+static void trace_cache_prune(const char *cache_path) {
+
+    const char *sep = strrchr(cache_path, PATHSEP[0]);
+    if (sep == NULL) {
+        return;
+    }
+    size_t dirlen = sep - cache_path + 1;
+
+    char *dir = calloc(dirlen + 1, sizeof(char));
+    if (dir == NULL) {
+        return;
+    }
+    memcpy(dir, cache_path, dirlen);
+
+    struct dirent **namelist;
+    int n = scandir(dir, &namelist, trace_cache_select, alphasort);
+    if (n < 0) {
+        free(dir);
+        return;
+    }
+
+    trace_cache_file_t *files = calloc(MAX(n, 1), sizeof(trace_cache_file_t));
+    int count = 0;
+    uint64_t total = 0;
+    time_t now = time(NULL);
+
+    for (int i = 0; i < n; i++) {
+        size_t len = dirlen + strlen(namelist[i]->d_name) + 1;
+        char *path = calloc(len, sizeof(char));
+        if (path == NULL || files == NULL) {
+            free(path);
+            free(namelist[i]);
+            continue;
+        }
+        snprintf(path, len, "%s%s", dir, namelist[i]->d_name);
+        free(namelist[i]);
+
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            free(path);
+            continue;
+        }
+        if (now - st.st_mtime > TRACE_CACHE_MAX_AGE) {
+            remove(path);
+            free(path);
+            continue;
+        }
+        files[count].path = path;
+        files[count].size = st.st_size;
+        files[count].mtime = st.st_mtime;
+        total += st.st_size;
+        count++;
+    }
+    free(namelist);
+    free(dir);
+
+    if (files == NULL) {
+        return;
+    }
+
+    qsort(files, count, sizeof(trace_cache_file_t), trace_cache_cmp);
+    for (int i = 0; i < count; i++) {
+        if (total > TRACE_CACHE_MAX_SIZE) {
+            remove(files[i].path);
+            total -= files[i].size;
+        }
+        free(files[i].path);
+    }
+    free(files);
+}
+
+static int trace_list_jsonl(const char *filename, uint32_t tracepos, uint32_t trace_end, uint8_t protocol,
+                            const uint64_t *dicKeys, uint32_t dicKeysCount, bool use_cache) {
+
+    bool to_stdout = (strcmp(filename, "-") == 0);
+    FILE *out = to_stdout ? stdout : fopen(filename, "wb");
+    if (out == NULL) {
+        PrintAndLogEx(WARNING, "file not found or locked `" _YELLOW_("%s") "`", filename);
+        return PM3_EFILE;
+    }
+    if (to_stdout == false) {
+        setvbuf(out, NULL, _IOFBF, TRACE_JSONL_BUFSIZE);
+    }
+
+    char *cache_path = use_cache ? trace_cache_path(tracepos, trace_end, protocol, dicKeys, dicKeysCount) : NULL;
+    if (cache_path) {
+        trace_cache_prune(cache_path);
+    }
+    int res = (cache_path) ? trace_copy_cache(cache_path, out) : PM3_EFILE;
+    // on any other error nothing was written yet,  decode instead
+    if (res == PM3_SUCCESS || res == PM3_EIO) {
+        if (fflush(out) != 0) {
+            res = PM3_EIO;
+        }
+        if (to_stdout == false && fclose(out) != 0) {
+            res = PM3_EIO;
+        }
+        if (res == PM3_SUCCESS) {
+            PrintAndLogEx(SUCCESS, "Reused annotation cache `" _YELLOW_("%s") "`", cache_path);
+        } else {
+            PrintAndLogEx(FAILED, "Error writing `" _YELLOW_("%s") "`", filename);
+        }
+        free(cache_path);
+        return res;
+    }
+
+    // written under a temporary name, a listing stopped halfway never ends up in the cache
+    char *tmp_path = NULL;
+    FILE *cache = NULL;
+    if (cache_path) {
+        size_t tmplen = strlen(cache_path) + 16;
+        tmp_path = calloc(tmplen, sizeof(char));
+        if (tmp_path) {
+#ifdef _WIN32
+            snprintf(tmp_path, tmplen, "%s.tmp", cache_path);
+#else
+            snprintf(tmp_path, tmplen, "%s.%d", cache_path, (int)getpid());
+#endif
+            cache = fopen(tmp_path, "wb");
+        }
+        if (cache) {
+            setvbuf(cache, NULL, _IOFBF, TRACE_JSONL_BUFSIZE);
+        }
+    }
+
+    char *line = malloc(jsonl_line_size());
+    if (line == NULL) {
+        PrintAndLogEx(FAILED, "Cannot allocate memory for trace output");
+        if (cache) {
+            fclose(cache);
+            remove(tmp_path);
+        }
+        free(tmp_path);
+        free(cache_path);
+        if (to_stdout == false) {
+            fclose(out);
+        }
+        return PM3_EMALLOC;
+    }
+
+    trace_decode_reset(protocol);
+
+    uint32_t first_ts = ((tracelog_hdr_t *)gs_trace)->timestamp;
+    uint32_t frames = 0;
+    bool aborted = false;
+    bool write_err = false;
+
+    while (tracepos < trace_end) {
+        uint8_t topaz_reader_command[9];
+        trace_frame_t fr;
+        if (trace_decode_frame(gs_trace, &tracepos, trace_end, first_ts, protocol, dicKeys, dicKeysCount, topaz_reader_command, &fr) == false) {
+            break;
+        }
+
+        size_t len = jsonl_format_frame(line, &fr);
+        if (fwrite(line, 1, len, out) != len) {
+            write_err = true;
+            break;
+        }
+        // a full cache disk only costs the cache
+        if (cache && fwrite(line, 1, len, cache) != len) {
+            fclose(cache);
+            remove(tmp_path);
+            cache = NULL;
+        }
+        frames++;
+
+        if ((frames & 0xFFF) == 0 && kbd_enter_pressed()) {
+            aborted = true;
+            break;
+        }
+    }
+    free(line);
+
+    if (fflush(out) != 0) {
+        write_err = true;
+    }
+    if (to_stdout == false && fclose(out) != 0) {
+        write_err = true;
+    }
+
+    if (cache) {
+        bool ok = (fclose(cache) == 0) && (aborted == false) && (write_err == false);
+        if (ok == false || rename(tmp_path, cache_path) != 0) {
+            remove(tmp_path);
+        }
+    }
+    free(tmp_path);
+    free(cache_path);
+
+    if (write_err) {
+        PrintAndLogEx(FAILED, "Error writing `" _YELLOW_("%s") "`, output is incomplete", filename);
+        return PM3_EIO;
+    }
+    if (aborted) {
+        PrintAndLogEx(WARNING, "Aborted,  `" _YELLOW_("%s") "` is incomplete with " _YELLOW_("%u") " frames", filename, frames);
+        return PM3_EOPABORTED;
+    }
+    if (to_stdout == false) {
+        PrintAndLogEx(SUCCESS, "Wrote " _YELLOW_("%u") " frames to `" _YELLOW_("%s") "`", frames, filename);
+    }
+    return PM3_SUCCESS;
+}
+
+// map the `trace list -t` names to protocol, empty name and "raw" means no annotations
+int TraceProtocolFromName(const char *type, uint8_t *protocol) {
+    if (strcmp(type, "14a") == 0)           *protocol = ISO_14443A;
+    else if (strcmp(type, "14b") == 0)      *protocol = ISO_14443B;
+    else if (strcmp(type, "15") == 0)       *protocol = ISO_15693;
+    else if (strcmp(type, "7816") == 0)     *protocol = ISO_7816_4;
+    else if (strcmp(type, "cryptorf") == 0) *protocol = PROTO_CRYPTORF;
+    else if (strcmp(type, "des") == 0)      *protocol = MFDES;
+    else if (strcmp(type, "felica") == 0)   *protocol = FELICA;
+    else if (strcmp(type, "hitag1") == 0)   *protocol = PROTO_HITAG1;
+    else if (strcmp(type, "hitag2") == 0)   *protocol = PROTO_HITAG2;
+    else if (strcmp(type, "hitags") == 0)   *protocol = PROTO_HITAGS;
+    else if (strcmp(type, "iclass") == 0)   *protocol = ICLASS;
+    else if (strcmp(type, "legic") == 0)    *protocol = LEGIC;
+    else if (strcmp(type, "lto") == 0)      *protocol = LTO;
+    else if (strcmp(type, "mf") == 0)       *protocol = PROTO_MIFARE;
+    else if (strcmp(type, "raw") == 0)      *protocol = -1;
+    else if (strcmp(type, "seos") == 0)     *protocol = SEOS;
+    else if (strcmp(type, "thinfilm") == 0) *protocol = THINFILM;
+    else if (strcmp(type, "topaz") == 0)    *protocol = TOPAZ;
+    else if (strcmp(type, "mfp") == 0)      *protocol = PROTO_MFPLUS;
+    else if (strcmp(type, "") == 0)         *protocol = -1;
+    else return PM3_EINVARG;
+    return PM3_SUCCESS;
+}
+
 static int download_trace(void) {
 
     if (IfPm3Present() == false) {
@@ -1074,11 +1784,7 @@ static int download_trace(void) {
     }
 
     // reserve some space.
-    if (gs_trace) {
-        free(gs_trace);
-    }
-
-    gs_traceLen = 0;
+    trace_free();
 
     gs_trace = calloc(PM3_CMD_DATA_SIZE, sizeof(uint8_t));
     if (gs_trace == NULL) {
@@ -1162,7 +1868,7 @@ static int CmdTraceExtract(const char *Cmd) {
         return PM3_SUCCESS;
     }
 
-    uint16_t tracepos = 0;
+    uint32_t tracepos = 0;
 
     while (tracepos < gs_traceLen) {
         tracepos = extractChallenges(tracepos, gs_traceLen, gs_trace);
@@ -1179,35 +1885,81 @@ static int CmdTraceLoad(const char *Cmd) {
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "trace load",
                   "Load protocol data from binary file to trace buffer\n"
-                  "File extension is <.trace>",
-                  "trace load -f mytracefile    -> w/o file extension"
+                  "File extension is <.trace>, files ending in <.pcapng> are imported as pcapng\n"
+                  "Several files are concatenated in the given order",
+                  "trace load -f mytracefile        -> w/o file extension\n"
+                  "trace load -f part1 -f part2     -> concatenate two traces\n"
+                  "trace load -f mytracefile.pcapng -> import pcapng"
                  );
 
     void *argtable[] = {
         arg_param_begin,
-        arg_str1("f", "file", "<fn>", "Specify trace file to load"),
+        arg_strn("f", "file", "<fn>", 1, 16, "Specify trace file to load"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, false);
 
-    int fnlen = 0;
-    char filename[FILE_PATH_SIZE] = {0};
-    CLIParamStrToBuf(arg_get_str(ctx, 1), (uint8_t *)filename, FILE_PATH_SIZE, &fnlen);
+    struct arg_str *files = arg_get_str(ctx, 1);
+    int nfiles = files->count;
+    char filenames[16][FILE_PATH_SIZE] = {{0}};
+    for (int i = 0; i < nfiles; i++) {
+        strncpy(filenames[i], files->sval[i], FILE_PATH_SIZE - 1);
+    }
     CLIParserFree(ctx);
 
-    if (gs_trace) {
-        free(gs_trace); // maybe better to not clobber this until we have successful load?
-        gs_trace = NULL;
-        gs_traceLen = 0;
-    }
+    trace_free();
 
-    size_t len = 0;
-    if (loadFile_safe(filename, ".trace", (void **)&gs_trace, &len) != PM3_SUCCESS) {
-        PrintAndLogEx(FAILED, "Could not open file " _YELLOW_("%s"), filename);
-        return PM3_EIO;
-    }
+    if (nfiles == 1 && str_endswith(filenames[0], ".pcapng") == false) {
+        if (trace_load_file(filenames[0]) != PM3_SUCCESS) {
+            PrintAndLogEx(FAILED, "Could not open file " _YELLOW_("%s"), filenames[0]);
+            return PM3_EIO;
+        }
+    } else {
+        for (int i = 0; i < nfiles; i++) {
+
+            if (str_endswith(filenames[i], ".pcapng")) {
+                int res = pcapng_load_trace(filenames[i], &gs_trace, &gs_traceLen);
+                if (res != PM3_SUCCESS) {
+                    PrintAndLogEx(FAILED, "Could not load pcapng file " _YELLOW_("%s"), filenames[i]);
+                    trace_free();
+                    return (res == PM3_EFILE) ? PM3_EIO : res;
+                }
+                continue;
+            }
 
-    gs_traceLen = (long)len;
+            uint8_t *part = NULL;
+            size_t len = 0;
+            if (loadFile_safe(filenames[i], ".trace", (void **)&part, &len) != PM3_SUCCESS) {
+                PrintAndLogEx(FAILED, "Could not open file " _YELLOW_("%s"), filenames[i]);
+                trace_free();
+                return PM3_EIO;
+            }
+
+            if ((uint64_t)gs_traceLen + len > UINT32_MAX) {
+                PrintAndLogEx(FAILED, "Concatenated traces are larger than 4 GiB");
+                free(part);
+                trace_free();
+                return PM3_EOVFLOW;
+            }
+
+            uint8_t *tmp = realloc(gs_trace, gs_traceLen + len);
+            if (tmp == NULL) {
+                PrintAndLogEx(FAILED, "Cannot allocate memory for trace");
+                free(part);
+                trace_free();
+                return PM3_EMALLOC;
+            }
+            memcpy(tmp + gs_traceLen, part, len);
+            gs_trace = tmp;
+            gs_traceLen += len;
+            free(part);
+        }
+
+        if (gs_traceLen == 0) {
+            PrintAndLogEx(WARNING, "no records found");
+            return PM3_SUCCESS;
+        }
+    }
 
     PrintAndLogEx(SUCCESS, "Recorded Activity (TraceLen = " _YELLOW_("%u") " bytes)", gs_traceLen);
     PrintAndLogEx(HINT, "try " _YELLOW_("`trace list -1 -t ...`") " to view trace.  Remember the " _YELLOW_("`-1`") " param");
@@ -1219,13 +1971,17 @@ static int CmdTraceSave(const char *Cmd) {
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "trace save",
                   "Save protocol data from trace buffer to binary file\n"
-                  "File extension is <.trace>",
-                  "trace save -f mytracefile    -> w/o file extension"
+                  "File extension is <.trace>, or <.pcapng> with `--pcapng`\n"
+                  "pcapng files use the ISO 14443 link type for 14443 based protocols and nanosecond timestamps",
+                  "trace save -f mytracefile                -> w/o file extension\n"
+                  "trace save -f mytracefile --pcapng -t mf -> save as pcapng for Wireshark"
                  );
 
     void *argtable[] = {
         arg_param_begin,
         arg_str1("f", "file", "<fn>", "Specify trace file to save"),
+        arg_lit0(NULL, "pcapng", "save as pcapng instead of binary trace"),
+        arg_str0("t", "type", NULL, "protocol of the trace, selects the pcapng link type (def 14a)"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, false);
@@ -1233,8 +1989,21 @@ static int CmdTraceSave(const char *Cmd) {
     int fnlen = 0;
     char filename[FILE_PATH_SIZE] = {0};
     CLIParamStrToBuf(arg_get_str(ctx, 1), (uint8_t *)filename, FILE_PATH_SIZE, &fnlen);
+    bool as_pcapng = arg_get_lit(ctx, 2);
+
+
+    int tlen = 0;
+    char type[10] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 3), (uint8_t *)type, sizeof(type), &tlen);
+    str_lower(type);
     CLIParserFree(ctx);
 
+    uint8_t protocol = ISO_14443A;
+    if (tlen && TraceProtocolFromName(type, &protocol) != PM3_SUCCESS) {
+        PrintAndLogEx(FAILED, "Unknown protocol \"%s\"", type);
+        return PM3_EINVARG;
+    }
+
     if (gs_traceLen == 0) {
         download_trace();
         if (gs_traceLen == 0) {
@@ -1243,6 +2012,10 @@ static int CmdTraceSave(const char *Cmd) {
         }
     }
 
+    if (as_pcapng) {
+        return pcapng_save_trace(filename, gs_trace, gs_traceLen, protocol);
+    }
+
     saveFile(filename, ".trace", gs_trace, gs_traceLen);
     return PM3_SUCCESS;
 }
@@ -1274,6 +2047,12 @@ int CmdTraceListAlias(const char *Cmd, const char *alias, const char *protocol)
         arg_lit0("x", NULL, "show hexdump to convert to pcap(ng)\n"
                  "                                   or to import into Wireshark using encapsulation type \"ISO 14443\""),
         arg_str0("f", "file", "<fn>", "filename of dictionary"),
+        arg_u64_0(NULL, "first", "<dec>", "first record to list"),
+        arg_u64_0("n", "count", "<dec>", "number of records to list"),
+        arg_u64_0(NULL, "from", "<dec>", "list records starting at or after this many carrier periods (1/13.56 MHz for HF) since trace start"),
+        arg_u64_0(NULL, "to", "<dec>", "list records starting before this many carrier periods (1/13.56 MHz for HF) since trace start"),
+        arg_str0(NULL, "jsonl", "<fn>", "write frames as JSON lines to file, `-` for stdout"),
+        arg_lit0(NULL, "nocache", "don't use the annotation cache with --jsonl"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, true);
@@ -1285,7 +2064,7 @@ int CmdTraceListAlias(const char *Cmd, const char *alias, const char *protocol)
     return CmdTraceList(args);
 }
 
-int CmdTraceList(const char *Cmd) {
+static int trace_list(const char *Cmd) {
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "trace list",
                   "Annotate trace buffer with selected protocol data\n"
@@ -1313,7 +2092,10 @@ int CmdTraceList(const char *Cmd) {
                   "\n"
                   "trace list -t mf -f mfc_default_keys.dic     -> use default dictionary file\n"
                   "trace list -t 14a --frame                    -> show frame delay times\n"
-                  "trace list -t 14a -1                         -> use trace buffer "
+                  "trace list -t 14a -1                         -> use trace buffer\n"
+                  "trace list -t 14a -1 --first 1000 -n 50      -> list records 1000 to 1049\n"
+                  "trace list -t 14a -1 --from 100000 --to 200000 -> list records started within this time\n"
+                  "trace list -t mf -1 --jsonl frames.jsonl     -> write decoded frames as JSON lines"
                  );
 
     void *argtable[] = {
@@ -1327,6 +2109,12 @@ int CmdTraceList(const char *Cmd) {
                  "                                   or to import into Wireshark using encapsulation type \"ISO 14443\""),
         arg_str0("t", "type", NULL, "protocol to annotate the trace"),
         arg_str0("f", "file", "<fn>", "filename of dictionary"),
+        arg_u64_0(NULL, "first", "<dec>", "first record to list"),
+        arg_u64_0("n", "count", "<dec>", "number of records to list"),
+        arg_u64_0(NULL, "from", "<dec>", "list records starting at or after this many carrier periods (1/13.56 MHz for HF) since trace start"),
+        arg_u64_0(NULL, "to", "<dec>", "list records starting before this many carrier periods (1/13.56 MHz for HF) since trace start"),
+        arg_str0(NULL, "jsonl", "<fn>", "write frames as JSON lines to file, `-` for stdout"),
+        arg_lit0(NULL, "nocache", "don't use the annotation cache with --jsonl"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, true);
@@ -1350,35 +2138,37 @@ int CmdTraceList(const char *Cmd) {
         diclen = 0;
     }
 
+    // paging and time range use the record index
+    bool use_index = arg_get_u64_count(ctx, 9) || arg_get_u64_count(ctx, 10) || arg_get_u64_count(ctx, 11) || arg_get_u64_count(ctx, 12);
+    uint64_t first_rec = arg_get_u64_def(ctx, 9, 0);
+    uint64_t rec_count = arg_get_u64_def(ctx, 10, UINT32_MAX);
+    uint64_t time_from = arg_get_u64_def(ctx, 11, 0);
+    uint64_t time_to = arg_get_u64_def(ctx, 12, UINT64_MAX);
+
+    int jsonl_len = 0;
+    char jsonl_fn[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 13), (uint8_t *)jsonl_fn, FILE_PATH_SIZE, &jsonl_len);
+    bool use_cache = (arg_get_lit(ctx, 14) == false);
+
     CLIParserFree(ctx);
 
+    if (jsonl_len && show_hex) {
+        PrintAndLogEx(FAILED, "Can't combine `" _YELLOW_("--jsonl") "` with `" _YELLOW_("-x") "`");
+        return PM3_EINVARG;
+    }
+
+    // keep stdout clean for the JSON lines, CmdTraceList restores this
+    if (jsonl_len && strcmp(jsonl_fn, "-") == 0) {
+        SetConsoleToStderr(true);
+    }
+
     clearCommandBuffer();
 
     // no crc, no annotations
     uint8_t protocol = -1;
 
     // validate type of output
-    if (strcmp(type, "14a") == 0)      protocol = ISO_14443A;
-    else if (strcmp(type, "14b") == 0)      protocol = ISO_14443B;
-    else if (strcmp(type, "15") == 0)       protocol = ISO_15693;
-    else if (strcmp(type, "7816") == 0)     protocol = ISO_7816_4;
-    else if (strcmp(type, "cryptorf") == 0) protocol = PROTO_CRYPTORF;
-    else if (strcmp(type, "des") == 0)      protocol = MFDES;
-    else if (strcmp(type, "felica") == 0)   protocol = FELICA;
-    else if (strcmp(type, "hitag1") == 0)   protocol = PROTO_HITAG1;
-    else if (strcmp(type, "hitag2") == 0)   protocol = PROTO_HITAG2;
-    else if (strcmp(type, "hitags") == 0)   protocol = PROTO_HITAGS;
-    else if (strcmp(type, "iclass") == 0)   protocol = ICLASS;
-    else if (strcmp(type, "legic") == 0)    protocol = LEGIC;
-    else if (strcmp(type, "lto") == 0)      protocol = LTO;
-    else if (strcmp(type, "mf") == 0)       protocol = PROTO_MIFARE;
-    else if (strcmp(type, "raw") == 0)      protocol = -1;
-    else if (strcmp(type, "seos") == 0)     protocol = SEOS;
-    else if (strcmp(type, "thinfilm") == 0) protocol = THINFILM;
-    else if (strcmp(type, "topaz") == 0)    protocol = TOPAZ;
-    else if (strcmp(type, "mfp") == 0)      protocol = PROTO_MFPLUS;
-    else if (strcmp(type, "") == 0)         protocol = -1;
-    else {
+    if (TraceProtocolFromName(type, &protocol) != PM3_SUCCESS) {
         PrintAndLogEx(FAILED, "Unknown protocol \"%s\"", type);
         return PM3_EINVARG;
     }
@@ -1396,7 +2186,30 @@ int CmdTraceList(const char *Cmd) {
         return PM3_SUCCESS;
     }
 
-    uint16_t tracepos = 0;
+    uint32_t tracepos = 0;
+    uint32_t trace_end = gs_traceLen;
+
+    if (use_index) {
+        int res = trace_build_index();
+        if (res != PM3_SUCCESS) {
+            return res;
+        }
+
+        uint32_t rec_start = trace_index_find_time(time_from);
+        uint32_t rec_end = (time_to == UINT64_MAX) ? gs_trace_records : trace_index_find_time(time_to);
+        if ((uint64_t)rec_start + first_rec < rec_end) {
+            rec_start += first_rec;
+        } else {
+            rec_start = rec_end;
+        }
+        if (rec_end - rec_start > rec_count) {
+            rec_end = rec_start + rec_count;
+        }
+
+        PrintAndLogEx(SUCCESS, "Records ( " _YELLOW_("%u") " - " _YELLOW_("%u") " of %u )", rec_start, rec_end, gs_trace_records);
+        tracepos = gs_trace_index[rec_start];
+        trace_end = gs_trace_index[rec_end];
+    }
 
     /*
     if (protocol == FELICA) {
@@ -1404,8 +2217,8 @@ int CmdTraceList(const char *Cmd) {
     } */
 
     if (show_hex) {
-        while (tracepos < gs_traceLen) {
-            tracepos = printHexLine(tracepos, gs_traceLen, gs_trace, protocol);
+        while (tracepos < trace_end) {
+            tracepos = printHexLine(tracepos, trace_end, gs_trace, protocol);
         }
     } else {
 
@@ -1514,6 +2327,14 @@ int CmdTraceList(const char *Cmd) {
             }
         }
 
+        if (jsonl_len) {
+            int res = trace_list_jsonl(jsonl_fn, tracepos, trace_end, protocol, dicKeys, dicKeysCount, use_cache);
+            if (dictionaryLoad)  {
+                free((void *) dicKeys);
+            }
+            return res;
+        }
+
         PrintAndLogEx(NORMAL, "");
         if (use_relative) {
             PrintAndLogEx(NORMAL, "        Gap |   Duration | Src | Data (! denotes parity error, ' denotes short bytes)                    | CRC | Annotation");
@@ -1525,6 +2346,7 @@ int CmdTraceList(const char *Cmd) {
         // clean authentication data used with the mifare classic decrypt fct
         if (protocol == ISO_14443A || protocol == PROTO_MIFARE || protocol == PROTO_MFPLUS) {
             ClearAuthData();
+            ClearMfKeyCache();
         }
 
         // reset hitag state  machine
@@ -1538,8 +2360,8 @@ int CmdTraceList(const char *Cmd) {
             prev_EOT = &previous_EOT;
         }
 
-        while (tracepos < gs_traceLen) {
-            tracepos = printTraceLine(tracepos, gs_traceLen, gs_trace, protocol, show_wait_cycles, mark_crc, prev_EOT, use_us, dicKeys, dicKeysCount);
+        while (tracepos < trace_end) {
+            tracepos = printTraceLine(tracepos, trace_end, gs_trace, protocol, show_wait_cycles, mark_crc, prev_EOT, use_us, dicKeys, dicKeysCount);
 
             if (kbd_enter_pressed()) {
                 break;
@@ -1558,6 +2380,13 @@ int CmdTraceList(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+int CmdTraceList(const char *Cmd) {
+    bool to_stderr = GetConsoleToStderr();
+    int res = trace_list(Cmd);
+    SetConsoleToStderr(to_stderr);
+    return res;
+}
+
 static command_t CommandTable[] = {
     {"help",    CmdHelp,          AlwaysAvailable, "This help"},
     {"extract", CmdTraceExtract,  AlwaysAvailable, "Extract authentication challenges found in trace"},
@@ -20,10 +20,13 @@
 #define CMDTRACE_H__
 
 #include "common.h"
+#include "jansson.h"
 
 int CmdTrace(const char *Cmd);
 int CmdTraceList(const char *Cmd);
 int CmdTraceListAlias(const char *Cmd, const char *alias, const char *protocol);
-bool ImportTraceBuffer(const uint8_t *trace_src, uint16_t trace_len);
+bool ImportTraceBuffer(const uint8_t *trace_src, uint32_t trace_len);
+int TraceProtocolFromName(const char *type, uint8_t *protocol);
+int TraceDecodeJSON(uint8_t *trace, uint32_t traceLen, uint8_t protocol, const uint64_t *dicKeys, uint32_t dicKeysCount, json_t *frames);
 
 #endif
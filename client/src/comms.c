@@ -19,13 +19,16 @@
 #include "comms.h"
 
 #include <inttypes.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "uart/uart.h"
 #include "ui.h"
 #include "crc16.h"
+#include "commonutil.h" // reflect16
 #include "util.h" // g_pendingPrompt
 #include "util_posix.h" // msclock
 #include "util_darwin.h" // en/dis-ableNapp();
@@ -51,26 +54,69 @@ static uint8_t *comm_raw_data = NULL;
 static size_t comm_raw_len = 0;
 static size_t comm_raw_pos = 0;
 
-// Transmit buffer.
-static PacketCommandOLD txBuffer;
-static PacketCommandNGRaw txBufferNG;
-static size_t txBufferNGLen;
-static bool txBuffer_pending = false;
+// Transmit queue.
+// Frames are sent in order by the communication thread. Frames sent with SendCommandNGSeq() carry a
+// sequence number and count against the in-flight window until the device answered them.
+// The device executes commands one after the other,  so replies come back in the same order and
+// the oldest in-flight frame with a matching cmd owns the next reply.
+#define TX_QUEUE_SIZE 32
+
+typedef struct {
+    bool     windowed;
+    uint32_t seq;
+    uint16_t cmd;
+    size_t   len;           // NG/MIX frame length,  0 = OLD frame
+    union {
+        PacketCommandOLD   old;
+        PacketCommandNGRaw ng;
+    } frame;
+} tx_frame_t;
+
+typedef struct {
+    uint32_t seq;
+    uint16_t cmd;
+} tx_inflight_t;
+
+static tx_frame_t txQueue[TX_QUEUE_SIZE];
+static size_t txQueue_head = 0;
+static size_t txQueue_count = 0;
+static tx_inflight_t txInflight[CMD_WINDOW_MAX];
+static size_t txInflight_head = 0;
+static size_t txInflight_count = 0;
+static uint32_t txSeq = 0;
+static uint8_t txWindow = CMD_WINDOW_DEFAULT;
 static pthread_mutex_t txBufferMutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t txBufferSig = PTHREAD_COND_INITIALIZER;
 
-// Used by PacketResponseReceived as a ring buffer for messages that are yet to be
-// processed by a command handler (WaitForResponse{,Timeout})
+// Receive ring.
+// Single producer / single consumer ring of preallocated frames. The communication thread receives each
+// reply straight into the free slot at cmd_head and publishes it by advancing cmd_head. The main thread
+// (WaitForResponse{,Timeout}, dl_it, ...) reads replies in place and releases them by advancing cmd_tail,
+// so neither side takes a lock and a reply is copied at most once, into the caller's struct.
 static PacketResponseNG rxBuffer[CMD_BUFFER_SIZE];
+// sequence number of the command each reply answers,  0 = not sent with SendCommandNGSeq
+static uint32_t rxSeq[CMD_BUFFER_SIZE];
 
-// Points to the next empty position to write to
+// Points to the next empty position to write to,  only written by the communication thread
 static int cmd_head = 0;
 
-// Points to the position of the last unread command
+// Points to the position of the last unread command,  only written by the main thread
 static int cmd_tail = 0;
 
-// to lock rxBuffer operations from different threads
-static pthread_mutex_t rxBufferMutex = PTHREAD_MUTEX_INITIALIZER;
+// The main thread sleeps on rxWaitSig instead of polling the ring.
+// rx_generation is bumped for every published reply and for completed raw transfers, a waiter samples it
+// before looking at the ring and only goes to sleep if it did not change meanwhile.
+// rx_waiter is the reply cmd the main thread sleeps for, CMD_UNKNOWN for any reply.
+#define RX_WAIT_NONE        0xFFFFFFFF
+#define RX_WAIT_RAW         0xFFFFFFFE
+#define RX_WAIT_SLICE_MS    100
+static uint32_t rx_generation = 0;
+static uint32_t rx_waiter = RX_WAIT_NONE;
+static pthread_mutex_t rxWaitMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rxWaitSig = PTHREAD_COND_INITIALIZER;
+
+// reply borrowed by WaitForResponseRef,  still at the tail of the ring
+static bool rx_borrowed = false;
 
 // Global start time for WaitForResponseTimeout & dl_it, so we can reset timeout when we get packets
 // as sending lot of these packets can slow down things wuite a lot on slow links (e.g. hw status or lf read at 9600)
@@ -80,6 +126,49 @@ static uint64_t last_packet_time;
 
 static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, size_t ms_timeout, bool show_warning, uint32_t rec_cmd);
 
+// next free frame in the transmit queue,  waits for the communication thread if it is full
+// txBufferMutex must be held
+static tx_frame_t *tx_queue_slot(void) {
+    /**
+    This causes hangups at times, when the pm3 unit is unresponsive or disconnected. The main console thread is alive,
+    but comm thread just spins here. Not good.../holiman
+    **/
+    while (txQueue_count == TX_QUEUE_SIZE) {
+        // wait for communication thread to send some of the queued commands
+        pthread_cond_wait(&txBufferSig, &txBufferMutex);
+    }
+    return &txQueue[(txQueue_head + txQueue_count) % TX_QUEUE_SIZE];
+}
+
+static void tx_queue_push(void) {
+    txQueue_count++;
+    // tell communication thread that a new command can be send
+    pthread_cond_broadcast(&txBufferSig);
+}
+
+// drop whatever a previous communication thread left unsent
+static void tx_queue_reset(void) {
+    pthread_mutex_lock(&txBufferMutex);
+    txQueue_head = 0;
+    txQueue_count = 0;
+    txInflight_count = 0;
+    pthread_cond_broadcast(&txBufferSig);
+    pthread_mutex_unlock(&txBufferMutex);
+}
+
+// sequence number of the command answered by a reply with this cmd,  0 if none is in flight
+static uint32_t tx_inflight_pop(uint16_t cmd) {
+    uint32_t seq = 0;
+    pthread_mutex_lock(&txBufferMutex);
+    if (txInflight_count && txInflight[txInflight_head].cmd == cmd) {
+        seq = txInflight[txInflight_head].seq;
+        txInflight_head = (txInflight_head + 1) % CMD_WINDOW_MAX;
+        txInflight_count--;
+    }
+    pthread_mutex_unlock(&txBufferMutex);
+    return seq;
+}
+
 // Simple alias to track usages linked to the Bootloader, these commands must not be migrated.
 // - commands sent to enter bootloader mode as we might have to talk to old firmwares
 // - commands sent to the bootloader as it only supports OLD frames (which will always be the case for old BL)
@@ -111,92 +200,89 @@ void SendCommandOLD(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, c
     }
 
     pthread_mutex_lock(&txBufferMutex);
-    /**
-    This causes hangups at times, when the pm3 unit is unresponsive or disconnected. The main console thread is alive,
-    but comm thread just spins here. Not good.../holiman
-    **/
-    while (txBuffer_pending) {
-        // wait for communication thread to complete sending a previous command
-        pthread_cond_wait(&txBufferSig, &txBufferMutex);
-    }
-
-    txBuffer = c;
-    txBuffer_pending = true;
-
-    // tell communication thread that a new command can be send
-    pthread_cond_signal(&txBufferSig);
-
+    tx_frame_t *tx = tx_queue_slot();
+    tx->windowed = false;
+    tx->seq = 0;
+    tx->cmd = cmd;
+    tx->len = 0;
+    tx->frame.old = c;
+    tx_queue_push();
     pthread_mutex_unlock(&txBufferMutex);
-
-//__atomic_test_and_set(&txcmd_pending, __ATOMIC_SEQ_CST);
 }
 
-static void SendCommandNG_internal(uint16_t cmd, uint8_t *data, size_t len, bool ng) {
+static uint32_t SendCommandNG_internal(uint16_t cmd, uint8_t *data, size_t len, bool ng, bool windowed) {
 #ifdef COMMS_DEBUG
     PrintAndLogEx(INFO, "Sending %s", ng ? "NG" : "MIX");
 #endif
 
     if (!g_session.pm3_present) {
         PrintAndLogEx(INFO, "Sending bytes to proxmark failed - offline");
-        return;
+        return 0;
     }
     if (len > PM3_CMD_DATA_SIZE) {
         PrintAndLogEx(WARNING, "Sending %zu bytes of payload is too much, abort", len);
-        return;
+        return 0;
     }
 
-    PacketCommandNGPostamble *tx_post = (PacketCommandNGPostamble *)((uint8_t *)&txBufferNG + sizeof(PacketCommandNGPreamble) + len);
-
     pthread_mutex_lock(&txBufferMutex);
-    /**
-    This causes hangups at times, when the pm3 unit is unresponsive or disconnected. The main console thread is alive,
-    but comm thread just spins here. Not good.../holiman
-    **/
-    while (txBuffer_pending) {
-        // wait for communication thread to complete sending a previous command
-        pthread_cond_wait(&txBufferSig, &txBufferMutex);
-    }
 
-    txBufferNG.pre.magic = COMMANDNG_PREAMBLE_MAGIC;
-    txBufferNG.pre.ng = ng;
-    txBufferNG.pre.length = len;
-    txBufferNG.pre.cmd = cmd;
+    tx_frame_t *tx = tx_queue_slot();
+    PacketCommandNGRaw *txBufferNG = &tx->frame.ng;
+    PacketCommandNGPostamble *tx_post = (PacketCommandNGPostamble *)((uint8_t *)txBufferNG + sizeof(PacketCommandNGPreamble) + len);
+
+    txBufferNG->pre.magic = COMMANDNG_PREAMBLE_MAGIC;
+    txBufferNG->pre.ng = ng;
+    txBufferNG->pre.length = len;
+    txBufferNG->pre.cmd = cmd;
     if (len > 0 && data) {
-        memcpy(&txBufferNG.data, data, len);
+        memcpy(&txBufferNG->data, data, len);
     }
 
     if ((g_conn.send_via_fpc_usart && g_conn.send_with_crc_on_fpc) || ((!g_conn.send_via_fpc_usart) && g_conn.send_with_crc_on_usb)) {
         uint8_t first = 0, second = 0;
-        compute_crc(CRC_14443_A, (uint8_t *)&txBufferNG, sizeof(PacketCommandNGPreamble) + len, &first, &second);
+        compute_crc(CRC_14443_A, (uint8_t *)txBufferNG, sizeof(PacketCommandNGPreamble) + len, &first, &second);
         tx_post->crc = (first << 8) + second;
     } else {
         tx_post->crc = COMMANDNG_POSTAMBLE_MAGIC;
     }
 
-    txBufferNGLen = sizeof(PacketCommandNGPreamble) + len + sizeof(PacketCommandNGPostamble);
-
 #ifdef COMMS_DEBUG_RAW
-    print_hex_break((uint8_t *)&txBufferNG.pre, sizeof(PacketCommandNGPreamble), 32);
+    print_hex_break((uint8_t *)&txBufferNG->pre, sizeof(PacketCommandNGPreamble), 32);
     if (ng) {
-        print_hex_break((uint8_t *)&txBufferNG.data, len, 32);
+        print_hex_break((uint8_t *)&txBufferNG->data, len, 32);
     } else {
-        print_hex_break((uint8_t *)&txBufferNG.data, 3 * sizeof(uint64_t), 32);
-        print_hex_break((uint8_t *)&txBufferNG.data + 3 * sizeof(uint64_t), len - 3 * sizeof(uint64_t), 32);
+        print_hex_break((uint8_t *)&txBufferNG->data, 3 * sizeof(uint64_t), 32);
+        print_hex_break((uint8_t *)&txBufferNG->data + 3 * sizeof(uint64_t), len - 3 * sizeof(uint64_t), 32);
     }
     print_hex_break((uint8_t *)tx_post, sizeof(PacketCommandNGPostamble), 32);
 #endif
-    txBuffer_pending = true;
 
-    // tell communication thread that a new command can be send
-    pthread_cond_signal(&txBufferSig);
+    tx->windowed = windowed;
+    tx->seq = 0;
+    if (windowed) {
+        // 0 is kept for untagged replies
+        if (++txSeq == 0) {
+            txSeq = 1;
+        }
+        tx->seq = txSeq;
+    }
+    tx->cmd = cmd;
+    tx->len = sizeof(PacketCommandNGPreamble) + len + sizeof(PacketCommandNGPostamble);
+    uint32_t seq = tx->seq;
+    tx_queue_push();
 
     pthread_mutex_unlock(&txBufferMutex);
-
-//__atomic_test_and_set(&txcmd_pending, __ATOMIC_SEQ_CST);
+    return seq;
 }
 
 void SendCommandNG(uint16_t cmd, uint8_t *data, size_t len) {
-    SendCommandNG_internal(cmd, data, len, true);
+    SendCommandNG_internal(cmd, data, len, true, false);
+}
+
+// Only pipeline commands whose device handler doesn't poll data_available() to abort,
+// the commands queued behind it would look like a key press from the client
+uint32_t SendCommandNGSeq(uint16_t cmd, uint8_t *data, size_t len) {
+    return SendCommandNG_internal(cmd, data, len, true, true);
 }
 
 void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, const void *data, size_t len) {
@@ -209,7 +295,7 @@ void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, c
     memcpy(cmddata, arg, sizeof(arg));
     if (len && data)
         memcpy(cmddata + sizeof(arg), data, len);
-    SendCommandNG_internal(cmd, cmddata, len + sizeof(arg), false);
+    SendCommandNG_internal(cmd, cmddata, len + sizeof(arg), false, false);
 }
 
 
@@ -220,52 +306,128 @@ void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, c
  *  operation. Right now we'll just have to live with this.
  */
 void clearCommandBuffer(void) {
-    //This is a very simple operation
-    pthread_mutex_lock(&rxBufferMutex);
-    cmd_tail = cmd_head;
-    pthread_mutex_unlock(&rxBufferMutex);
+    // replies still to come for in-flight commands are not tagged anymore
+    pthread_mutex_lock(&txBufferMutex);
+    txInflight_count = 0;
+    pthread_mutex_unlock(&txBufferMutex);
+
+    // drop everything received so far
+    __atomic_store_n(&cmd_tail, __atomic_load_n(&cmd_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    rx_borrowed = false;
+}
+
+// wakes the main thread if it sleeps for this reply
+// called by the communication thread only
+static void rx_wake(uint32_t cmd, bool force) {
+    __atomic_add_fetch(&rx_generation, 1, __ATOMIC_SEQ_CST);
+
+    uint32_t waiter = __atomic_load_n(&rx_waiter, __ATOMIC_SEQ_CST);
+    if (waiter == RX_WAIT_NONE) {
+        return;
+    }
+
+    if (force || waiter == CMD_UNKNOWN || waiter == cmd || cmd == CMD_WTX) {
+        pthread_mutex_lock(&rxWaitMutex);
+        pthread_cond_signal(&rxWaitSig);
+        pthread_mutex_unlock(&rxWaitMutex);
+    }
+}
+
+// free slot the communication thread receives the next reply into
+static PacketResponseNG *rx_slot(void) {
+    return &rxBuffer[__atomic_load_n(&cmd_head, __ATOMIC_RELAXED)];
 }
+
 /**
- * @brief storeCommand stores a USB command in a circular buffer
- * @param UC
+ * @brief rx_publish hands the reply received into rx_slot() over to the main thread
+ * @param seq sequence number of the command it answers
  */
-static void storeReply(const PacketResponseNG *packet) {
-    pthread_mutex_lock(&rxBufferMutex);
-    if ((cmd_head + 1) % CMD_BUFFER_SIZE == cmd_tail) {
-        //If these two are equal, we're about to overwrite in the
-        // circular buffer.
-        PrintAndLogEx(FAILED, "WARNING: Command buffer about to overwrite command! This needs to be fixed!");
+static void rx_publish(uint32_t seq) {
+    int head = __atomic_load_n(&cmd_head, __ATOMIC_RELAXED);
+    int next = (head + 1) % CMD_BUFFER_SIZE;
+    int tail = __atomic_load_n(&cmd_tail, __ATOMIC_ACQUIRE);
+    uint16_t cmd = rxBuffer[head].cmd;
+
+    if (next == tail) {
+        // The main thread doesn't keep up, the slot is reused for the next reply
+        PrintAndLogEx(FAILED, "WARNING: Command buffer full, dropping reply 0x%04x! This needs to be fixed!", cmd);
         fflush(stdout);
+        rx_wake(cmd, true);
+        return;
     }
-    //Store the command at the 'head' location
-    PacketResponseNG *destination = &rxBuffer[cmd_head];
-    memcpy(destination, packet, sizeof(PacketResponseNG));
 
-    //increment head and wrap
-    cmd_head = (cmd_head + 1) % CMD_BUFFER_SIZE;
-    pthread_mutex_unlock(&rxBufferMutex);
+    rxSeq[head] = seq;
+    __atomic_store_n(&cmd_head, next, __ATOMIC_RELEASE);
+
+    // wake the main thread early when the ring fills up with replies it doesn't wait for
+    int used = (next - tail + CMD_BUFFER_SIZE) % CMD_BUFFER_SIZE;
+    rx_wake(cmd, used >= CMD_BUFFER_SIZE / 2);
 }
+
 /**
- * @brief getCommand gets a command from an internal circular buffer.
- * @param response location to write command
- * @return 1 if response was returned, 0 if nothing has been received
+ * @brief rx_peek gives the oldest unread reply without releasing it
+ * @param seq where to store the sequence number of the command it answers,  can be NULL
+ * @return the reply,  NULL if nothing has been received
  */
-static int getReply(PacketResponseNG *packet) {
-    pthread_mutex_lock(&rxBufferMutex);
-    //If head == tail, there's nothing to read, or if we just got initialized
-    if (cmd_head == cmd_tail)  {
-        pthread_mutex_unlock(&rxBufferMutex);
-        return 0;
+static PacketResponseNG *rx_peek(uint32_t *seq) {
+    int tail = __atomic_load_n(&cmd_tail, __ATOMIC_RELAXED);
+    if (tail == __atomic_load_n(&cmd_head, __ATOMIC_ACQUIRE)) {
+        return NULL;
     }
+    if (seq) {
+        *seq = rxSeq[tail];
+    }
+    return &rxBuffer[tail];
+}
 
-    //Pick out the next unread command
-    memcpy(packet, &rxBuffer[cmd_tail], sizeof(PacketResponseNG));
+// releases the reply returned by rx_peek,  the communication thread may reuse its slot afterwards
+static void rx_pop(void) {
+    int tail = __atomic_load_n(&cmd_tail, __ATOMIC_RELAXED);
+    __atomic_store_n(&cmd_tail, (tail + 1) % CMD_BUFFER_SIZE, __ATOMIC_RELEASE);
+}
+
+static uint32_t rx_snapshot(void) {
+    return __atomic_load_n(&rx_generation, __ATOMIC_SEQ_CST);
+}
 
-    //Increment tail - this is a circular buffer, so modulo buffer size
-    cmd_tail = (cmd_tail + 1) % CMD_BUFFER_SIZE;
+/**
+ * @brief rx_wait sleeps until a reply to `cmd` arrived after `generation` was sampled with rx_snapshot
+ * @param cmd reply to wait for,  CMD_UNKNOWN for any reply or RX_WAIT_RAW for a completed raw transfer
+ * @param generation rx_snapshot() taken before the ring was last looked at
+ * @param ms maximum time to sleep,  capped at RX_WAIT_SLICE_MS
+ */
+static void rx_wait(uint32_t cmd, uint32_t generation, uint64_t ms) {
+    ms = MIN(ms, RX_WAIT_SLICE_MS);
+    if (ms == 0) {
+        return;
+    }
 
-    pthread_mutex_unlock(&rxBufferMutex);
-    return 1;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&rxWaitMutex);
+    __atomic_store_n(&rx_waiter, cmd, __ATOMIC_SEQ_CST);
+    // pairs with rx_wake:  either we see the new generation or it sees us waiting
+    if (rx_snapshot() == generation && IsCommunicationThreadDead() == false) {
+        pthread_cond_timedwait(&rxWaitSig, &rxWaitMutex, &deadline);
+    }
+    __atomic_store_n(&rx_waiter, RX_WAIT_NONE, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&rxWaitMutex);
+}
+
+// CRC_14443_A continued over one more piece of a frame,  start with crc = 0xC6C6
+// and reflect16() the final value to get what crc16_a() gives for the whole frame
+static uint16_t rx_crc_a(uint16_t crc, const uint8_t *d, size_t n) {
+    if (n == 0) {
+        return crc;
+    }
+    return reflect16(crc16_fast(d, n, crc, true, true));
 }
 
 //-----------------------------------------------------------------------------
@@ -341,7 +503,7 @@ static void PacketResponseReceived(PacketResponseNG *packet) {
         // CMD_DOWNLOAD_BIGBUF packages which is not dealt with. I wonder if simply ignoring them will
         // work. lets try it.
         default: {
-            storeReply(packet);
+            rx_publish(tx_inflight_pop(packet->cmd));
             break;
         }
     }
@@ -409,8 +571,8 @@ __attribute__((force_align_arg_pointer))
     const communication_arg_t *connection = (communication_arg_t *)targ;
     uint32_t rxlen;
     bool commfailed = false;
-    PacketResponseNG rx;
-    PacketResponseNGRaw rx_raw;
+    PacketResponseNGPreamble pre;
+    PacketResponseNGPostamble post;
     // Stash the last state of is_receiving_raw, to detect if state changed
     bool is_receiving_raw_last = false;
 
@@ -432,6 +594,7 @@ __attribute__((force_align_arg_pointer))
                 PrintAndLogEx(WARNING, "\nCommunicating with Proxmark3 device " _RED_("failed"));
             }
             __atomic_test_and_set(&comm_thread_dead, __ATOMIC_SEQ_CST);
+            rx_wake(CMD_UNKNOWN, true);
             break;
         }
 
@@ -451,6 +614,9 @@ __attribute__((force_align_arg_pointer))
                     uint64_t clk = msclock();
                     __atomic_store_n(&timeout_start_time,  clk, __ATOMIC_SEQ_CST);
                     __atomic_store_n(&comm_raw_pos, bufferPos + rxlen, __ATOMIC_SEQ_CST);
+                    if (bufferPos + rxlen >= bufferLen) {
+                        rx_wake(RX_WAIT_RAW, false);
+                    }
                 } else if (res != PM3_ENODATA) {
                     PrintAndLogEx(WARNING, "Error when reading raw data: %zu/%zu, %d", bufferPos, bufferLen, res);
                     error = true;
@@ -472,17 +638,21 @@ __attribute__((force_align_arg_pointer))
                 // comm_raw_data == NULL is used in SetCommunicationReceiveMode()
                 __atomic_store_n(&comm_raw_data, NULL, __ATOMIC_SEQ_CST);
             }
-            res = uart_receive(sp, (uint8_t *)&rx_raw.pre, sizeof(PacketResponseNGPreamble), &rxlen);
+            res = uart_receive(sp, (uint8_t *)&pre, sizeof(PacketResponseNGPreamble), &rxlen);
 
             if ((res == PM3_SUCCESS) && (rxlen == sizeof(PacketResponseNGPreamble))) {
 
-                rx.magic = rx_raw.pre.magic;
-                uint16_t length = rx_raw.pre.length;
-                rx.ng = rx_raw.pre.ng;
-                rx.status = rx_raw.pre.status;
-                rx.cmd = rx_raw.pre.cmd;
+                // the reply is received in place,  into the slot it is handed over in
+                PacketResponseNG *rx = rx_slot();
+                rx->magic = pre.magic;
+                uint16_t length = pre.length;
+                rx->ng = pre.ng;
+                rx->status = pre.status;
+                rx->cmd = pre.cmd;
+
+                if (rx->magic == RESPONSENG_PREAMBLE_MAGIC) { // New style NG reply
 
-                if (rx.magic == RESPONSENG_PREAMBLE_MAGIC) { // New style NG reply
+                    uint64_t arg[3];
 
                     if (length > PM3_CMD_DATA_SIZE) {
                         PrintAndLogEx(WARNING, "Received packet frame with incompatible length: 0x%04x", length);
@@ -491,49 +661,49 @@ __attribute__((force_align_arg_pointer))
 
                     if ((!error) && (length > 0)) { // Get the variable length payload
 
-                        res = uart_receive(sp, (uint8_t *)&rx_raw.data, length, &rxlen);
+                        if (rx->ng) {
+                            res = uart_receive(sp, rx->data.asBytes, length, &rxlen);
+                        } else if (length < sizeof(arg)) {
+                            PrintAndLogEx(WARNING, "Received MIX packet frame with incompatible length: 0x%04x", length);
+                            error = true;
+                        } else {
+                            res = uart_receive(sp, (uint8_t *)arg, sizeof(arg), &rxlen);
+                            if ((res == PM3_SUCCESS) && (rxlen == sizeof(arg)) && (length > sizeof(arg))) {
+                                uint32_t datalen = 0;
+                                res = uart_receive(sp, rx->data.asBytes, length - sizeof(arg), &datalen);
+                                rxlen += datalen;
+                            }
+                        }
 
-                        if ((res != PM3_SUCCESS) || (rxlen != length)) {
+                        if (error) {
+                            // incompatible MIX frame, already reported
+                        } else if ((res != PM3_SUCCESS) || (rxlen != length)) {
 
                             PrintAndLogEx(WARNING, "Received packet frame with variable part too short? %d/%d", rxlen, length);
                             error = true;
 
-                        } else {
+                        } else if (rx->ng) {      // Received a valid NG frame
+
+                            rx->length = length;
+                            if ((rx->cmd == g_conn.last_command) && (rx->status == PM3_SUCCESS)) {
+                                ACK_received = true;
+                            }
+
+                        } else {                  // Received a valid MIX frame
 
-                            if (rx.ng) {      // Received a valid NG frame
-
-                                memcpy(&rx.data, &rx_raw.data, length);
-                                rx.length = length;
-                                if ((rx.cmd == g_conn.last_command) && (rx.status == PM3_SUCCESS)) {
-                                    ACK_received = true;
-                                }
-
-                            } else {
-                                uint64_t arg[3];
-                                if (length < sizeof(arg)) {
-                                    PrintAndLogEx(WARNING, "Received MIX packet frame with incompatible length: 0x%04x", length);
-                                    error = true;
-                                }
-
-                                if (!error) { // Received a valid MIX frame
-
-                                    memcpy(arg, &rx_raw.data, sizeof(arg));
-                                    rx.oldarg[0] = arg[0];
-                                    rx.oldarg[1] = arg[1];
-                                    rx.oldarg[2] = arg[2];
-                                    memcpy(&rx.data, ((uint8_t *)&rx_raw.data) + sizeof(arg), length - sizeof(arg));
-                                    rx.length = length - sizeof(arg);
-
-                                    if (rx.cmd == CMD_ACK) {
-                                        ACK_received = true;
-                                    }
-                                }
+                            rx->oldarg[0] = arg[0];
+                            rx->oldarg[1] = arg[1];
+                            rx->oldarg[2] = arg[2];
+                            rx->length = length - sizeof(arg);
+
+                            if (rx->cmd == CMD_ACK) {
+                                ACK_received = true;
                             }
                         }
                     } else if ((!error) && (length == 0)) { // we received an empty frame
 
-                        if (rx.ng) {
-                            rx.length = 0; // set received length to 0
+                        if (rx->ng) {
+                            rx->length = 0; // set received length to 0
                         } else {  // old frames can't be empty
                             PrintAndLogEx(WARNING, "Received empty MIX packet frame (length: 0x00)");
                             error = true;
@@ -542,7 +712,7 @@ __attribute__((force_align_arg_pointer))
                     }
 
                     if (!error) {                        // Get the postamble
-                        res = uart_receive(sp, (uint8_t *)&rx_raw.foopost, sizeof(PacketResponseNGPostamble), &rxlen);
+                        res = uart_receive(sp, (uint8_t *)&post, sizeof(PacketResponseNGPostamble), &rxlen);
                         if ((res != PM3_SUCCESS) || (rxlen != sizeof(PacketResponseNGPostamble))) {
                             PrintAndLogEx(WARNING, "Received packet frame without postamble");
                             error = true;
@@ -550,33 +720,43 @@ __attribute__((force_align_arg_pointer))
                     }
 
                     if (!error) {                        // Check CRC, accept MAGIC as placeholder
-                        rx.crc = rx_raw.foopost.crc;
+                        rx->crc = post.crc;
 
-                        if (rx.crc != RESPONSENG_POSTAMBLE_MAGIC) {
+                        if (rx->crc != RESPONSENG_POSTAMBLE_MAGIC) {
 
-                            uint8_t first, second;
-                            compute_crc(CRC_14443_A, (uint8_t *)&rx_raw, sizeof(PacketResponseNGPreamble) + length, &first, &second);
+                            // CRC over preamble and payload,  the payload pieces are not contiguous
+                            init_table(CRC_14443_A);
+                            uint16_t crc = rx_crc_a(0xC6C6, (uint8_t *)&pre, sizeof(PacketResponseNGPreamble));
+                            if (rx->ng == false) {
+                                crc = rx_crc_a(crc, (uint8_t *)arg, sizeof(arg));
+                            }
+                            crc = rx_crc_a(crc, rx->data.asBytes, rx->length);
+                            crc = reflect16(crc);
+                            uint8_t first = crc & 0xFF, second = crc >> 8;
 
-                            if ((first << 8) + second != rx.crc) {
-                                PrintAndLogEx(WARNING, "Received packet frame with invalid CRC %02X%02X <> %04X", first, second, rx.crc);
+                            if ((first << 8) + second != rx->crc) {
+                                PrintAndLogEx(WARNING, "Received packet frame with invalid CRC %02X%02X <> %04X", first, second, rx->crc);
                                 error = true;
                             }
                         }
                     }
                     if (!error) {             // Received a valid OLD frame
 #ifdef COMMS_DEBUG
-                        PrintAndLogEx(NORMAL, "Receiving %s:", rx.ng ? "NG" : "MIX");
+                        PrintAndLogEx(NORMAL, "Receiving %s:", rx->ng ? "NG" : "MIX");
 #endif
 #ifdef COMMS_DEBUG_RAW
-                        print_hex_break((uint8_t *)&rx_raw.pre, sizeof(PacketResponseNGPreamble), 32);
-                        print_hex_break((uint8_t *)&rx_raw.data, rx_raw.pre.length, 32);
-                        print_hex_break((uint8_t *)&rx_raw.foopost, sizeof(PacketResponseNGPostamble), 32);
+                        print_hex_break((uint8_t *)&pre, sizeof(PacketResponseNGPreamble), 32);
+                        if (rx->ng == false) {
+                            print_hex_break((uint8_t *)arg, sizeof(arg), 32);
+                        }
+                        print_hex_break(rx->data.asBytes, rx->length, 32);
+                        print_hex_break((uint8_t *)&post, sizeof(PacketResponseNGPostamble), 32);
 #endif
-                        PacketResponseReceived(&rx);
+                        PacketResponseReceived(rx);
                     }
                 } else {                               // Old style reply
                     PacketResponseOLD rx_old;
-                    memcpy(&rx_old, &rx_raw.pre, sizeof(PacketResponseNGPreamble));
+                    memcpy(&rx_old, &pre, sizeof(PacketResponseNGPreamble));
 
                     res = uart_receive(sp, ((uint8_t *)&rx_old) + sizeof(PacketResponseNGPreamble), sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble), &rxlen);
                     if ((res != PM3_SUCCESS) || (rxlen != sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble))) {
@@ -592,20 +772,20 @@ __attribute__((force_align_arg_pointer))
                         print_hex_break((uint8_t *)&rx_old.arg, sizeof(rx_old.arg), 32);
                         print_hex_break((uint8_t *)&rx_old.d, sizeof(rx_old.d), 32);
 #endif
-                        rx.ng = false;
-                        rx.magic = 0;
-                        rx.status = 0;
-                        rx.crc = 0;
-                        rx.cmd = rx_old.cmd;
-                        rx.oldarg[0] = rx_old.arg[0];
-                        rx.oldarg[1] = rx_old.arg[1];
-                        rx.oldarg[2] = rx_old.arg[2];
-                        rx.length = PM3_CMD_DATA_SIZE;
-                        memcpy(&rx.data, &rx_old.d, rx.length);
-                        PacketResponseReceived(&rx);
-                        if (rx.cmd == CMD_ACK) {
+                        rx->ng = false;
+                        rx->magic = 0;
+                        rx->status = 0;
+                        rx->crc = 0;
+                        rx->cmd = rx_old.cmd;
+                        rx->oldarg[0] = rx_old.arg[0];
+                        rx->oldarg[1] = rx_old.arg[1];
+                        rx->oldarg[2] = rx_old.arg[2];
+                        rx->length = PM3_CMD_DATA_SIZE;
+                        memcpy(&rx->data, &rx_old.d, rx->length);
+                        if (rx->cmd == CMD_ACK) {
                             ACK_received = true;
                         }
+                        PacketResponseReceived(rx);
                     }
                 }
             } else {
@@ -631,35 +811,46 @@ __attribute__((force_align_arg_pointer))
 #ifdef COMMS_DEBUG
                 PrintAndLogEx(NORMAL, "Received ACK, fast TX mode: ignoring other RX till TX");
 #endif
-                while (!txBuffer_pending) {
+                while (txQueue_count == 0) {
                     pthread_cond_wait(&txBufferSig, &txBufferMutex);
                 }
             }
         }
 
-        if (txBuffer_pending) {
+        // send everything queued,  windowed frames only while the window has room
+        bool sent = false;
+        while (txQueue_count && (commfailed == false)) {
 
-            if (txBufferNGLen) { // NG packet
-                res = uart_send(sp, (uint8_t *) &txBufferNG, txBufferNGLen);
-                if (res == PM3_EIO) {
-                    commfailed = true;
-                }
-                g_conn.last_command = txBufferNG.pre.cmd;
-                txBufferNGLen = 0;
+            tx_frame_t *tx = &txQueue[txQueue_head];
+            if (tx->windowed && txInflight_count >= MIN(txWindow, CMD_WINDOW_MAX)) {
+                break;
+            }
+
+            if (tx->len) { // NG packet
+                res = uart_send(sp, (uint8_t *) &tx->frame.ng, tx->len);
             } else {
-                res = uart_send(sp, (uint8_t *) &txBuffer, sizeof(PacketCommandOLD));
-                if (res == PM3_EIO) {
-                    commfailed = true;
-                }
-                g_conn.last_command = txBuffer.cmd;
+                res = uart_send(sp, (uint8_t *) &tx->frame.old, sizeof(PacketCommandOLD));
+            }
+            if (res == PM3_EIO) {
+                commfailed = true;
             }
+            g_conn.last_command = tx->cmd;
 
-            txBuffer_pending = false;
+            if (tx->windowed) {
+                txInflight[(txInflight_head + txInflight_count) % CMD_WINDOW_MAX] = (tx_inflight_t) { tx->seq, tx->cmd };
+                txInflight_count++;
+            }
 
-            // main thread doesn't know send failed...
+            txQueue_head = (txQueue_head + 1) % TX_QUEUE_SIZE;
+            txQueue_count--;
+            sent = true;
+        }
 
-            // tell main thread that txBuffer is empty
-            pthread_cond_signal(&txBufferSig);
+        // main thread doesn't know send failed...
+
+        if (sent) {
+            // tell main thread that there is room in the queue
+            pthread_cond_broadcast(&txBufferSig);
         }
 
         pthread_mutex_unlock(&txBufferMutex);
@@ -749,6 +940,7 @@ bool OpenProxmarkSilent(pm3_device_t **dev, const char *port, uint32_t speed) {
         // "Session" flag, to tell via which interface next msgs should be sent: USB or FPC USART
         g_conn.send_via_fpc_usart = false;
 
+        tx_queue_reset();
         pthread_create(&communication_thread, NULL, &uart_communication, &g_conn);
         __atomic_clear(&comm_thread_dead, __ATOMIC_SEQ_CST);
         __atomic_clear(&reconnect_ok, __ATOMIC_SEQ_CST);
@@ -809,6 +1001,7 @@ bool OpenProxmark(pm3_device_t **dev, const char *port, bool wait_for_port, int
         // "Session" flag, to tell via which interface next msgs should be sent: USB or FPC USART
         g_conn.send_via_fpc_usart = false;
 
+        tx_queue_reset();
         pthread_create(&communication_thread, NULL, &uart_communication, &g_conn);
         __atomic_clear(&comm_thread_dead, __ATOMIC_SEQ_CST);
         g_session.pm3_present = true; // TODO support for multiple devices
@@ -971,6 +1164,8 @@ size_t WaitForRawDataTimeout(uint8_t *buffer, size_t len, size_t ms_timeout, boo
     size_t pos = 0;
     while (pos < len) {
 
+        uint32_t generation = rx_snapshot();
+
         if (kbd_enter_pressed()) {
             // Send anything to stop the transfer
             PrintAndLogEx(INFO, "Stopping");
@@ -1001,7 +1196,8 @@ size_t WaitForRawDataTimeout(uint8_t *buffer, size_t len, size_t ms_timeout, boo
 
         print_counter++;
         last_pos = pos;
-        msleep(10);
+        // the communication thread wakes us up as soon as the buffer is complete
+        rx_wait(RX_WAIT_RAW, generation, 10);
     }
     if (pos == len && (ms_timeout != (size_t) - 1)) {
         // If ms_timeout != -1, when the desired data is received, tell the arm side
@@ -1017,33 +1213,41 @@ size_t WaitForRawDataTimeout(uint8_t *buffer, size_t len, size_t ms_timeout, boo
     return pos;
 }
 
-/**
- * @brief Waits for a certain response type. This method waits for a maximum of
- * ms_timeout milliseconds for a specified response command.
+// time left until ms_timeout passed without receiving anything,  -1 = wait forever
+static uint64_t rx_time_left(size_t ms_timeout) {
+    if (ms_timeout == (size_t) - 1) {
+        return RX_WAIT_SLICE_MS;
+    }
+    uint64_t elapsed = msclock() - __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
+    return (elapsed >= ms_timeout) ? 0 : ms_timeout - elapsed;
+}
+
+// applies a Waiting Time eXtension request to the timeout
+static void rx_apply_wtx(const PacketResponseNG *response, size_t *ms_timeout) {
+    if (response->cmd == CMD_WTX && response->length == sizeof(uint16_t)) {
+        uint16_t wtx = response->data.asDwords[0] & 0xFFFF;
+        PrintAndLogEx(DEBUG, "Got Waiting Time eXtension request %i ms", wtx);
+        if (*ms_timeout != (size_t) - 1) {
+            *ms_timeout += wtx;
+        }
+    }
+}
 
+/**
+ * @brief Waits for a certain response type and leaves it unreleased at the tail of the receive ring.
+ * Other replies are released on the way.
+ *
  * @param cmd command to wait for, or CMD_UNKNOWN to take any command.
- * @param response struct to copy received command into.
- * @param ms_timeout display message after 3 seconds
+ * @param ms_timeout timeout in milliseconds
  * @param show_warning display message after 3 seconds
- * @return true if command was returned, otherwise false
+ * @return the reply,  NULL on timeout
  */
-bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout, bool show_warning) {
-
-    PacketResponseNG resp;
-    // init to ZERO
-    resp.cmd = 0,
-    resp.length = 0,
-    resp.magic = 0,
-    resp.status = 0,
-    resp.crc = 0,
-    resp.ng = false,
-    resp.oldarg[0] = 0;
-    resp.oldarg[1] = 0;
-    resp.oldarg[2] = 0;
-    memset(resp.data.asBytes, 0, PM3_CMD_DATA_SIZE);
+static PacketResponseNG *rx_wait_reply(uint32_t cmd, size_t ms_timeout, bool show_warning) {
 
-    if (response == NULL) {
-        response = &resp;
+    // a reply still borrowed by WaitForResponseRef is released by the next wait
+    if (rx_borrowed) {
+        rx_pop();
+        rx_borrowed = false;
     }
 
     // Add delay depending on the communication channel & speed
@@ -1060,34 +1264,84 @@ bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms
             break;
         }
 
-        while (getReply(response)) {
-            if (cmd == CMD_UNKNOWN || response->cmd == cmd) {
-                return true;
-            }
+        uint32_t generation = rx_snapshot();
 
-            if (response->cmd == CMD_WTX && response->length == sizeof(uint16_t)) {
-                uint16_t wtx = response->data.asDwords[0] & 0xFFFF;
-                PrintAndLogEx(DEBUG, "Got Waiting Time eXtension request %i ms", wtx);
-                if (ms_timeout != (size_t) - 1) {
-                    ms_timeout += wtx;
-                }
+        PacketResponseNG *response;
+        while ((response = rx_peek(NULL)) != NULL) {
+            if (cmd == CMD_UNKNOWN || response->cmd == cmd) {
+                return response;
             }
+            rx_apply_wtx(response, &ms_timeout);
+            rx_pop();
         }
 
-        uint64_t tmp_clk = __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
-        if ((ms_timeout != (size_t) - 1) && (msclock() - tmp_clk > ms_timeout)) {
+        uint64_t left = rx_time_left(ms_timeout);
+        if (left == 0) {
             break;
         }
 
+        uint64_t tmp_clk = __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
         if (msclock() - tmp_clk > 3000 && show_warning) {
             // 3 seconds elapsed (but this doesn't mean the timeout was exceeded)
             PrintAndLogEx(INFO, "You can cancel this operation by pressing the pm3 button");
             show_warning = false;
         }
-        // just to avoid CPU busy loop:
-        msleep(1);
+
+        rx_wait(cmd, generation, left);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Waits for a certain response type. This method waits for a maximum of
+ * ms_timeout milliseconds for a specified response command.
+
+ * @param cmd command to wait for, or CMD_UNKNOWN to take any command.
+ * @param response struct to copy received command into.
+ * @param ms_timeout display message after 3 seconds
+ * @param show_warning display message after 3 seconds
+ * @return true if command was returned, otherwise false
+ */
+bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout, bool show_warning) {
+
+    const PacketResponseNG *reply = rx_wait_reply(cmd, ms_timeout, show_warning);
+    if (reply == NULL) {
+        return false;
+    }
+
+    if (response) {
+        // only the received part of the payload
+        memcpy(response, reply, offsetof(PacketResponseNG, data));
+        memcpy(response->data.asBytes, reply->data.asBytes, MIN(reply->length, PM3_CMD_DATA_SIZE));
+    }
+    rx_pop();
+    return true;
+}
+
+/**
+ * @brief Like WaitForResponseTimeout,  but lends the reply in place instead of copying it.
+ * The reply stays valid until ReleaseResponse(),  the next wait or clearCommandBuffer().
+ *
+ * @param cmd command to wait for, or CMD_UNKNOWN to take any command.
+ * @param response where to store a pointer to the reply
+ * @param ms_timeout timeout in milliseconds
+ * @return true if command was returned, otherwise false
+ */
+bool WaitForResponseRef(uint32_t cmd, const PacketResponseNG **response, size_t ms_timeout) {
+    const PacketResponseNG *reply = rx_wait_reply(cmd, ms_timeout, true);
+    if (reply == NULL) {
+        return false;
+    }
+    rx_borrowed = true;
+    *response = reply;
+    return true;
+}
+
+void ReleaseResponse(void) {
+    if (rx_borrowed) {
+        rx_pop();
+        rx_borrowed = false;
     }
-    return false;
 }
 
 bool WaitForResponseTimeout(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout) {
@@ -1098,6 +1352,150 @@ bool WaitForResponse(uint32_t cmd, PacketResponseNG *response) {
     return WaitForResponseTimeoutW(cmd, response, -1, true);
 }
 
+void SetCommunicationWindow(uint8_t window) {
+    pthread_mutex_lock(&txBufferMutex);
+    txWindow = MAX(1, MIN(window, CMD_WINDOW_MAX));
+    pthread_mutex_unlock(&txBufferMutex);
+}
+
+uint8_t GetCommunicationWindow(void) {
+    return __atomic_load_n(&txWindow, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Waits for the reply to a command sent with SendCommandNGSeq.
+ * Replies to older commands are dropped,  other replies are handled like WaitForResponseTimeout does.
+ *
+ * @param seq sequence number returned by SendCommandNGSeq
+ * @param response struct to copy received command into.
+ * @param ms_timeout timeout in milliseconds
+ * @return true if the reply was received,  false on timeout or if it got lost
+ */
+bool WaitForResponseSeq(uint32_t seq, PacketResponseNG *response, size_t ms_timeout) {
+
+    if (seq == 0) {
+        return false;
+    }
+
+    ReleaseResponse();
+
+    // Add delay depending on the communication channel & speed
+    if (ms_timeout != (size_t) - 1)
+        ms_timeout += communication_delay();
+
+    __atomic_store_n(&timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
+
+    while (true) {
+
+        if (IsCommunicationThreadDead()) {
+            break;
+        }
+
+        uint32_t generation = rx_snapshot();
+
+        uint32_t rseq = 0;
+        const PacketResponseNG *reply;
+        while ((reply = rx_peek(&rseq)) != NULL) {
+
+            if (rseq == seq) {
+                memcpy(response, reply, offsetof(PacketResponseNG, data));
+                memcpy(response->data.asBytes, reply->data.asBytes, MIN(reply->length, PM3_CMD_DATA_SIZE));
+                rx_pop();
+                return true;
+            }
+
+            // sequence numbers wrap,  compare the distance
+            if (rseq && (int32_t)(rseq - seq) > 0) {
+                // the device already answered a later command,  leave its reply for the next wait
+                return false;
+            }
+
+            rx_apply_wtx(reply, &ms_timeout);
+            rx_pop();
+        }
+
+        uint64_t left = rx_time_left(ms_timeout);
+        if (left == 0) {
+            break;
+        }
+        // the reply cmd isn't known here,  any reply wakes us up
+        rx_wait(CMD_UNKNOWN, generation, left);
+    }
+    return false;
+}
+
+// Waits until the device answered all in-flight commands,  or ms_timeout passed without a reply.
+// Afterwards the receive buffer is empty and the window is free again.
+void DrainCommandWindow(size_t ms_timeout) {
+
+    __atomic_store_n(&timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
+
+    while (IsCommunicationThreadDead() == false) {
+
+        uint32_t generation = rx_snapshot();
+
+        pthread_mutex_lock(&txBufferMutex);
+        bool busy = (txInflight_count > 0);
+        for (size_t i = 0; i < txQueue_count; i++) {
+            busy |= txQueue[(txQueue_head + i) % TX_QUEUE_SIZE].windowed;
+        }
+        pthread_mutex_unlock(&txBufferMutex);
+
+        if (busy == false) {
+            break;
+        }
+
+        uint64_t left = rx_time_left(ms_timeout);
+        if (left == 0) {
+            break;
+        }
+        // every reply frees a place in the window
+        rx_wait(CMD_UNKNOWN, generation, left);
+    }
+    clearCommandBuffer();
+}
+
+/**
+ * @brief Sends `count` independent commands and keeps up to the communication window of them in flight.
+ * Only for NG commands the device answers with a reply of the same cmd.
+ *
+ * @param cmd command to send
+ * @param payloads `count` payloads of `len` bytes each
+ * @param len payload length
+ * @param count number of commands
+ * @param responses `count` replies,  in the same order as the payloads
+ * @param received `count` flags,  true if the reply at this position was received
+ * @param ms_timeout timeout in milliseconds per reply
+ * @return number of received replies.  The commands after a lost reply are not sent.
+ */
+size_t SendCommandNGWindowed(uint16_t cmd, uint8_t *payloads, size_t len, size_t count, PacketResponseNG *responses, bool *received, size_t ms_timeout) {
+
+    uint32_t seqs[CMD_WINDOW_MAX] = {0};
+    size_t window = GetCommunicationWindow();
+    size_t sent = 0, got = 0;
+
+    memset(received, 0, count * sizeof(bool));
+    clearCommandBuffer();
+
+    for (size_t i = 0; i < count; i++) {
+
+        // keep the next commands in flight while waiting for this one
+        while (sent < count && sent < i + window) {
+            seqs[sent % CMD_WINDOW_MAX] = SendCommandNGSeq(cmd, payloads + (sent * len), len);
+            sent++;
+        }
+
+        received[i] = WaitForResponseSeq(seqs[i % CMD_WINDOW_MAX], &responses[i], ms_timeout);
+        if (received[i] == false) {
+            // in-flight replies might be shifted,  let the caller retry the remaining ones
+            DrainCommandWindow(ms_timeout);
+            break;
+        }
+        got++;
+    }
+    return got;
+}
+
 /**
 * Data transfer from Proxmark to client. This method times out after
 * ms_timeout milliseconds.
@@ -1181,31 +1579,43 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, siz
     uint32_t bytes_completed = 0;
     __atomic_store_n(&timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
 
+    ReleaseResponse();
+
     // Add delay depending on the communication channel & speed
     if (ms_timeout != (size_t) - 1)
         ms_timeout += communication_delay();
 
     while (true) {
 
-        if (getReply(response)) {
+        uint32_t generation = rx_snapshot();
 
-            if (response->cmd == CMD_ACK)
-                return true;
-            if (response->cmd == CMD_SPIFFS_DOWNLOAD && response->status == PM3_EMALLOC)
-                return false;
-            // Spiffs // fpgamem-plot download is converted to NG,
-            if (response->cmd == CMD_SPIFFS_DOWNLOAD || response->cmd == CMD_FPGAMEM_DOWNLOAD)
+        // the chunks are copied straight from the receive ring into dest
+        const PacketResponseNG *reply;
+        while ((reply = rx_peek(NULL)) != NULL) {
+
+            if (reply->cmd == CMD_ACK ||
+                    reply->cmd == CMD_SPIFFS_DOWNLOAD ||
+                    reply->cmd == CMD_FPGAMEM_DOWNLOAD) {
+
+                memcpy(response, reply, offsetof(PacketResponseNG, data));
+                memcpy(response->data.asBytes, reply->data.asBytes, MIN(reply->length, PM3_CMD_DATA_SIZE));
+                rx_pop();
+
+                if (response->cmd == CMD_SPIFFS_DOWNLOAD && response->status == PM3_EMALLOC)
+                    return false;
+                // Spiffs // fpgamem-plot download is converted to NG,
                 return true;
+            }
 
             // sample_buf is a array pointer, located in data.c
             // arg0 = offset in transfer. Startindex of this chunk
             // arg1 = length bytes to transfer
             // arg2 = bigbuff tracelength (?)
-            if (response->cmd == rec_cmd) {
+            if (reply->cmd == rec_cmd) {
 
-                uint32_t offset = response->oldarg[0];
-                uint32_t copy_bytes = MIN(bytes - bytes_completed, response->oldarg[1]);
-                //uint32_t tracelen = response->oldarg[2];
+                uint32_t offset = reply->oldarg[0];
+                uint32_t copy_bytes = MIN(bytes - bytes_completed, reply->oldarg[1]);
+                //uint32_t tracelen = reply->oldarg[2];
 
                 // extended bounds check1.  upper limit is PM3_CMD_DATA_SIZE
                 // shouldn't happen
@@ -1214,31 +1624,34 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, siz
                 // extended bounds check2.
                 if (offset + copy_bytes > bytes) {
                     PrintAndLogEx(FAILED, "ERROR: Out of bounds when downloading from device,  offset %u | len %u | total len %u > buf_size %u", offset, copy_bytes,  offset + copy_bytes,  bytes);
-                    break;
+                    rx_pop();
+                    return false;
                 }
 
-                memcpy(dest + offset, response->data.asBytes, copy_bytes);
+                memcpy(dest + offset, reply->data.asBytes, copy_bytes);
                 bytes_completed += copy_bytes;
-            } else if (response->cmd == CMD_WTX && response->length == sizeof(uint16_t)) {
-                uint16_t wtx = response->data.asDwords[0] & 0xFFFF;
-                PrintAndLogEx(DEBUG, "Got Waiting Time eXtension request %i ms", wtx);
-                if (ms_timeout != (size_t) - 1)
-                    ms_timeout += wtx;
+            } else {
+                rx_apply_wtx(reply, &ms_timeout);
             }
+            rx_pop();
         }
 
-        uint64_t tmp_clk = __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
-        if (msclock() - tmp_clk > ms_timeout) {
+        uint64_t left = rx_time_left(ms_timeout);
+        if (left == 0) {
             PrintAndLogEx(FAILED, "Timed out while trying to download data from device");
             break;
         }
 
+        uint64_t tmp_clk = __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
         if (msclock() - tmp_clk > 3000 && show_warning) {
             // 3 seconds elapsed (but this doesn't mean the timeout was exceeded)
             PrintAndLogEx(INFO, "Waiting for a response from the Proxmark3...");
             PrintAndLogEx(INFO, "You can cancel this operation by pressing the pm3 button");
             show_warning = false;
         }
+
+        // sleeps until the next chunk arrives instead of spinning on the ring
+        rx_wait(CMD_UNKNOWN, generation, left);
     }
     return false;
 }
@@ -47,6 +47,10 @@ extern "C" {
 
 #define COMM_RAW_RECEIVE_LEN (1024)
 
+// number of commands sent with SendCommandNGSeq that can wait for their reply at the same time
+#define CMD_WINDOW_DEFAULT 4
+#define CMD_WINDOW_MAX     16
+
 typedef enum {
     BIG_BUF,
     BIG_BUF_EML,
@@ -99,6 +103,8 @@ void SendCommandBL(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, vo
 void SendCommandOLD(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, const void *data, size_t len);
 void SendCommandNG(uint16_t cmd, uint8_t *data, size_t len);
 void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, const void *data, size_t len);
+uint32_t SendCommandNGSeq(uint16_t cmd, uint8_t *data, size_t len);
+size_t SendCommandNGWindowed(uint16_t cmd, uint8_t *payloads, size_t len, size_t count, PacketResponseNG *responses, bool *received, size_t ms_timeout);
 void clearCommandBuffer(void);
 
 #define FLASHMODE_SPEED 460800
@@ -119,6 +125,13 @@ size_t WaitForRawDataTimeout(uint8_t *buffer, size_t len, size_t ms_timeout, boo
 bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout, bool show_warning);
 bool WaitForResponseTimeout(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout);
 bool WaitForResponse(uint32_t cmd, PacketResponseNG *response);
+bool WaitForResponseRef(uint32_t cmd, const PacketResponseNG **response, size_t ms_timeout);
+void ReleaseResponse(void);
+bool WaitForResponseSeq(uint32_t seq, PacketResponseNG *response, size_t ms_timeout);
+void DrainCommandWindow(size_t ms_timeout);
+
+void SetCommunicationWindow(uint8_t window);
+uint8_t GetCommunicationWindow(void);
 
 //bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint32_t start_index, PacketResponseNG *response, size_t ms_timeout, bool show_warning);
 bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint32_t start_index, uint8_t *data, uint32_t datalen, PacketResponseNG *response, size_t ms_timeout, bool show_warning);
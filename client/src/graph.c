@@ -18,6 +18,7 @@
 #include "graph.h"
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "ui.h"
 #include "proxgui.h"
 #include "util.h"           // param_get32ex
@@ -26,16 +27,121 @@
 #include "commonutil.h"     // Uint4bytetomemle
 
 
-int32_t g_GraphBuffer[MAX_GRAPH_TRACE_LEN];
-int32_t g_OperationBuffer[MAX_GRAPH_TRACE_LEN];
-int32_t g_OverlayBuffer[MAX_GRAPH_TRACE_LEN];
+demod_ctx_t g_demod_ctx;
+__thread demod_ctx_t *g_demod_ctx_bound = NULL;
+static pthread_once_t gs_demod_ctx_once = PTHREAD_ONCE_INIT;
 bool    g_useOverlays = false;
-size_t  g_GraphTraceLen;
 buffer_savestate_t g_saveState_gb;
 marker_t g_MarkerA, g_MarkerB, g_MarkerC, g_MarkerD;
 marker_t *g_TempMarkers;
 uint8_t g_TempMarkerSize = 0;
 
+static bool demod_ctx_alloc(demod_ctx_t *ctx, size_t samples) {
+    memset(ctx, 0, sizeof(demod_ctx_t));
+    ctx->signal = (signal_t) { 255, -255, 0, 0, true };
+
+    ctx->demod = calloc(MAX_DEMOD_BUF_LEN, sizeof(uint8_t));
+    if (ctx->demod == NULL) {
+        return false;
+    }
+    ctx->demod_size = MAX_DEMOD_BUF_LEN;
+    return demod_ctx_reserve(ctx, samples);
+}
+
+static void demod_ctx_release(demod_ctx_t *ctx) {
+    for (size_t i = 0; i < ctx->cache.count; i++) {
+        free(ctx->cache.entries[i].bits);
+    }
+    free(ctx->graph);
+    free(ctx->operation);
+    free(ctx->overlay);
+    free(ctx->demod);
+    memset(ctx, 0, sizeof(demod_ctx_t));
+}
+
+// The default instance is shared with the plot window,  which draws from another thread.
+// It gets the full size once so the buffers never move under the painter.
+static void demod_ctx_default_init(void) {
+    if (demod_ctx_alloc(&g_demod_ctx, MAX_GRAPH_TRACE_LEN) == false) {
+        PrintAndLogEx(ERR, "failed to allocate graph buffers");
+        exit(EXIT_FAILURE);
+    }
+}
+
+demod_ctx_t *demod_ctx_default(void) {
+    pthread_once(&gs_demod_ctx_once, demod_ctx_default_init);
+    return &g_demod_ctx;
+}
+
+// new context with room for `samples` samples,  the buffers grow with demod_ctx_reserve
+demod_ctx_t *demod_ctx_new(size_t samples) {
+    demod_ctx_t *ctx = calloc(1, sizeof(demod_ctx_t));
+    if (ctx == NULL) {
+        return NULL;
+    }
+
+    if (demod_ctx_alloc(ctx, samples) == false) {
+        demod_ctx_release(ctx);
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void demod_ctx_free(demod_ctx_t *ctx) {
+    if (ctx == NULL || ctx == &g_demod_ctx) {
+        return;
+    }
+
+    if (g_demod_ctx_bound == ctx) {
+        demod_ctx_bind(NULL);
+    }
+    demod_ctx_release(ctx);
+    free(ctx);
+}
+
+// grow the graph buffers to hold at least `samples` samples,  false if they can't (max MAX_GRAPH_TRACE_LEN)
+bool demod_ctx_reserve(demod_ctx_t *ctx, size_t samples) {
+    if (ctx == NULL) {
+        return false;
+    }
+
+    bool fits = (samples <= MAX_GRAPH_TRACE_LEN);
+    if (fits == false) {
+        samples = MAX_GRAPH_TRACE_LEN;
+    }
+
+    if (samples <= ctx->graph_size && ctx->graph) {
+        return fits;
+    }
+
+    // grow geometrically,  AppendGraph adds a few samples at the time
+    size_t n = MAX(samples, ctx->graph_size + (ctx->graph_size >> 1));
+    n = MAX(n, 1024);
+    n = MIN(n, MAX_GRAPH_TRACE_LEN);
+
+    int32_t **bufs[] = { &ctx->graph, &ctx->operation, &ctx->overlay };
+    for (size_t i = 0; i < ARRAYLEN(bufs); i++) {
+        int32_t *tmp = realloc(*bufs[i], n * sizeof(int32_t));
+        if (tmp == NULL) {
+            return false;
+        }
+        memset(tmp + ctx->graph_size, 0, (n - ctx->graph_size) * sizeof(int32_t));
+        *bufs[i] = tmp;
+    }
+    ctx->graph_size = n;
+    return fits;
+}
+
+// make the calling thread use `ctx` for the graph / demod buffers and signal properties,  NULL = default
+void demod_ctx_bind(demod_ctx_t *ctx) {
+    if (ctx == &g_demod_ctx) {
+        ctx = NULL;
+    }
+    g_demod_ctx_bound = ctx;
+    setSignalPropertiesStore((ctx) ? &ctx->signal : NULL);
+}
+
 /* write a manchester bit to the graph
 */
 void AppendGraph(bool redraw, uint16_t clock, int bit) {
@@ -47,6 +153,8 @@ void AppendGraph(bool redraw, uint16_t clock, int bit) {
     //     _Assert(g_GraphTraceLen >= 0);
     //     _Assert(g_GraphTraceLen <= MAX_GRAPH_TRACE_LEN);
     // If this occurs, allow partial rendering, up to the last sample...
+    GraphReserve(g_GraphTraceLen + end);
+
     if ((MAX_GRAPH_TRACE_LEN - g_GraphTraceLen) < half) {
         PrintAndLogEx(DEBUG, "WARNING: AppendGraph() - Request exceeds max graph length");
         end = MAX_GRAPH_TRACE_LEN - g_GraphTraceLen;
@@ -66,6 +174,7 @@ void AppendGraph(bool redraw, uint16_t clock, int bit) {
     for (; i < end; ++i) {
         g_GraphBuffer[g_GraphTraceLen++] = bit ^ 1;
     }
+    GraphChanged();
 
     if (redraw) {
         RepaintGraphWindow();
@@ -81,6 +190,7 @@ size_t ClearGraph(bool redraw) {
     memset(g_OverlayBuffer, 0x00, g_GraphTraceLen);
 
     g_GraphTraceLen = 0;
+    GraphChanged();
     g_GraphStart = 0;
     g_GraphStop = 0;
     g_DemodBufferLen = 0;
@@ -110,6 +220,11 @@ void setGraphBuffer(const uint8_t *src, size_t size) {
         size = MAX_GRAPH_TRACE_LEN;
     }
 
+    if (GraphReserve(size) == false) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return;
+    }
+
     for (size_t i = 0; i < size; ++i) {
         g_GraphBuffer[i] = src[i] - 128;
         g_OperationBuffer[i] = src[i] - 128;
@@ -117,6 +232,7 @@ void setGraphBuffer(const uint8_t *src, size_t size) {
 
     remove_temporary_markers();
     g_GraphTraceLen = size;
+    GraphChanged();
     RepaintGraphWindow();
 }
 
@@ -136,18 +252,25 @@ size_t getFromGraphBufferEx(uint8_t *dest, size_t maxLen) {
     }
 
     size_t i;
+    bool clipped = false;
     maxLen = (maxLen < g_GraphTraceLen) ? maxLen : g_GraphTraceLen;
     for (i = 0; i < maxLen; ++i) {
         //trim
         if (g_GraphBuffer[i] > 127) {
             g_GraphBuffer[i] = 127;
+            clipped = true;
         }
 
         if (g_GraphBuffer[i] < -127) {
             g_GraphBuffer[i] = -127;
+            clipped = true;
         }
         dest[i] = (uint8_t)(g_GraphBuffer[i] + 128);
     }
+    // only a real clip counts,  every demod reads the graph through here
+    if (clipped) {
+        GraphChanged();
+    }
     return i;
 }
 
@@ -218,6 +341,7 @@ void convertGraphFromBitstreamEx(int hi, int low) {
         else
             g_GraphBuffer[i] = 0;
     }
+    GraphChanged();
 
     uint8_t *bits = calloc(g_GraphTraceLen, sizeof(uint8_t));
     if (bits == NULL) {
@@ -596,6 +720,9 @@ size_t restore_bufferS32(buffer_savestate_t saveState, int32_t *dest) {
     }
 
     memcpy(dest, saveState.buffer, (saveState.bufferSize * sizeof(int32_t)));
+    if (dest == g_GraphBuffer) {
+        GraphChanged();
+    }
 
     return saveState.bufferSize;
 }
@@ -20,6 +20,7 @@
 #define GRAPH_H__
 
 #include "common.h"
+#include "lfdemod.h"        // signal_t
 
 #ifdef __cplusplus
 extern "C" {
@@ -71,11 +72,82 @@ size_t restore_buffer8(buffer_savestate_t saveState, uint8_t *dest);
 #define GRAPH_SAVE 1
 #define GRAPH_RESTORE 0
 
-extern int32_t g_GraphBuffer[MAX_GRAPH_TRACE_LEN];
-extern int32_t g_OperationBuffer[MAX_GRAPH_TRACE_LEN];
-extern int32_t g_OverlayBuffer[MAX_GRAPH_TRACE_LEN];
+// raw demod results kept for `lf search`,  see demod_cache_enable() in cmddata.c
+#define DEMOD_CACHE_SIZE 16
+
+typedef struct {
+    uint8_t type;
+    int args[6];
+    int ret;
+    bool has_demod;      // demod wrote g_DemodBuffer / clock grid
+    uint8_t *bits;
+    size_t bitlen;
+    int clk;
+    int32_t start_idx;
+    bool st;             // ASK only, sequence terminator found
+    uint32_t st_start;
+    uint32_t st_end;
+} demod_cache_entry_t;
+
+typedef struct {
+    bool enabled;
+    uint32_t graph_gen;  // samples the entries were made from
+    size_t graph_len;
+    size_t count;
+    demod_cache_entry_t entries[DEMOD_CACHE_SIZE];
+} demod_cache_t;
+
+// Everything a demodulation works on: sample buffers, demod buffer, clock grid and signal properties.
+// The commands use the default instance through the g_GraphBuffer / g_DemodBuffer.. names below,
+// a thread can bind its own instance with demod_ctx_bind() and run the same code on another capture.
+typedef struct {
+    int32_t *graph;
+    int32_t *operation;
+    int32_t *overlay;
+    size_t   graph_len;
+    size_t   graph_size;        // allocated samples in graph / operation / overlay
+    uint32_t graph_gen;         // bumped by GraphChanged() whenever the samples are rewritten
+
+    uint8_t *demod;
+    size_t   demod_len;
+    size_t   demod_size;
+    int      demod_clock;
+    int32_t  demod_start_idx;
+
+    signal_t signal;            // used by lfdemod while the context is bound
+    demod_cache_t cache;
+} demod_ctx_t;
+
+demod_ctx_t *demod_ctx_new(size_t samples);
+void demod_ctx_free(demod_ctx_t *ctx);
+bool demod_ctx_reserve(demod_ctx_t *ctx, size_t samples);
+void demod_ctx_bind(demod_ctx_t *ctx);
+demod_ctx_t *demod_ctx_default(void);
+
+extern demod_ctx_t g_demod_ctx;
+extern __thread demod_ctx_t *g_demod_ctx_bound;
+
+static inline demod_ctx_t *demod_ctx_current(void) {
+    if (g_demod_ctx_bound) {
+        return g_demod_ctx_bound;
+    }
+    return (g_demod_ctx.graph) ? &g_demod_ctx : demod_ctx_default();
+}
+
+// make room for `samples` samples in the current graph buffers before writing past g_GraphTraceLen
+#define GraphReserve(samples) demod_ctx_reserve(demod_ctx_current(), (samples))
+
+// call after writing the samples directly,  drops demod results derived from the old ones
+static inline void GraphChanged(void) {
+    demod_ctx_current()->graph_gen++;
+}
+
+#define g_GraphBuffer     (demod_ctx_current()->graph)
+#define g_OperationBuffer (demod_ctx_current()->operation)
+#define g_OverlayBuffer   (demod_ctx_current()->overlay)
+#define g_GraphTraceLen   (demod_ctx_current()->graph_len)
+
 extern bool    g_useOverlays;
-extern size_t  g_GraphTraceLen;
 
 extern marker_t g_MarkerA, g_MarkerB, g_MarkerC, g_MarkerD;
 extern marker_t *g_TempMarkers;
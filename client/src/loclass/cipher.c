@@ -39,7 +39,9 @@
 #include <stdbool.h>
 #include <stdint.h>
 #ifndef ON_DEVICE
+#include <inttypes.h>
 #include "fileutils.h"
+#include "util_posix.h"
 #endif
 
 
@@ -276,6 +278,126 @@ void doMAC_N(uint8_t *address_data_p, uint8_t address_data_size, uint8_t *div_ke
     free(address_data);
 }
 
+/**
+* Bitsliced MAC over up to LOCLASS_MAC_BATCH keys at once. Bit j of every uint64_t
+* belongs to key j, each cipher register is kept as one such word per bit, least
+* significant bit first. The cipher then runs branch free on all keys in parallel,
+* following the same definitions as successor() and output() above.
+**/
+typedef struct {
+    uint64_t l[8];
+    uint64_t r[8];
+    uint64_t b[8];
+    uint64_t t[16];
+} BitslicedState_t;
+
+static void bs_const8(uint64_t *x, uint8_t v) {
+    for (int i = 0; i < 8; i++) {
+        x[i] = ((v >> i) & 1) ? ~0ULL : 0;
+    }
+}
+
+// sum = a + b mod 256, ripple carry
+static void bs_add8(uint64_t *sum, const uint64_t *a, const uint64_t *b) {
+    uint64_t carry = 0;
+    for (int i = 0; i < 8; i++) {
+        uint64_t x = a[i] ^ b[i];
+        sum[i] = x ^ carry;
+        carry = (a[i] & b[i]) | (carry & x);
+    }
+}
+
+static void bs_successor(const uint64_t k[8][8], BitslicedState_t *s, uint64_t y) {
+    const uint64_t *t = s->t;
+    const uint64_t *r = s->r;
+
+    // T(t), _select(T(t), y, r), with r0 the most significant bit
+    uint64_t Tt = t[15] ^ t[14] ^ t[10] ^ t[8] ^ t[5] ^ t[4] ^ t[1] ^ t[0];
+    uint64_t z0 = (r[7] & r[5]) ^ (r[6] & ~r[4]) ^ (r[5] | r[3]);
+    uint64_t z1 = (r[7] | r[5]) ^ (r[2] | r[0]) ^ r[6] ^ r[1] ^ Tt ^ y;
+    uint64_t z2 = (r[4] & ~r[2]) ^ (r[3] & r[1]) ^ r[0] ^ Tt;
+
+    uint64_t t_in = Tt ^ r[7] ^ r[3];
+    uint64_t b_in = s->b[6] ^ s->b[5] ^ s->b[4] ^ s->b[0] ^ r[0];
+    memmove(s->t, s->t + 1, 15 * sizeof(uint64_t));
+    s->t[15] = t_in;
+    memmove(s->b, s->b + 1, 7 * sizeof(uint64_t));
+    s->b[7] = b_in;
+
+    // k[select] ^ b', the key byte picked per lane by a 8:1 multiplexer
+    uint64_t kb[8];
+    for (int i = 0; i < 8; i++) {
+        uint64_t m0 = k[0][i] ^ (z2 & (k[0][i] ^ k[1][i]));
+        uint64_t m1 = k[2][i] ^ (z2 & (k[2][i] ^ k[3][i]));
+        uint64_t m2 = k[4][i] ^ (z2 & (k[4][i] ^ k[5][i]));
+        uint64_t m3 = k[6][i] ^ (z2 & (k[6][i] ^ k[7][i]));
+        m0 ^= z1 & (m0 ^ m1);
+        m2 ^= z1 & (m2 ^ m3);
+        kb[i] = (m0 ^ (z0 & (m0 ^ m2))) ^ s->b[i];
+    }
+
+    uint64_t nr[8];
+    bs_add8(nr, kb, s->l);
+    bs_add8(s->l, nr, s->r);
+    memcpy(s->r, nr, sizeof(nr));
+}
+
+void doMAC_batch(const uint8_t *cc_nr_p, const uint8_t div_keys[][8], size_t count, uint8_t macs[][4]) {
+    if (count > LOCLASS_MAC_BATCH) {
+        count = LOCLASS_MAC_BATCH;
+    }
+
+    // k[byte][bit]
+    uint64_t k[8][8] = {{0}};
+    for (size_t j = 0; j < count; j++) {
+        for (int z = 0; z < 8; z++) {
+            uint8_t v = div_keys[j][z];
+            for (int i = 0; i < 8; i++) {
+                k[z][i] |= (uint64_t)((v >> i) & 1) << j;
+            }
+        }
+    }
+
+    // init()
+    BitslicedState_t s;
+    uint64_t c[8], k0[8];
+    for (int i = 0; i < 8; i++) {
+        k0[i] = k[0][i] ^ (((0x4c >> i) & 1) ? ~0ULL : 0);
+    }
+    bs_const8(c, 0xEC);
+    bs_add8(s.l, k0, c);
+    bs_const8(c, 0x21);
+    bs_add8(s.r, k0, c);
+    bs_const8(s.b, 0x4c);
+    for (int i = 0; i < 16; i++) {
+        s.t[i] = ((0xE012 >> i) & 1) ? ~0ULL : 0;
+    }
+
+    // suc() takes the bit reversed cc_nr head first, i.e. each byte lsb first
+    for (int n = 0; n < 12; n++) {
+        for (int i = 0; i < 8; i++) {
+            bs_successor(k, &s, ((cc_nr_p[n] >> i) & 1) ? ~0ULL : 0);
+        }
+    }
+
+    // output() on 32 zero bits, the reversed output stream is lsb first as well
+    uint64_t out[32];
+    for (int n = 0; n < 32; n++) {
+        out[n] = s.r[2];
+        bs_successor(k, &s, 0);
+    }
+
+    for (size_t j = 0; j < count; j++) {
+        for (int n = 0; n < 4; n++) {
+            uint8_t v = 0;
+            for (int i = 0; i < 8; i++) {
+                v |= ((out[n * 8 + i] >> j) & 1) << i;
+            }
+            macs[j][n] = v;
+        }
+    }
+}
+
 #ifndef ON_DEVICE
 int testMAC(void) {
     PrintAndLogEx(SUCCESS, "Testing MAC calculation...");
@@ -297,6 +419,52 @@ int testMAC(void) {
         printarr("    Correct_MAC   ", correct_MAC, 4);
         return PM3_ESOFT;
     }
+
+    // the bitsliced batch must agree with doMAC on every lane, the paper key goes in lane 0
+    uint8_t keys[LOCLASS_MAC_BATCH][8];
+    uint8_t macs[LOCLASS_MAC_BATCH][4];
+    uint32_t x = 0x2545F491;
+    for (int j = 0; j < LOCLASS_MAC_BATCH; j++) {
+        for (int i = 0; i < 8; i++) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            keys[j][i] = x & 0xFF;
+        }
+    }
+    memcpy(keys[0], div_key, sizeof(div_key));
+    doMAC_batch(cc_nr, (const uint8_t (*)[8])keys, LOCLASS_MAC_BATCH, macs);
+
+    for (int j = 0; j < LOCLASS_MAC_BATCH; j++) {
+        doMAC(cc_nr, keys[j], calculated_mac);
+        if (memcmp(calculated_mac, macs[j], 4) != 0) {
+            PrintAndLogEx(FAILED, "    Bitsliced MAC calculation ( %s )", _RED_("fail"));
+            printarr("    Calculated_MAC", macs[j], 4);
+            printarr("    Correct_MAC   ", calculated_mac, 4);
+            return PM3_ESOFT;
+        }
+    }
+    PrintAndLogEx(SUCCESS, "    Bitsliced MAC calculation ( %s )", _GREEN_("ok"));
+
+    // throughput, one key byte changes per call so nothing gets hoisted
+    uint64_t t1 = msclock();
+    for (int n = 0; n < 0x2000; n++) {
+        div_key[7] = n & 0xFF;
+        doMAC(cc_nr, div_key, calculated_mac);
+    }
+    uint64_t t_scalar = msclock() - t1;
+
+    t1 = msclock();
+    for (int n = 0; n < 0x2000 / LOCLASS_MAC_BATCH * 8; n++) {
+        keys[0][7] = n & 0xFF;
+        doMAC_batch(cc_nr, (const uint8_t (*)[8])keys, LOCLASS_MAC_BATCH, macs);
+    }
+    uint64_t t_batch = msclock() - t1;
+
+    PrintAndLogEx(INFO, "    MAC throughput... scalar " _YELLOW_("%" PRIu64) " keys/s, bitsliced " _YELLOW_("%" PRIu64) " keys/s"
+                  , (uint64_t)0x2000 * 1000 / (t_scalar ? t_scalar : 1)
+                  , (uint64_t)0x2000 * 8 * 1000 / (t_batch ? t_batch : 1)
+                 );
     return PM3_SUCCESS;
 }
 #endif
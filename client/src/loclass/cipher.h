@@ -35,10 +35,16 @@
 #ifndef CIPHER_H
 #define CIPHER_H
 #include <stdint.h>
+#include <stddef.h>
 #include "pm3_cmd.h"
 
+// number of keys doMAC_batch handles per call
+#define LOCLASS_MAC_BATCH 64
+
 void doMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4]);
 void doMAC_N(uint8_t *address_data_p, uint8_t address_data_size, uint8_t *div_key_p, uint8_t mac[4]);
+// MAC of the same cc_nr under up to LOCLASS_MAC_BATCH diversified keys, bitsliced
+void doMAC_batch(const uint8_t *cc_nr_p, const uint8_t div_keys[][8], size_t count, uint8_t macs[][4]);
 
 #ifndef ON_DEVICE
 int testMAC(void);
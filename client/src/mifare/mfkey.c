@@ -18,6 +18,9 @@
 //-----------------------------------------------------------------------------
 #include "mfkey.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include "crapto1/crapto1.h"
 
 // MIFARE
@@ -27,6 +30,45 @@ int inline compare_uint64(const void *a, const void *b) {
     return -1;
 }
 
+// LSD radix sort of a list by (value & mask), ascending, one pass per non-zero byte of mask.
+// Passes where all values share the same byte are skipped. Returns false if out of memory.
+bool radixsort_uint64(uint64_t *list, uint32_t len, uint64_t mask) {
+    uint64_t *tmp = calloc(len + 1, sizeof(uint64_t));
+    if (tmp == NULL)
+        return false;
+
+    uint64_t *src = list, *dst = tmp;
+    for (uint8_t shift = 0; shift < 64; shift += 8) {
+        if (((mask >> shift) & 0xFF) == 0)
+            continue;
+
+        uint32_t count[256] = {0};
+        for (uint32_t i = 0; i < len; i++) {
+            count[((src[i] & mask) >> shift) & 0xFF]++;
+        }
+        if (len == 0 || count[((src[0] & mask) >> shift) & 0xFF] == len)
+            continue;
+
+        uint32_t pos = 0;
+        for (uint16_t b = 0; b < 256; b++) {
+            uint32_t c = count[b];
+            count[b] = pos;
+            pos += c;
+        }
+        for (uint32_t i = 0; i < len; i++) {
+            dst[count[((src[i] & mask) >> shift) & 0xFF]++] = src[i];
+        }
+        uint64_t *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != list) {
+        memcpy(list, src, len * sizeof(uint64_t));
+    }
+    free(tmp);
+    return true;
+}
+
 // create the intersection (common members) of two sorted lists. Lists are terminated by -1. Result will be in list1. Number of elements is returned.
 uint32_t intersection(uint64_t *listA, uint64_t *listB) {
     if (listA == NULL || listB == NULL)
@@ -98,6 +140,10 @@ uint32_t nonce2key(uint32_t uid, uint32_t nt, uint32_t nr, uint32_t ar, uint64_t
 
 // recover key from 2 different reader responses on same tag challenge
 bool mfkey32(nonces_t *data, uint64_t *outputkey) {
+    return mfkey32_r(NULL, data, outputkey);
+}
+
+bool mfkey32_r(struct Crypto1Recovery *recovery, nonces_t *data, uint64_t *outputkey) {
     struct Crypto1State *s, *t;
     uint64_t outkey = 0;
     uint64_t key = 0;     // recovered key
@@ -106,7 +152,11 @@ bool mfkey32(nonces_t *data, uint64_t *outputkey) {
 
     uint32_t p640 = prng_successor(data->nonce, 64);
 
-    s = lfsr_recovery32(data->ar ^ p640, 0);
+    s = (recovery) ? lfsr_recovery32_r(recovery, data->ar ^ p640, 0) : lfsr_recovery32(data->ar ^ p640, 0);
+    if (s == NULL) {
+        *outputkey = 0;
+        return false;
+    }
 
     for (t = s; t->odd | t->even; ++t) {
         lfsr_rollback_word(t, 0, 0);
@@ -123,13 +173,19 @@ bool mfkey32(nonces_t *data, uint64_t *outputkey) {
     }
     isSuccess = (counter == 1);
     *outputkey = (isSuccess) ? outkey : 0;
-    crypto1_destroy(s);
+    if (recovery == NULL) {
+        crypto1_destroy(s);
+    }
     return isSuccess;
 }
 
 // recover key from 2 reader responses on 2 different tag challenges
 // skip "several found keys".  Only return true if ONE key is found
 bool mfkey32_moebius(nonces_t *data, uint64_t *outputkey) {
+    return mfkey32_moebius_r(NULL, data, outputkey);
+}
+
+bool mfkey32_moebius_r(struct Crypto1Recovery *recovery, nonces_t *data, uint64_t *outputkey) {
     struct Crypto1State *s, *t;
     uint64_t outkey  = 0;
     uint64_t key     = 0; // recovered key
@@ -138,7 +194,11 @@ bool mfkey32_moebius(nonces_t *data, uint64_t *outputkey) {
     uint32_t p640 = prng_successor(data->nonce, 64);
     uint32_t p641 = prng_successor(data->nonce2, 64);
 
-    s = lfsr_recovery32(data->ar ^ p640, 0);
+    s = (recovery) ? lfsr_recovery32_r(recovery, data->ar ^ p640, 0) : lfsr_recovery32(data->ar ^ p640, 0);
+    if (s == NULL) {
+        *outputkey = 0;
+        return false;
+    }
 
     for (t = s; t->odd | t->even; ++t) {
         lfsr_rollback_word(t, 0, 0);
@@ -156,7 +216,9 @@ bool mfkey32_moebius(nonces_t *data, uint64_t *outputkey) {
     }
     isSuccess  = (counter == 1);
     *outputkey = (isSuccess) ? outkey : 0;
-    crypto1_destroy(s);
+    if (recovery == NULL) {
+        crypto1_destroy(s);
+    }
     return isSuccess;
 }
 
@@ -180,3 +242,196 @@ int mfkey64(nonces_t *data, uint64_t *outputkey) {
     *outputkey = key;
     return 0;
 }
+
+//-----------------------------------------------------------------------------
+// Dictionary search for the key of a nested authentication.
+//
+// The tag nonce of a nested authentication is encrypted, so a key is right when
+// the keystream it generates decrypts nt_enc to some nt whose successor matches
+// the decrypted reader response ar_enc. That is 32 bits of filtering per key.
+//
+// Crypto1 is run bitsliced over MFKEY_DICT_BATCH keys, bit j of every word belongs
+// to key j. The LFSR is kept as the sequence of bits it generates: lfsr[t .. t+47]
+// is the state after t steps, lfsr[t+47] the newest bit.
+//-----------------------------------------------------------------------------
+
+typedef uint64_t bitslice_t;
+
+#define BS_ONES         (~(bitslice_t)0)
+#define BS_BIT(x, n)    ((bitslice_t)0 - (((x) >> (n)) & 1))
+
+// Crypto1 filter, nibble functions and output function in boolean form
+#define bs_fa(a, b, c, d)       (((a | b) ^ (a & d)) ^ (c & ((a ^ b) | d)))
+#define bs_fb(a, b, c, d)       (((a & b) | c) ^ ((a ^ b) & (c | d)))
+#define bs_fc(a, b, c, d, e)    ((a | ((b | e) & (d ^ e))) ^ ((a ^ (b & d)) & ((c ^ d) | (b & e))))
+
+static inline bitslice_t bs_filter(const bitslice_t *s) {
+    return bs_fc(bs_fa(s[9], s[11], s[13], s[15]),
+                 bs_fb(s[17], s[19], s[21], s[23]),
+                 bs_fb(s[25], s[27], s[29], s[31]),
+                 bs_fa(s[33], s[35], s[37], s[39]),
+                 bs_fb(s[41], s[43], s[45], s[47]));
+}
+
+// offsets into the 48 bit window of the LFSR feedback taps
+static uint8_t bs_taps[48];
+static uint8_t bs_ntaps;
+
+static void bs_init_taps(void) {
+    uint8_t n = 0;
+    for (uint8_t j = 0; j < 24; j++) {
+        if ((LF_POLY_ODD >> j) & 1) {
+            bs_taps[n++] = 47 - 2 * j;
+        }
+        if ((LF_POLY_EVEN >> j) & 1) {
+            bs_taps[n++] = 46 - 2 * j;
+        }
+    }
+    bs_ntaps = n;
+}
+
+// Returns the lanes of keys[0 .. count-1] whose keystream matches nt_enc / nr_enc / ar_enc
+static uint64_t bs_nested_check(uint32_t uid, uint32_t nt_enc, uint32_t nr_enc, uint32_t ar_enc, const uint64_t *keys, uint32_t count) {
+
+    // 48 key bits and 96 clocked bits
+    bitslice_t lfsr[48 + 96];
+    // tag nonce prng, 32 bits and 64 successor steps
+    bitslice_t prng[32 + 64];
+
+    uint64_t lanes = (count >= MFKEY_DICT_BATCH) ? BS_ONES : (((uint64_t)1 << count) - 1);
+
+    // crypto1_init order, lfsr[47 - m] is key bit m ^ 7
+    for (uint8_t n = 0; n < 48; n++) {
+        bitslice_t v = 0;
+        uint8_t kb = (47 - n) ^ 7;
+        for (uint32_t l = 0; l < count; l++) {
+            v |= ((keys[l] >> kb) & 1) << l;
+        }
+        lfsr[n] = v;
+    }
+
+    // nt ^ uid and nr are fed in encrypted, crypto1_word(.., 1)
+    uint32_t in = nt_enc ^ uid;
+    for (uint8_t t = 0; t < 64; t++) {
+        if (t == 32) {
+            in = nr_enc;
+        }
+        bitslice_t *s = lfsr + t;
+        bitslice_t ks = bs_filter(s);
+        bitslice_t fb = BS_BIT(in, (t & 0x1F) ^ 24) ^ ks;
+        for (uint8_t i = 0; i < bs_ntaps; i++) {
+            fb ^= s[bs_taps[i]];
+        }
+        s[48] = fb;
+
+        // byte swapped tag nonce, prng_successor works on that
+        if (t < 32) {
+            prng[t] = ks ^ BS_BIT(nt_enc, t ^ 24);
+        }
+    }
+
+    for (uint8_t t = 0; t < 64; t++) {
+        prng[32 + t] = prng[t + 16] ^ prng[t + 18] ^ prng[t + 19] ^ prng[t + 21];
+    }
+
+    // reader response, crypto1_word(.., 0, 0) against prng_successor(nt, 64)
+    bitslice_t diff = ~lanes;
+    for (uint8_t t = 64; t < 96; t++) {
+        bitslice_t *s = lfsr + t;
+        bitslice_t ks = bs_filter(s);
+        bitslice_t fb = 0;
+        for (uint8_t i = 0; i < bs_ntaps; i++) {
+            fb ^= s[bs_taps[i]];
+        }
+        s[48] = fb;
+
+        diff |= ks ^ BS_BIT(ar_enc, (t - 64) ^ 24) ^ prng[t];
+        if (diff == BS_ONES) {
+            break;
+        }
+    }
+    return ~diff;
+}
+
+typedef struct {
+    uint32_t uid;
+    uint32_t nt_enc;
+    uint32_t nr_enc;
+    uint32_t ar_enc;
+    const uint64_t *keys;
+    uint32_t start;
+    uint32_t count;
+    uint32_t next;      // next chunk, atomic
+    uint32_t found;     // lowest matching key index, atomic
+} mfkey_dict_ctx_t;
+
+static void *mfkey_dict_worker(void *arg) {
+    mfkey_dict_ctx_t *ctx = (mfkey_dict_ctx_t *)arg;
+
+    for (;;) {
+        uint32_t chunk = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED);
+        uint64_t first = (uint64_t)ctx->start + (uint64_t)chunk * MFKEY_DICT_BATCH;
+        // chunks after a match can not give a lower index
+        if (first >= ctx->count || first > __atomic_load_n(&ctx->found, __ATOMIC_RELAXED)) {
+            break;
+        }
+
+        uint32_t n = MIN(MFKEY_DICT_BATCH, ctx->count - first);
+        uint64_t hit = bs_nested_check(ctx->uid, ctx->nt_enc, ctx->nr_enc, ctx->ar_enc, ctx->keys + first, n);
+        if (hit == 0) {
+            continue;
+        }
+
+        uint32_t idx = first + __builtin_ctzll(hit);
+        uint32_t cur = __atomic_load_n(&ctx->found, __ATOMIC_RELAXED);
+        while (idx < cur && __atomic_compare_exchange_n(&ctx->found, &cur, idx, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false) {
+        }
+    }
+    return NULL;
+}
+
+int32_t mfkey_nested_dict(uint32_t uid, uint32_t nt_enc, uint32_t nr_enc, uint32_t ar_enc, const uint64_t *keys, uint32_t count, uint32_t start, size_t threads) {
+
+    if (keys == NULL || start >= count || count > INT32_MAX) {
+        return -1;
+    }
+
+    static pthread_once_t taps_once = PTHREAD_ONCE_INIT;
+    pthread_once(&taps_once, bs_init_taps);
+
+    mfkey_dict_ctx_t ctx = {
+        .uid = uid,
+        .nt_enc = nt_enc,
+        .nr_enc = nr_enc,
+        .ar_enc = ar_enc,
+        .keys = keys,
+        .start = start,
+        .count = count,
+        .next = 0,
+        .found = UINT32_MAX,
+    };
+
+    // thread start up only pays off with some chunks for every thread
+    uint32_t chunks = (count - start + MFKEY_DICT_BATCH - 1) / MFKEY_DICT_BATCH;
+    size_t tc = MIN(threads, (chunks + MFKEY_DICT_THREAD_CHUNKS - 1) / MFKEY_DICT_THREAD_CHUNKS);
+    if (tc <= 1) {
+        mfkey_dict_worker(&ctx);
+    } else {
+        pthread_t thr[tc];
+        size_t started = 0;
+        for (; started < tc; started++) {
+            if (pthread_create(&thr[started], NULL, mfkey_dict_worker, &ctx)) {
+                break;
+            }
+        }
+        // the threads already running pick up all chunks, run inline if none started
+        if (started == 0) {
+            mfkey_dict_worker(&ctx);
+        }
+        for (size_t i = 0; i < started; i++) {
+            pthread_join(thr[i], NULL);
+        }
+    }
+
+    return (ctx.found == UINT32_MAX) ? -1 : (int32_t)ctx.found;
+}
@@ -22,13 +22,26 @@
 
 #include "common.h"
 #include "mifare.h"
+#include "crapto1/crapto1.h"
 
 uint32_t nonce2key(uint32_t uid, uint32_t nt, uint32_t nr, uint32_t ar, uint64_t par_info, uint64_t ks_info, uint64_t **keys);
 bool mfkey32(nonces_t *data, uint64_t *outputkey);
 bool mfkey32_moebius(nonces_t *data, uint64_t *outputkey);
+// same, reusing the buffers of a crypto1_recovery_create() context between calls
+bool mfkey32_r(struct Crypto1Recovery *recovery, nonces_t *data, uint64_t *outputkey);
+bool mfkey32_moebius_r(struct Crypto1Recovery *recovery, nonces_t *data, uint64_t *outputkey);
 int mfkey64(nonces_t *data, uint64_t *outputkey);
 
+// keys tested per bitsliced pass of mfkey_nested_dict, and per thread at least
+#define MFKEY_DICT_BATCH            64
+#define MFKEY_DICT_THREAD_CHUNKS    16
+// First key at or after `start` in the dictionary whose keystream decrypts a nested authentication
+// to a tag nonce and its reader response. Bitsliced, split over up to `threads` threads.
+// Returns the key index or -1, the caller still checks the key against the decrypted data.
+int32_t mfkey_nested_dict(uint32_t uid, uint32_t nt_enc, uint32_t nr_enc, uint32_t ar_enc, const uint64_t *keys, uint32_t count, uint32_t start, size_t threads);
+
 int compare_uint64(const void *a, const void *b);
 uint32_t intersection(uint64_t *listA, uint64_t *listB);
+bool radixsort_uint64(uint64_t *list, uint32_t len, uint64_t mask);
 
 #endif
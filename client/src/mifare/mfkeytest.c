@@ -0,0 +1,175 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+//  tests for mfkey
+//-----------------------------------------------------------------------------
+
+#include "mfkeytest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "ui.h"
+#include "mifare/mfkey.h"
+#include "mifare/mifarehost.h"
+#include "crapto1/crapto1.h"
+
+// more than MFKEY_DICT_BATCH * MFKEY_DICT_THREAD_CHUNKS keys, so the threaded path runs
+#define TEST_DICT_COUNT     2000
+#define TEST_DICT_THREADS   4
+
+static const uint32_t test_uid = 0x2A5C4F91;
+static const uint32_t test_nt  = 0x8A3BD4E7;
+static const uint32_t test_nr  = 0x12345678;
+static const uint64_t test_key = 0xB38D82CF7B6C;
+
+// nested authentication as the reader sees it, keyed with `key`
+static void NestedAuth(uint64_t key, uint32_t *nt_enc, uint32_t *nr_enc, uint32_t *ar_enc) {
+    struct Crypto1State *s = crypto1_create(key);
+    *nt_enc = test_nt ^ crypto1_word(s, test_nt ^ test_uid, 0);
+    *nr_enc = test_nr ^ crypto1_word(s, test_nr, 0);
+    *ar_enc = prng_successor(test_nt, 64) ^ crypto1_word(s, 0, 0);
+    crypto1_destroy(s);
+}
+
+// deterministic 48 bit keys, none equal to test_key
+static void FillDict(uint64_t *keys, uint32_t count) {
+    uint64_t x = 0x9E3779B97F4A7C15;
+    for (uint32_t i = 0; i < count; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        keys[i] = x & 0xFFFFFFFFFFFF;
+        if (keys[i] == test_key) {
+            keys[i] ^= 1;
+        }
+    }
+}
+
+static bool TestNestedDict(uint64_t *keys, uint32_t nt_enc, uint32_t nr_enc, uint32_t ar_enc) {
+    bool res = true;
+
+    keys[1499] = test_key;
+    res = res && (mfkey_nested_dict(test_uid, nt_enc, nr_enc, ar_enc, keys, TEST_DICT_COUNT, 0, TEST_DICT_THREADS) == 1499);
+    res = res && (mfkey_nested_dict(test_uid, nt_enc, nr_enc, ar_enc, keys, TEST_DICT_COUNT, 0, 1) == 1499);
+    res = res && (mfkey_nested_dict(test_uid, nt_enc, nr_enc, ar_enc, keys, TEST_DICT_COUNT, 1499, TEST_DICT_THREADS) == 1499);
+    res = res && (mfkey_nested_dict(test_uid, nt_enc, nr_enc, ar_enc, keys, TEST_DICT_COUNT, 1500, TEST_DICT_THREADS) == -1);
+
+    PrintAndLogEx(INFO, "Nested dict....... ( %s )", (res) ? _GREEN_("ok") : _RED_("fail"));
+    return res;
+}
+
+static bool TestNestedDictLowest(uint64_t *keys, uint32_t nt_enc, uint32_t nr_enc, uint32_t ar_enc) {
+    bool res = true;
+
+    // matches in chunks handled by different threads, the lowest index wins
+    keys[300] = test_key;
+    res = res && (mfkey_nested_dict(test_uid, nt_enc, nr_enc, ar_enc, keys, TEST_DICT_COUNT, 0, TEST_DICT_THREADS) == 300);
+    res = res && (mfkey_nested_dict(test_uid, nt_enc, nr_enc, ar_enc, keys, TEST_DICT_COUNT, 301, TEST_DICT_THREADS) == 1499);
+
+    PrintAndLogEx(INFO, "Nested lowest..... ( %s )", (res) ? _GREEN_("ok") : _RED_("fail"));
+    return res;
+}
+
+static bool TestNestedDictEdges(uint64_t *keys, uint32_t nt_enc, uint32_t nr_enc, uint32_t ar_enc) {
+    bool res = true;
+
+    FillDict(keys, TEST_DICT_COUNT);
+    res = res && (mfkey_nested_dict(test_uid, nt_enc, nr_enc, ar_enc, keys, TEST_DICT_COUNT, 0, TEST_DICT_THREADS) == -1);
+
+    keys[TEST_DICT_COUNT - 1] = test_key;
+    res = res && (mfkey_nested_dict(test_uid, nt_enc, nr_enc, ar_enc, keys, TEST_DICT_COUNT, 0, TEST_DICT_THREADS) == TEST_DICT_COUNT - 1);
+
+    keys[0] = test_key;
+    res = res && (mfkey_nested_dict(test_uid, nt_enc, nr_enc, ar_enc, keys, TEST_DICT_COUNT, 0, TEST_DICT_THREADS) == 0);
+
+    // a single key, shorter than one bitsliced batch
+    res = res && (mfkey_nested_dict(test_uid, nt_enc, nr_enc, ar_enc, keys, 1, 0, TEST_DICT_THREADS) == 0);
+    res = res && (mfkey_nested_dict(test_uid, nt_enc, nr_enc, ar_enc, keys, TEST_DICT_COUNT, TEST_DICT_COUNT, TEST_DICT_THREADS) == -1);
+
+    PrintAndLogEx(INFO, "Nested edges...... ( %s )", (res) ? _GREEN_("ok") : _RED_("fail"));
+    return res;
+}
+
+// two nested authentications with test_key, as `hf mf nested` gets them from the device:
+// the tag nonce 160 and 320 PRNG steps after 01200145 and the keystream that encrypted it
+static const uint32_t test_nested_nt[2] = { 0x7EEF3586, 0x322BC14D };
+static const uint32_t test_nested_ks[2] = { 0xE7A54565, 0xF754BE50 };
+
+static int NestedCandidates(uint64_t known_key, uint64_t **keys, uint32_t *keycnt) {
+    StateList_t statelists[2];
+    memset(statelists, 0, sizeof(statelists));
+    for (uint8_t i = 0; i < 2; i++) {
+        statelists[i].uid = test_uid;
+        statelists[i].nt_enc = test_nested_nt[i];
+        statelists[i].ks1 = test_nested_ks[i];
+    }
+    return mfNestedCandidates(statelists, known_key, keys, keycnt);
+}
+
+static bool TestNestedStatelists(void) {
+    bool res = true;
+
+    // the key used for the nested authentication is tried first
+    uint64_t *keys = NULL;
+    uint32_t keycnt = 0;
+    res = res && (NestedCandidates(test_key, &keys, &keycnt) == PM3_SUCCESS);
+    res = res && (keycnt > 0) && (keys[0] == test_key);
+    free(keys);
+
+    // otherwise it is somewhere in the intersection
+    keys = NULL;
+    keycnt = 0;
+    res = res && (NestedCandidates(0, &keys, &keycnt) == PM3_SUCCESS);
+    bool found = false;
+    for (uint32_t i = 0; i < keycnt; i++) {
+        found |= (keys[i] == test_key);
+    }
+    res = res && found;
+    free(keys);
+
+    PrintAndLogEx(INFO, "Nested statelists. ( %s )", (res) ? _GREEN_("ok") : _RED_("fail"));
+    return res;
+}
+
+bool MfkeyTest(bool verbose) {
+    bool res = true;
+
+    PrintAndLogEx(INFO, "------ " _CYAN_("MIFARE Classic key recovery tests") " ------");
+
+    uint64_t *keys = calloc(TEST_DICT_COUNT, sizeof(uint64_t));
+    if (keys == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return false;
+    }
+
+    uint32_t nt_enc, nr_enc, ar_enc;
+    NestedAuth(test_key, &nt_enc, &nr_enc, &ar_enc);
+    if (verbose) {
+        PrintAndLogEx(DEBUG, "uid %08x nt_enc %08x nr_enc %08x ar_enc %08x", test_uid, nt_enc, nr_enc, ar_enc);
+    }
+
+    FillDict(keys, TEST_DICT_COUNT);
+    res = res && TestNestedDict(keys, nt_enc, nr_enc, ar_enc);
+    res = res && TestNestedDictLowest(keys, nt_enc, nr_enc, ar_enc);
+    res = res && TestNestedDictEdges(keys, nt_enc, nr_enc, ar_enc);
+    res = res && TestNestedStatelists();
+
+    free(keys);
+
+    PrintAndLogEx(INFO, "---------------------------");
+    PrintAndLogEx(SUCCESS, "Tests ( %s )", (res) ? _GREEN_("ok") : _RED_("fail"));
+    PrintAndLogEx(NORMAL, "");
+    return res;
+}
@@ -265,6 +265,11 @@ int mfCheckKeys_fast_ex(uint8_t sectorsCnt, uint8_t firstChunk, uint8_t lastChun
             uint64_t foo = bytes_to_num(resp.data.asBytes, 6);
             PrintAndLogEx(NORMAL, "");
             PrintAndLogEx(SUCCESS, _GREEN_("Key %s for block %2i found: %012" PRIx64), (singleSectorParams >> 8) & 1 ? "B" : "A", singleSectorParams & 0xFF, foo);
+            uint8_t sector = mfSectorNum(singleSectorParams & 0xFF);
+            if (e_sector != NULL && sector < sectorsCnt) {
+                e_sector[sector].Key[(singleSectorParams >> 8) & 1] = foo;
+                e_sector[sector].foundKey[(singleSectorParams >> 8) & 1] = 1;
+            }
             return PM3_SUCCESS;
         }
     }
@@ -427,11 +432,14 @@ int mfKeyBrute(uint8_t blockNo, uint8_t keyType, const uint8_t *key, uint64_t *r
     return found;
 }
 
+// nested statelists are sorted and intersected on these 16 bits of the cryptostate
+#define NESTED_STATE16_MASK  UINT64_C(0x00ff000000ff0000)
+
 // Compare 16 Bits out of cryptostate
 inline static int Compare16Bits(const void *a, const void *b) {
-    if ((*(uint64_t *)b & 0x00ff000000ff0000) == (*(uint64_t *)a & 0x00ff000000ff0000)) return 0;
-    if ((*(uint64_t *)b & 0x00ff000000ff0000) > (*(uint64_t *)a & 0x00ff000000ff0000)) return 1;
-    return -1;
+    if ((*(uint64_t *)b & NESTED_STATE16_MASK) == (*(uint64_t *)a & NESTED_STATE16_MASK)) return 0;
+    if ((*(uint64_t *)b & NESTED_STATE16_MASK) > (*(uint64_t *)a & NESTED_STATE16_MASK)) return -1;
+    return 1;
 }
 
 // wrapper function for multi-threaded lfsr_recovery32
@@ -445,22 +453,197 @@ __attribute__((force_align_arg_pointer))
     struct Crypto1State *p1;
     StateList_t *statelist = arg;
     statelist->head.slhead = lfsr_recovery32(statelist->ks1, statelist->nt_enc ^ statelist->uid);
+    if (statelist->head.slhead == NULL) {
+        statelist->len = 0;
+        return NULL;
+    }
 
     for (p1 = statelist->head.slhead; p1->odd | p1->even; p1++) {};
 
     statelist->len = p1 - statelist->head.slhead;
     statelist->tail.sltail = --p1;
 
-    qsort(statelist->head.slhead, statelist->len, sizeof(uint64_t), Compare16Bits);
+    if (radixsort_uint64(statelist->head.keyhead, statelist->len, NESTED_STATE16_MASK) == false) {
+        qsort(statelist->head.slhead, statelist->len, sizeof(uint64_t), Compare16Bits);
+    }
 
     return statelist->head.slhead;
 }
 
+// run fn on both statelists in parallel,  on this thread when no thread could be started
+static void nested_run_pair(void *(*fn)(void *), StateList_t statelists[2]) {
+    pthread_t thread_id[2];
+    bool started[2] = {false, false};
+
+    for (uint8_t k = 0; k < 2; k++) {
+        started[k] = (pthread_create(thread_id + k, NULL, fn, &statelists[k]) == 0);
+    }
+
+    for (uint8_t k = 0; k < 2; k++) {
+        if (started[k]) {
+            pthread_join(thread_id[k], NULL);
+        } else {
+            fn(&statelists[k]);
+        }
+    }
+}
+
+// roll back the cryptostates of one statelist to the key, and sort them
+static void
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+*nested_rollback_thread(void *arg) {
+    StateList_t *statelist = arg;
+    for (uint32_t i = 0; i < statelist->len; i++) {
+        lfsr_rollback_word(statelist->head.slhead + i, statelist->nt_enc ^ statelist->uid, 0);
+    }
+    if (radixsort_uint64(statelist->head.keyhead, statelist->len, UINT64_C(-1)) == false) {
+        qsort(statelist->head.keyhead, statelist->len, sizeof(uint64_t), compare_uint64);
+    }
+    statelist->head.keyhead[statelist->len] = UINT64_C(-1);
+    return NULL;
+}
+
+// The first 16 Bits of the cryptostate already contain part of our key.
+// Both sorted statelists are merged on these 16 bits, the survivors of each list are
+// rolled back and sorted in parallel, and the key we are searching for must be in the
+// intersection of both lists. Returns the number of key candidates, left in statelists[0].
+static uint32_t nested_intersect_statelists(StateList_t statelists[2]) {
+    uint64_t *a = statelists[0].head.keyhead;
+    uint64_t *b = statelists[1].head.keyhead;
+    uint32_t i = 0, j = 0, na = 0, nb = 0;
+
+    while (i < statelists[0].len && j < statelists[1].len) {
+        uint64_t ka = a[i] & NESTED_STATE16_MASK;
+        uint64_t kb = b[j] & NESTED_STATE16_MASK;
+        if (ka < kb) {
+            i++;
+        } else if (ka > kb) {
+            j++;
+        } else {
+            while (i < statelists[0].len && (a[i] & NESTED_STATE16_MASK) == ka) {
+                a[na++] = a[i++];
+            }
+            while (j < statelists[1].len && (b[j] & NESTED_STATE16_MASK) == kb) {
+                b[nb++] = b[j++];
+            }
+        }
+    }
+    statelists[0].len = na;
+    statelists[1].len = nb;
+
+    nested_run_pair(nested_rollback_thread, statelists);
+
+    statelists[0].len = intersection(statelists[0].head.keyhead, statelists[1].head.keyhead);
+    return statelists[0].len;
+}
+
+// Extract the key candidates from the intersected statelist, most probable first:
+// keys are often reused across sectors, so the key used for the nested authentication,
+// then the default keys, then all others. Returns NULL if out of memory.
+static uint64_t *nested_ranked_keys(const StateList_t *statelist, uint64_t known_key) {
+    uint64_t *keys = calloc(statelist->len + 1, sizeof(uint64_t));
+    if (keys == NULL)
+        return NULL;
+
+    uint32_t n = 0;
+    for (uint8_t rank = 0; rank < 3; rank++) {
+        for (uint32_t i = 0; i < statelist->len; i++) {
+            uint64_t key64 = 0;
+            crypto1_get_lfsr(statelist->head.slhead + i, &key64);
+
+            uint8_t key_rank = 2;
+            if (key64 == known_key) {
+                key_rank = 0;
+            } else {
+                for (uint32_t k = 0; k < ARRAYLEN(g_mifare_default_keys); k++) {
+                    if (key64 == g_mifare_default_keys[k]) {
+                        key_rank = 1;
+                        break;
+                    }
+                }
+            }
+            if (key_rank == rank) {
+                keys[n++] = key64;
+            }
+        }
+    }
+    return keys;
+}
+
+// Key candidates of the two nested authentications in statelists (uid, nt_enc and ks1 set), most probable first.
+// *keys must be freed by the caller. The statelists are freed.
+int mfNestedCandidates(StateList_t statelists[2], uint64_t known_key, uint64_t **keys, uint32_t *keycnt) {
+    *keys = NULL;
+    *keycnt = 0;
+
+    nested_run_pair(nested_worker_thread, statelists);
+    if (statelists[0].head.slhead == NULL || statelists[1].head.slhead == NULL) {
+        free(statelists[0].head.slhead);
+        free(statelists[1].head.slhead);
+        return PM3_EMALLOC;
+    }
+
+    int res = PM3_SUCCESS;
+    uint32_t cnt = nested_intersect_statelists(statelists);
+    if (cnt) {
+        *keys = nested_ranked_keys(&statelists[0], known_key);
+        if (*keys == NULL) {
+            res = PM3_EMALLOC;
+        } else {
+            *keycnt = cnt;
+        }
+    }
+    free(statelists[0].head.slhead);
+    free(statelists[1].head.slhead);
+    return res;
+}
+
+// Test the key candidates on the card, in chunks of keys streamed to the device.
+// Key A and B use the single sector mode of the fast check, which keeps the card selected between chunks.
+static int nested_check_keys(uint8_t blockNo, uint8_t keyType, const uint64_t *keys, uint32_t keycnt, uint64_t *found_key) {
+
+    uint32_t max_keys = (keyType < 2) ? (PM3_CMD_DATA_SIZE / MIFARE_KEY_SIZE) : KEYS_IN_BLOCK;
+    uint8_t keyBlock[PM3_CMD_DATA_SIZE] = {0x00};
+    sector_t e_sector[MIFARE_4K_MAXSECTOR];
+    memset(e_sector, 0, sizeof(e_sector));
+
+    uint64_t start_time = msclock();
+    for (uint32_t i = 0; i < keycnt; i += max_keys) {
+
+        uint32_t size = keycnt - i > max_keys ? max_keys : keycnt - i;
+
+        for (uint32_t j = 0; j < size; j++) {
+            num_to_bytes(keys[i + j], MIFARE_KEY_SIZE, keyBlock + j * MIFARE_KEY_SIZE);
+        }
+
+        int res;
+        if (keyType < 2) {
+            uint16_t singleSectorParams = blockNo | (keyType << 8) | (1 << 15);
+            res = mfCheckKeys_fast_ex(MIFARE_4K_MAXSECTOR, (i == 0), (i + size == keycnt), 1, size, keyBlock, e_sector, false, false, true, singleSectorParams);
+            if (res == PM3_SUCCESS) {
+                *found_key = e_sector[mfSectorNum(blockNo)].Key[keyType];
+            }
+        } else {
+            res = mfCheckKeys(blockNo, keyType, false, size, keyBlock, found_key);
+        }
+        if (res == PM3_SUCCESS || res == PM3_ETIMEOUT) {
+            return res;
+        }
+
+        float bruteforce_per_second = (float)(i + size) / ((msclock() - start_time) / 1000.0);
+        PrintAndLogEx(INPLACE, "%6d/%u keys | %5.1f keys/sec | worst case %6.1f seconds remaining", i + size, keycnt, bruteforce_per_second, (keycnt - i - size) / bruteforce_per_second);
+    }
+    return PM3_ESOFT;
+}
+
 int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *resultKey, bool calibrate) {
 
     uint32_t uid;
     StateList_t statelists[2];
-    struct Crypto1State *p1, *p2, *p3, *p4;
 
     struct {
         uint8_t block;
@@ -517,64 +700,12 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo,
     memcpy(&statelists[1].ks1, package->ks_b, sizeof(package->ks_b));
 
     // calc keys
-    pthread_t thread_id[2];
-
-    // create and run worker threads
-    for (uint8_t i = 0; i < 2; i++)
-        pthread_create(thread_id + i, NULL, nested_worker_thread, &statelists[i]);
-
-    // wait for threads to terminate:
-    for (uint8_t i = 0; i < 2; i++)
-        pthread_join(thread_id[i], (void *)&statelists[i].head.slhead);
-
-    // the first 16 Bits of the cryptostate already contain part of our key.
-    // Create the intersection of the two lists based on these 16 Bits and
-    // roll back the cryptostate
-    p1 = p3 = statelists[0].head.slhead;
-    p2 = p4 = statelists[1].head.slhead;
-
-    while (p1 <= statelists[0].tail.sltail && p2 <= statelists[1].tail.sltail) {
-        if (Compare16Bits(p1, p2) == 0) {
-
-            struct Crypto1State savestate;
-            savestate = *p1;
-            while (Compare16Bits(p1, &savestate) == 0 && p1 <= statelists[0].tail.sltail) {
-                *p3 = *p1;
-                lfsr_rollback_word(p3, statelists[0].nt_enc ^ statelists[0].uid, 0);
-                p3++;
-                p1++;
-            }
-            savestate = *p2;
-            while (Compare16Bits(p2, &savestate) == 0 && p2 <= statelists[1].tail.sltail) {
-                *p4 = *p2;
-                lfsr_rollback_word(p4, statelists[1].nt_enc ^ statelists[1].uid, 0);
-                p4++;
-                p2++;
-            }
-        } else {
-            while (Compare16Bits(p1, p2) == -1) p1++;
-            while (Compare16Bits(p1, p2) == 1) p2++;
-        }
+    uint64_t *keys = NULL;
+    uint32_t keycnt = 0;
+    int res = mfNestedCandidates(statelists, bytes_to_num(key, MIFARE_KEY_SIZE), &keys, &keycnt);
+    if (res != PM3_SUCCESS) {
+        return res;
     }
-
-    p3->odd = -1;
-    p3->even = -1;
-    p4->odd = -1;
-    p4->even = -1;
-    statelists[0].len = p3 - statelists[0].head.slhead;
-    statelists[1].len = p4 - statelists[1].head.slhead;
-    statelists[0].tail.sltail = --p3;
-    statelists[1].tail.sltail = --p4;
-
-    // the statelists now contain possible keys. The key we are searching for must be in the
-    // intersection of both lists
-    qsort(statelists[0].head.keyhead, statelists[0].len, sizeof(uint64_t), compare_uint64);
-    qsort(statelists[1].head.keyhead, statelists[1].len, sizeof(uint64_t), compare_uint64);
-    // Create the intersection
-    statelists[0].len = intersection(statelists[0].head.keyhead, statelists[1].head.keyhead);
-
-    //statelists[0].tail.keytail = --p7;
-    uint32_t keycnt = statelists[0].len;
     if (keycnt == 0) goto out;
 
     PrintAndLogEx(SUCCESS, "Found " _YELLOW_("%u") " key candidates", keycnt);
@@ -582,47 +713,22 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo,
     memset(resultKey, 0, 6);
     uint64_t key64 = -1;
 
-    // The list may still contain several key candidates. Test each of them with mfCheckKeys
-    uint32_t max_keys = keycnt > KEYS_IN_BLOCK ? KEYS_IN_BLOCK : keycnt;
-    uint8_t keyBlock[PM3_CMD_DATA_SIZE] = {0x00};
-
-    for (uint32_t i = 0; i < keycnt; i += max_keys) {
-
-        uint64_t start_time = msclock();
-
-        uint8_t size = keycnt - i > max_keys ? max_keys : keycnt - i;
-
-        register uint8_t j;
-        for (j = 0; j < size; j++) {
-            crypto1_get_lfsr(statelists[0].head.slhead + i, &key64);
-            num_to_bytes(key64, 6, keyBlock + j * 6);
-        }
-
-        if (mfCheckKeys(statelists[0].blockNo, statelists[0].keyType, false, size, keyBlock, &key64) == PM3_SUCCESS) {
-            free(statelists[0].head.slhead);
-            free(statelists[1].head.slhead);
-            num_to_bytes(key64, 6, resultKey);
-
-            if (package->keytype < 2) {
-                PrintAndLogEx(SUCCESS, "\nTarget block %4u key type %c -- found valid key [ " _GREEN_("%s") " ]",
-                              package->block,
-                              package->keytype ? 'B' : 'A',
-                              sprint_hex_inrow(resultKey, 6)
-                             );
-            } else {
-                PrintAndLogEx(SUCCESS, "\nTarget block %4u key type %02x -- found valid key [ " _GREEN_("%s") " ]",
-                              package->block,
-                              MIFARE_AUTH_KEYA + package->keytype,
-                              sprint_hex_inrow(resultKey, 6)
-                             );
-            }
+    // The list may still contain several key candidates. Test each of them, most probable first
+    res = nested_check_keys(package->block, package->keytype, keys, keycnt, &key64);
+    free(keys);
 
+    if (res == PM3_SUCCESS) {
+        num_to_bytes(key64, 6, resultKey);
 
-            return PM3_SUCCESS;
+        // key A and B come from the single sector fast check,  which already printed the key
+        if (package->keytype >= 2) {
+            PrintAndLogEx(SUCCESS, "\nTarget block %4u key type %02x -- found valid key [ " _GREEN_("%s") " ]",
+                          package->block,
+                          MIFARE_AUTH_KEYA + package->keytype,
+                          sprint_hex_inrow(resultKey, 6)
+                         );
         }
-
-        float bruteforce_per_second = (float)(i + max_keys) / ((msclock() - start_time) / 1000.0);
-        PrintAndLogEx(INPLACE, "%6d/%u keys | %5.1f keys/sec | worst case %6.1f seconds remaining", i, keycnt, bruteforce_per_second, (keycnt - i) / bruteforce_per_second);
+        return PM3_SUCCESS;
     }
 
 out:
@@ -637,8 +743,6 @@ out:
                       MIFARE_AUTH_KEYA + package->keytype
                      );
     }
-    free(statelists[0].head.slhead);
-    free(statelists[1].head.slhead);
     return PM3_ESOFT;
 }
 
@@ -646,7 +750,6 @@ int mfStaticNested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBl
 
     uint32_t uid;
     StateList_t statelists[2];
-    struct Crypto1State *p1, *p2, *p3, *p4;
 
     struct {
         uint8_t block;
@@ -697,62 +800,14 @@ int mfStaticNested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBl
     memcpy(&statelists[1].ks1, package->ks_b, sizeof(package->ks_b));
 
     // calc keys
-    pthread_t thread_id[2];
-
-    // create and run worker threads
-    for (uint8_t i = 0; i < 2; i++)
-        pthread_create(thread_id + i, NULL, nested_worker_thread, &statelists[i]);
-
-    // wait for threads to terminate:
-    for (uint8_t i = 0; i < 2; i++)
-        pthread_join(thread_id[i], (void *)&statelists[i].head.slhead);
-
-    // the first 16 Bits of the cryptostate already contain part of our key.
-    // Create the intersection of the two lists based on these 16 Bits and
-    // roll back the cryptostate
-    p1 = p3 = statelists[0].head.slhead;
-    p2 = p4 = statelists[1].head.slhead;
-
-    while (p1 <= statelists[0].tail.sltail && p2 <= statelists[1].tail.sltail) {
-        if (Compare16Bits(p1, p2) == 0) {
-
-            struct Crypto1State savestate;
-            savestate = *p1;
-            while (Compare16Bits(p1, &savestate) == 0 && p1 <= statelists[0].tail.sltail) {
-                *p3 = *p1;
-                lfsr_rollback_word(p3, statelists[0].nt_enc ^ statelists[0].uid, 0);
-                p3++;
-                p1++;
-            }
-            savestate = *p2;
-            while (Compare16Bits(p2, &savestate) == 0 && p2 <= statelists[1].tail.sltail) {
-                *p4 = *p2;
-                lfsr_rollback_word(p4, statelists[1].nt_enc ^ statelists[1].uid, 0);
-                p4++;
-                p2++;
-            }
-        } else {
-            while (Compare16Bits(p1, p2) == -1) p1++;
-            while (Compare16Bits(p1, p2) == 1) p2++;
-        }
+    nested_run_pair(nested_worker_thread, statelists);
+    if (statelists[0].head.slhead == NULL || statelists[1].head.slhead == NULL) {
+        free(statelists[0].head.slhead);
+        free(statelists[1].head.slhead);
+        return PM3_EMALLOC;
     }
 
-    p3->odd = -1;
-    p3->even = -1;
-    p4->odd = -1;
-    p4->even = -1;
-    statelists[0].len = p3 - statelists[0].head.slhead;
-    statelists[1].len = p4 - statelists[1].head.slhead;
-    statelists[0].tail.sltail = --p3;
-    statelists[1].tail.sltail = --p4;
-
-    // the statelists now contain possible keys. The key we are searching for must be in the
-    // intersection of both lists
-    qsort(statelists[0].head.keyhead, statelists[0].len, sizeof(uint64_t), compare_uint64);
-    qsort(statelists[1].head.keyhead, statelists[1].len, sizeof(uint64_t), compare_uint64);
-    // Create the intersection
-    statelists[0].len = intersection(statelists[0].head.keyhead, statelists[1].head.keyhead);
-
+    uint32_t keycnt = nested_intersect_statelists(statelists);
 
     /*
 
@@ -795,13 +850,22 @@ int mfStaticNested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBl
         statelists[0].tail.sltail = --p3;
     */
 
-    uint32_t keycnt = statelists[0].len;
     if (keycnt == 0) goto out;
 
     PrintAndLogEx(SUCCESS, "Found " _YELLOW_("%u") " key candidates", keycnt);
 
     memset(resultKey, 0, 6);
 
+    // most probable candidates first, the list holds keys instead of cryptostates from now on
+    uint64_t *keys = nested_ranked_keys(&statelists[0], bytes_to_num(key, MIFARE_KEY_SIZE));
+    if (keys == NULL) {
+        free(statelists[0].head.slhead);
+        free(statelists[1].head.slhead);
+        return PM3_EMALLOC;
+    }
+    memcpy(statelists[0].head.keyhead, keys, keycnt * sizeof(uint64_t));
+    free(keys);
+
     // The list may still contain several key candidates. Test each of them with mfCheckKeys
     uint32_t maxkeysinblock = IfPm3Flash() ? 1000 : KEYS_IN_BLOCK;
     uint32_t max_keys_chunk = keycnt > maxkeysinblock ? maxkeysinblock : keycnt;
@@ -856,8 +920,7 @@ int mfStaticNested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBl
 
         // copy x keys to device.
         for (uint32_t j = 0; j < chunk; j++) {
-            crypto1_get_lfsr(statelists[0].head.slhead + i + j, &key64);
-            num_to_bytes(key64, 6, p_keyblock + j * 6);
+            num_to_bytes(statelists[0].head.keyhead[i + j], 6, p_keyblock + j * 6);
         }
 
         // check a block of generated key candidates.
@@ -0,0 +1,647 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// pcapng export and import of trace buffers
+//
+// One section with one interface, one enhanced packet block per trace record.
+// ISO 14443 based protocols use the ISO 14443 link type and its pseudo header,
+// the other protocols store the raw frame under LINKTYPE_USER0.
+// Direction is in the epb_flags option, record duration and parity bytes go
+// into a packet comment so a saved trace loads back unchanged.
+//-----------------------------------------------------------------------------
+
+#include "pcapng.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "ui.h"
+#include "commonutil.h"     // BSWAP_16
+#include "fileutils.h"
+#include "parity.h"         // oddparity8
+#include "pm3_cmd.h"        // tracelog_hdr_t
+#include "protocols.h"
+
+#define PCAPNG_BT_SHB           0x0A0D0D0A
+#define PCAPNG_BT_IDB           0x00000001
+#define PCAPNG_BT_EPB           0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+
+#define PCAPNG_OPT_ENDOFOPT     0
+#define PCAPNG_OPT_COMMENT      1
+#define PCAPNG_OPT_SHB_USERAPPL 4
+#define PCAPNG_OPT_IF_NAME      2
+#define PCAPNG_OPT_IF_TSRESOL   9
+#define PCAPNG_OPT_EPB_FLAGS    2
+
+// epb_flags bits 0-1
+#define PCAPNG_EPB_INBOUND      0x1
+#define PCAPNG_EPB_OUTBOUND     0x2
+
+// ISO 14443 pseudo header events
+#define ISO14443_PSEUDO_HDR_LEN 4
+#define ISO14443_EVT_PCD        0xFE
+#define ISO14443_EVT_PICC       0xFF
+
+#define PCAPNG_USERAPPL         "proxmark3"
+#define PCAPNG_WRITE_BUFSIZE    (1 << 20)
+#define PCAPNG_PAD4(x)          (((x) + 3) & ~3u)
+
+typedef struct {
+    uint32_t type;
+    uint32_t total_len;
+} PACKED pcapng_block_hdr_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t major;
+    uint16_t minor;
+    int64_t section_len;
+} PACKED pcapng_shb_t;
+
+typedef struct {
+    uint16_t linktype;
+    uint16_t reserved;
+    uint32_t snaplen;
+} PACKED pcapng_idb_t;
+
+typedef struct {
+    uint32_t if_id;
+    uint32_t ts_high;
+    uint32_t ts_low;
+    uint32_t cap_len;
+    uint32_t orig_len;
+} PACKED pcapng_epb_t;
+
+typedef struct {
+    uint16_t code;
+    uint16_t len;
+} PACKED pcapng_opt_t;
+
+uint16_t pcapng_linktype(uint8_t protocol) {
+    switch (protocol) {
+        case ISO_14443A:
+        case ISO_14443B:
+        case TOPAZ:
+        case ISO_7816_4:
+        case MFDES:
+        case PROTO_MIFARE:
+        case PROTO_CRYPTORF:
+        case SEOS:
+        case PROTO_MFPLUS:
+            return PCAPNG_LINKTYPE_ISO_14443;
+        default:
+            return PCAPNG_LINKTYPE_USER0;
+    }
+}
+
+static uint64_t ticks_to_ns(uint32_t ticks) {
+    return ((uint64_t)ticks * 1000000000ULL + PCAPNG_TRACE_CLOCK / 2) / PCAPNG_TRACE_CLOCK;
+}
+
+static uint32_t ns_to_ticks(uint64_t ns) {
+    // split to keep the multiplication in 64 bits for timestamps of any age
+    uint64_t sec = ns / 1000000000ULL;
+    uint64_t rem = ns % 1000000000ULL;
+    return (uint32_t)(sec * PCAPNG_TRACE_CLOCK + (rem * PCAPNG_TRACE_CLOCK + 500000000ULL) / 1000000000ULL);
+}
+
+//-----------------------------------------------------------------------------
+// Writer
+//-----------------------------------------------------------------------------
+
+static const uint8_t s_zero_pad[4] = {0};
+
+static void write_opt(FILE *f, uint16_t code, const void *data, uint16_t len) {
+    pcapng_opt_t opt = { .code = code, .len = len };
+    fwrite(&opt, sizeof(opt), 1, f);
+    if (len) {
+        fwrite(data, 1, len, f);
+        fwrite(s_zero_pad, 1, PCAPNG_PAD4(len) - len, f);
+    }
+}
+
+static uint32_t opt_size(uint16_t len) {
+    return sizeof(pcapng_opt_t) + PCAPNG_PAD4(len);
+}
+
+static void write_shb(FILE *f) {
+    uint32_t total = sizeof(pcapng_block_hdr_t) + sizeof(pcapng_shb_t)
+                     + opt_size(strlen(PCAPNG_USERAPPL)) + opt_size(0) + sizeof(uint32_t);
+
+    pcapng_block_hdr_t bh = { .type = PCAPNG_BT_SHB, .total_len = total };
+    pcapng_shb_t shb = { .magic = PCAPNG_BYTE_ORDER_MAGIC, .major = 1, .minor = 0, .section_len = -1 };
+    fwrite(&bh, sizeof(bh), 1, f);
+    fwrite(&shb, sizeof(shb), 1, f);
+    write_opt(f, PCAPNG_OPT_SHB_USERAPPL, PCAPNG_USERAPPL, strlen(PCAPNG_USERAPPL));
+    write_opt(f, PCAPNG_OPT_ENDOFOPT, NULL, 0);
+    fwrite(&total, sizeof(total), 1, f);
+}
+
+static void write_idb(FILE *f, uint16_t linktype, uint8_t protocol) {
+    char name[32] = {0};
+    snprintf(name, sizeof(name), "proxmark3 protocol %u", protocol);
+    uint8_t tsresol = 9;
+
+    uint32_t total = sizeof(pcapng_block_hdr_t) + sizeof(pcapng_idb_t)
+                     + opt_size(strlen(name)) + opt_size(sizeof(tsresol)) + opt_size(0) + sizeof(uint32_t);
+
+    pcapng_block_hdr_t bh = { .type = PCAPNG_BT_IDB, .total_len = total };
+    pcapng_idb_t idb = { .linktype = linktype, .reserved = 0, .snaplen = 0 };
+    fwrite(&bh, sizeof(bh), 1, f);
+    fwrite(&idb, sizeof(idb), 1, f);
+    write_opt(f, PCAPNG_OPT_IF_NAME, name, strlen(name));
+    write_opt(f, PCAPNG_OPT_IF_TSRESOL, &tsresol, sizeof(tsresol));
+    write_opt(f, PCAPNG_OPT_ENDOFOPT, NULL, 0);
+    fwrite(&total, sizeof(total), 1, f);
+}
+
+static void write_epb(FILE *f, const tracelog_hdr_t *hdr, uint16_t linktype) {
+
+    uint8_t pseudo[ISO14443_PSEUDO_HDR_LEN] = {0};
+    uint32_t pseudo_len = 0;
+    if (linktype == PCAPNG_LINKTYPE_ISO_14443) {
+        pseudo[0] = 0x00;
+        pseudo[1] = hdr->isResponse ? ISO14443_EVT_PICC : ISO14443_EVT_PCD;
+        pseudo[2] = (hdr->data_len >> 8) & 0xFF;
+        pseudo[3] = hdr->data_len & 0xFF;
+        pseudo_len = sizeof(pseudo);
+    }
+
+    uint32_t cap_len = pseudo_len + hdr->data_len;
+    uint32_t flags = hdr->isResponse ? PCAPNG_EPB_INBOUND : PCAPNG_EPB_OUTBOUND;
+
+    // "pm3 duration=<dec> parity=<hex>"
+    const uint8_t *parity = hdr->frame + hdr->data_len;
+    uint16_t parity_len = TRACELOG_PARITY_LEN(hdr);
+    char comment[40 + 2 * 4096] = {0};
+    int clen = snprintf(comment, sizeof(comment), "pm3 duration=%u parity=", hdr->duration);
+    for (uint16_t i = 0; i < parity_len && clen + 3 < (int)sizeof(comment); i++) {
+        clen += snprintf(comment + clen, sizeof(comment) - clen, "%02x", parity[i]);
+    }
+
+    uint32_t total = sizeof(pcapng_block_hdr_t) + sizeof(pcapng_epb_t) + PCAPNG_PAD4(cap_len)
+                     + opt_size(sizeof(flags)) + opt_size(clen) + opt_size(0) + sizeof(uint32_t);
+
+    uint64_t ts = ticks_to_ns(hdr->timestamp);
+
+    pcapng_block_hdr_t bh = { .type = PCAPNG_BT_EPB, .total_len = total };
+    pcapng_epb_t epb = {
+        .if_id = 0,
+        .ts_high = (uint32_t)(ts >> 32),
+        .ts_low = (uint32_t)ts,
+        .cap_len = cap_len,
+        .orig_len = cap_len,
+    };
+    fwrite(&bh, sizeof(bh), 1, f);
+    fwrite(&epb, sizeof(epb), 1, f);
+    fwrite(pseudo, 1, pseudo_len, f);
+    fwrite(hdr->frame, 1, hdr->data_len, f);
+    fwrite(s_zero_pad, 1, PCAPNG_PAD4(cap_len) - cap_len, f);
+    write_opt(f, PCAPNG_OPT_EPB_FLAGS, &flags, sizeof(flags));
+    write_opt(f, PCAPNG_OPT_COMMENT, comment, clen);
+    write_opt(f, PCAPNG_OPT_ENDOFOPT, NULL, 0);
+    fwrite(&total, sizeof(total), 1, f);
+}
+
+int pcapng_save_trace(const char *preferredName, const uint8_t *trace, uint32_t traceLen, uint8_t protocol) {
+
+    if (trace == NULL || traceLen == 0) {
+        return PM3_EINVARG;
+    }
+
+    char *fileName = newfilenamemcopy(preferredName, ".pcapng");
+    if (fileName == NULL) {
+        return PM3_EMALLOC;
+    }
+
+    FILE *f = fopen(fileName, "wb");
+    if (f == NULL) {
+        PrintAndLogEx(WARNING, "file not found or locked `" _YELLOW_("%s") "`", fileName);
+        free(fileName);
+        return PM3_EFILE;
+    }
+
+    // records are written one by one, let stdio batch them
+    setvbuf(f, NULL, _IOFBF, PCAPNG_WRITE_BUFSIZE);
+
+    uint16_t linktype = pcapng_linktype(protocol);
+    write_shb(f);
+    write_idb(f, linktype, protocol);
+
+    uint32_t records = 0;
+    uint32_t tracepos = 0;
+    while (tracepos + TRACELOG_HDR_LEN < traceLen) {
+        const tracelog_hdr_t *hdr = (const tracelog_hdr_t *)(trace + tracepos);
+        uint32_t next = tracepos + TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr);
+        if (next > traceLen) {
+            break;
+        }
+        write_epb(f, hdr, linktype);
+        records++;
+        tracepos = next;
+    }
+
+    int res = PM3_SUCCESS;
+    if (fflush(f) != 0 || ferror(f)) {
+        PrintAndLogEx(FAILED, "error, writing to file `" _YELLOW_("%s") "`", fileName);
+        res = PM3_EFILE;
+    } else {
+        PrintAndLogEx(SUCCESS, "Saved " _YELLOW_("%u") " records to pcapng file `" _YELLOW_("%s") "`", records, fileName);
+    }
+    fclose(f);
+    free(fileName);
+    return res;
+}
+
+//-----------------------------------------------------------------------------
+// Reader
+//-----------------------------------------------------------------------------
+
+typedef struct {
+    uint16_t linktype;
+    uint64_t ts_div;    // timestamp units per second
+} pcapng_if_t;
+
+#define PCAPNG_MAX_INTERFACES   16
+
+typedef struct {
+    bool swapped;
+    bool pm3;           // written by us, timestamps are trace ticks since power up
+    bool have_first;
+    uint64_t first_ns;
+    uint32_t nif;
+    pcapng_if_t ifs[PCAPNG_MAX_INTERFACES];
+} pcapng_section_t;
+
+static uint16_t rd16(const pcapng_section_t *s, const uint8_t *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return s->swapped ? BSWAP_16(v) : v;
+}
+
+static uint32_t rd32(const pcapng_section_t *s, const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return s->swapped ? BSWAP_32(v) : v;
+}
+
+// walk the options of a block body, return the value of `code` or NULL
+static const uint8_t *find_opt(const pcapng_section_t *s, const uint8_t *opts, size_t len, uint16_t code, uint16_t *optlen) {
+    size_t pos = 0;
+    while (pos + sizeof(pcapng_opt_t) <= len) {
+        uint16_t c = rd16(s, opts + pos);
+        uint16_t l = rd16(s, opts + pos + 2);
+        if (c == PCAPNG_OPT_ENDOFOPT) {
+            break;
+        }
+        if (pos + sizeof(pcapng_opt_t) + l > len) {
+            break;
+        }
+        if (c == code) {
+            *optlen = l;
+            return opts + pos + sizeof(pcapng_opt_t);
+        }
+        pos += sizeof(pcapng_opt_t) + PCAPNG_PAD4(l);
+    }
+    return NULL;
+}
+
+static int hexval(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// parse our "pm3 duration=.. parity=.." comment
+static bool parse_comment(const uint8_t *opt, uint16_t len, uint16_t *duration, uint8_t *parity, uint16_t parity_len) {
+    char comment[40 + 2 * 4096] = {0};
+    if (len >= sizeof(comment)) {
+        return false;
+    }
+    memcpy(comment, opt, len);
+
+    unsigned int dur = 0;
+    int n = 0;
+    if (sscanf(comment, "pm3 duration=%u parity=%n", &dur, &n) != 1 || n == 0) {
+        return false;
+    }
+
+    const char *hex = comment + n;
+    if (strlen(hex) != 2 * (size_t)parity_len) {
+        return false;
+    }
+    for (uint16_t i = 0; i < parity_len; i++) {
+        int hi = hexval(hex[2 * i]);
+        int lo = hexval(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        parity[i] = (hi << 4) | lo;
+    }
+    *duration = dur;
+    return true;
+}
+
+static int append_record(uint8_t **trace, uint32_t *traceLen, uint32_t *cap,
+                         uint32_t timestamp, uint16_t duration, bool isResponse,
+                         const uint8_t *data, uint16_t data_len, const uint8_t *parity) {
+
+    tracelog_hdr_t tmp = { .data_len = data_len };
+    uint32_t parity_len = TRACELOG_PARITY_LEN(&tmp);
+    uint64_t need = (uint64_t) * traceLen + TRACELOG_HDR_LEN + data_len + parity_len;
+    if (need > UINT32_MAX) {
+        return PM3_EOVFLOW;
+    }
+
+    if (need > *cap) {
+        uint64_t ncap = (*cap) ? *cap : 0x10000;
+        while (ncap < need) {
+            ncap <<= 1;
+        }
+        if (ncap > UINT32_MAX) {
+            ncap = UINT32_MAX;
+        }
+        uint8_t *p = realloc(*trace, ncap);
+        if (p == NULL) {
+            return PM3_EMALLOC;
+        }
+        *trace = p;
+        *cap = ncap;
+    }
+
+    tracelog_hdr_t *hdr = (tracelog_hdr_t *)(*trace + *traceLen);
+    hdr->timestamp = timestamp;
+    hdr->duration = duration;
+    hdr->data_len = data_len;
+    hdr->isResponse = isResponse;
+    memcpy(hdr->frame, data, data_len);
+    memcpy(hdr->frame + data_len, parity, parity_len);
+    *traceLen = need;
+    return PM3_SUCCESS;
+}
+
+static int read_epb(pcapng_section_t *s, const uint8_t *body, size_t len, uint8_t **trace, uint32_t *traceLen, uint32_t *cap, uint32_t *records) {
+
+    if (len < sizeof(pcapng_epb_t)) {
+        return PM3_ESOFT;
+    }
+
+    uint32_t if_id = rd32(s, body);
+    uint64_t ts = ((uint64_t)rd32(s, body + 4) << 32) | rd32(s, body + 8);
+    uint32_t cap_len = rd32(s, body + 12);
+    if (if_id >= s->nif || sizeof(pcapng_epb_t) + (size_t)cap_len > len) {
+        return PM3_ESOFT;
+    }
+
+    const pcapng_if_t *ifc = &s->ifs[if_id];
+    const uint8_t *data = body + sizeof(pcapng_epb_t);
+    const uint8_t *opts = data + PCAPNG_PAD4(cap_len);
+    size_t opts_len = (sizeof(pcapng_epb_t) + PCAPNG_PAD4(cap_len) <= len) ? len - sizeof(pcapng_epb_t) - PCAPNG_PAD4(cap_len) : 0;
+
+    bool isResponse = false;
+    uint16_t optlen = 0;
+    const uint8_t *flags = find_opt(s, opts, opts_len, PCAPNG_OPT_EPB_FLAGS, &optlen);
+    if (flags && optlen == 4) {
+        isResponse = ((rd32(s, flags) & 0x3) == PCAPNG_EPB_INBOUND);
+    }
+
+    if (ifc->linktype == PCAPNG_LINKTYPE_ISO_14443) {
+        if (cap_len < ISO14443_PSEUDO_HDR_LEN) {
+            return PM3_SUCCESS;
+        }
+        // only data events, field on / off and the like carry no frame
+        if (data[1] != ISO14443_EVT_PCD && data[1] != ISO14443_EVT_PICC) {
+            return PM3_SUCCESS;
+        }
+        isResponse = (data[1] == ISO14443_EVT_PICC);
+        data += ISO14443_PSEUDO_HDR_LEN;
+        cap_len -= ISO14443_PSEUDO_HDR_LEN;
+    } else if (ifc->linktype != PCAPNG_LINKTYPE_USER0) {
+        return PM3_SUCCESS;
+    }
+
+    if (cap_len > 0x7FFF) {
+        PrintAndLogEx(DEBUG, "skipping %u bytes frame, too long for a trace record", cap_len);
+        return PM3_SUCCESS;
+    }
+
+    // timestamps in nanoseconds, then in carrier periods
+    uint64_t ns;
+    if (ifc->ts_div == 1000000000ULL) {
+        ns = ts;
+    } else {
+        ns = (ts / ifc->ts_div) * 1000000000ULL + ((ts % ifc->ts_div) * 1000000000ULL) / ifc->ts_div;
+    }
+
+    // foreign captures carry wall clock time, make them relative to their first packet
+    if (s->pm3 == false) {
+        if (s->have_first == false) {
+            s->first_ns = ns;
+            s->have_first = true;
+        }
+        ns -= (ns >= s->first_ns) ? s->first_ns : ns;
+    }
+
+    uint16_t data_len = cap_len;
+    tracelog_hdr_t tmp = { .data_len = data_len };
+    uint8_t parity[4096] = {0};
+    uint16_t duration = 0;
+
+    const uint8_t *comment = find_opt(s, opts, opts_len, PCAPNG_OPT_COMMENT, &optlen);
+    if (comment == NULL || parse_comment(comment, optlen, &duration, parity, TRACELOG_PARITY_LEN(&tmp)) == false) {
+        // not one of ours, rebuild what a 14a sniff would have recorded
+        if (ifc->linktype == PCAPNG_LINKTYPE_ISO_14443) {
+            for (uint16_t i = 0; i < data_len; i++) {
+                parity[i >> 3] |= oddparity8(data[i]) << (7 - (i & 0x07));
+            }
+            duration = MIN(data_len * 9 * 128, UINT16_MAX);
+        }
+    }
+
+    int res = append_record(trace, traceLen, cap, ns_to_ticks(ns), duration, isResponse, data, data_len, parity);
+    if (res == PM3_SUCCESS) {
+        (*records)++;
+    }
+    return res;
+}
+
+static void read_shb(pcapng_section_t *s, const uint8_t *body, size_t len) {
+    s->nif = 0;
+    s->pm3 = false;
+    s->have_first = false;
+
+    if (len <= sizeof(pcapng_shb_t)) {
+        return;
+    }
+
+    uint16_t optlen = 0;
+    const uint8_t *appl = find_opt(s, body + sizeof(pcapng_shb_t), len - sizeof(pcapng_shb_t), PCAPNG_OPT_SHB_USERAPPL, &optlen);
+    s->pm3 = (appl && optlen == strlen(PCAPNG_USERAPPL) && memcmp(appl, PCAPNG_USERAPPL, optlen) == 0);
+}
+
+static void read_idb(pcapng_section_t *s, const uint8_t *body, size_t len) {
+    if (len < sizeof(pcapng_idb_t) || s->nif >= PCAPNG_MAX_INTERFACES) {
+        if (s->nif < PCAPNG_MAX_INTERFACES) {
+            s->nif++;
+        }
+        return;
+    }
+
+    pcapng_if_t *ifc = &s->ifs[s->nif++];
+    ifc->linktype = rd16(s, body);
+    ifc->ts_div = 1000000;
+
+    uint16_t optlen = 0;
+    const uint8_t *tsresol = find_opt(s, body + sizeof(pcapng_idb_t), len - sizeof(pcapng_idb_t), PCAPNG_OPT_IF_TSRESOL, &optlen);
+    if (tsresol && optlen == 1) {
+        uint8_t exp = tsresol[0] & 0x7F;
+        uint64_t div = 1;
+        if (tsresol[0] & 0x80) {
+            div = (exp < 64) ? (1ULL << exp) : 0;
+        } else {
+            for (uint8_t i = 0; i < exp && div; i++) {
+                div = (div > UINT64_MAX / 10) ? 0 : div * 10;
+            }
+        }
+        if (div) {
+            ifc->ts_div = div;
+        }
+    }
+}
+
+int pcapng_load_trace(const char *preferredName, uint8_t **trace, uint32_t *traceLen) {
+
+    if (trace == NULL || traceLen == NULL) {
+        return PM3_EINVARG;
+    }
+
+    char *path;
+    if (searchFile(&path, RESOURCES_SUBDIR, preferredName, ".pcapng", false) != PM3_SUCCESS) {
+        return PM3_EFILE;
+    }
+
+    FILE *f = fopen(path, "rb");
+    free(path);
+    if (f == NULL) {
+        return PM3_EFILE;
+    }
+
+    pcapng_section_t s = {0};
+    bool have_section = false;
+    uint32_t cap = *traceLen;
+    uint32_t records = 0;
+    uint8_t *body = NULL;
+    size_t body_cap = 0;
+    int res = PM3_SUCCESS;
+
+    pcapng_block_hdr_t bh;
+    while (fread(&bh, sizeof(bh), 1, f) == 1) {
+
+        if (bh.type == PCAPNG_BT_SHB) {
+            // byte order of the section is only known from its magic
+            uint32_t magic;
+            if (fread(&magic, sizeof(magic), 1, f) != 1) {
+                res = PM3_EFILE;
+                break;
+            }
+            if (magic == PCAPNG_BYTE_ORDER_MAGIC) {
+                s.swapped = false;
+            } else if (magic == BSWAP_32(PCAPNG_BYTE_ORDER_MAGIC)) {
+                s.swapped = true;
+            } else {
+                PrintAndLogEx(FAILED, "error, not a pcapng file");
+                res = PM3_EFILE;
+                break;
+            }
+            if (s.swapped) {
+                bh.total_len = BSWAP_32(bh.total_len);
+            }
+            // rewind so the magic is part of the body below
+            fseek(f, -(long)sizeof(magic), SEEK_CUR);
+            have_section = true;
+        } else {
+            if (have_section == false) {
+                PrintAndLogEx(FAILED, "error, not a pcapng file");
+                res = PM3_EFILE;
+                break;
+            }
+            if (s.swapped) {
+                bh.type = BSWAP_32(bh.type);
+                bh.total_len = BSWAP_32(bh.total_len);
+            }
+        }
+
+        if (bh.total_len < sizeof(bh) + sizeof(uint32_t) || (bh.total_len & 3)) {
+            PrintAndLogEx(FAILED, "error, malformed pcapng block");
+            res = PM3_EFILE;
+            break;
+        }
+
+        size_t len = bh.total_len - sizeof(bh);
+        if (len > body_cap) {
+            uint8_t *p = realloc(body, len);
+            if (p == NULL) {
+                res = PM3_EMALLOC;
+                break;
+            }
+            body = p;
+            body_cap = len;
+        }
+        if (fread(body, 1, len, f) != len) {
+            PrintAndLogEx(WARNING, "truncated pcapng block, stopping");
+            break;
+        }
+        // body without the trailing block length
+        len -= sizeof(uint32_t);
+
+        switch (bh.type) {
+            case PCAPNG_BT_SHB:
+                read_shb(&s, body, len);
+                break;
+            case PCAPNG_BT_IDB:
+                read_idb(&s, body, len);
+                break;
+            case PCAPNG_BT_EPB:
+                res = read_epb(&s, body, len, trace, traceLen, &cap, &records);
+                if (res == PM3_ESOFT) {
+                    PrintAndLogEx(DEBUG, "skipping malformed enhanced packet block");
+                    res = PM3_SUCCESS;
+                }
+                break;
+            default:
+                break;
+        }
+
+        if (res != PM3_SUCCESS) {
+            break;
+        }
+    }
+
+    free(body);
+    fclose(f);
+
+    if (res == PM3_EOVFLOW) {
+        PrintAndLogEx(FAILED, "Concatenated traces are larger than 4 GiB");
+    } else if (res == PM3_EMALLOC) {
+        PrintAndLogEx(FAILED, "Cannot allocate memory for trace");
+    } else if (res == PM3_SUCCESS) {
+        PrintAndLogEx(SUCCESS, "Loaded " _YELLOW_("%u") " records from pcapng file", records);
+    }
+    return res;
+}
@@ -0,0 +1,40 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// pcapng export and import of trace buffers
+//-----------------------------------------------------------------------------
+
+#ifndef PCAPNG_H__
+#define PCAPNG_H__
+
+#include "common.h"
+
+// https://www.tcpdump.org/linktypes.html
+#define PCAPNG_LINKTYPE_USER0       147     // raw frames of protocols without an assigned link type
+#define PCAPNG_LINKTYPE_ISO_14443   264     // https://www.kaiser.cx/pcap-iso14443.html
+
+// HF trace timestamps count 13.56 MHz carrier periods
+#define PCAPNG_TRACE_CLOCK          13560000
+
+uint16_t pcapng_linktype(uint8_t protocol);
+
+// Write every record of a trace as one enhanced packet block, nanosecond timestamps.
+int pcapng_save_trace(const char *preferredName, const uint8_t *trace, uint32_t traceLen, uint8_t protocol);
+
+// Read the enhanced packet blocks of a pcapng file and append them as records to *trace,
+// which is reallocated as needed. *traceLen is updated.
+int pcapng_load_trace(const char *preferredName, uint8_t **trace, uint32_t *traceLen);
+
+#endif
@@ -339,6 +339,7 @@ void ProxWidget::applyOperation() {
     //printf("ApplyOperation()");
     //g_saveState_gb = save_bufferS32(g_GraphBuffer, g_GraphTraceLen);
     memcpy(g_GraphBuffer, g_OverlayBuffer, sizeof(int) * g_GraphTraceLen);
+    GraphChanged();
     RepaintGraphWindow();
 }
 void ProxWidget::stickOperation() {
@@ -1230,6 +1231,7 @@ void Plot::Trim(void) {
     }
 
     g_GraphTraceLen = rref - lref;
+    GraphChanged();
     g_GraphStart = 0;
 }
 
@@ -1476,6 +1478,7 @@ void Plot::keyPressEvent(QKeyEvent *event) {
             } else {
                 g_GraphBuffer[g_MarkerA.pos] += 1;
             }
+            GraphChanged();
 
             RepaintGraphWindow();
             break;
@@ -1486,6 +1489,7 @@ void Plot::keyPressEvent(QKeyEvent *event) {
             } else {
                 g_GraphBuffer[g_MarkerA.pos] -= 1;
             }
+            GraphChanged();
 
             RepaintGraphWindow();
             break;
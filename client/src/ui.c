@@ -56,6 +56,7 @@ uint32_t g_GraphStop = 0;
 uint32_t g_GraphStart_old = 0;
 double g_GraphPixelsPerPoint = 1.f; // How many visual pixels are between each sample point (x axis)
 static bool flushAfterWrite = false;
+static bool consoleToStderr = false;
 double g_GridOffset = 0;
 bool g_GridLocked = false;
 
@@ -235,7 +236,7 @@ void PrintAndLogEx(logLevel_t level, const char *fmt, ...) {
     char buffer2[MAX_PRINT_BUFFER + sizeof(prefix)] = {0};
     char *token = NULL;
     char *tmp_ptr = NULL;
-    FILE *stream = stdout;
+    FILE *stream = (consoleToStderr) ? stderr : stdout;
     const char *spinner[] = {_YELLOW_("[\\]"), _YELLOW_("[|]"), _YELLOW_("[/]"), _YELLOW_("[-]")};
     const char *spinner_emoji[] = {" :clock1: ", " :clock2: ", " :clock3: ", " :clock4: ", " :clock5: ", " :clock6: ",
                                    " :clock7: ", " :clock8: ", " :clock9: ", " :clock10: ", " :clock11: ", " :clock12: "
@@ -473,6 +474,15 @@ bool GetFlushAfterWrite(void) {
     return flushAfterWrite;
 }
 
+// while stdout carries data, e.g. `trace list --jsonl -`, console messages go to stderr
+void SetConsoleToStderr(bool value) {
+    consoleToStderr = value;
+}
+
+bool GetConsoleToStderr(void) {
+    return consoleToStderr;
+}
+
 void memcpy_filter_rlmarkers(void *dest, const void *src, size_t n) {
     uint8_t *rdest = (uint8_t *)dest;
     uint8_t *rsrc = (uint8_t *)src;
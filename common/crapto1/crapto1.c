@@ -155,15 +155,26 @@ recover(uint32_t *o_head, uint32_t *o_tail, uint32_t oks,
 
 
 #if !defined(__arm__) || defined(__linux__) || defined(_WIN32) || defined(__APPLE__) // bare metal ARM Proxmark lacks malloc()/free()
-/** lfsr_recovery
- * recover the state of the lfsr given 32 bits of the keystream
- * additionally you can use the in parameter to specify the value
- * that was fed into the lfsr at the time the keystream was generated
- */
-struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in) {
+#define RECOVERY32_TABLE_SIZE   (1 << 21)
+#define RECOVERY32_STATES       (1 << 18)
+#define RECOVERY32_BUCKET_SIZE  (1 << 14)
+#define RECOVERY64_STATES       (1 << 4)
+
+struct Crypto1Recovery {
+    uint32_t *odd;
+    uint32_t *even;
+    uint32_t *buckets;
     struct Crypto1State *statelist;
-    uint32_t *odd_head = 0, *odd_tail = 0, oks = 0;
-    uint32_t *even_head = 0, *even_tail = 0, eks = 0;
+    struct Crypto1State statelist64[RECOVERY64_STATES];
+};
+
+/** recovery32
+ * lfsr_recovery32 with caller provided tables, none of them needs to be zeroed
+ */
+static void recovery32(uint32_t ks2, uint32_t in, uint32_t *odd_head, uint32_t *even_head,
+                       uint32_t *buckets, struct Crypto1State *statelist) {
+    uint32_t *odd_tail = odd_head - 1, oks = 0;
+    uint32_t *even_tail = even_head - 1, eks = 0;
     register int i;
 
     // split the keystream into an odd and even part
@@ -172,26 +183,13 @@ struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in) {
     for (i = 30; i >= 0; i -= 2)
         eks = eks << 1 | BEBIT(ks2, i);
 
-    odd_head = odd_tail = calloc(1, sizeof(uint32_t) << 21);
-    even_head = even_tail = calloc(1, sizeof(uint32_t) << 21);
-    statelist =  calloc(1, sizeof(struct Crypto1State) << 18);
-    if (!odd_tail-- || !even_tail-- || !statelist) {
-        free(statelist);
-        statelist = 0;
-        goto out;
-    }
-
     statelist->odd = statelist->even = 0;
 
-    // allocate memory for out of place bucket_sort
+    // memory for out of place bucket_sort
     bucket_array_t bucket;
-
     for (i = 0; i < 2; i++) {
         for (uint32_t j = 0; j <= 0xff; j++) {
-            bucket[i][j].head = calloc(1, sizeof(uint32_t) << 14);
-            if (!bucket[i][j].head) {
-                goto out;
-            }
+            bucket[i][j].head = buckets + (((uint32_t)i << 8 | j) * RECOVERY32_BUCKET_SIZE);
         }
     }
 
@@ -218,16 +216,73 @@ struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in) {
     // parameter into account.
     in = (in >> 16 & 0xff) | (in << 16) | (in & 0xff00); // Byte swapping
     recover(odd_head, odd_tail, oks, even_head, even_tail, eks, 11, statelist, in << 1, bucket);
+}
 
-out:
-    for (i = 0; i < 2; i++)
-        for (uint32_t j = 0; j <= 0xff; j++)
-            free(bucket[i][j].head);
-    free(odd_head);
-    free(even_head);
+/** lfsr_recovery
+ * recover the state of the lfsr given 32 bits of the keystream
+ * additionally you can use the in parameter to specify the value
+ * that was fed into the lfsr at the time the keystream was generated
+ */
+struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in) {
+    uint32_t *odd = malloc(sizeof(uint32_t) * RECOVERY32_TABLE_SIZE);
+    uint32_t *even = malloc(sizeof(uint32_t) * RECOVERY32_TABLE_SIZE);
+    uint32_t *buckets = malloc(sizeof(uint32_t) * 2 * 0x100 * RECOVERY32_BUCKET_SIZE);
+    struct Crypto1State *statelist = calloc(1, sizeof(struct Crypto1State) * RECOVERY32_STATES);
+
+    if (odd && even && buckets && statelist) {
+        recovery32(ks2, in, odd, even, buckets, statelist);
+    } else {
+        free(statelist);
+        statelist = 0;
+    }
+    free(buckets);
+    free(odd);
+    free(even);
     return statelist;
 }
 
+/** crypto1_recovery_create
+ * buffers of lfsr_recovery32_r/lfsr_recovery64_r, kept across calls.
+ * Large tables are allocated on first use of lfsr_recovery32_r.
+ * A context must not be shared between threads
+ */
+struct Crypto1Recovery *crypto1_recovery_create(void) {
+    return calloc(1, sizeof(struct Crypto1Recovery));
+}
+
+void crypto1_recovery_destroy(struct Crypto1Recovery *ctx) {
+    if (!ctx)
+        return;
+    free(ctx->odd);
+    free(ctx->even);
+    free(ctx->buckets);
+    free(ctx->statelist);
+    free(ctx);
+}
+
+/** lfsr_recovery32_r
+ * same as lfsr_recovery32, the state list belongs to ctx and is valid until its next use
+ */
+struct Crypto1State *lfsr_recovery32_r(struct Crypto1Recovery *ctx, uint32_t ks2, uint32_t in) {
+    if (!ctx->statelist) {
+        ctx->odd = malloc(sizeof(uint32_t) * RECOVERY32_TABLE_SIZE);
+        ctx->even = malloc(sizeof(uint32_t) * RECOVERY32_TABLE_SIZE);
+        ctx->buckets = malloc(sizeof(uint32_t) * 2 * 0x100 * RECOVERY32_BUCKET_SIZE);
+        ctx->statelist = malloc(sizeof(struct Crypto1State) * RECOVERY32_STATES);
+        if (!ctx->odd || !ctx->even || !ctx->buckets || !ctx->statelist) {
+            free(ctx->odd);
+            free(ctx->even);
+            free(ctx->buckets);
+            free(ctx->statelist);
+            ctx->odd = ctx->even = ctx->buckets = 0;
+            ctx->statelist = 0;
+            return 0;
+        }
+    }
+    recovery32(ks2, in, ctx->odd, ctx->even, ctx->buckets, ctx->statelist);
+    return ctx->statelist;
+}
+
 static const uint32_t S1[] = {     0x62141, 0x310A0, 0x18850, 0x0C428, 0x06214,
                                    0x0310A, 0x85E30, 0xC69AD, 0x634D6, 0xB5CDE, 0xDE8DA, 0x6F46D, 0xB3C83,
                                    0x59E41, 0xA8995, 0xD027F, 0x6813F, 0x3409F, 0x9E6FA
@@ -255,16 +310,13 @@ static const uint32_t C2[] = { 0x1A822E0, 0x21A822E0, 0x21A822E0};
 /** Reverse 64 bits of keystream into possible cipher states
  * Variation mentioned in the paper. Somewhat optimized version
  */
-struct Crypto1State *lfsr_recovery64(uint32_t ks2, uint32_t ks3) {
-    struct Crypto1State *statelist, *sl;
+static void recovery64(uint32_t ks2, uint32_t ks3, struct Crypto1State *statelist) {
+    struct Crypto1State *sl = statelist;
     uint8_t oks[32], eks[32], hi[32];
     uint32_t low = 0,  win = 0;
     uint32_t *tail, table[1 << 16];
     int i, j;
 
-    sl = statelist = calloc(1, sizeof(struct Crypto1State) << 4);
-    if (!sl)
-        return 0;
     sl->odd = sl->even = 0;
 
     for (i = 30; i >= 0; i -= 2) {
@@ -319,8 +371,23 @@ continue2:
             ;
         }
     }
+}
+
+struct Crypto1State *lfsr_recovery64(uint32_t ks2, uint32_t ks3) {
+    struct Crypto1State *statelist = calloc(1, sizeof(struct Crypto1State) * RECOVERY64_STATES);
+    if (!statelist)
+        return 0;
+    recovery64(ks2, ks3, statelist);
     return statelist;
 }
+
+/** lfsr_recovery64_r
+ * same as lfsr_recovery64, the state list belongs to ctx and is valid until its next use
+ */
+struct Crypto1State *lfsr_recovery64_r(struct Crypto1Recovery *ctx, uint32_t ks2, uint32_t ks3) {
+    recovery64(ks2, ks3, ctx->statelist64);
+    return ctx->statelist64;
+}
 #endif
 
 /** lfsr_rollback_bit
@@ -404,23 +471,65 @@ uint32_t lfsr_rollback_word(struct Crypto1State *s, uint32_t in, int fb) {
     return ret;
 }
 
+/** nonce16 index
+ * position of every 16 bit tag nonce half in the lfsr16 sequence (index[0]),
+ * and the nonce half at every position (index[1]), in tag nonce byte order.
+ * Built once, published atomically so concurrent callers never see a partial table.
+ */
+static uint16_t (*nonce16_index)[1 << 16] = 0;
+static uint16_t (*get_nonce16_index(void))[1 << 16] {
+    uint16_t (*index)[1 << 16] = __atomic_load_n(&nonce16_index, __ATOMIC_ACQUIRE);
+    if (index)
+        return index;
+
+    // allocation 2 * 2bytes * 0x10000 times.
+    index = calloc(2, sizeof(*index));
+    if (!index)
+        return 0;
+    uint16_t x = 1;
+    for (uint16_t i = 1; i; ++i) {
+        uint16_t n = (x & 0xff) << 8 | x >> 8;
+        index[0][n] = i;
+        index[1][i % 65535] = n;
+        x = x >> 1 | (x ^ x >> 2 ^ x >> 3 ^ x >> 5) << 15;
+    }
+
+    uint16_t (*expected)[1 << 16] = 0;
+    if (!__atomic_compare_exchange_n(&nonce16_index, &expected, index, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        // another thread was faster
+        free(index);
+        index = expected;
+    }
+    return index;
+}
+
 /** nonce_distance
  * x,y valid tag nonces, then prng_successor(x, nonce_distance(x, y)) = y
  */
-static uint16_t *dist = 0;
 int nonce_distance(uint32_t from, uint32_t to) {
-    if (!dist) {
-        // allocation 2bytes * 0xFFFF times.
-        dist = calloc(2 << 16,  sizeof(uint8_t));
-        if (!dist)
-            return -1;
-        uint16_t x = 1;
-        for (uint16_t i = 1; i; ++i) {
-            dist[(x & 0xff) << 8 | x >> 8] = i;
-            x = x >> 1 | (x ^ x >> 2 ^ x >> 3 ^ x >> 5) << 15;
-        }
+    uint16_t (*index)[1 << 16] = get_nonce16_index();
+    if (!index)
+        return -1;
+    return (65535 + index[0][to >> 16] - index[0][from >> 16]) % 65535;
+}
+
+static bool validate_prng_nonce_slow(uint32_t nonce) {
+    uint16_t x = nonce >> 16;
+    x = (x & 0xff) << 8 | x >> 8;
+    for (uint8_t i = 0; i < 16; i++) {
+        x = x >> 1 | (x ^ x >> 2 ^ x >> 3 ^ x >> 5) << 15;
     }
-    return (65535 + dist[to >> 16] - dist[from >> 16]) % 65535;
+    x = (x & 0xff) << 8 | x >> 8;
+    return x == (nonce & 0xFFFF);
+}
+
+// low half of a valid nonce is the high half 16 lfsr16 steps later. 0 is a fixed point of the lfsr.
+static inline bool validate_prng_nonce_index(uint16_t (*index)[1 << 16], uint32_t nonce) {
+    uint16_t hi = nonce >> 16;
+    uint16_t lo = nonce & 0xFFFF;
+    if (hi == 0)
+        return lo == 0;
+    return index[1][(index[0][hi] + 16) % 65535] == lo;
 }
 
 /** validate_prng_nonce
@@ -430,13 +539,10 @@ int nonce_distance(uint32_t from, uint32_t to) {
  *   false = hardend prng
  */
 bool validate_prng_nonce(uint32_t nonce) {
-    uint16_t x = nonce >> 16;
-    x = (x & 0xff) << 8 | x >> 8;
-    for (uint8_t i = 0; i < 16; i++) {
-        x = x >> 1 | (x ^ x >> 2 ^ x >> 3 ^ x >> 5) << 15;
-    }
-    x = (x & 0xff) << 8 | x >> 8;
-    return x == (nonce & 0xFFFF);
+    uint16_t (*index)[1 << 16] = get_nonce16_index();
+    if (!index)
+        return validate_prng_nonce_slow(nonce);
+    return validate_prng_nonce_index(index, nonce);
 }
 
 static uint32_t fastfwd[2][8] = {
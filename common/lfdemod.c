@@ -45,7 +45,6 @@
 
 #include "lfdemod.h"
 #include <string.h>  // for memset, memcmp and size_t
-#include <stdlib.h>  // qsort
 #include "parity.h"  // for parity test
 #include "pm3_cmd.h" // error codes
 #include "commonutil.h"  // Arraylen
@@ -69,7 +68,325 @@ uint8_t g_debugMode = 0;
 # define prnt Dbprintf
 #endif
 
+#ifndef ON_DEVICE
+// a thread can point the demods at its own signal properties (see demod_ctx_bind),
+// otherwise all threads share the default one
+static signal_t signalprop_default = { 255, -255, 0, 0, true };
+static __thread signal_t *signalprop_store = NULL;
+# define signalprop (*(signalprop_store ? signalprop_store : &signalprop_default))
+
+void setSignalPropertiesStore(signal_t *store) {
+    signalprop_store = store;
+}
+#else
 static signal_t signalprop = { 255, -255, 0, 0, true };
+#endif
+
+// **********************************************************************************************
+// ---------------------------------Sample scan kernels------------------------------------------
+// **********************************************************************************************
+// The clock detection and raw demods spend most of their time walking the sample buffer
+// looking for the next threshold crossing, rising edge or peak.  On the client these scans
+// have SSE2 / AVX2 / NEON variants, selected at runtime.  All variants return the exact same
+// index as the scalar loops, so results are bit identical whatever instruction set is used.
+
+// first index in [i, size) where samples[i] >= v, size if none
+static size_t scan_ge_scalar(const uint8_t *s, size_t i, size_t size, uint8_t v) {
+    while (i < size && s[i] < v)
+        i++;
+    return i;
+}
+
+// first index in [i, size) where samples[i] <= v, size if none
+static size_t scan_le_scalar(const uint8_t *s, size_t i, size_t size, uint8_t v) {
+    while (i < size && s[i] > v)
+        i++;
+    return i;
+}
+
+// first index in [i, end) where samples[i-1] < samples[i], end if none.  i >= 1
+static size_t scan_rise_scalar(const uint8_t *s, size_t i, size_t end) {
+    while (i < end && s[i] <= s[i - 1])
+        i++;
+    return i;
+}
+
+// first index in [i, end) where samples[i-1] < samples[i] >= samples[i+1], end if none.  i >= 1
+static size_t scan_peak_scalar(const uint8_t *s, size_t i, size_t end) {
+    while (i < end && (s[i] <= s[i - 1] || s[i] < s[i + 1]))
+        i++;
+    return i;
+}
+
+#ifndef ON_DEVICE
+
+#if defined(LF_HAS_SIMD_X86)
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static size_t scan_ge_sse2(const uint8_t *s, size_t i, size_t size, uint8_t v) {
+    const __m128i t = _mm_set1_epi8((char)v);
+    for (; i + 16 <= size; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+        uint32_t m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(x, t), x));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+    return scan_ge_scalar(s, i, size, v);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_le_sse2(const uint8_t *s, size_t i, size_t size, uint8_t v) {
+    const __m128i t = _mm_set1_epi8((char)v);
+    for (; i + 16 <= size; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+        uint32_t m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(x, t), x));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+    return scan_le_scalar(s, i, size, v);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_rise_sse2(const uint8_t *s, size_t i, size_t end) {
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= end; i += 16) {
+        __m128i prev = _mm_loadu_si128((const __m128i *)(s + i - 1));
+        __m128i cur = _mm_loadu_si128((const __m128i *)(s + i));
+        // cur > prev  <=>  saturated cur - prev != 0
+        uint32_t m = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(cur, prev), zero)) & 0xFFFF;
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+    return scan_rise_scalar(s, i, end);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_peak_sse2(const uint8_t *s, size_t i, size_t end) {
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= end; i += 16) {
+        __m128i prev = _mm_loadu_si128((const __m128i *)(s + i - 1));
+        __m128i cur = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i next = _mm_loadu_si128((const __m128i *)(s + i + 1));
+        uint32_t rise = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(cur, prev), zero)) & 0xFFFF;
+        uint32_t fall = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(next, cur), zero));
+        uint32_t m = rise & fall;
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+    return scan_peak_scalar(s, i, end);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_ge_avx2(const uint8_t *s, size_t i, size_t size, uint8_t v) {
+    const __m256i t = _mm256_set1_epi8((char)v);
+    for (; i + 32 <= size; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(s + i));
+        uint32_t m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(x, t), x));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+    return scan_ge_sse2(s, i, size, v);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_le_avx2(const uint8_t *s, size_t i, size_t size, uint8_t v) {
+    const __m256i t = _mm256_set1_epi8((char)v);
+    for (; i + 32 <= size; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(s + i));
+        uint32_t m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(x, t), x));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+    return scan_le_sse2(s, i, size, v);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_rise_avx2(const uint8_t *s, size_t i, size_t end) {
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 32 <= end; i += 32) {
+        __m256i prev = _mm256_loadu_si256((const __m256i *)(s + i - 1));
+        __m256i cur = _mm256_loadu_si256((const __m256i *)(s + i));
+        uint32_t m = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_subs_epu8(cur, prev), zero));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+    return scan_rise_sse2(s, i, end);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_peak_avx2(const uint8_t *s, size_t i, size_t end) {
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 32 <= end; i += 32) {
+        __m256i prev = _mm256_loadu_si256((const __m256i *)(s + i - 1));
+        __m256i cur = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i next = _mm256_loadu_si256((const __m256i *)(s + i + 1));
+        uint32_t rise = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_subs_epu8(cur, prev), zero));
+        uint32_t fall = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_subs_epu8(next, cur), zero));
+        uint32_t m = rise & fall;
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+    return scan_peak_sse2(s, i, end);
+}
+#endif // LF_HAS_SIMD_X86
+
+#if defined(LF_HAS_SIMD_NEON)
+#include <arm_neon.h>
+
+// NEON has no movemask,  find the block holding a hit and let the scalar loop pinpoint it
+static size_t scan_ge_neon(const uint8_t *s, size_t i, size_t size, uint8_t v) {
+    const uint8x16_t t = vdupq_n_u8(v);
+    for (; i + 16 <= size; i += 16) {
+        if (vmaxvq_u8(vcgeq_u8(vld1q_u8(s + i), t)))
+            break;
+    }
+    return scan_ge_scalar(s, i, size, v);
+}
+
+static size_t scan_le_neon(const uint8_t *s, size_t i, size_t size, uint8_t v) {
+    const uint8x16_t t = vdupq_n_u8(v);
+    for (; i + 16 <= size; i += 16) {
+        if (vmaxvq_u8(vcleq_u8(vld1q_u8(s + i), t)))
+            break;
+    }
+    return scan_le_scalar(s, i, size, v);
+}
+
+static size_t scan_rise_neon(const uint8_t *s, size_t i, size_t end) {
+    for (; i + 16 <= end; i += 16) {
+        if (vmaxvq_u8(vcgtq_u8(vld1q_u8(s + i), vld1q_u8(s + i - 1))))
+            break;
+    }
+    return scan_rise_scalar(s, i, end);
+}
+
+static size_t scan_peak_neon(const uint8_t *s, size_t i, size_t end) {
+    for (; i + 16 <= end; i += 16) {
+        uint8x16_t cur = vld1q_u8(s + i);
+        uint8x16_t m = vandq_u8(vcgtq_u8(cur, vld1q_u8(s + i - 1)), vcgeq_u8(cur, vld1q_u8(s + i + 1)));
+        if (vmaxvq_u8(m))
+            break;
+    }
+    return scan_peak_scalar(s, i, end);
+}
+#endif // LF_HAS_SIMD_NEON
+
+typedef struct {
+    size_t (*ge)(const uint8_t *s, size_t i, size_t size, uint8_t v);
+    size_t (*le)(const uint8_t *s, size_t i, size_t size, uint8_t v);
+    size_t (*rise)(const uint8_t *s, size_t i, size_t end);
+    size_t (*peak)(const uint8_t *s, size_t i, size_t end);
+} lf_scan_kernels_t;
+
+static const lf_scan_kernels_t scan_kernels_scalar = { scan_ge_scalar, scan_le_scalar, scan_rise_scalar, scan_peak_scalar };
+#if defined(LF_HAS_SIMD_X86)
+static const lf_scan_kernels_t scan_kernels_sse2 = { scan_ge_sse2, scan_le_sse2, scan_rise_sse2, scan_peak_sse2 };
+static const lf_scan_kernels_t scan_kernels_avx2 = { scan_ge_avx2, scan_le_avx2, scan_rise_avx2, scan_peak_avx2 };
+#endif
+#if defined(LF_HAS_SIMD_NEON)
+static const lf_scan_kernels_t scan_kernels_neon = { scan_ge_neon, scan_le_neon, scan_rise_neon, scan_peak_neon };
+#endif
+
+static const lf_scan_kernels_t *scan_kernels = NULL;
+static LFSIMDInstr lf_simd_instr = LF_SIMD_AUTO;
+
+LFSIMDInstr GetLFSIMDInstrAuto(void) {
+#if defined(LF_HAS_SIMD_X86)
+    if (__builtin_cpu_supports("avx2"))
+        return LF_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return LF_SIMD_SSE2;
+#endif
+#if defined(LF_HAS_SIMD_NEON)
+    return LF_SIMD_NEON;
+#endif
+    return LF_SIMD_NONE;
+}
+
+LFSIMDInstr GetLFSIMDInstr(void) {
+    return (lf_simd_instr == LF_SIMD_AUTO) ? GetLFSIMDInstrAuto() : lf_simd_instr;
+}
+
+void SetLFSIMDInstr(LFSIMDInstr instr) {
+    lf_simd_instr = instr;
+    switch (GetLFSIMDInstr()) {
+#if defined(LF_HAS_SIMD_X86)
+        case LF_SIMD_AVX2:
+            scan_kernels = &scan_kernels_avx2;
+            break;
+        case LF_SIMD_SSE2:
+            scan_kernels = &scan_kernels_sse2;
+            break;
+#endif
+#if defined(LF_HAS_SIMD_NEON)
+        case LF_SIMD_NEON:
+            scan_kernels = &scan_kernels_neon;
+            break;
+#endif
+        case LF_SIMD_AUTO:
+        case LF_SIMD_NONE:
+        default:
+            scan_kernels = &scan_kernels_scalar;
+            break;
+    }
+}
+
+static const lf_scan_kernels_t *get_scan_kernels(void) {
+    if (scan_kernels == NULL)
+        SetLFSIMDInstr(lf_simd_instr);
+    return scan_kernels;
+}
+
+#define SCAN_GE(s, i, size, v)  get_scan_kernels()->ge(s, i, size, v)
+#define SCAN_LE(s, i, size, v)  get_scan_kernels()->le(s, i, size, v)
+#define SCAN_RISE(s, i, end)    get_scan_kernels()->rise(s, i, end)
+#define SCAN_PEAK(s, i, end)    get_scan_kernels()->peak(s, i, end)
+#else
+#define SCAN_GE(s, i, size, v)  scan_ge_scalar(s, i, size, v)
+#define SCAN_LE(s, i, size, v)  scan_le_scalar(s, i, size, v)
+#define SCAN_RISE(s, i, end)    scan_rise_scalar(s, i, end)
+#define SCAN_PEAK(s, i, end)    scan_peak_scalar(s, i, end)
+#endif // ON_DEVICE
+
+// Most scans stop within a wave or two,  so they start out as plain loops and only runs
+// longer than a few samples are handed over to the kernels.
+#define SCAN_INLINE_SAMPLES 16
+
+// first index from i on where samples[i] >= v,  size if none.  v may be outside of the sample range
+static inline size_t scan_samples_ge(const uint8_t *s, size_t i, size_t size, int v) {
+    for (size_t stop = i + SCAN_INLINE_SAMPLES; i < size && s[i] < v; i++) {
+        if (i == stop)
+            return (v > 255) ? size : SCAN_GE(s, i, size, (uint8_t)v);
+    }
+    return i;
+}
+
+// first index from i on where samples[i] <= v,  size if none.  v may be outside of the sample range
+static inline size_t scan_samples_le(const uint8_t *s, size_t i, size_t size, int v) {
+    for (size_t stop = i + SCAN_INLINE_SAMPLES; i < size && s[i] > v; i++) {
+        if (i == stop)
+            return (v < 0) ? size : SCAN_LE(s, i, size, (uint8_t)v);
+    }
+    return i;
+}
+
+// first rising edge / peak index from i on,  end if none.  Reads samples[i - 1] .. samples[end]
+static inline size_t scan_samples_rise(const uint8_t *s, size_t i, size_t end) {
+    for (size_t stop = i + SCAN_INLINE_SAMPLES; i < end && s[i] <= s[i - 1]; i++) {
+        if (i == stop)
+            return SCAN_RISE(s, i, end);
+    }
+    return i;
+}
+
+static inline size_t scan_samples_peak(const uint8_t *s, size_t i, size_t end) {
+    for (size_t stop = i + SCAN_INLINE_SAMPLES; i < end && (s[i] <= s[i - 1] || s[i] < s[i + 1]); i++) {
+        if (i == stop)
+            return SCAN_PEAK(s, i, end);
+    }
+    return i;
+}
 signal_t *getSignalProperties(void) {
     return &signalprop;
 }
@@ -93,11 +410,34 @@ static void printSignal(void) {
 }
 
 #ifndef ON_DEVICE
-static int cmp_uint8(const void *a, const void *b) {
-    if (*(const uint8_t *)a < * (const uint8_t *)b)
-        return -1;
-    else
-        return *(const uint8_t *)a > *(const uint8_t *)b;
+// value at position idx if samples were sorted ascending, from a 256 bin histogram
+static uint8_t hist_nth(const uint32_t *hist, uint32_t idx) {
+    uint32_t acc = 0;
+    for (uint16_t v = 0; v < 256; v++) {
+        acc += hist[v];
+        if (acc > idx)
+            return v;
+    }
+    return 255;
+}
+
+// histogram of samples, counting sort of uint8 gives exactly the same order statistics as sorting them
+static void sample_histogram(const uint8_t *samples, uint32_t size, uint32_t *hist) {
+    // four sub histograms to avoid store to load stalls on runs of identical samples
+    uint32_t h[4][256];
+    memset(h, 0, sizeof(h));
+    uint32_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        h[0][samples[i]]++;
+        h[1][samples[i + 1]]++;
+        h[2][samples[i + 2]]++;
+        h[3][samples[i + 3]]++;
+    }
+    for (; i < size; i++)
+        h[0][samples[i]]++;
+
+    for (uint16_t v = 0; v < 256; v++)
+        hist[v] = h[0][v] + h[1][v] + h[2][v] + h[3][v];
 }
 #endif
 
@@ -110,23 +450,24 @@ void computeSignalProperties(const uint8_t *samples, uint32_t size) {
     uint32_t offset_size = size - SIGNAL_IGNORE_FIRST_SAMPLES;
 
 #ifndef ON_DEVICE
-    uint8_t tmp[offset_size];
-    memcpy(tmp, samples + SIGNAL_IGNORE_FIRST_SAMPLES, sizeof(tmp));
-    qsort(tmp, sizeof(tmp), sizeof(uint8_t), cmp_uint8);
+    uint32_t hist[256];
+    sample_histogram(samples + SIGNAL_IGNORE_FIRST_SAMPLES, offset_size, hist);
 
-    uint8_t low10 = 0.5 * (tmp[(int)(offset_size * 0.1)] + tmp[(int)((offset_size - 1) * 0.1)]);
-    uint8_t hi90 =  0.5 * (tmp[(int)(offset_size * 0.9)] + tmp[(int)((offset_size - 1) * 0.9)]);
+    uint8_t low10 = 0.5 * (hist_nth(hist, (int)(offset_size * 0.1)) + hist_nth(hist, (int)((offset_size - 1) * 0.1)));
+    uint8_t hi90 =  0.5 * (hist_nth(hist, (int)(offset_size * 0.9)) + hist_nth(hist, (int)((offset_size - 1) * 0.9)));
     uint32_t cnt = 0;
-    for (uint32_t i = SIGNAL_IGNORE_FIRST_SAMPLES; i < size; i++) {
+    for (uint16_t v = 0; v < 256; v++) {
+        if (hist[v] == 0)
+            continue;
 
-        if (samples[i] < signalprop.low) signalprop.low = samples[i];
-        if (samples[i] > signalprop.high) signalprop.high = samples[i];
+        if (v < signalprop.low) signalprop.low = v;
+        if (v > signalprop.high) signalprop.high = v;
 
-        if (samples[i] < low10 || samples[i] > hi90)
+        if (v < low10 || v > hi90)
             continue;
 
-        sum += samples[i];
-        cnt++;
+        sum += v * hist[v];
+        cnt += hist[v];
     }
     if (cnt > 0)
         signalprop.mean = sum / cnt;
@@ -159,20 +500,15 @@ void removeSignalOffset(uint8_t *samples, uint32_t size) {
 
 #ifndef ON_DEVICE
 
-    uint8_t tmp[offset_size];
-    memcpy(tmp, samples + SIGNAL_IGNORE_FIRST_SAMPLES, sizeof(tmp));
-    qsort(tmp, sizeof(tmp), sizeof(uint8_t), cmp_uint8);
+    uint32_t hist[256];
+    sample_histogram(samples + SIGNAL_IGNORE_FIRST_SAMPLES, offset_size, hist);
 
-    uint8_t low10 = 0.5 * (tmp[(int)(offset_size * 0.05)] + tmp[(int)((offset_size - 1) * 0.05)]);
-    uint8_t hi90 =  0.5 * (tmp[(int)(offset_size * 0.95)] + tmp[(int)((offset_size - 1) * 0.95)]);
+    uint8_t low10 = 0.5 * (hist_nth(hist, (int)(offset_size * 0.05)) + hist_nth(hist, (int)((offset_size - 1) * 0.05)));
+    uint8_t hi90 =  0.5 * (hist_nth(hist, (int)(offset_size * 0.95)) + hist_nth(hist, (int)((offset_size - 1) * 0.95)));
     int32_t cnt = 0;
-    for (uint32_t i = SIGNAL_IGNORE_FIRST_SAMPLES; i < size; i++) {
-
-        if (samples[i] < low10 || samples[i] > hi90)
-            continue;
-
-        acc_off += samples[i] - 128;
-        cnt++;
+    for (uint16_t v = low10; v <= hi90; v++) {
+        acc_off += (v - 128) * (int)hist[v];
+        cnt += hist[v];
     }
     if (cnt > 0)
         acc_off /= cnt;
@@ -475,13 +811,11 @@ static int getClosestClock(int testclk) {
 }
 
 void getNextLow(const uint8_t *samples, size_t size, int low, size_t *i) {
-    while ((samples[*i] > low) && (*i < size))
-        *i += 1;
+    *i = scan_samples_le(samples, *i, size, low);
 }
 
 void getNextHigh(const uint8_t *samples, size_t size, int high, size_t *i) {
-    while ((samples[*i] < high) && (*i < size))
-        *i += 1;
+    *i = scan_samples_ge(samples, *i, size, high);
 }
 
 // load wave counters
@@ -1080,12 +1414,15 @@ uint16_t countFC(const uint8_t *bits, size_t size, bool fskAdj) {
     if (size < 180) return 0;
 
     // prime i to first up transition
-    for (i = 160; i < size - 20; i++)
-        if (bits[i] > bits[i - 1] && bits[i] >= bits[i + 1])
-            break;
+    i = scan_samples_peak(bits, 160, size - 20);
 
     for (; i < size - 20; i++) {
-        if (bits[i] > bits[i - 1] && bits[i] >= bits[i + 1]) {
+        // count samples up to the next up transition
+        size_t peak = scan_samples_peak(bits, i, size - 20);
+        fcCounter += peak - i;
+        i = peak;
+
+        if (i < size - 20) {
             // new up transition
             fcCounter++;
             if (fskAdj) {
@@ -1111,9 +1448,6 @@ uint16_t countFC(const uint8_t *bits, size_t size, bool fskAdj) {
                 fcLens[fcLensFnd++] = fcCounter;
             }
             fcCounter = 0;
-        } else {
-            // count sample
-            fcCounter++;
         }
     }
 
@@ -1275,17 +1609,19 @@ uint8_t detectFSKClk(const uint8_t *bits, size_t size, uint8_t fcHigh, uint8_t f
     uint8_t fcTol = ((fcHigh * 100 - fcLow * 100) / 2 + 50) / 100; //(uint8_t)(0.5+(float)(fcHigh-fcLow)/2);
 
     // prime i to first peak / up transition
-    for (i = 160; i < size - 20; i++)
-        if (bits[i] > bits[i - 1] && bits[i] >= bits[i + 1])
-            break;
+    i = scan_samples_peak(bits, 160, size - 20);
 
     for (; i < size - 20; i++) {
-        fcCounter++;
-        rfCounter++;
+        // skip to next peak,  counting every sample up to and including it
+        size_t peak = scan_samples_peak(bits, i, size - 20);
+        if (peak >= size - 20)
+            break;
 
-        if (bits[i] <= bits[i - 1] || bits[i] < bits[i + 1])
-            continue;
-        // else new peak
+        fcCounter += peak - i + 1;
+        rfCounter += peak - i + 1;
+        i = peak;
+
+        // new peak
         // if we got less than the small fc + tolerance then set it to the small fc
         // if it is inbetween set it to the last counter
         if (fcCounter < fcHigh && fcCounter > fcLow)
@@ -1676,69 +2012,71 @@ static uint16_t cleanAskRawDemod(uint8_t *bits, size_t *size, int clk, int inver
         bits[bitCnt++] = invert ^ 1;
     }
 
+    // a high wave only ends on a sample that is low and not high,  a low wave on one that is high and not low
+    int hi_end = (high > low) ? high : low + 1;
+    int lo_end = (low < high) ? low : high - 1;
+
     // sample counts,   like clock = 32.. it tries to find  32/4 = 8,  32/2 = 16
     for (size_t i = pos; i < *size; i++) {
-        if (bits[i] >= high && waveHigh) {
-            smplCnt++;
-        } else if (bits[i] <= low && !waveHigh) {
-            smplCnt++;
-        } else {
-            //transition
-            if ((bits[i] >= high && !waveHigh) || (bits[i] <= low && waveHigh)) {
+        // every sample until the wave changes level just counts
+        if ((waveHigh && bits[i] > lo_end) || (waveHigh == false && bits[i] < hi_end)) {
+            size_t next = (waveHigh) ? scan_samples_le(bits, i + 1, *size, lo_end) : scan_samples_ge(bits, i + 1, *size, hi_end);
+            smplCnt += next - i;
+            i = next;
+            if (i >= *size)
+                break;
+        }
 
-                // 8  ::    8-2-1 =  5   8+2+1 = 11
-                // 16 ::   16-4-1 = 11  16+4+1 = 21
-                // 32 ::   32-8-1 = 23  32+8+1 = 41
-                // 64 ::  64-16-1 = 47 64+16+1 = 81
-                if (smplCnt > clk - cl_4 - 1) { //full clock
+        //transition
+        // 8  ::    8-2-1 =  5   8+2+1 = 11
+        // 16 ::   16-4-1 = 11  16+4+1 = 21
+        // 32 ::   32-8-1 = 23  32+8+1 = 41
+        // 64 ::  64-16-1 = 47 64+16+1 = 81
+        if (smplCnt > clk - cl_4 - 1) { //full clock
 
-                    if (smplCnt > clk + cl_4 + 1) {
-                        //too many samples
-                        errCnt++;
-                        if (g_debugMode == 2) prnt("DEBUG ASK: cleanAskRawDemod ASK Modulation Error FULL at: %zu  [%zu > %u]", i, smplCnt, clk + cl_4 + 1);
-                        bits[bitCnt++] = 7;
-                    } else if (waveHigh) {
-                        bits[bitCnt++] = invert;
-                        bits[bitCnt++] = invert;
-                    } else {
-                        bits[bitCnt++] = invert ^ 1;
-                        bits[bitCnt++] = invert ^ 1;
-                    }
-                    if (*startIdx == 0) {
-                        *startIdx = i - clk;
-                        if (g_debugMode == 2) prnt("DEBUG ASK: cleanAskRawDemod minus clock [%d]", *startIdx);
-                    }
-                    waveHigh = !waveHigh;
-                    smplCnt = 0;
+            if (smplCnt > clk + cl_4 + 1) {
+                //too many samples
+                errCnt++;
+                if (g_debugMode == 2) prnt("DEBUG ASK: cleanAskRawDemod ASK Modulation Error FULL at: %zu  [%zu > %u]", i, smplCnt, clk + cl_4 + 1);
+                bits[bitCnt++] = 7;
+            } else if (waveHigh) {
+                bits[bitCnt++] = invert;
+                bits[bitCnt++] = invert;
+            } else {
+                bits[bitCnt++] = invert ^ 1;
+                bits[bitCnt++] = invert ^ 1;
+            }
+            if (*startIdx == 0) {
+                *startIdx = i - clk;
+                if (g_debugMode == 2) prnt("DEBUG ASK: cleanAskRawDemod minus clock [%d]", *startIdx);
+            }
+            waveHigh = !waveHigh;
+            smplCnt = 0;
 
-                    // 16-8-1 = 7
-                } else if (smplCnt > cl_2 - cl_4 - 1) { //half clock
+            // 16-8-1 = 7
+        } else if (smplCnt > cl_2 - cl_4 - 1) { //half clock
 
-                    if (smplCnt > cl_2 + cl_4 + 1) { //too many samples
-                        errCnt++;
-                        if (g_debugMode == 2) prnt("DEBUG ASK: cleanAskRawDemod ASK Modulation Error HALF at: %zu  [%zu]", i, smplCnt);
-                        bits[bitCnt++] = 7;
-                    }
+            if (smplCnt > cl_2 + cl_4 + 1) { //too many samples
+                errCnt++;
+                if (g_debugMode == 2) prnt("DEBUG ASK: cleanAskRawDemod ASK Modulation Error HALF at: %zu  [%zu]", i, smplCnt);
+                bits[bitCnt++] = 7;
+            }
 
-                    if (waveHigh) {
-                        bits[bitCnt++] = invert;
-                    } else {
-                        bits[bitCnt++] = invert ^ 1;
-                    }
+            if (waveHigh) {
+                bits[bitCnt++] = invert;
+            } else {
+                bits[bitCnt++] = invert ^ 1;
+            }
 
-                    if (*startIdx == 0) {
-                        *startIdx = i - cl_2;
-                        if (g_debugMode == 2) prnt("DEBUG ASK: cleanAskRawDemod minus half clock [%d]", *startIdx);
-                    }
-                    waveHigh = !waveHigh;
-                    smplCnt = 0;
-                } else {
-                    smplCnt++;
-                    //transition bit oops
-                }
-            } else { //haven't hit new high or new low yet
-                smplCnt++;
+            if (*startIdx == 0) {
+                *startIdx = i - cl_2;
+                if (g_debugMode == 2) prnt("DEBUG ASK: cleanAskRawDemod minus half clock [%d]", *startIdx);
             }
+            waveHigh = !waveHigh;
+            smplCnt = 0;
+        } else {
+            smplCnt++;
+            //transition bit oops
         }
     }
 
@@ -1948,13 +2286,16 @@ static size_t fsk_wave_demod(uint8_t *dest, size_t size, uint8_t fchigh, uint8_t
     // width should be divided with exp_one.  i:e 6+7+6+2=21,  21/5 = 4,
     // the 1-0 to 0-1  width should be divided with exp_zero.   Ie: 3+5+6+7 = 21/6 = 3
 
-    for (; idx < size - 20; idx++) {
+    // threshold all values up front,  bits are only ever written behind the current position
+    for (size_t k = idx; k < size - 20; k++) {
+        dest[k] = (dest[k] < signalprop.mean) ? 0 : 1;
+    }
 
-        // threshold current value
-        dest[idx] = (dest[idx] < signalprop.mean) ? 0 : 1;
+    for (; idx < size - 20; idx++) {
 
         // Check for 0->1 transition
-        if (dest[idx - 1] < dest[idx]) {
+        idx = scan_samples_rise(dest, idx, size - 20);
+        if (idx < size - 20) {
             preLastSample = LastSample;
             LastSample = currSample;
             currSample = idx - last_transition;
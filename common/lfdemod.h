@@ -43,6 +43,35 @@ typedef struct {
 } signal_t;
 signal_t *getSignalProperties(void);
 
+#ifndef ON_DEVICE
+// per thread signal properties,  NULL = shared default
+void setSignalPropertiesStore(signal_t *store);
+
+// instruction sets for the sample scan kernels used by clock detection and raw demods
+#if ( defined (__i386__) || defined (__x86_64__) ) && defined (__GNUC__) && \
+    ( !defined(__APPLE__) || \
+      (defined(__APPLE__) && (__clang_major__ > 8 || __clang_major__ == 8 && __clang_minor__ >= 1)) )
+#  define LF_HAS_SIMD_X86
+#elif defined(__arm64__) || defined(__aarch64__)
+#  define LF_HAS_SIMD_NEON
+#endif
+
+typedef enum {
+    LF_SIMD_AUTO,
+#if defined(LF_HAS_SIMD_X86)
+    LF_SIMD_AVX2,
+    LF_SIMD_SSE2,
+#endif
+#if defined(LF_HAS_SIMD_NEON)
+    LF_SIMD_NEON,
+#endif
+    LF_SIMD_NONE,
+} LFSIMDInstr;
+void SetLFSIMDInstr(LFSIMDInstr instr);
+LFSIMDInstr GetLFSIMDInstr(void);
+LFSIMDInstr GetLFSIMDInstrAuto(void);
+#endif
+
 void computeSignalProperties(const uint8_t *samples, uint32_t size);
 void removeSignalOffset(uint8_t *samples, uint32_t size);
 void getNextLow(const uint8_t *samples, size_t size, int low, size_t *i);
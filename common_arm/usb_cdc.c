@@ -643,6 +643,19 @@ inline uint16_t usb_available_length(void) {
     return (((pUdp->UDP_CSR[AT91C_EP_OUT] & AT91C_UDP_RXBYTECNT) >> 16) & 0x7FF);
 }
 
+// bytes of the last USB packet which usb_read_ng didn't hand out yet,
+// with pipelined commands this can be the start of the next frame
+static uint8_t usb_read_ng_buffer[64] = {0};
+static uint8_t usb_read_ng_bufoffset = 0;
+static uint8_t usb_read_ng_buflen = 0;
+
+// a frame which came in the same USB packet as the previous one,
+// kept apart from usb_poll_validate_length() so abort checks through data_available()
+// don't see the pipelined commands the host queued behind the running one
+bool usb_read_ng_pending(void) {
+    return (usb_read_ng_buflen > 0);
+}
+
 /**
     In github PR #129, some users appears to get a false positive from
     usb_poll, which returns true, but the usb_read operation
@@ -714,9 +727,6 @@ uint32_t usb_read(uint8_t *data, size_t len) {
     return nbBytesRcv;
 }
 
-static uint8_t usb_read_ng_buffer[64] = {0};
-static uint8_t usb_read_ng_bufoffset = 0;
-static uint8_t usb_read_ng_buflen = 0;
 
 uint32_t usb_read_ng(uint8_t *data, size_t len) {
 
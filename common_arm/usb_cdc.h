@@ -40,6 +40,7 @@ void async_usb_write_pushByte(uint8_t data);
 bool async_usb_write_requestWrite(void);
 int async_usb_write_stop(void);
 uint32_t usb_read_ng(uint8_t *data, size_t len);
+bool usb_read_ng_pending(void);
 void usb_update_serial(uint64_t newSerialNumber);
 
 void SetUSBreconnect(int value);
@@ -77,7 +77,7 @@ static countKeys *uniqsort(uint64_t *possibleKeys, uint32_t size) {
 
 // nested decrypt
 static void *nested_revover(void *args) {
-    struct Crypto1State *revstate, * revstate_start = NULL;
+    struct Crypto1State *revstate;
     uint64_t lfsr = 0;
     uint32_t i, kcount = 0;
     bool is_ok = true;
@@ -87,6 +87,11 @@ static void *nested_revover(void *args) {
     rp->keyCount = 0;
     rp->keys = NULL;
 
+    struct Crypto1Recovery *recovery = crypto1_recovery_create();
+    if (recovery == NULL) {
+        return NULL;
+    }
+
     //printf("Start pos is %d, End pos is %d\r\n", rp->startPos, rp->endPos);
 
     for (i = rp->startPos; i < rp->endPos; i++) {
@@ -100,9 +105,11 @@ static void *nested_revover(void *args) {
         */
 
         // And finally recover the first 32 bits of the key
-        revstate = lfsr_recovery32(ks1, nt_probe);
-        if (revstate_start == NULL) {
-            revstate_start = revstate;
+        revstate = lfsr_recovery32_r(recovery, ks1, nt_probe);
+        if (revstate == NULL) {
+            printf("Memory allocation error for lfsr_recovery32");
+            is_ok = false;
+            break;
         }
 
         while ((revstate->odd != 0x0) || (revstate->even != 0x0)) {
@@ -125,8 +132,6 @@ static void *nested_revover(void *args) {
             revstate++;
         }
         --kcount;
-        free(revstate_start);
-        revstate_start = NULL;
         if (!is_ok) {
             break;
         }
@@ -147,6 +152,7 @@ static void *nested_revover(void *args) {
         rp->keyCount = 0;
         free(rp->keys);
     }
+    crypto1_recovery_destroy(recovery);
     return NULL;
 }
 
@@ -269,3 +275,355 @@ uint8_t valid_nonce(uint32_t Nt, uint32_t NtEnc, uint32_t Ks1, uint8_t *parity)
                (oddparity8((Nt >> 8) & 0xFF) == ((parity[2]) ^ oddparity8((NtEnc >> 8) & 0xFF) ^ BIT(Ks1, 0)))
            ) ? 1 : 0;
 }
+
+// determine number of logical CPU cores (use for multithreaded functions)
+int num_CPUs(void) {
+#ifdef __WIN32
+    SYSTEM_INFO sysinfo;
+    GetSystemInfo(&sysinfo);
+    return sysinfo.dwNumberOfProcessors;
+#else
+    int count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count < 1)
+        count = 1;
+    return count;
+#endif
+}
+
+#define KEY_BIN_SIZE 6
+
+bool keys_file_is_binary(const char *filename) {
+    size_t len = strlen(filename);
+    return (len > 4) && (strcmp(filename + len - 4, ".bin") == 0);
+}
+
+static int hexval(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+uint64_t *load_keys_file(const char *filename, uint32_t *keyCount) {
+    *keyCount = 0;
+
+    FILE *fptr = fopen(filename, "rb");
+    if (fptr == NULL) {
+        fprintf(stderr, "Warning: Cannot open %s\n", filename);
+        return NULL;
+    }
+
+    // the whole file is parsed from memory
+    fseek(fptr, 0, SEEK_END);
+    long fsize = ftell(fptr);
+    rewind(fptr);
+    if (fsize < 0) {
+        fprintf(stderr, "Error: Cannot read %s\n", filename);
+        fclose(fptr);
+        return NULL;
+    }
+
+    uint8_t *data = malloc(fsize + 1);
+    if (data == NULL) {
+        perror("Failed to allocate memory");
+        fclose(fptr);
+        return NULL;
+    }
+    if (fread(data, 1, fsize, fptr) != (size_t)fsize) {
+        fprintf(stderr, "Error: Cannot read %s\n", filename);
+        free(data);
+        fclose(fptr);
+        return NULL;
+    }
+    fclose(fptr);
+
+    bool binary = keys_file_is_binary(filename);
+    if (binary && (fsize % KEY_BIN_SIZE)) {
+        fprintf(stderr, "Error: %s size is not a multiple of %i bytes\n", filename, KEY_BIN_SIZE);
+        free(data);
+        return NULL;
+    }
+
+    // a text key holds at least one digit and a separator
+    uint64_t *keys = malloc(((binary ? fsize / KEY_BIN_SIZE : fsize / 2 + 1) + 1) * sizeof(uint64_t));
+    if (keys == NULL) {
+        perror("Failed to allocate memory");
+        free(data);
+        return NULL;
+    }
+
+    uint32_t count = 0;
+    if (binary) {
+        for (long i = 0; i < fsize; i += KEY_BIN_SIZE) {
+            uint64_t key = 0;
+            for (uint8_t j = 0; j < KEY_BIN_SIZE; j++) {
+                key = key << 8 | data[i + j];
+            }
+            keys[count++] = key;
+        }
+    } else {
+        // same as reading with fscanf("%012" PRIx64) until the first mismatch
+        const char *p = (const char *)data, *end = p + fsize;
+        while (p < end) {
+            while (p < end && isspace((unsigned char)*p)) {
+                p++;
+            }
+            uint64_t key = 0;
+            uint8_t digits = 0;
+            int v;
+            while (p < end && digits < 12 && (v = hexval(*p)) >= 0) {
+                key = key << 4 | v;
+                digits++;
+                p++;
+            }
+            if (digits == 0) {
+                break;
+            }
+            keys[count++] = key;
+        }
+    }
+    free(data);
+
+    *keyCount = count;
+    return keys;
+}
+
+int64_t save_keys_file(const char *filename, const uint64_t *keys, const uint8_t *filter, uint32_t keyCount) {
+    FILE *fptr = fopen(filename, keys_file_is_binary(filename) ? "wb" : "w");
+    if (fptr == NULL) {
+        fprintf(stderr, "Warning: Cannot save keys in %s\n", filename);
+        return -1;
+    }
+
+    bool binary = keys_file_is_binary(filename);
+    int64_t saved = 0;
+    for (uint32_t i = 0; i < keyCount; i++) {
+        if (filter && (filter[i] == 0)) {
+            continue;
+        }
+        if (binary) {
+            uint8_t key[KEY_BIN_SIZE];
+            for (uint8_t j = 0; j < KEY_BIN_SIZE; j++) {
+                key[j] = keys[i] >> (8 * (KEY_BIN_SIZE - 1 - j));
+            }
+            fwrite(key, 1, sizeof(key), fptr);
+        } else {
+            fprintf(fptr, "%012" PRIx64 "\n", keys[i]);
+        }
+        saved++;
+    }
+    if (fclose(fptr) != 0) {
+        fprintf(stderr, "Warning: Cannot save keys in %s\n", filename);
+        return -1;
+    }
+    return saved;
+}
+
+// FM11RF08S static encrypted nonce attack helpers, cf https://eprint.iacr.org/2024/1275
+
+#define RF08S_KEY_SPACE_SIZE (1 << 18)
+
+static uint16_t i_lfsr16[1 << 16] = {0};
+static uint16_t s_lfsr16[1 << 16] = {0};
+// prev_lfsr16 applied 14 and 8 times
+static uint16_t prev14_lfsr16[1 << 16] = {0};
+static uint16_t prev8_lfsr16[1 << 16] = {0};
+
+static uint16_t prev_lfsr16(uint16_t nonce) {
+    // 0 is not part of the sequence, don't index s_lfsr16[-1]
+    if (nonce == 0) {
+        return 0;
+    }
+    return s_lfsr16[(i_lfsr16[nonce] - 1) % 65535];
+}
+
+void rf08s_init_tables(void) {
+    static bool initialized = false;
+    if (initialized) {
+        return;
+    }
+    uint16_t x = 1;
+    for (uint16_t i = 1; i; ++i) {
+        i_lfsr16[(x & 0xff) << 8 | x >> 8] = i;
+        s_lfsr16[i] = (x & 0xff) << 8 | x >> 8;
+        x = x >> 1 | (x ^ x >> 2 ^ x >> 3 ^ x >> 5) << 15;
+    }
+    for (uint32_t i = 0; i < (1 << 16); i++) {
+        uint16_t nt = i;
+        for (uint8_t j = 0; j < 8; j++) {
+            nt = prev_lfsr16(nt);
+        }
+        prev8_lfsr16[i] = nt;
+        for (uint8_t j = 8; j < 14; j++) {
+            nt = prev_lfsr16(nt);
+        }
+        prev14_lfsr16[i] = nt;
+    }
+    initialized = true;
+}
+
+uint16_t rf08s_seednt16(uint32_t nt32, uint64_t key) {
+    static const uint8_t a[] = {0, 8, 9, 4, 6, 11, 1, 15, 12, 5, 2, 13, 10, 14, 3, 7};
+    static const uint8_t b[] = {0, 13, 1, 14, 4, 10, 15, 7, 5, 3, 8, 6, 9, 2, 12, 11};
+    uint16_t nt = prev14_lfsr16[nt32 >> 16];
+    bool odd = 1;
+
+    for (uint8_t i = 0; i < 6 * 8; i += 8) {
+        if (odd) {
+            nt ^= (a[(key >> i) & 0xF]);
+            nt ^= (b[(key >> i >> 4) & 0xF]) << 4;
+        } else {
+            nt ^= (b[(key >> i) & 0xF]);
+            nt ^= (a[(key >> i >> 4) & 0xF]) << 4;
+        }
+        odd ^= 1;
+        nt = prev8_lfsr16[nt];
+    }
+    return nt;
+}
+
+uint8_t rf08s_nt_par_enc(uint32_t nt_enc, const uint8_t nt_par_err[4]) {
+    return ((nt_par_err[0] ^ oddparity8((nt_enc >> 24) & 0xFF)) << 3) |
+           ((nt_par_err[1] ^ oddparity8((nt_enc >> 16) & 0xFF)) << 2) |
+           ((nt_par_err[2] ^ oddparity8((nt_enc >>  8) & 0xFF)) << 1) |
+           ((nt_par_err[3] ^ oddparity8((nt_enc >>  0) & 0xFF)) << 0);
+}
+
+uint64_t *rf08s_generate_keys(struct Crypto1Recovery *recovery, uint32_t authuid, uint32_t nt, uint32_t nt_enc, uint8_t nt_par_enc, uint32_t *keyCount) {
+    *keyCount = 0;
+    uint64_t *result_keys = (uint64_t *)malloc(RF08S_KEY_SPACE_SIZE * sizeof(uint64_t));
+    if (result_keys == NULL) {
+        fprintf(stderr, "\nMalloc error in generate_keys!\n");
+        return NULL;
+    }
+
+    struct Crypto1State *revstate, *revstate_start = NULL, s;
+    uint64_t lfsr = 0;
+    uint32_t ks1 = nt ^ nt_enc;
+
+    if (recovery != NULL) {
+        revstate = lfsr_recovery32_r(recovery, ks1, nt ^ authuid);
+    } else {
+        revstate = revstate_start = lfsr_recovery32(ks1, nt ^ authuid);
+    }
+    if (revstate == NULL) {
+        fprintf(stderr, "\nMalloc error in generate_keys!\n");
+        free(result_keys);
+        return NULL;
+    }
+    while ((revstate->odd != 0x0) || (revstate->even != 0x0)) {
+        lfsr_rollback_word(revstate, nt ^ authuid, 0);
+        crypto1_get_lfsr(revstate, &lfsr);
+
+        // only filtering possibility: last parity bit ks in ks2
+        uint32_t ks2;
+        uint8_t lastpar1, lastpar2, kslastp;
+        crypto1_init(&s, lfsr);
+        crypto1_word(&s, nt ^ authuid, 0);
+        ks2 = crypto1_word(&s, 0, 0);
+        lastpar1 = oddparity8(nt & 0xFF);
+        kslastp = (ks2 >> 24) & 1;
+        lastpar2 = (nt_par_enc & 1) ^ kslastp;
+        if (lastpar1 == lastpar2) {
+            result_keys[(*keyCount)++] = lfsr;
+            if (*keyCount == RF08S_KEY_SPACE_SIZE) {
+                fprintf(stderr, "No space left on result_keys, abort! Increase RF08S_KEY_SPACE_SIZE\n");
+                break;
+            }
+        }
+        revstate++;
+    }
+    free(revstate_start);
+    return result_keys;
+}
+
+typedef struct {
+    uint32_t nt;
+    const uint64_t *keys;
+    uint16_t *seednt;
+    uint32_t start;
+    uint32_t end;
+} seednt_job_t;
+
+static void *compute_seednt_thread(void *arg) {
+    const seednt_job_t *job = (seednt_job_t *)arg;
+    for (uint32_t i = job->start; i < job->end; i++) {
+        job->seednt[i] = rf08s_seednt16(job->nt, job->keys[i]);
+    }
+    return NULL;
+}
+
+// seed nonces of all keys, split over thread_count threads
+static uint16_t *compute_seednt(uint32_t nt, const uint64_t *keys, uint32_t keycount, uint32_t thread_count) {
+    uint16_t *seednt = (uint16_t *)malloc(keycount * sizeof(uint16_t) + 1);
+    if (seednt == NULL) {
+        perror("Failed to allocate memory");
+        return NULL;
+    }
+
+    if (thread_count > keycount / 1024 + 1) {
+        thread_count = keycount / 1024 + 1;
+    }
+    if (thread_count <= 1) {
+        seednt_job_t job = {nt, keys, seednt, 0, keycount};
+        compute_seednt_thread(&job);
+        return seednt;
+    }
+
+    pthread_t threads[thread_count];
+    bool started[thread_count];
+    seednt_job_t jobs[thread_count];
+    for (uint32_t i = 0; i < thread_count; i++) {
+        jobs[i] = (seednt_job_t) {
+            nt, keys, seednt,
+            (uint32_t)((uint64_t)keycount * i / thread_count),
+            (uint32_t)((uint64_t)keycount * (i + 1) / thread_count)
+        };
+        started[i] = (pthread_create(&threads[i], NULL, compute_seednt_thread, &jobs[i]) == 0);
+        if (started[i] == false) {
+            // no thread for this slice, compute it here
+            compute_seednt_thread(&jobs[i]);
+        }
+    }
+    for (uint32_t i = 0; i < thread_count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    return seednt;
+}
+
+bool rf08s_filter_keys(uint32_t nt1, const uint64_t *keys1, uint32_t keycount1, uint8_t *filter1,
+                       uint32_t nt2, const uint64_t *keys2, uint32_t keycount2, uint8_t *filter2,
+                       uint32_t thread_count) {
+    bool ok = false;
+    uint16_t *seednt1 = compute_seednt(nt1, keys1, keycount1, thread_count);
+    uint16_t *seednt2 = compute_seednt(nt2, keys2, keycount2, thread_count);
+    uint8_t *seeds1 = (uint8_t *)calloc(1 << 16, sizeof(uint8_t));
+    uint8_t *seeds2 = (uint8_t *)calloc(1 << 16, sizeof(uint8_t));
+    if ((seednt1 == NULL) || (seednt2 == NULL) || (seeds1 == NULL) || (seeds2 == NULL)) {
+        goto out;
+    }
+
+    // a key matches if any key of the other list has the same seed nonce
+    for (uint32_t i = 0; i < keycount1; i++) {
+        seeds1[seednt1[i]] = 1;
+    }
+    for (uint32_t j = 0; j < keycount2; j++) {
+        seeds2[seednt2[j]] = 1;
+    }
+    for (uint32_t i = 0; i < keycount1; i++) {
+        filter1[i] = seeds2[seednt1[i]];
+    }
+    for (uint32_t j = 0; j < keycount2; j++) {
+        filter2[j] = seeds1[seednt2[j]];
+    }
+    ok = true;
+
+out:
+    free(seednt1);
+    free(seednt2);
+    free(seeds1);
+    free(seeds2);
+    return ok;
+}
@@ -1,6 +1,7 @@
 #ifndef NESTED_H__
 #define NESTED_H__
 
+#include <stdbool.h>
 #include "crapto1/crapto1.h"
 
 typedef struct {
@@ -12,4 +13,26 @@ typedef struct {
 uint8_t valid_nonce(uint32_t Nt, uint32_t NtEnc, uint32_t Ks1, uint8_t *parity);
 uint64_t *nested(NtpKs1 *pNK, uint32_t sizePNK, uint32_t authuid, uint32_t *keyCount);
 
+int num_CPUs(void);
+
+// Key candidate files: `.dic` text files with one %012x key per line,
+// or `.bin` binary files with 6 bytes per key, most significant byte first
+bool keys_file_is_binary(const char *filename);
+uint64_t *load_keys_file(const char *filename, uint32_t *keyCount);
+// saves the keys with a non-zero filter entry,  all keys if filter is NULL.  Returns the number of saved keys or -1
+int64_t save_keys_file(const char *filename, const uint64_t *keys, const uint8_t *filter, uint32_t keyCount);
+
+// FM11RF08S static encrypted nonces
+// rf08s_init_tables() must be called once before rf08s_seednt16() and rf08s_filter_keys()
+void rf08s_init_tables(void);
+uint16_t rf08s_seednt16(uint32_t nt32, uint64_t key);
+// parity bits of nt_enc as sent by the card, from the parity error bits of the trace
+uint8_t rf08s_nt_par_enc(uint32_t nt_enc, const uint8_t nt_par_err[4]);
+// recovery: buffers reused between calls, or NULL
+uint64_t *rf08s_generate_keys(struct Crypto1Recovery *recovery, uint32_t authuid, uint32_t nt, uint32_t nt_enc, uint8_t nt_par_enc, uint32_t *keyCount);
+// sets filter1/filter2 for the keys having the same seed nonce as at least one key of the other list
+bool rf08s_filter_keys(uint32_t nt1, const uint64_t *keys1, uint32_t keycount1, uint8_t *filter1,
+                       uint32_t nt2, const uint64_t *keys2, uint32_t keycount2, uint8_t *filter2,
+                       uint32_t thread_count);
+
 #endif
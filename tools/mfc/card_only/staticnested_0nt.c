@@ -36,6 +36,7 @@ typedef struct {
 typedef struct {
     uint32_t authuid;
     NtpKs1 *pNK;
+    uint16_t *pNKindex;     // nonce >> 16 -> position in pNK + 1, 0 if absent
     uint32_t sizeNK;
     uint32_t nt_enc;
     uint8_t nt_par_enc;
@@ -106,23 +107,20 @@ static bool search_match(NtData *pND, NtData *pND0, uint64_t key) {
     uint32_t nt = crypto1_word(s, nt_enc ^ authuid, 1) ^ nt_enc;
     // filter: we know nt should be valid, no need to spend time on other ones
     if (validate_prng_nonce(nt)) {
-        // look for same nt
-        for (uint32_t k = 0; k < pND->sizeNK; k++) {
-            if (nt == pND->pNK[k].ntp) {
-                // Possible match
-                // filter: check the full 4 bits of parity (actually only the last one might be wrong)
-                uint32_t ks1, ks2;
-                uint8_t par1, par2, ksp;
-                par1 = (oddparity8((nt >> 24) & 0xFF) << 3) | (oddparity8((nt >> 16) & 0xFF) << 2) | (oddparity8((nt >> 8) & 0xFF) << 1) | (oddparity8(nt & 0xFF));
-                ks1 = nt ^ nt_enc;
-                ks2 = crypto1_word(s, 0, 0);
-                ksp = (((ks1 >> 16) & 1) << 3) | (((ks1 >> 8) & 1) << 2) | (((ks1 >> 0) & 1) << 1) | ((ks2 >> 24) & 1);
-                par2 = nt_par_enc ^ ksp;
-
-                if (par1 != par2) {
-                    continue;
-                }
-
+        // look for same nt, pNK entries are indexed by the high half of their nonce
+        uint16_t k = pND->pNKindex[nt >> 16];
+        if ((k != 0) && (nt == pND->pNK[k - 1].ntp)) {
+            // Possible match
+            // filter: check the full 4 bits of parity (actually only the last one might be wrong)
+            uint32_t ks1, ks2;
+            uint8_t par1, par2, ksp;
+            par1 = (oddparity8((nt >> 24) & 0xFF) << 3) | (oddparity8((nt >> 16) & 0xFF) << 2) | (oddparity8((nt >> 8) & 0xFF) << 1) | (oddparity8(nt & 0xFF));
+            ks1 = nt ^ nt_enc;
+            ks2 = crypto1_word(s, 0, 0);
+            ksp = (((ks1 >> 16) & 1) << 3) | (((ks1 >> 8) & 1) << 2) | (((ks1 >> 0) & 1) << 1) | ((ks2 >> 24) & 1);
+            par2 = nt_par_enc ^ ksp;
+
+            if (par1 == par2) {
                 // filter: same check on the full 4 bits of parity of initial nonce
                 // check is slow so we do it only now
                 crypto1_init(s, key);
@@ -135,12 +133,7 @@ static bool search_match(NtData *pND, NtData *pND0, uint64_t key) {
                 ks2 = crypto1_word(s, 0, 0);
                 ksp = (((ks1 >> 16) & 1) << 3) | (((ks1 >> 8) & 1) << 2) | (((ks1 >> 0) & 1) << 1) | ((ks2 >> 24) & 1);
                 par2 = nt_par_enc ^ ksp;
-                if (par1 != par2) {
-                    continue;
-                }
-
-                k = pND->sizeNK;
-                ret = 1;
+                ret = (par1 == par2);
             }
         }
     }
@@ -156,23 +149,28 @@ static void *generate_and_intersect_keys(void *threadarg) {
     uint32_t thread_id = data->thread_id;
     uint32_t num_nonces = data->num_nonces;
 
-    struct Crypto1State *revstate, *revstate_start = NULL;
+    struct Crypto1State *revstate;
     uint64_t lfsr = 0;
 
+    // recovery buffers are reused for all nonces of this chunk
+    struct Crypto1Recovery *recovery = crypto1_recovery_create();
+    if (recovery == NULL) {
+        fprintf(stderr, "\nMalloc error in generate_and_intersect_keys!\n");
+        pthread_exit(NULL);
+    }
+
     uint32_t authuid = pNKL->NtDataList[0].authuid;
     for (uint32_t i = startPos; i < endPos; i++) {
         uint32_t ntp = pNKL->NtDataList[0].pNK[i].ntp;
         uint32_t ks1 = pNKL->NtDataList[0].pNK[i].ks1;
         uint32_t nt_probe = ntp ^ authuid;
 
-        revstate = lfsr_recovery32(ks1, nt_probe);
+        revstate = lfsr_recovery32_r(recovery, ks1, nt_probe);
         if (revstate == NULL) {
             fprintf(stderr, "\nMalloc error in generate_and_intersect_keys!\n");
+            crypto1_recovery_destroy(recovery);
             pthread_exit(NULL);
         }
-        if (revstate_start == NULL) {
-            revstate_start = revstate;
-        }
         uint32_t keyCount0 = 0;
         while ((revstate->odd != 0x0) || (revstate->even != 0x0)) {
             lfsr_rollback_word(revstate, nt_probe, 0);
@@ -193,8 +191,6 @@ static void *generate_and_intersect_keys(void *threadarg) {
             }
             revstate++;
         }
-        free(revstate_start);
-        revstate_start = NULL;
 
         pthread_mutex_lock(data->keyCount_mutex[0]);
         (*data->keyCount[0]) += keyCount0;
@@ -202,6 +198,8 @@ static void *generate_and_intersect_keys(void *threadarg) {
         pthread_mutex_unlock(data->keyCount_mutex[0]);
     }
 
+    crypto1_recovery_destroy(recovery);
+
     pthread_mutex_lock(&status_mutex);
     thread_status[thread_id] = false;  // Mark thread as inactive
     pthread_cond_signal(&status_cond);       // Signal the main thread
@@ -404,7 +402,8 @@ int main(int argc, char *const argv[]) {
         // Try to recover the keystream1
         uint32_t nttest = prng_successor(1, 16); // a first valid nonce
         pNtData->pNK = (NtpKs1 *)calloc(8192, sizeof(NtpKs1)); // 2**16 filtered with 3 parity bits => 2**13
-        if (pNtData->pNK == NULL) {
+        pNtData->pNKindex = (uint16_t *)calloc(1 << 16, sizeof(uint16_t));
+        if ((pNtData->pNK == NULL) || (pNtData->pNKindex == NULL)) {
             return 1;
         }
         uint32_t j = 0;
@@ -414,6 +413,7 @@ int main(int argc, char *const argv[]) {
                 pNtData->pNK[j].ntp = nttest;
                 pNtData->pNK[j].ks1 = ks1;
                 j++;
+                pNtData->pNKindex[nttest >> 16] = j;
             }
             nttest = prng_successor(nttest, 1);
         }
@@ -433,8 +433,10 @@ int main(int argc, char *const argv[]) {
     keys = unpredictable_nested(&NKL, keyCounts);
     printf("\n\nFinding phase complete.\n");
 
-    for (uint32_t k = 0; k < NKL.nr_nonces; k++)
+    for (uint32_t k = 0; k < NKL.nr_nonces; k++) {
         free(NKL.NtDataList[k].pNK);
+        free(NKL.NtDataList[k].pNKindex);
+    }
 
     analyze_keys(keys, keyCounts, NKL.nr_nonces);
     FILE *fptr;
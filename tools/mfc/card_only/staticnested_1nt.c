@@ -17,15 +17,7 @@
 #include "common.h"
 #include "crapto1/crapto1.h"
 #include "parity.h"
-
-#define KEY_SPACE_SIZE (1 << 18)
-
-typedef struct {
-    uint32_t authuid;
-    uint32_t nt;
-    uint32_t nt_enc;
-    uint8_t nt_par_enc;
-} NtData;
+#include "nested_util.h"
 
 static uint32_t hex_to_uint32(const char *hex_str) {
     return (uint32_t)strtoul(hex_str, NULL, 16);
@@ -50,67 +42,14 @@ static int bin_to_uint8_arr(const char *bin_str, uint8_t bit_arr[], uint8_t arr_
     return 0;
 }
 
-static uint64_t *generate_keys(uint64_t authuid, uint32_t nt, uint32_t nt_enc, uint32_t nt_par_enc, uint32_t *keyCount) {
-    uint64_t *result_keys = (uint64_t *)malloc(KEY_SPACE_SIZE * sizeof(uint64_t));
-    if (result_keys == NULL) {
-        fprintf(stderr, "\nMalloc error in generate_and_intersect_keys!\n");
-        return NULL;
-    }
-
-    struct Crypto1State *revstate, *revstate_start = NULL, *s = NULL;
-    uint64_t lfsr = 0;
-    uint32_t ks1 = nt ^ nt_enc;
-
-    revstate = lfsr_recovery32(ks1, nt ^ authuid);
-    if (revstate == NULL) {
-        fprintf(stderr, "\nMalloc error in generate_keys!\n");
-        free(result_keys);
-        return NULL;
-    }
-    if (revstate_start == NULL) {
-        revstate_start = revstate;
-    }
-    s = crypto1_create(0);
-    if (s == NULL) {
-        fprintf(stderr, "\nMalloc error in generate_keys!\n");
-        free(result_keys);
-        crypto1_destroy(revstate_start);
-        return 0;
-    }
-    while ((revstate->odd != 0x0) || (revstate->even != 0x0)) {
-        lfsr_rollback_word(revstate, nt ^ authuid, 0);
-        crypto1_get_lfsr(revstate, &lfsr);
-
-        // only filtering possibility: last parity bit ks in ks2
-        uint32_t ks2;
-        uint8_t lastpar1, lastpar2, kslastp;
-        crypto1_init(s, lfsr);
-        crypto1_word(s, nt ^ authuid, 0);
-        ks2 = crypto1_word(s, 0, 0);
-        lastpar1 = oddparity8(nt & 0xFF);
-        kslastp = (ks2 >> 24) & 1;
-        lastpar2 = (nt_par_enc & 1) ^ kslastp;
-        if (lastpar1 == lastpar2) {
-            result_keys[(*keyCount)++] = lfsr;
-            if (*keyCount == KEY_SPACE_SIZE) {
-                fprintf(stderr, "No space left on result_keys, abort! Increase KEY_SPACE_SIZE\n");
-                break;
-            }
-        }
-        revstate++;
-    }
-    crypto1_destroy(s);
-    crypto1_destroy(revstate_start);
-    revstate_start = NULL;
-    return result_keys;
-}
-
 int main(int argc, char *const argv[]) {
-    if (argc != 6) {
+    bool binary = (argc == 7) && (strcmp(argv[6], "--bin") == 0);
+    if ((argc != 6) && (binary == false)) {
         int cmdlen = strlen(argv[0]);
-        printf("Usage:\n  %s <uid:hex> <sector:dec> <nt:hex> <nt_enc:hex> <nt_par_err:bin>\n"
+        printf("Usage:\n  %s <uid:hex> <sector:dec> <nt:hex> <nt_enc:hex> <nt_par_err:bin> [--bin]\n"
                "  parity example:  if for block 63 == sector 15, nt in trace is 7b! fc! 7a! 5b\n"
                "                   then nt_enc is 7bfc7a5b and nt_par_err is 1110\n"
+               "  --bin            save the keys in a binary .bin file instead of a .dic file\n"
                "Example:\n"
                "  %*s a13e4902 15 d14191b3 2e9e49fc 1111\n"
                "  %*s +uid     +s +nt      +nt_enc  +nt_par_err\n",
@@ -128,10 +67,7 @@ int main(int argc, char *const argv[]) {
     if (bin_to_uint8_arr(argv[5], nt_par_err_arr, 4)) {
         return 1;
     }
-    uint8_t nt_par_enc = ((nt_par_err_arr[0] ^ oddparity8((nt_enc >> 24) & 0xFF)) << 3) |
-                         ((nt_par_err_arr[1] ^ oddparity8((nt_enc >> 16) & 0xFF)) << 2) |
-                         ((nt_par_err_arr[2] ^ oddparity8((nt_enc >>  8) & 0xFF)) << 1) |
-                         ((nt_par_err_arr[3] ^ oddparity8((nt_enc >>  0) & 0xFF)) << 0);
+    uint8_t nt_par_enc = rf08s_nt_par_enc(nt_enc, nt_par_err_arr);
     printf("uid=%08x nt=%08x nt_enc=%08x nt_par_err=%i%i%i%i nt_par_enc=%i%i%i%i ks1=%08x\n", authuid, nt, nt_enc,
            nt_par_err_arr[0], nt_par_err_arr[1], nt_par_err_arr[2], nt_par_err_arr[3],
            (nt_par_enc >> 3) & 1, (nt_par_enc >> 2) & 1, (nt_par_enc >> 1) & 1, nt_par_enc & 1,
@@ -139,24 +75,12 @@ int main(int argc, char *const argv[]) {
 
 
     printf("Finding key candidates...\n");
-    keys = generate_keys(authuid, nt, nt_enc, nt_par_enc, &keyCount);
+    keys = rf08s_generate_keys(NULL, authuid, nt, nt_enc, nt_par_enc, &keyCount);
     printf("Finding phase complete, found %i keys\n", keyCount);
 
-    FILE *fptr;
     char filename[30];
-    snprintf(filename, sizeof(filename), "keys_%08x_%02i_%08x.dic", authuid, sector, nt);
-
-    fptr = fopen(filename, "w");
-    if (fptr != NULL) {
-        if (keyCount > 0) {
-            for (uint32_t j = 0; j < keyCount; j++) {
-                fprintf(fptr, "%012" PRIx64 "\n", keys[j]);
-            }
-        }
-        fclose(fptr);
-    } else {
-        fprintf(stderr, "Warning: Cannot save keys in %s\n", filename);
-    }
+    snprintf(filename, sizeof(filename), "keys_%08x_%02i_%08x.%s", authuid, sector, nt, binary ? "bin" : "dic");
+    save_keys_file(filename, keys, NULL, keyCount);
     if (keys != NULL) {
         free(keys);
     }
@@ -0,0 +1,422 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// Backdoored Nested Attack against all sectors of a Fudan FM11RF08S tag
+//
+// Attack conditions:
+// * Backdoor
+//
+// Strategy:
+// * Same as staticnested_1nt, staticnested_2x1nt_rf08s and the cross-sector
+//   duplicates search of fm11rf08s_recovery.py, for all sectors at once
+// * Key candidates stay in memory, sectors are processed concurrently on all cores
+// * Only the dictionaries needed to bruteforce the keys with fchk are written
+//
+// cf https://eprint.iacr.org/2024/1275 for the attack
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "nested_util.h"
+
+#define MAX_SECTORS 40
+#define MAX_LINE_LEN 256
+
+typedef struct {
+    uint32_t nt;
+    uint32_t nt_enc;
+    uint8_t nt_par_enc;
+    bool known;             // key already found, nothing to compute
+    bool generate;
+    uint64_t *keys;         // candidates as generated by staticnested_1nt
+    uint32_t keycount;
+    uint8_t *filter;        // staticnested_2x1nt_rf08s filter, NULL if not applicable
+    uint64_t *set;          // sorted unique candidates, after filter
+    uint32_t setcount;
+    uint64_t *dups;         // candidates also present in another set
+    uint32_t dupcount;
+} rf08s_key_t;
+
+typedef struct {
+    uint32_t sector;
+    rf08s_key_t key[2];
+} rf08s_sector_t;
+
+typedef struct {
+    uint32_t authuid;
+    rf08s_sector_t sectors[MAX_SECTORS];
+    uint32_t nr_sectors;
+    // work distribution, see worker()
+    pthread_mutex_t lock;
+    uint32_t next_job;
+    uint32_t nr_jobs;
+    int phase;
+    bool error;
+} rf08s_card_t;
+
+static uint32_t hex_to_uint32(const char *hex_str) {
+    return (uint32_t)strtoul(hex_str, NULL, 16);
+}
+
+static int bin_to_uint8_arr(const char *bin_str, uint8_t bit_arr[], uint8_t arr_size) {
+    if (strlen(bin_str) != arr_size) {
+        fprintf(stderr, "Error: Binary string (%s) length does not match array size (%i).\n", bin_str, arr_size);
+        return 1;
+    }
+
+    for (uint8_t i = 0; i < arr_size; i++) {
+        if (bin_str[i] == '0') {
+            bit_arr[i] = 0;
+        } else if (bin_str[i] == '1') {
+            bit_arr[i] = 1;
+        } else {
+            fprintf(stderr, "Error: Invalid character '%c' in binary string.\n", bin_str[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int compar_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// sorted copy of the unfiltered keys, without duplicates
+static uint64_t *sorted_set(const uint64_t *keys, const uint8_t *filter, uint32_t keycount, uint32_t *setcount) {
+    uint64_t *set = (uint64_t *)malloc(keycount * sizeof(uint64_t) + 1);
+    *setcount = 0;
+    if (set == NULL) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < keycount; i++) {
+        if ((filter == NULL) || filter[i]) {
+            set[(*setcount)++] = keys[i];
+        }
+    }
+    qsort(set, *setcount, sizeof(uint64_t), compar_u64);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < *setcount; i++) {
+        if ((n == 0) || (set[n - 1] != set[i])) {
+            set[n++] = set[i];
+        }
+    }
+    *setcount = n;
+    return set;
+}
+
+// phase 0: one job per key to generate, phase 1: one job per sector
+static bool run_job(rf08s_card_t *card, uint32_t job, struct Crypto1Recovery *recovery) {
+    if (card->phase == 0) {
+        rf08s_sector_t *sec = &card->sectors[job / 2];
+        rf08s_key_t *k = &sec->key[job % 2];
+        if (k->generate == false) {
+            return true;
+        }
+        k->keys = rf08s_generate_keys(recovery, card->authuid, k->nt, k->nt_enc, k->nt_par_enc, &k->keycount);
+        return (k->keys != NULL);
+    }
+
+    rf08s_sector_t *sec = &card->sectors[job];
+    rf08s_key_t *ka = &sec->key[0], *kb = &sec->key[1];
+    if (ka->generate && kb->generate) {
+        ka->filter = (uint8_t *)calloc(ka->keycount + 1, sizeof(uint8_t));
+        kb->filter = (uint8_t *)calloc(kb->keycount + 1, sizeof(uint8_t));
+        if ((ka->filter == NULL) || (kb->filter == NULL)) {
+            return false;
+        }
+        // sectors already run concurrently
+        if (!rf08s_filter_keys(ka->nt, ka->keys, ka->keycount, ka->filter,
+                               kb->nt, kb->keys, kb->keycount, kb->filter, 1)) {
+            return false;
+        }
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+        rf08s_key_t *k = &sec->key[i];
+        if (k->generate) {
+            k->set = sorted_set(k->keys, k->filter, k->keycount, &k->setcount);
+            if (k->set == NULL) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void *worker(void *arg) {
+    rf08s_card_t *card = (rf08s_card_t *)arg;
+    // Crypto1 recovery buffers shared by all jobs of this thread
+    struct Crypto1Recovery *recovery = crypto1_recovery_create();
+    if (recovery == NULL) {
+        pthread_mutex_lock(&card->lock);
+        card->error = true;
+        pthread_mutex_unlock(&card->lock);
+        return NULL;
+    }
+    for (;;) {
+        pthread_mutex_lock(&card->lock);
+        uint32_t job = card->next_job++;
+        bool stop = card->error || (job >= card->nr_jobs);
+        pthread_mutex_unlock(&card->lock);
+        if (stop) {
+            break;
+        }
+        if (!run_job(card, job, recovery)) {
+            pthread_mutex_lock(&card->lock);
+            card->error = true;
+            pthread_mutex_unlock(&card->lock);
+        }
+    }
+    crypto1_recovery_destroy(recovery);
+    return NULL;
+}
+
+static bool run_phase(rf08s_card_t *card, int phase, uint32_t nr_jobs) {
+    card->phase = phase;
+    card->next_job = 0;
+    card->nr_jobs = nr_jobs;
+
+    uint32_t thread_count = num_CPUs();
+    if (thread_count > nr_jobs) {
+        thread_count = nr_jobs;
+    }
+    pthread_t threads[MAX_SECTORS * 2];
+    uint32_t started = 0;
+    for (uint32_t i = 0; i < thread_count; i++) {
+        if (pthread_create(&threads[started], NULL, worker, card) == 0) {
+            started++;
+        }
+    }
+    // workers take jobs until none are left, so one running here is enough
+    if (started == 0) {
+        worker(card);
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return (card->error == false);
+}
+
+// keys present in more than one candidate set, over all sectors and key types
+static bool search_duplicates(rf08s_card_t *card) {
+    uint64_t total = 0;
+    for (uint32_t s = 0; s < card->nr_sectors; s++) {
+        for (uint8_t i = 0; i < 2; i++) {
+            total += card->sectors[s].key[i].setcount;
+        }
+    }
+    uint64_t *all = (uint64_t *)malloc(total * sizeof(uint64_t) + 1);
+    if (all == NULL) {
+        return false;
+    }
+    uint64_t n = 0;
+    for (uint32_t s = 0; s < card->nr_sectors; s++) {
+        for (uint8_t i = 0; i < 2; i++) {
+            rf08s_key_t *k = &card->sectors[s].key[i];
+            if (k->setcount) {
+                memcpy(all + n, k->set, k->setcount * sizeof(uint64_t));
+                n += k->setcount;
+            }
+        }
+    }
+    qsort(all, n, sizeof(uint64_t), compar_u64);
+    // sets are unique, so a repeated key belongs to several sets
+    uint64_t nd = 0;
+    for (uint64_t i = 1; i < n; i++) {
+        if ((all[i] == all[i - 1]) && ((nd == 0) || (all[nd - 1] != all[i]))) {
+            all[nd++] = all[i];
+        }
+    }
+
+    for (uint32_t s = 0; s < card->nr_sectors; s++) {
+        for (uint8_t i = 0; i < 2; i++) {
+            rf08s_key_t *k = &card->sectors[s].key[i];
+            if (k->setcount == 0) {
+                continue;
+            }
+            k->dups = (uint64_t *)malloc(k->setcount * sizeof(uint64_t));
+            if (k->dups == NULL) {
+                free(all);
+                return false;
+            }
+            // both lists are sorted
+            uint64_t d = 0;
+            for (uint32_t j = 0; j < k->setcount; j++) {
+                while ((d < nd) && (all[d] < k->set[j])) {
+                    d++;
+                }
+                if ((d < nd) && (all[d] == k->set[j])) {
+                    k->dups[k->dupcount++] = k->set[j];
+                }
+            }
+        }
+    }
+    free(all);
+    return true;
+}
+
+static void save_dict(const rf08s_card_t *card, const rf08s_sector_t *sec, uint8_t keytype, const char *kind,
+                      const uint64_t *keys, const uint8_t *filter, uint32_t keycount) {
+    char filename[50];
+    if (strcmp(kind, "full") == 0) {
+        snprintf(filename, sizeof(filename), "keys_%08x_%02i_%08x.dic", card->authuid, sec->sector, sec->key[keytype].nt);
+    } else {
+        snprintf(filename, sizeof(filename), "keys_%08x_%02i_%08x_%s.dic", card->authuid, sec->sector, sec->key[keytype].nt, kind);
+    }
+    int64_t saved = save_keys_file(filename, keys, filter, keycount);
+    if (saved >= 0) {
+        printf("DICT: %02i %c %s %s %" PRIi64 "\n", sec->sector, keytype ? 'B' : 'A', kind, filename, saved);
+    }
+}
+
+static int parse_nonces(rf08s_card_t *card, const char *filename) {
+    FILE *fptr = fopen(filename, "r");
+    if (fptr == NULL) {
+        fprintf(stderr, "Error: Cannot open %s\n", filename);
+        return 1;
+    }
+    char line[MAX_LINE_LEN];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fptr) != NULL) {
+        lineno++;
+        char nt_a[9], nt_enc_a[9], par_a[5], nt_b[9], nt_enc_b[9], par_b[5], known[2];
+        uint32_t sector;
+        if ((line[0] == '#') || (line[strspn(line, " \t\r\n")] == '\0')) {
+            continue;
+        }
+        if (sscanf(line, "%u %8s %8s %4s %8s %8s %4s %1s", &sector, nt_a, nt_enc_a, par_a, nt_b, nt_enc_b, par_b, known) != 8) {
+            fprintf(stderr, "Error: Failed to parse %s line %i\n", filename, lineno);
+            fclose(fptr);
+            return 1;
+        }
+        if (card->nr_sectors == MAX_SECTORS) {
+            fprintf(stderr, "Error: Too many sectors in %s\n", filename);
+            fclose(fptr);
+            return 1;
+        }
+        rf08s_sector_t *sec = &card->sectors[card->nr_sectors++];
+        sec->sector = sector;
+        const char *nts[2][3] = {{nt_a, nt_enc_a, par_a}, {nt_b, nt_enc_b, par_b}};
+        for (uint8_t i = 0; i < 2; i++) {
+            rf08s_key_t *k = &sec->key[i];
+            uint8_t nt_par_err_arr[4];
+            k->nt = hex_to_uint32(nts[i][0]);
+            k->nt_enc = hex_to_uint32(nts[i][1]);
+            if (bin_to_uint8_arr(nts[i][2], nt_par_err_arr, 4)) {
+                fclose(fptr);
+                return 1;
+            }
+            k->nt_par_enc = rf08s_nt_par_enc(k->nt_enc, nt_par_err_arr);
+        }
+        sec->key[0].known = (known[0] == 'a') || (known[0] == 'A');
+        sec->key[1].known = (known[0] == 'b') || (known[0] == 'B');
+
+        // same choices as fm11rf08s_recovery.py
+        if (!sec->key[0].known && !sec->key[1].known && (sec->key[0].nt != sec->key[1].nt)) {
+            sec->key[0].generate = true;
+            sec->key[1].generate = true;
+        } else if (!sec->key[0].known) {
+            sec->key[0].generate = true;
+        } else {
+            sec->key[1].generate = true;
+        }
+    }
+    fclose(fptr);
+    return 0;
+}
+
+int main(int argc, char *const argv[]) {
+    if (argc != 3) {
+        int cmdlen = strlen(argv[0]);
+        printf("Usage:\n  %s <uid:hex> <nonces_file>\n"
+               "  nonces_file has one line per sector with at least one unknown key:\n"
+               "    <sector:dec> <ntA:hex> <nt_encA:hex> <nt_par_errA:bin> <ntB:hex> <nt_encB:hex> <nt_par_errB:bin> <known:-|a|b>\n"
+               "  known: - if both keys are unknown, a or b if that key is already found\n"
+               "  Dictionaries are saved as keys_<uid:08x>_<sector:02>_<nt:08x>[_filtered|_duplicates].dic\n"
+               "  and reported as DICT: <sector> <A|B> <full|filtered|duplicates> <filename> <nr keys>\n"
+               "Example:\n"
+               "  %*s 5c467f63 nonces.txt\n",
+               argv[0], cmdlen, argv[0]);
+        return 1;
+    }
+
+    static rf08s_card_t card;
+    card.authuid = hex_to_uint32(argv[1]);
+    if (parse_nonces(&card, argv[2])) {
+        return 1;
+    }
+    if (card.nr_sectors == 0) {
+        printf("No sector to process\n");
+        return 0;
+    }
+    pthread_mutex_init(&card.lock, NULL);
+    rf08s_init_tables();
+
+    int ret = 1;
+    printf("Finding key candidates for %i sectors...\n", card.nr_sectors);
+    if (!run_phase(&card, 0, card.nr_sectors * 2)) {
+        fprintf(stderr, "Error: Failed to generate key candidates\n");
+        goto end;
+    }
+    if (!run_phase(&card, 1, card.nr_sectors)) {
+        fprintf(stderr, "Error: Failed to filter key candidates\n");
+        goto end;
+    }
+    printf("Looking for common keys across sectors...\n");
+    if (!search_duplicates(&card)) {
+        perror("Failed to allocate memory");
+        goto end;
+    }
+
+    for (uint32_t s = 0; s < card.nr_sectors; s++) {
+        rf08s_sector_t *sec = &card.sectors[s];
+        for (uint8_t i = 0; i < 2; i++) {
+            rf08s_key_t *k = &sec->key[i];
+            if (k->generate == false) {
+                continue;
+            }
+            printf("Sector %2i key%c: %i keys", sec->sector, i ? 'B' : 'A', k->keycount);
+            if (k->filter != NULL) {
+                printf(", %i filtered", k->setcount);
+            }
+            printf(", %i duplicates\n", k->dupcount);
+            save_dict(&card, sec, i, k->filter ? "filtered" : "full", k->keys, k->filter, k->keycount);
+            if (k->dupcount) {
+                save_dict(&card, sec, i, "duplicates", k->dups, NULL, k->dupcount);
+            }
+        }
+        // keyA == keyB when both nonces are equal
+        if (sec->key[0].generate && !sec->key[1].generate && !sec->key[1].known && sec->key[0].dupcount) {
+            save_dict(&card, sec, 1, "duplicates", sec->key[0].dups, NULL, sec->key[0].dupcount);
+        }
+    }
+    ret = 0;
+
+end:
+    for (uint32_t s = 0; s < card.nr_sectors; s++) {
+        for (uint8_t i = 0; i < 2; i++) {
+            rf08s_key_t *k = &card.sectors[s].key[i];
+            free(k->keys);
+            free(k->filter);
+            free(k->set);
+            free(k->dups);
+        }
+    }
+    pthread_mutex_destroy(&card.lock);
+    return ret;
+}
@@ -493,6 +493,12 @@ static void *brute_thread(void *arguments) {
     struct thread_args *args = (struct thread_args *) arguments;
 
     struct Crypto1State *revstate = NULL;
+    // state lists are reused for every nonce candidate
+    struct Crypto1Recovery *recovery = crypto1_recovery_create();
+    if (recovery == NULL) {
+        free(args);
+        return NULL;
+    }
     uint64_t key;     // recovered key candidate
     uint32_t ks2;     // keystream used to encrypt reader response
     uint32_t ks3;     // keystream used to encrypt tag response
@@ -518,11 +524,10 @@ static void *brute_thread(void *arguments) {
         p64 = prng_successor(nt, 64);
         ks2 = ar_enc ^ p64;
         ks3 = at_enc ^ prng_successor(p64, 32);
-        revstate = lfsr_recovery64(ks2, ks3);
+        revstate = lfsr_recovery64_r(recovery, ks2, ks3);
         ks4 = crypto1_word(revstate, 0, 0);
 
         if (ks4 == 0) {
-            free(revstate);
             continue;
         }
 
@@ -549,7 +554,6 @@ static void *brute_thread(void *arguments) {
             if (isOK == false) {
                 printf(_RED_("<-- not a valid cmd\n"));
                 pthread_mutex_unlock(&print_lock);
-                free(revstate);
                 continue;
             }
 
@@ -558,7 +562,6 @@ static void *brute_thread(void *arguments) {
             if (isOK == false) {
                 printf(_RED_("<-- not a valid crc\n"));
                 pthread_mutex_unlock(&print_lock);
-                free(revstate);
                 continue;
             }
 
@@ -571,7 +574,6 @@ static void *brute_thread(void *arguments) {
         lfsr_rollback_word(revstate, nr_enc, 1);
         lfsr_rollback_word(revstate, uid ^ nt, 0);
         crypto1_get_lfsr(revstate, &key);
-        free(revstate);
 
         if (args->ev1) {
             // if it was EV1,  we know for sure xxxAAAAAAAA recovery
@@ -587,6 +589,7 @@ static void *brute_thread(void *arguments) {
         __sync_fetch_and_add(&global_candidate_key, key);
         break;
     }
+    crypto1_recovery_destroy(recovery);
     free(args);
     return NULL;
 }
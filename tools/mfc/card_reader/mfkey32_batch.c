@@ -0,0 +1,366 @@
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "crapto1/crapto1.h"
+
+// MIFARE Classic key recovery from many reader authentication answers (mfkey32 moebius)
+//
+// Tuples are grouped by uid, sector and key type.  In every group the keystream of one tuple
+// is reversed once with lfsr_recovery32, then each candidate key is checked against
+// the other tuples of the group.  Tuples explained by a found key are removed and
+// the next remaining tuple is used, until fewer than two tuples are left.
+
+#define MAX_LINE_LEN 256
+#define MAX_CANDIDATES 20
+
+typedef struct {
+    uint32_t uid;
+    uint32_t nt;
+    uint32_t nr_enc;
+    uint32_t ar_enc;
+    int16_t sector;     // -1 if unknown
+    int8_t keytype;     // 'A', 'B' or '?'
+} tuple_t;
+
+typedef struct {
+    uint32_t uid;
+    int16_t sector;
+    int8_t keytype;
+    uint64_t key;
+    uint32_t tuples;    // number of tuples explained by this key
+} found_t;
+
+typedef struct {
+    tuple_t *tuples;
+    size_t *group_start;    // groups are contiguous ranges of the sorted tuples
+    size_t nr_groups;
+
+    pthread_mutex_t lock;
+    size_t next_group;
+    found_t *found;
+    size_t nr_found;
+    size_t max_found;
+    size_t unsolved;        // tuples not explained by any key
+} batch_t;
+
+static int compar_tuple(const void *a, const void *b) {
+    const tuple_t *x = (const tuple_t *)a, *y = (const tuple_t *)b;
+    if (x->uid != y->uid) return (x->uid > y->uid) ? 1 : -1;
+    if (x->sector != y->sector) return (x->sector > y->sector) ? 1 : -1;
+    if (x->keytype != y->keytype) return (x->keytype > y->keytype) ? 1 : -1;
+    if (x->nt != y->nt) return (x->nt > y->nt) ? 1 : -1;
+    if (x->nr_enc != y->nr_enc) return (x->nr_enc > y->nr_enc) ? 1 : -1;
+    if (x->ar_enc != y->ar_enc) return (x->ar_enc > y->ar_enc) ? 1 : -1;
+    return 0;
+}
+
+static bool same_group(const tuple_t *x, const tuple_t *y) {
+    return (x->uid == y->uid) && (x->sector == y->sector) && (x->keytype == y->keytype);
+}
+
+// state must be the initial cipher state, ie the key
+static bool check_tuple(const struct Crypto1State *key_state, const tuple_t *t) {
+    struct Crypto1State s = *key_state;
+    crypto1_word(&s, t->uid ^ t->nt, 0);
+    crypto1_word(&s, t->nr_enc, 1);
+    return (t->ar_enc == (crypto1_word(&s, 0, 0) ^ prng_successor(t->nt, 64)));
+}
+
+static void add_found(batch_t *b, const tuple_t *t, uint64_t key, uint32_t count) {
+    pthread_mutex_lock(&b->lock);
+    if (b->nr_found == b->max_found) {
+        size_t max = b->max_found ? b->max_found * 2 : 64;
+        found_t *tmp = realloc(b->found, max * sizeof(found_t));
+        if (tmp == NULL) {
+            pthread_mutex_unlock(&b->lock);
+            fprintf(stderr, "Error: Failed to allocate memory\n");
+            return;
+        }
+        b->found = tmp;
+        b->max_found = max;
+    }
+    b->found[b->nr_found++] = (found_t) {t->uid, t->sector, t->keytype, key, count};
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void solve_group(batch_t *b, tuple_t *g, size_t n, struct Crypto1Recovery *recovery) {
+    // remaining tuples are kept at the front of g
+    size_t remaining = n;
+    size_t unsolved = 0;
+
+    while (remaining >= 2) {
+        const tuple_t *base = &g[0];
+        uint32_t p64 = prng_successor(base->nt, 64);
+        struct Crypto1State *s = lfsr_recovery32_r(recovery, base->ar_enc ^ p64, 0);
+        if (s == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory\n");
+            break;
+        }
+
+        // candidates explaining the base tuple and at least one other tuple
+        struct Crypto1State candidates[MAX_CANDIDATES];
+        uint32_t nr_candidates = 0;
+        for (; (s->odd | s->even) && (nr_candidates < MAX_CANDIDATES); ++s) {
+            lfsr_rollback_word(s, 0, 0);
+            lfsr_rollback_word(s, base->nr_enc, 1);
+            lfsr_rollback_word(s, base->uid ^ base->nt, 0);
+            for (size_t j = 1; j < remaining; j++) {
+                if (check_tuple(s, &g[j])) {
+                    candidates[nr_candidates++] = *s;
+                    break;
+                }
+            }
+        }
+
+        // keep the candidate explaining the most tuples
+        int best = -1;
+        uint32_t best_count = 0;
+        bool tie = false;
+        for (uint32_t c = 0; c < nr_candidates; c++) {
+            uint32_t count = 0;
+            for (size_t j = 0; j < remaining; j++) {
+                count += check_tuple(&candidates[c], &g[j]);
+            }
+            if (count > best_count) {
+                best = c;
+                best_count = count;
+                tie = false;
+            } else if (count == best_count) {
+                tie = true;
+            }
+        }
+
+        if ((best < 0) || tie) {
+            // no other tuple shares the key of the base tuple, or ambiguous
+            unsolved++;
+            g[0] = g[--remaining];
+            continue;
+        }
+
+        uint64_t key = 0;
+        struct Crypto1State ks = candidates[best];
+        crypto1_get_lfsr(&ks, &key);
+        add_found(b, base, key, best_count);
+
+        // drop the explained tuples
+        for (size_t j = 0; j < remaining;) {
+            if (check_tuple(&candidates[best], &g[j])) {
+                g[j] = g[--remaining];
+            } else {
+                j++;
+            }
+        }
+    }
+    unsolved += remaining;
+
+    pthread_mutex_lock(&b->lock);
+    b->unsolved += unsolved;
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void *solve_thread(void *arg) {
+    batch_t *b = (batch_t *)arg;
+    // recovery buffers are reused for all groups of this thread
+    struct Crypto1Recovery *recovery = crypto1_recovery_create();
+    if (recovery == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory\n");
+        return NULL;
+    }
+    for (;;) {
+        pthread_mutex_lock(&b->lock);
+        size_t gi = b->next_group++;
+        pthread_mutex_unlock(&b->lock);
+        if (gi >= b->nr_groups) {
+            break;
+        }
+        size_t start = b->group_start[gi];
+        size_t end = b->group_start[gi + 1];
+        solve_group(b, &b->tuples[start], end - start, recovery);
+    }
+    crypto1_recovery_destroy(recovery);
+    return NULL;
+}
+
+// <uid> <nt> <nr_enc> <ar_enc> [<sector> <A|B>]
+static tuple_t *load_tuples(const char *filename, size_t *count) {
+    *count = 0;
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Error: Cannot open %s\n", filename);
+        return NULL;
+    }
+    size_t max = 1024;
+    tuple_t *tuples = malloc(max * sizeof(tuple_t));
+    if (tuples == NULL) {
+        fclose(f);
+        return NULL;
+    }
+
+    char line[MAX_LINE_LEN];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        if ((line[0] == '#') || (line[strspn(line, " \t\r\n")] == '\0')) {
+            continue;
+        }
+        tuple_t t = {0, 0, 0, 0, -1, '?'};
+        int sector = -1;
+        char keytype = '?';
+        int res = sscanf(line, "%x %x %x %x %d %c", &t.uid, &t.nt, &t.nr_enc, &t.ar_enc, &sector, &keytype);
+        if ((res != 4) && (res != 6)) {
+            fprintf(stderr, "Error: Failed to parse %s line %i\n", filename, lineno);
+            free(tuples);
+            fclose(f);
+            return NULL;
+        }
+        if (res == 6) {
+            t.sector = sector;
+            t.keytype = toupper(keytype);
+        }
+        if (*count == max) {
+            max *= 2;
+            tuple_t *tmp = realloc(tuples, max * sizeof(tuple_t));
+            if (tmp == NULL) {
+                free(tuples);
+                fclose(f);
+                return NULL;
+            }
+            tuples = tmp;
+        }
+        tuples[(*count)++] = t;
+    }
+    fclose(f);
+    return tuples;
+}
+
+static int compar_found(const void *a, const void *b) {
+    const found_t *x = (const found_t *)a, *y = (const found_t *)b;
+    if (x->uid != y->uid) return (x->uid > y->uid) ? 1 : -1;
+    if (x->sector != y->sector) return (x->sector > y->sector) ? 1 : -1;
+    if (x->keytype != y->keytype) return (x->keytype > y->keytype) ? 1 : -1;
+    if (x->key != y->key) return (x->key > y->key) ? 1 : -1;
+    return 0;
+}
+
+static int compar_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[]) {
+    printf("MIFARE Classic key recovery - based 32 bits of keystream, batch version\n");
+    printf("Recover keys from many reader authentication answers, grouped by uid, sector and key type\n\n");
+
+    if ((argc < 2) || (argc > 3)) {
+        printf("syntax: %s <nonces file> [<keys dictionary>]\n\n", argv[0]);
+        printf("nonces file: one authentication per line\n");
+        printf("    <uid> <nt> <nr> <ar> [<sector> <A|B>]\n");
+        printf("keys dictionary: optional output file for the unique keys found\n\n");
+        return 1;
+    }
+
+    size_t count = 0;
+    tuple_t *tuples = load_tuples(argv[1], &count);
+    if (tuples == NULL) {
+        return 1;
+    }
+
+    // sort, drop repeated authentications and split into groups
+    qsort(tuples, count, sizeof(tuple_t), compar_tuple);
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if ((n == 0) || compar_tuple(&tuples[n - 1], &tuples[i])) {
+            tuples[n++] = tuples[i];
+        }
+    }
+
+    static batch_t b;
+    b.tuples = tuples;
+    b.group_start = malloc((n + 1) * sizeof(size_t));
+    if (b.group_start == NULL) {
+        free(tuples);
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if ((i == 0) || !same_group(&tuples[i - 1], &tuples[i])) {
+            b.group_start[b.nr_groups++] = i;
+        }
+    }
+    b.group_start[b.nr_groups] = n;
+    printf("%zu authentications loaded, %zu unique, %zu groups\n", count, n, b.nr_groups);
+
+    long thread_count = sysconf(_SC_NPROCESSORS_CONF);
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+    if ((size_t)thread_count > b.nr_groups) {
+        thread_count = b.nr_groups ? b.nr_groups : 1;
+    }
+
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_t *threads = calloc(thread_count, sizeof(pthread_t));
+    if (threads == NULL) {
+        free(b.group_start);
+        free(tuples);
+        return 1;
+    }
+    for (long i = 0; i < thread_count; i++) {
+        pthread_create(&threads[i], NULL, solve_thread, &b);
+    }
+    for (long i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&b.lock);
+
+    qsort(b.found, b.nr_found, sizeof(found_t), compar_found);
+
+    printf("\n    uid   | sec | key |     key      | auths\n");
+    printf("----------+-----+-----+--------------+------\n");
+    for (size_t i = 0; i < b.nr_found; i++) {
+        const found_t *f = &b.found[i];
+        char sector[8] = " ? ";
+        if (f->sector >= 0) {
+            snprintf(sector, sizeof(sector), "%3d", f->sector);
+        }
+        printf(" %08x | %s |  %c  | %012" PRIx64 " | %5u\n", f->uid, sector, f->keytype, f->key, f->tuples);
+    }
+    printf("----------+-----+-----+--------------+------\n");
+    printf("%zu keys found, %zu authentications without a key\n\n", b.nr_found, b.unsolved);
+
+    if ((argc == 3) && b.nr_found) {
+        uint64_t *keys = malloc(b.nr_found * sizeof(uint64_t));
+        FILE *f = fopen(argv[2], "w");
+        if ((keys != NULL) && (f != NULL)) {
+            for (size_t i = 0; i < b.nr_found; i++) {
+                keys[i] = b.found[i].key;
+            }
+            qsort(keys, b.nr_found, sizeof(uint64_t), compar_u64);
+            size_t saved = 0;
+            for (size_t i = 0; i < b.nr_found; i++) {
+                if ((i == 0) || (keys[i] != keys[i - 1])) {
+                    fprintf(f, "%012" PRIX64 "\n", keys[i]);
+                    saved++;
+                }
+            }
+            printf("%zu unique keys saved in %s\n", saved, argv[2]);
+        } else {
+            fprintf(stderr, "Error: Cannot save keys in %s\n", argv[2]);
+        }
+        if (f != NULL) {
+            fclose(f);
+        }
+        free(keys);
+    }
+
+    free(b.found);
+    free(b.group_start);
+    free(tuples);
+    return 0;
+}
@@ -35,6 +35,11 @@
 #include <unistd.h>
 #include <inttypes.h>
 #include "util_posix.h"
+#include "aes-ni.h"
+
+#if defined(__x86_64__) || defined(__i386)
+#include "detectaes.h"
+#endif
 
 #define AEND  "\x1b[0m"
 #define _RED_(s) "\x1b[31m" s AEND
@@ -75,30 +80,32 @@ static void handleErrors(void) {
     abort();
 }
 
-// source https://wiki.openssl.org/index.php/EVP_Symmetric_Encryption_and_Decryption#Decrypting_the_Message
-static int decrypt_aes(uint8_t ciphertext[], int ciphertext_len, uint8_t key[], uint8_t iv[], uint8_t plaintext[]) {
-    EVP_CIPHER_CTX *ctx;
-    if (!(ctx = EVP_CIPHER_CTX_new()))
-        handleErrors();
-
-    if (1 != EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, key, iv))
-        handleErrors();
-
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
-
-    int len = 0;
-    if (1 != EVP_DecryptUpdate(ctx, plaintext, &len, ciphertext, ciphertext_len))
-        handleErrors();
-
-    int plaintext_len = len;
+// keys tried per batch, and per AES-NI call
+#if defined(__x86_64__) || defined(__i386)
+#define BRUTE_BATCH AES_NI_LANES
+static bool use_aesni = false;
+#else
+#define BRUTE_BATCH 8
+#endif
 
-    if (1 != EVP_DecryptFinal_ex(ctx, plaintext + len, &len))
-        handleErrors();
+// ECB decryption of the two blocks needed by the check, one reused context per thread
+static void decrypt_aes_batch(EVP_CIPHER_CTX *ctx, const uint8_t keys[BRUTE_BATCH][16], uint32_t n, const uint8_t in[32], uint8_t out[BRUTE_BATCH][32]) {
+#if defined(__x86_64__) || defined(__i386)
+    if (use_aesni) {
+        aes_ni_decrypt2_x8(keys, in, out);
+        return;
+    }
+#endif
+    for (uint32_t k = 0; k < n; k++) {
+        if (1 != EVP_DecryptInit_ex(ctx, EVP_aes_128_ecb(), NULL, keys[k], NULL))
+            handleErrors();
 
-    plaintext_len += len;
+        EVP_CIPHER_CTX_set_padding(ctx, 0);
 
-    EVP_CIPHER_CTX_free(ctx);
-    return plaintext_len;
+        int len = 0;
+        if (1 != EVP_DecryptUpdate(ctx, out[k], &len, in, 32))
+            handleErrors();
+    }
 }
 
 static int hexstr_to_byte_array(char hexstr[], uint8_t bytes[], size_t byte_len) {
@@ -154,65 +161,71 @@ static void *brute_thread(void *arguments) {
     struct thread_args *args = (struct thread_args *) arguments;
 
     uint64_t starttime = args->starttime;
-
     uint64_t stoptime = args->stoptime;
-    uint8_t local_tag[16];
-    uint8_t local_rdr[32];
-    memcpy(local_tag, args->tag, 16);
-    memcpy(local_rdr, args->rdr, 32);
 
-    for (uint64_t i = starttime + args->idx; i < stoptime; i += thread_count) {
+    // tag challenge is decrypted with a zero IV, the reader challenge (second block)
+    // with the first reader block as IV, so only these two blocks are needed
+    uint8_t blocks[32];
+    memcpy(blocks, args->tag, 16);
+    memcpy(blocks + 16, args->rdr + 16, 16);
+    uint8_t local_iv[16];
+    memcpy(local_iv, args->rdr, 16);
+
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if (ctx == NULL)
+        handleErrors();
+
+    for (uint64_t i = starttime; i < stoptime; i += BRUTE_BATCH) {
 
         if (__atomic_load_n(&global_found, __ATOMIC_ACQUIRE) == 1) {
             break;
         }
 
-        uint8_t key[16] = {0x00};
-        make_key(i, key);
-
-        uint8_t iv[16] = {0x00};
-        uint8_t dec_tag[16] = {0x00};
-        decrypt_aes(local_tag, 16, key, iv, dec_tag);
-
-        uint8_t dec_rdr[32] = {0x00};
-        decrypt_aes(local_rdr, 32, key, local_tag, dec_rdr);
-
-        // check rol byte first
-        if (dec_tag[0] != dec_rdr[31]) continue;
-
-        // compare rest
-        if (dec_tag[1] != dec_rdr[16]) continue;
-        if (dec_tag[2] != dec_rdr[17]) continue;
-        if (dec_tag[3] != dec_rdr[18]) continue;
-        if (dec_tag[4] != dec_rdr[19]) continue;
-        if (dec_tag[5] != dec_rdr[20]) continue;
-        if (dec_tag[6] != dec_rdr[21]) continue;
-        if (dec_tag[7] != dec_rdr[22]) continue;
-        if (dec_tag[8] != dec_rdr[23]) continue;
-        if (dec_tag[9] != dec_rdr[24]) continue;
-        if (dec_tag[10] != dec_rdr[25]) continue;
-        if (dec_tag[11] != dec_rdr[26]) continue;
-        if (dec_tag[12] != dec_rdr[27]) continue;
-        if (dec_tag[13] != dec_rdr[28]) continue;
-        if (dec_tag[14] != dec_rdr[29]) continue;
-        if (dec_tag[15] != dec_rdr[30]) continue;
-
-        __sync_fetch_and_add(&global_found, 1);
-
-        // lock this section to avoid interlacing prints from different threats
-        pthread_mutex_lock(&print_lock);
-
-        printf("Found timestamp........ ");
-        print_time(i);
-
-        printf("key.................... \x1b[32m");
-        print_hex(key, sizeof(key));
-        printf(AEND);
-
-        pthread_mutex_unlock(&print_lock);
-        break;
+        uint32_t n = (stoptime - i < BRUTE_BATCH) ? stoptime - i : BRUTE_BATCH;
+
+        uint8_t keys[BRUTE_BATCH][16] = {{0x00}};
+        for (uint32_t k = 0; k < n; k++) {
+            make_key(i + k, keys[k]);
+        }
+
+        uint8_t dec[BRUTE_BATCH][32];
+        decrypt_aes_batch(ctx, keys, n, blocks, dec);
+
+        for (uint32_t k = 0; k < n; k++) {
+            const uint8_t *dec_tag = dec[k];
+            const uint8_t *dec_rdr = dec[k] + 16;
+
+            // check rol byte first
+            if (dec_tag[0] != (dec_rdr[15] ^ local_iv[15])) continue;
+
+            // compare rest
+            bool match = true;
+            for (uint8_t j = 0; j < 15; j++) {
+                if (dec_tag[j + 1] != (dec_rdr[j] ^ local_iv[j])) {
+                    match = false;
+                    break;
+                }
+            }
+            if (match == false) continue;
+
+            __sync_fetch_and_add(&global_found, 1);
+
+            // lock this section to avoid interlacing prints from different threats
+            pthread_mutex_lock(&print_lock);
+
+            printf("Found timestamp........ ");
+            print_time(i + k);
+
+            printf("key.................... \x1b[32m");
+            print_hex(keys[k], sizeof(keys[k]));
+            printf(AEND);
+
+            pthread_mutex_unlock(&print_lock);
+            break;
+        }
     }
 
+    EVP_CIPHER_CTX_free(ctx);
     free(args);
     return NULL;
 }
@@ -248,6 +261,11 @@ int main(int argc, char *argv[]) {
     if (hexstr_to_byte_array(argv[3], rdr_resp_challenge, sizeof(rdr_resp_challenge)))
         return 3;
 
+#if defined(__x86_64__) || defined(__i386)
+    use_aesni = platform_aes_hw_available();
+    printf("AES-NI detected........ " _GREEN_("%s") "\n", (use_aesni) ? "yes" : "no");
+#endif
+
     printf("Starting timestamp..... ");
     print_time(start_time);
 
@@ -273,14 +291,20 @@ int main(int argc, char *argv[]) {
     // create a mutex to avoid interlacing print commands from our different threads
     pthread_mutex_init(&print_lock, NULL);
 
-    // threads
+    // threads, each one searching a contiguous part of the time range
     uint64_t stop_time = time(NULL);
+    uint64_t chunk = 0;
+    if (stop_time > start_time) {
+        chunk = (stop_time - start_time + thread_count - 1) / thread_count;
+    }
     for (int i = 0; i < thread_count; ++i) {
         struct thread_args *a = calloc(1, sizeof(struct thread_args));
         a->thread = i;
         a->idx = i;
-        a->starttime = start_time;
-        a->stoptime = stop_time;
+        a->starttime = start_time + i * chunk;
+        a->stoptime = start_time + (i + 1) * chunk;
+        if (a->stoptime > stop_time)
+            a->stoptime = stop_time;
         memcpy(a->tag, tag_challenge, 16);
         memcpy(a->rdr, rdr_resp_challenge, 32);
         pthread_create(&threads[i], NULL, brute_thread, (void *)a);
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+
+#  pm3_fake_device.py - stand-in Proxmark3 on a TCP port for client comms tests
+#
+#  Answers the connection test (CMD_PING, CMD_CAPABILITIES) and echoes every
+#  later CMD_PING after spending --delay ms on it, like a device that runs its
+#  commands one after the other.  Reports how many frames the client had queued
+#  behind a running command,  which shows if `hw window` pipelining happened.
+#
+#    This code is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This code is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#  usage:
+#    ./tools/pm3_fake_device.py --port 18888 --delay 20 &
+#    ./client/proxmark3 -p tcp:localhost:18888 -c "hw window -n 8; hw ping -n 32"
+
+import argparse
+import os
+import re
+import socket
+import struct
+import time
+
+PM3_CMD_H = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'include', 'pm3_cmd.h')
+
+COMMANDNG_PREAMBLE_MAGIC = 0x61334d50   # PM3a
+RESPONSENG_PREAMBLE_MAGIC = 0x62334d50  # PM3b
+RESPONSENG_POSTAMBLE_MAGIC = 0x3362     # b3
+
+
+def read_defines():
+    with open(PM3_CMD_H) as f:
+        src = f.read()
+    defs = {}
+    for name in ('CMD_PING', 'CMD_CAPABILITIES', 'CAPABILITIES_VERSION'):
+        defs[name] = int(re.search(r'#define\s+' + name + r'\s+(\w+)', src).group(1), 0)
+    # capabilities_t: version, baudrate, bigbuf_size then one bit per bool
+    caps = re.search(r'typedef struct \{([^}]*)\} PACKED capabilities_t;', src).group(1)
+    bits = len(re.findall(r'bool\s+\w+\s*:\s*1;', caps))
+    defs['capabilities_size'] = 1 + 4 + 4 + (bits + 7) // 8
+    return defs
+
+
+def response(cmd, data=b''):
+    return struct.pack('<IHhH', RESPONSENG_PREAMBLE_MAGIC, len(data) | 0x8000, 0, cmd) + data + \
+        struct.pack('<H', RESPONSENG_POSTAMBLE_MAGIC)
+
+
+def split_frames(buf):
+    """returns the complete NG frames in buf and the bytes left"""
+    frames = []
+    while len(buf) >= 8:
+        magic, lenng, cmd = struct.unpack('<IHH', buf[:8])
+        if magic != COMMANDNG_PREAMBLE_MAGIC:
+            buf = buf[1:]
+            continue
+        total = 8 + (lenng & 0x7FFF) + 2
+        if len(buf) < total:
+            break
+        frames.append((cmd, buf[8:total - 2]))
+        buf = buf[total:]
+    return frames, buf
+
+
+def serve(conn, defs, delay):
+    buf = b''
+    pending = []
+    pings = 0
+    max_queued = 0
+    conn.settimeout(5)
+    while True:
+        if not pending:
+            chunk = conn.recv(4096)
+            if not chunk:
+                break
+            frames, buf = split_frames(buf + chunk)
+            pending.extend(frames)
+            continue
+
+        cmd, data = pending.pop(0)
+        if cmd == defs['CMD_CAPABILITIES']:
+            caps = bytearray(defs['capabilities_size'])
+            caps[0] = defs['CAPABILITIES_VERSION']
+            caps[9] = 0x02  # via_usb
+            conn.sendall(response(cmd, bytes(caps)))
+        elif cmd == defs['CMD_PING']:
+            pings += 1
+            # first one is the connection test
+            if pings > 1:
+                time.sleep(delay / 1000)
+                # whatever the client sent meanwhile is queued behind this command
+                conn.setblocking(False)
+                try:
+                    while True:
+                        chunk = conn.recv(4096)
+                        if not chunk:
+                            break
+                        buf += chunk
+                except BlockingIOError:
+                    pass
+                conn.settimeout(5)
+                frames, buf = split_frames(buf)
+                pending.extend(frames)
+                max_queued = max(max_queued, len(pending))
+            conn.sendall(response(cmd, data))
+        # anything else, like CMD_QUIT_SESSION, gets no reply.  Serve until the client hangs up
+    return pings - 1, max_queued
+
+
+def main():
+    parser = argparse.ArgumentParser(description='stand-in Proxmark3 on a TCP port')
+    parser.add_argument('--port', type=int, default=18888, help='TCP port to listen on')
+    parser.add_argument('--delay', type=int, default=20, help='ms spent on every ping')
+    args = parser.parse_args()
+
+    defs = read_defines()
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as srv:
+        srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        srv.bind(('127.0.0.1', args.port))
+        srv.listen(1)
+        srv.settimeout(30)
+        conn, _ = srv.accept()
+        with conn:
+            pings, max_queued = serve(conn, defs, args.delay)
+
+    print('pings answered: %d, most frames queued behind a running command: %d ( %s )' %
+          (pings, max_queued, 'ok' if max_queued > 1 else 'fail'))
+
+
+if __name__ == '__main__':
+    main()
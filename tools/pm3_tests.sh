@@ -290,27 +290,32 @@ while true; do
       if ! CheckFileExist "fpgacompress exists"            "$FPGACPMPRESSBIN"; then break; fi
     fi
     if $TESTALL || $TESTMFKEY; then
-      echo -e "\n${C_BLUE}Testing mfkey:${C_NC} ${MFKEY32V2BIN:=./tools/mfc/card_reader/mfkey32v2} ${MFKEY64BIN:=./tools/mfc/card_reader/mfkey64}"
+      echo -e "\n${C_BLUE}Testing mfkey:${C_NC} ${MFKEY32V2BIN:=./tools/mfc/card_reader/mfkey32v2} ${MFKEY64BIN:=./tools/mfc/card_reader/mfkey64} ${MFKEY32BATCHBIN:=./tools/mfc/card_reader/mfkey32_batch}"
       if ! CheckFileExist "mfkey32v2 exists"               "$MFKEY32V2BIN"; then break; fi
       if ! CheckFileExist "mfkey64 exists"                 "$MFKEY64BIN"; then break; fi
+      if ! CheckFileExist "mfkey32_batch exists"           "$MFKEY32BATCHBIN"; then break; fi
       # Need a decent example for mfkey32...
       if ! CheckExecute "mfkey32v2 test"                   "$MFKEY32V2BIN 12345678 1AD8DF2B 1D316024 620EF048 30D6CB07 C52077E2 837AC61A" "Found Key: \[a0a1a2a3a4a5\]"; then break; fi
+      if ! CheckExecute "mfkey32_batch test"               "printf '12345678 1AD8DF2B 1D316024 620EF048 0 A\\n52B0F519 5417D1F8 4D545EA7 E15AC8C2 1 B\\n12345678 30D6CB07 C52077E2 837AC61A 0 A\\n52B0F519 A1BA88C6 DAC1A7F4 5AE5C37F 1 B\\n' > mfkey32_batch_nonces.txt; $MFKEY32BATCHBIN mfkey32_batch_nonces.txt; rm mfkey32_batch_nonces.txt" "12345678 \|   0 \|  A  \| a0a1a2a3a4a5 \|     2"; then break; fi
       if ! CheckExecute "mfkey64 test"                     "$MFKEY64BIN 9c599b32 82a4166c a1e458ce 6eea41e0 5cadf439" "Found Key: \[ffffffffffff\]"; then break; fi
       if ! CheckExecute "mfkey64 long trace test"          "$MFKEY64BIN 14579f69 ce844261 f8049ccb 0525c84f 9431cc40 7093df99 9972428ce2e8523f456b99c831e769dced09 8ca6827b ab797fd369e8b93a86776b40dae3ef686efd c3c381ba 49e2c9def4868d1777670e584c27230286f4 fbdcd7c1 4abd964b07d3563aa066ed0a2eac7f6312bf 9f9149ea" "Found Key: \[091e639cb715\]"; then break; fi
     fi
     if $TESTALL || $TESTSTATICNESTED; then
-      echo -e "\n${C_BLUE}Testing staticnested:${C_NC} ${STATICNESTED0NTBIN:=./tools/mfc/card_only/staticnested_0nt} ${STATICNESTED1NTBIN:=./tools/mfc/card_only/staticnested_1nt} ${STATICNESTED2NTBIN:=./tools/mfc/card_only/staticnested_2nt} ${STATICNESTED2X1NTBIN:=./tools/mfc/card_only/staticnested_2x1nt_rf08s} ${STATICNESTED2X11KNTBIN:=./tools/mfc/card_only/staticnested_2x1nt_rf08s_1key}"
+      echo -e "\n${C_BLUE}Testing staticnested:${C_NC} ${STATICNESTED0NTBIN:=./tools/mfc/card_only/staticnested_0nt} ${STATICNESTED1NTBIN:=./tools/mfc/card_only/staticnested_1nt} ${STATICNESTED2NTBIN:=./tools/mfc/card_only/staticnested_2nt} ${STATICNESTED2X1NTBIN:=./tools/mfc/card_only/staticnested_2x1nt_rf08s} ${STATICNESTED2X11KNTBIN:=./tools/mfc/card_only/staticnested_2x1nt_rf08s_1key} ${STATICNESTEDRF08SCARDBIN:=./tools/mfc/card_only/staticnested_rf08s_card}"
       if ! CheckFileExist "staticnested_0nt exists"            "$STATICNESTED0NTBIN"; then break; fi
       if ! CheckFileExist "staticnested_1nt exists"            "$STATICNESTED1NTBIN"; then break; fi
       if ! CheckFileExist "staticnested_2nt exists"            "$STATICNESTED2NTBIN"; then break; fi
       if ! CheckFileExist "staticnested_2x1nt_rf08s exists"    "$STATICNESTED2X1NTBIN"; then break; fi
       if ! CheckFileExist "staticnested_2x1nt_rf08s_1key exists" "$STATICNESTED2X11KNTBIN"; then break; fi
+      if ! CheckFileExist "staticnested_rf08s_card exists"    "$STATICNESTEDRF08SCARDBIN"; then break; fi
       if ! CheckExecute slow "staticnested_0nt test"                "$STATICNESTED0NTBIN a13e4902 2e9e49fc 1111 . 7bfc7a5b 1110 a17e4902 50f2abc2 1101; rm keys.dic" "Key ffffffffffff found in 3 arrays"; then break; fi
       if ! CheckExecute "staticnested_1nt 1/2 test"            "$STATICNESTED1NTBIN 5c467f63 0 456ace4e da53428d 1001" "found 19823 keys"; then break; fi
       if ! CheckExecute "staticnested_1nt 2/2 test"            "$STATICNESTED1NTBIN 5c467f63 0 e56f9fa2 7a9616b6 1110" "found 34531 keys"; then break; fi
       if ! CheckExecute "staticnested_2nt test"                "$STATICNESTED2NTBIN 461dce03 7eef3586 7fa28c7e 322bc14d 7f62b3d6" "\[ 2 \].*ffffffffff40.*"; then break; fi
       if ! CheckExecute "staticnested_2x1nt_rf08s test"        "$STATICNESTED2X1NTBIN keys_5c467f63_00_456ace4e.dic keys_5c467f63_00_e56f9fa2.dic; rm keys_5c467f63_00_456ace4e.dic keys_5c467f63_00_e56f9fa2.dic; grep ffffffffff keys_5c467f63_00_456ace4e_filtered.dic" "fffffffffff1"; then break; fi
       if ! CheckExecute "staticnested_2x1nt_rf08s_1key test"        "$STATICNESTED2X11KNTBIN 456ace4e fffffffffff1 keys_5c467f63_00_e56f9fa2_filtered.dic; rm keys_5c467f63_00_456ace4e_filtered.dic keys_5c467f63_00_e56f9fa2_filtered.dic" "MATCH: key2=fffffffffff2"; then break; fi
+      if ! CheckExecute "staticnested_2x1nt_rf08s bin test"    "$STATICNESTED1NTBIN 5c467f63 0 456ace4e da53428d 1001 --bin >/dev/null; $STATICNESTED1NTBIN 5c467f63 0 e56f9fa2 7a9616b6 1110 --bin >/dev/null; $STATICNESTED2X1NTBIN keys_5c467f63_00_456ace4e.bin keys_5c467f63_00_e56f9fa2.bin >/dev/null; rm keys_5c467f63_00_456ace4e.bin keys_5c467f63_00_e56f9fa2.bin; $STATICNESTED2X11KNTBIN 456ace4e fffffffffff1 keys_5c467f63_00_e56f9fa2_filtered.bin; rm keys_5c467f63_00_456ace4e_filtered.bin keys_5c467f63_00_e56f9fa2_filtered.bin" "MATCH: key2=fffffffffff2"; then break; fi
+      if ! CheckExecute "staticnested_rf08s_card test"         "echo '0 456ace4e da53428d 1001 e56f9fa2 7a9616b6 1110 -' > keys_5c467f63_nonces.txt; $STATICNESTEDRF08SCARDBIN 5c467f63 keys_5c467f63_nonces.txt; rm keys_5c467f63_nonces.txt keys_5c467f63_00_456ace4e_filtered.dic keys_5c467f63_00_e56f9fa2_filtered.dic" "DICT: 00 B filtered keys_5c467f63_00_e56f9fa2_filtered.dic 9026"; then break; fi
     fi
     if $TESTALL || $TESTNONCE2KEY; then
       echo -e "\n${C_BLUE}Testing nonce2key:${C_NC} ${NONCE2KEYBIN:=./tools/mfc/card_only/nonce2key}"
@@ -407,6 +412,8 @@ while true; do
       if ! CheckExecute "proxmark multi stdin 2/4"         "echo 'rem foo;rem bar;quit' |$CLIENTBIN" "remark: bar"; then break; fi
       if ! CheckExecute "proxmark multi stdin 3/4"         "echo -e 'rem foo\nrem bar;quit' |$CLIENTBIN" "remark: foo"; then break; fi
       if ! CheckExecute "proxmark multi stdin 4/4"         "echo -e 'rem foo\nrem bar;quit' |$CLIENTBIN" "remark: bar"; then break; fi
+      if ! CheckExecute "proxmark pipelined cmds 1/2"      "python3 ./tools/pm3_fake_device.py --port 18888 & sleep 1; $CLIENTBIN -p tcp:localhost:18888 -c 'hw window -n 8; hw ping -n 32'; wait" "Pipelined pings.*content \( ok"; then break; fi
+      if ! CheckExecute "proxmark pipelined cmds 2/2"      "python3 ./tools/pm3_fake_device.py --port 18888 & sleep 1; $CLIENTBIN -p tcp:localhost:18888 -c 'hw window -n 8; hw ping -n 32' > /dev/null; wait" "queued behind a running command: [2-8] \( ok"; then break; fi
 
       echo -e "\n${C_BLUE}Testing scripts:${C_NC}"
       if ! CheckExecute "script run cmdscript"             "$CLIENTBIN -c 'script run example.cmd'" "remark: world"; then break; fi
@@ -426,6 +433,20 @@ while true; do
       if ! CheckExecute "jooki encode test"       "$CLIENTBIN -c 'hf jooki encode -t'" "04 28 F4 DA F0 4A 81  \( ok \)"; then break; fi
       if ! CheckExecute "trace load/list 14a"     "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace; trace list -1 -t 14a;'" "READBLOCK\(8\)"; then break; fi
       if ! CheckExecute "trace load/list x"       "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace; trace list -x1 -t 14a;'" "0.0101840425"; then break; fi
+      if ! CheckExecute "trace list paging"       "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace; trace list -1 -t 14a --first 2 -n 2;'" "Records \( 2 - 4 of 22 \)"; then break; fi
+      if ! CheckExecute "trace list time range"   "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace; trace list -1 -t 14a --from 2500000 --to 2600000;'" "Records \( 12 - 14 of 22 \)"; then break; fi
+      if ! CheckExecute "trace load multiple"     "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace -f traces/hf_14a_mfu.trace;'" "TraceLen = 744 bytes"; then break; fi
+      if ! CheckExecute "trace pcapng round trip" "rm -f /tmp/pm3_trace.pcapng; $CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace; trace save -f /tmp/pm3_trace --pcapng -t 14a; trace load -f /tmp/pm3_trace.pcapng; trace list -1 -t 14a;'" "READBLOCK\(8\)"; then break; fi
+      if ! CheckExecute "trace pcapng byte exact" "rm -f /tmp/pm3_trace.pcapng /tmp/pm3_trace_rt.trace; $CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace; trace save -f /tmp/pm3_trace --pcapng -t 14a; trace load -f /tmp/pm3_trace.pcapng; trace save -f /tmp/pm3_trace_rt;' >/dev/null && cmp /tmp/pm3_trace_rt.trace traces/hf_14a_mfu.trace && echo 'pcapng round trip ok'" "pcapng round trip ok"; then break; fi
+      if ! CheckExecute "trace list jsonl"        "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace; trace list -1 -t 14a --nocache --jsonl /tmp/pm3_trace.jsonl;' >/dev/null && cat /tmp/pm3_trace.jsonl" "\"code\":\"READBLOCK\",\"note\":\"READBLOCK\(8\)\""; then break; fi
+      if ! CheckExecute "trace list jsonl cache"  "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace; trace list -1 -t 14a --jsonl /tmp/pm3_trace_c1.jsonl; trace list -1 -t 14a --jsonl /tmp/pm3_trace_c2.jsonl;' | grep -c 'Reused annotation cache' && cmp /tmp/pm3_trace_c1.jsonl /tmp/pm3_trace_c2.jsonl && echo 'jsonl cache ok'" "jsonl cache ok"; then break; fi
+      if ! CheckExecute "trace list jsonl cache prune" "mkdir -p ~/.proxmark3/cache && touch -t 202001010000 ~/.proxmark3/cache/trace_00000000000000000000000000000000.jsonl && $CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace; trace list -1 -t 14a --jsonl /tmp/pm3_trace_c1.jsonl;' >/dev/null; ls ~/.proxmark3/cache/trace_00000000000000000000000000000000.jsonl 2>&1" "No such file"; then break; fi
+      if [ -c /dev/full ]; then
+        if ! CheckExecute "trace list jsonl write error" "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace; trace list -1 -t 14a --nocache --jsonl /dev/full;'" "Error writing.*incomplete"; then break; fi
+      fi
+      if ! CheckExecute "trace list jsonl stdout" "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace; trace list -1 -t 14a --jsonl -;' 2>/dev/null | sed '1,/pm3 --> trace list/d' | grep -v -c '^{'" "^0$"; then break; fi
+      if ! CheckExecute "trace list mf nested dict" "$CLIENTBIN -c 'trace load -f traces/hf_mf_nested_dict.trace; trace list -1 -t mf -f $DICPATH/mfc_default_keys.dic;'" "key B38D82CF7B6C"; then break; fi
+      if ! CheckExecute "data batch hf test"      "$CLIENTBIN -c 'data batch -d traces -p hf_14a_mfu.trace -t 14a -o /tmp/pm3_batch.jsonl' >/dev/null && cat /tmp/pm3_batch.jsonl" "\"note\":\"READBLOCK\(8\)\""; then break; fi
       if ! CheckExecute "nfc decode test - oob"          "$CLIENTBIN -c 'nfc decode -d DA2010016170706C69636174696F6E2F766E642E626C7565746F6F74682E65702E6F6F62301000649201B96DFB0709466C65782032'" "Flex 2"; then break; fi
       if ! CheckExecute "nfc decode test - device info"  "$CLIENTBIN -c 'nfc decode -d d1025744690004536f6e79010752432d533338300220426c61636b204e46432052656164657220636f6e6e656374656420746f2050430310123e4567e89b12d3a45642665544000004124e464320506f72742d3130302076312e3032'" "NFC Port-100 v1.02"; then break; fi
       if ! CheckExecute "nfc decode test - vcard"        "$CLIENTBIN -c 'nfc decode -d d20ca3746578742f782d7643617264424547494e3a56434152440a56455253494f4e3a332e300a4e3a43687269733b4963656d616e3b3b3b0a464e3a476f7468656e627572670a5245563a323032312d30362d32345432303a31353a30385a0a6974656d322e582d4142444154453b747970653d707265663a323032302d30362d32340a4954454d322e582d41424c4142454c3a5f24213c416e6e69766572736172793e21245f0a454e443a56434152440a'" "END:VCARD"; then break; fi
@@ -436,6 +457,10 @@ while true; do
       if ! CheckExecute "lf hitag2 test"             "$CLIENTBIN -c 'lf hitag test'" "Tests \( ok"; then break; fi
       if ! CheckExecute "lf cotag demod test"        "$CLIENTBIN -c 'data load -f traces/lf_cotag_220_8331.pm3; data norm; data cthreshold -u 50 -d -20; data envelope; data raw --ar -c 272; lf cotag demod'" \
                                                                      "COTAG Found: FC 220, CN: 8331 Raw: FFB841170363FFFE00001E7F00000000"; then break; fi
+      if ! CheckExecute "data autocorr FFT test"     "$CLIENTBIN -c 'data load -f traces/lf_AWID-15-259.pm3; data autocorr -w 4000'" "correlation at 14402 samples"; then break; fi
+      if ! CheckExecute slow "data autocorr bench test"   "$CLIENTBIN -c 'data load -f traces/lf_EM4102-1.pm3; data autocorr -w 4000 --bench'" "FFT vs O\(n\^2\) \( ok \)"; then break; fi
+      if ! CheckExecute slow "lf demod golden test"     "for f in traces/lf_*.pm3; do echo \$(basename \$f) \$($CLIENTBIN -c \"data setdebugmode -1; data load -f \$f; data test_lfdemod\" | grep -o 'digest [0-9a-f]*' | cut -d' ' -f2); done | diff - traces/golden_lfdemod.txt && echo 'golden ok'" "golden ok"; then break; fi
+      if ! CheckExecute "data batch lf test"         "$CLIENTBIN -c 'data batch -d traces -p lf_EM4102-1.pm3 -o /tmp/pm3_batch.jsonl' >/dev/null && cat /tmp/pm3_batch.jsonl" "\"id\":\"010872E77C\""; then break; fi
       if ! CheckExecute "lf AWID test"               "$CLIENTBIN -c 'data load -f traces/lf_AWID-15-259.pm3;lf search -1'" "AWID ID found"; then break; fi
       if ! CheckExecute "lf EM410x test"             "$CLIENTBIN -c 'data load -f traces/lf_EM4102-1.pm3;lf search -1'" "EM410x ID found"; then break; fi
       if ! CheckExecute "lf EM4x05 test"             "$CLIENTBIN -c 'data load -f traces/lf_EM4x05.pm3;lf search -1'" "FDX-B ID found"; then break; fi
@@ -551,14 +576,22 @@ while true; do
       echo -e "\n${C_BLUE}Testing HF:${C_NC}"
       if ! CheckExecute "hf mf offline text"               "$CLIENTBIN -c 'hf mf'" "content from tag dump file"; then break; fi
       if ! CheckExecute slow retry ignore "hf mf hardnested long test"  "$CLIENTBIN -c 'hf mf hardnested -t --tk 000000000000'" "found:"; then break; fi
+      if ! CheckExecute slow "hf mf hardnested sim nonces"  "rm -f /tmp/pm3_hn.chk; $CLIENTBIN -c 'hf mf hardnested -t --tk 000000000000 -w -f /tmp/pm3_hn.bin'" "Key found: 000000000000"; then break; fi
+      # wrong cuid, so the whole key space is searched without a hit and every work item ends up in the checkpoint
+      if ! CheckExecute slow "hf mf hardnested checkpoint"  "printf '\\336\\255\\276\\357' | dd of=/tmp/pm3_hn.bin bs=1 count=4 conv=notrunc 2>/dev/null; $CLIENTBIN -c 'hf mf hardnested -r -f /tmp/pm3_hn.bin --checkpoint /tmp/pm3_hn.chk'" "Failed to recover a key"; then break; fi
+      if ! CheckExecute slow "hf mf hardnested resume"      "$CLIENTBIN -c 'hf mf hardnested -r -f /tmp/pm3_hn.bin --checkpoint /tmp/pm3_hn.chk'" "Resuming from checkpoint, skipping [1-9]"; then break; fi
       if ! CheckExecute slow "hf iclass loclass long test" "$CLIENTBIN -c 'hf iclass loclass --long'" "verified \( ok \)"; then break; fi
       if ! CheckExecute slow "emv long test"               "$CLIENTBIN -c 'emv test -l'" "Tests \( ok"; then break; fi
       if ! CheckExecute "hf iclass lookup test"            "$CLIENTBIN -c 'hf iclass lookup --csn 9655a400f8ff12e0 --epurse f0ffffffffffffff --macs 0000000089cb984b -f $DICPATH/iclass_default_keys.dic'" \
                                                                 "valid key AE A6 84 A6 DA B2 32 78"; then break; fi
+      if ! CheckExecute "hf iclass lookup threads test"    "$CLIENTBIN -c 'hf iclass lookup --csn 9655a400f8ff12e0 --epurse f0ffffffffffffff --macs 0000000089cb984b -f $DICPATH/iclass_default_keys.dic --threads 2'" \
+                                                                "valid key AE A6 84 A6 DA B2 32 78"; then break; fi
       if ! CheckExecute "hf iclass loclass test"         "$CLIENTBIN -c 'hf iclass loclass --test'" "key diversification \( ok \)"; then break; fi
+      if ! CheckExecute "hf iclass loclass bitsliced MAC"  "$CLIENTBIN -c 'hf iclass loclass --test'" "Bitsliced MAC calculation \( ok \)"; then break; fi
       if ! CheckExecute "emv test"                       "$CLIENTBIN -c 'emv test'" "Tests \( ok"; then break; fi
       if ! CheckExecute "hf cipurse test"                "$CLIENTBIN -c 'hf cipurse test'" "Tests \( ok"; then break; fi
       if ! CheckExecute "hf mfdes test"                  "$CLIENTBIN -c 'hf mfdes test'"   "Tests \( ok"; then break; fi
+      if ! CheckExecute "hf mf test"                     "$CLIENTBIN -c 'hf mf test'"      "Tests \( ok"; then break; fi
       if ! CheckExecute "hf waveshare load"              "$CLIENTBIN -c 'hf waveshare load -m 6 -f tools/lena.bmp -s dither.bmp' && echo '34ff55fe7257876acf30dae00eb0e439 dither.bmp' | md5sum -c" "dither.bmp: OK"; then break; fi
     fi
   echo -e "\n------------------------------------------------------------"